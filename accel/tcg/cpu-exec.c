@@ -28,6 +28,7 @@
 #include "sysemu/qtest.h"
 #include "qemu/timer.h"
 #include "qemu/rcu.h"
+#include "qemu/processor.h"
 #include "exec/tb-hash.h"
 #include "exec/tb-lookup.h"
 #include "exec/log.h"
@@ -241,6 +242,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
 
     if (sigsetjmp(cpu->jmp_env, 0) == 0) {
         start_exclusive();
+        cpu->atomic_steps++;
 
         tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, cf_mask);
         if (tb == NULL) {
@@ -393,6 +395,94 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     return;
 }
 
+/*
+ * A TB that only reads guest memory can loop on itself forever without
+ * changing what it reads; only parallel vCPUs make that worth detecting.
+ */
+static inline bool tb_is_spin_candidate(TranslationBlock *tb)
+{
+    uint32_t cflags = tb_cflags(tb);
+
+    return (cflags & (CF_NO_STORE | CF_HAS_LOAD | CF_PARALLEL)) ==
+           (CF_NO_STORE | CF_HAS_LOAD | CF_PARALLEL);
+}
+
+/* Iterations of a busy-wait loop before we start backing off */
+#define SPIN_THRESHOLD      64
+/* Iterations spent in cpu_relax() backoff before yielding the host CPU */
+#define SPIN_RELAX_ROUNDS   256
+
+static void cpu_spin_backoff(CPUState *cpu)
+{
+    unsigned int n = cpu->spin_count - SPIN_THRESHOLD;
+
+    if (n < SPIN_RELAX_ROUNDS) {
+        unsigned int i;
+
+        for (i = 0; i < (1u << (n / 32)); i++) {
+            cpu_relax();
+        }
+    } else {
+        cpu->spin_yields++;
+        g_thread_yield();
+    }
+}
+
+/*
+ * Hash of the architectural state of the vCPU.  Between two iterations of
+ * a load-only loop, only the registers can tell whether it got anywhere.
+ */
+static uint64_t cpu_spin_state_hash(CPUState *cpu)
+{
+    const uint64_t *p = cpu->env_ptr;
+    size_t i, n = sizeof(CPUArchState) / sizeof(uint64_t);
+    uint64_t h = 0;
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/*
+ * Called with the TB about to run and the TB that just exited to us.
+ * A load-only TB that keeps jumping to itself without changing the vCPU
+ * state is waiting for another vCPU to change memory, so give the host
+ * CPU to someone who can.  A loop that changes registers on every
+ * iteration, like strlen or a checksum, is making progress.
+ *
+ * Returns true if @tb must not be chained to itself, so that the next
+ * iteration comes back here.
+ */
+static bool cpu_spin_check(CPUState *cpu, TranslationBlock *tb,
+                           TranslationBlock *last_tb)
+{
+    uint64_t hash;
+
+    if (likely(tb != last_tb) || !tcg_spin_yield ||
+        !tb_is_spin_candidate(tb)) {
+        cpu->spin_count = 0;
+        return false;
+    }
+
+    hash = cpu_spin_state_hash(cpu);
+    if (cpu->spin_count == 0) {
+        /* first iteration, look at one more before deciding */
+        cpu->spin_hash = hash;
+        cpu->spin_count = 1;
+        return true;
+    }
+    if (hash != cpu->spin_hash) {
+        /* making progress, let it run chained */
+        cpu->spin_count = 0;
+        return false;
+    }
+    if (++cpu->spin_count > SPIN_THRESHOLD) {
+        cpu_spin_backoff(cpu);
+    }
+    return true;
+}
+
 static inline TranslationBlock *tb_find(CPUState *cpu,
                                         TranslationBlock *last_tb,
                                         int tb_exit, uint32_t cf_mask)
@@ -409,6 +499,13 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         /* We add the TB in the virtual pc hash table for the fast lookup */
         atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
     }
+    /*
+     * Keep possible busy-wait loops coming back here, so that
+     * cpu_spin_check() can see them, until they prove to make progress.
+     */
+    if (cpu_spin_check(cpu, tb, last_tb)) {
+        last_tb = NULL;
+    }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
      * system emulation. So it's not safe to make a direct jump to a TB
@@ -595,6 +692,11 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
         qemu_mutex_unlock_iothread();
     }
 
+    if (unlikely(atomic_read(&cpu->plugin_sample_pending))) {
+        atomic_set(&cpu->plugin_sample_pending, false);
+        qemu_plugin_vcpu_sample(cpu);
+    }
+
     /* Finally, check if we need to exit to the main loop.  */
     if (unlikely(atomic_read(&cpu->exit_request))
         || (use_icount
@@ -609,6 +711,28 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
     return false;
 }
 
+/*
+ * A TB that does not write guest memory and jumps back to itself can only
+ * make progress when another vCPU or a device changes memory, so it is
+ * most likely a busy-wait loop.
+ */
+static inline bool tb_is_spin_loop(TranslationBlock *tb)
+{
+    int n;
+
+    if (!(tb_cflags(tb) & CF_NO_STORE)) {
+        return false;
+    }
+    for (n = 0; n < 2; n++) {
+        uintptr_t dest = atomic_read(&tb->jmp_dest[n]);
+
+        if ((TranslationBlock *)(dest & ~(uintptr_t)1) == tb) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
                                     TranslationBlock **last_tb, int *tb_exit)
 {
@@ -625,6 +749,7 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
     }
 
     *last_tb = NULL;
+    cpu->in_spin_loop = tb_is_spin_loop(tb);
     insns_left = atomic_read(&cpu_neg(cpu)->icount_decr.u32);
     if (insns_left < 0) {
         /* Something asked us to stop executing chained TBs; just
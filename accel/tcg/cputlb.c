@@ -1218,6 +1218,12 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
         page_collection_unlock(pages);
     }
 
+    /* Account the page to this vCPU for dirty rate measurements */
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr,
+                                            DIRTY_MEMORY_MIGRATION)) {
+        atomic_set(&cpu->dirty_pages, cpu->dirty_pages + 1);
+    }
+
     /*
      * Set both VGA and migration bits for simplicity and to remove
      * the notdirty callback faster.
@@ -0,0 +1,340 @@
+/*
+ * Export translated code symbols to host profilers
+ *
+ * perf cannot tell what runs in the code generation buffer, so it shows
+ * up as anonymous memory.  This file writes the perf map and jitdump
+ * formats that "perf report" and "perf inject --jit" understand, mapping
+ * each translation block to the guest symbol it was translated from.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/error-report.h"
+#include "cpu.h"
+#include "disas/disas.h"
+#include "elf.h"
+#include "exec/perf.h"
+
+/* From tools/perf/util/jitdump.h in the Linux sources */
+#define JITHEADER_MAGIC 0x4A695444
+#define JITHEADER_VERSION 1
+
+enum {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_CLOSE = 3,
+};
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct jr_prefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+struct jr_code_load {
+    struct jr_prefix p;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+typedef struct PerfRecord {
+    QSIMPLEQ_ENTRY(PerfRecord) entry;
+    uint64_t guest_pc;
+    uintptr_t start;
+    size_t size;
+    uint64_t timestamp;
+    uint32_t tid;
+    /* a copy of the code, only for jitdump */
+    uint8_t code[];
+} PerfRecord;
+
+static bool perfmap_enabled;
+static bool jitdump_enabled;
+static bool perf_running;
+
+static QemuMutex perf_lock;
+static QemuCond perf_cond;
+static QSIMPLEQ_HEAD(, PerfRecord) perf_pending =
+    QSIMPLEQ_HEAD_INITIALIZER(perf_pending);
+
+/* Only the thread that dequeued the records writes them out */
+static QemuMutex perf_file_lock;
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_marker;
+static uint64_t jitdump_index;
+
+static uint64_t perf_timestamp(void)
+{
+    struct timespec ts;
+
+    /* perf correlates jitdump records with samples on CLOCK_MONOTONIC */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t perf_elf_mach(void)
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__arm__)
+    return EM_ARM;
+#elif defined(__powerpc64__)
+    return EM_PPC64;
+#elif defined(__s390x__)
+    return EM_S390;
+#elif defined(__riscv)
+    return EM_RISCV;
+#elif defined(__mips__)
+    return EM_MIPS;
+#elif defined(__sparc__)
+    return EM_SPARCV9;
+#else
+    return EM_NONE;
+#endif
+}
+
+void perf_enable_perfmap(void)
+{
+    perfmap_enabled = true;
+}
+
+void perf_enable_jitdump(void)
+{
+    jitdump_enabled = true;
+}
+
+static void perf_open_perfmap(void)
+{
+    g_autofree char *name = g_strdup_printf("/tmp/perf-%d.map", getpid());
+
+    perfmap = fopen(name, "w");
+    if (!perfmap) {
+        warn_report("could not open %s: %s", name, strerror(errno));
+    }
+}
+
+static void perf_open_jitdump(void)
+{
+    g_autofree char *name = g_strdup_printf("jit-%d.dump", getpid());
+    struct jitheader header = {
+        .magic = JITHEADER_MAGIC,
+        .version = JITHEADER_VERSION,
+        .total_size = sizeof(header),
+        .elf_mach = perf_elf_mach(),
+        .pid = getpid(),
+        .timestamp = perf_timestamp(),
+    };
+    int fd;
+
+    fd = open(name, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0) {
+        warn_report("could not open %s: %s", name, strerror(errno));
+        return;
+    }
+
+    /*
+     * perf finds the jitdump file through the executable mapping of it
+     * that it sees in the mmap events.
+     */
+    jitdump_marker = mmap(NULL, qemu_real_host_page_size,
+                          PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (jitdump_marker == MAP_FAILED) {
+        warn_report("could not map %s: %s", name, strerror(errno));
+        jitdump_marker = NULL;
+        close(fd);
+        return;
+    }
+
+    jitdump = fdopen(fd, "w");
+    if (!jitdump || fwrite(&header, sizeof(header), 1, jitdump) != 1) {
+        warn_report("could not write %s", name);
+        if (jitdump) {
+            fclose(jitdump);
+            jitdump = NULL;
+        } else {
+            close(fd);
+        }
+        munmap(jitdump_marker, qemu_real_host_page_size);
+        jitdump_marker = NULL;
+    }
+}
+
+static void perf_write_record(PerfRecord *rec)
+{
+    const char *sym = lookup_symbol(rec->guest_pc);
+    g_autofree char *name = NULL;
+
+    /* TBs of one guest function share a name, so perf aggregates them */
+    if (sym[0]) {
+        name = g_strdup_printf("guest:%s", sym);
+    } else {
+        name = g_strdup_printf("guest:0x%" PRIx64, rec->guest_pc);
+    }
+
+    if (perfmap) {
+        fprintf(perfmap, "%" PRIxPTR " %zx %s\n", rec->start, rec->size, name);
+    }
+
+    if (jitdump) {
+        size_t name_len = strlen(name) + 1;
+        struct jr_code_load load = {
+            .p.id = JIT_CODE_LOAD,
+            .p.total_size = sizeof(load) + name_len + rec->size,
+            .p.timestamp = rec->timestamp,
+            .pid = getpid(),
+            .tid = rec->tid,
+            .vma = rec->start,
+            .code_addr = rec->start,
+            .code_size = rec->size,
+            .code_index = jitdump_index++,
+        };
+
+        if (fwrite(&load, sizeof(load), 1, jitdump) != 1 ||
+            fwrite(name, name_len, 1, jitdump) != 1 ||
+            fwrite(rec->code, rec->size, 1, jitdump) != 1) {
+            warn_report_once("could not write jitdump record");
+        }
+    }
+}
+
+/* Write out everything queued so far */
+static void perf_flush(void)
+{
+    QSIMPLEQ_HEAD(, PerfRecord) batch = QSIMPLEQ_HEAD_INITIALIZER(batch);
+    PerfRecord *rec, *next;
+
+    qemu_mutex_lock(&perf_lock);
+    QSIMPLEQ_CONCAT(&batch, &perf_pending);
+    qemu_mutex_unlock(&perf_lock);
+
+    qemu_mutex_lock(&perf_file_lock);
+    QSIMPLEQ_FOREACH_SAFE(rec, &batch, entry, next) {
+        perf_write_record(rec);
+        g_free(rec);
+    }
+    if (perfmap) {
+        fflush(perfmap);
+    }
+    if (jitdump) {
+        fflush(jitdump);
+    }
+    qemu_mutex_unlock(&perf_file_lock);
+}
+
+static void *perf_thread(void *opaque)
+{
+    for (;;) {
+        qemu_mutex_lock(&perf_lock);
+        while (QSIMPLEQ_EMPTY(&perf_pending)) {
+            qemu_cond_wait(&perf_cond, &perf_lock);
+        }
+        qemu_mutex_unlock(&perf_lock);
+
+        perf_flush();
+    }
+    return NULL;
+}
+
+static void perf_exit(void)
+{
+    struct jr_prefix close_rec = {
+        .id = JIT_CODE_CLOSE,
+        .total_size = sizeof(close_rec),
+    };
+
+    perf_flush();
+
+    qemu_mutex_lock(&perf_file_lock);
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        close_rec.timestamp = perf_timestamp();
+        if (fwrite(&close_rec, sizeof(close_rec), 1, jitdump) != 1) {
+            warn_report("could not write jitdump record");
+        }
+        fclose(jitdump);
+        jitdump = NULL;
+        munmap(jitdump_marker, qemu_real_host_page_size);
+        jitdump_marker = NULL;
+    }
+    qemu_mutex_unlock(&perf_file_lock);
+}
+
+void perf_init(void)
+{
+    QemuThread thread;
+
+    if (!perfmap_enabled && !jitdump_enabled) {
+        return;
+    }
+
+    if (perfmap_enabled) {
+        perf_open_perfmap();
+    }
+    if (jitdump_enabled) {
+        perf_open_jitdump();
+    }
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    qemu_mutex_init(&perf_lock);
+    qemu_mutex_init(&perf_file_lock);
+    qemu_cond_init(&perf_cond);
+    qemu_thread_create(&thread, "perf-map", perf_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+    atexit(perf_exit);
+    perf_running = true;
+}
+
+void perf_report_code(uint64_t guest_pc, const void *start, size_t size)
+{
+    PerfRecord *rec;
+    bool copy_code;
+
+    if (likely(!perf_running)) {
+        return;
+    }
+
+    /* the code buffer may be flushed before the thread gets to it */
+    copy_code = jitdump != NULL;
+    rec = g_malloc(sizeof(*rec) + (copy_code ? size : 0));
+    rec->guest_pc = guest_pc;
+    rec->start = (uintptr_t)start;
+    rec->size = size;
+    rec->timestamp = perf_timestamp();
+    rec->tid = qemu_get_thread_id();
+    if (copy_code) {
+        memcpy(rec->code, start, size);
+    }
+
+    qemu_mutex_lock(&perf_lock);
+    QSIMPLEQ_INSERT_TAIL(&perf_pending, rec, entry);
+    qemu_cond_signal(&perf_cond);
+    qemu_mutex_unlock(&perf_lock);
+}
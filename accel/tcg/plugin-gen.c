@@ -93,6 +93,45 @@ void HELPER(plugin_vcpu_mem_cb)(unsigned int vcpu_index,
                                 void *userdata)
 { }
 
+/*
+ * Conditional callbacks are not switched out: the condition is checked
+ * here, so that no branch has to be injected into the TB.
+ */
+void HELPER(plugin_vcpu_cond_udata_cb)(uint32_t cpu_index, void *f,
+                                       void *udata, void *entry,
+                                       uint64_t imm, uint32_t cond)
+{
+    uint64_t val = *(uint64_t *)entry;
+    bool pass;
+
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        pass = val == imm;
+        break;
+    case QEMU_PLUGIN_COND_NE:
+        pass = val != imm;
+        break;
+    case QEMU_PLUGIN_COND_LT:
+        pass = val < imm;
+        break;
+    case QEMU_PLUGIN_COND_LE:
+        pass = val <= imm;
+        break;
+    case QEMU_PLUGIN_COND_GT:
+        pass = val > imm;
+        break;
+    case QEMU_PLUGIN_COND_GE:
+        pass = val >= imm;
+        break;
+    default:
+        /* ALWAYS and NEVER are handled at translation time */
+        g_assert_not_reached();
+    }
+    if (pass) {
+        ((qemu_plugin_vcpu_udata_cb_t)f)(cpu_index, udata);
+    }
+}
+
 static void do_gen_mem_cb(TCGv vaddr, uint32_t info)
 {
     TCGv_i32 cpu_index = tcg_temp_new_i32();
@@ -126,20 +165,11 @@ static void gen_empty_udata_cb(void)
 }
 
 /*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
+ * Inline ops and conditional callbacks are generated directly at injection
+ * time (see inject_inline_cb), so all we need here are the markers.
  */
 static void gen_empty_inline_cb(void)
 {
-    TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
-
-    tcg_gen_ld_i64(val, ptr, 0);
-    /* pass an immediate != 0 so that it doesn't get optimized away */
-    tcg_gen_addi_i64(val, val, 0xdeadface);
-    tcg_gen_st_i64(val, ptr, 0);
-    tcg_temp_free_ptr(ptr);
-    tcg_temp_free_i64(val);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -336,11 +366,6 @@ static TCGOp *copy_const_ptr(TCGOp **begin_op, TCGOp *op, void *ptr)
     return op;
 }
 
-static TCGOp *copy_const_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
-{
-    return copy_movi_i64(begin_op, op, v);
-}
-
 static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TARGET_LONG_BITS == 32) {
@@ -353,19 +378,6 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* 2x ld_i32 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-    } else {
-        /* ld_i64 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i64);
-    }
-    return op;
-}
-
 static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -379,18 +391,6 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* all 32-bit backends must implement add2_i32 */
-        g_assert(TCG_TARGET_HAS_add2_i32);
-        op = copy_op(begin_op, op, INDEX_op_add2_i32);
-    } else {
-        op = copy_op(begin_op, op, INDEX_op_add_i64);
-    }
-    return op;
-}
-
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -457,28 +457,6 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
-static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
-                               TCGOp *begin_op, TCGOp *op,
-                               int *unused)
-{
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
-
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
-
-    /* const_i64 */
-    op = copy_const_i64(&begin_op, op, cb->inline_insn.imm);
-
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op);
-
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
-
-    return op;
-}
-
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -565,10 +543,161 @@ inject_udata_cb(const GArray *cbs, TCGOp *begin_op)
     inject_cb_type(cbs, begin_op, append_udata_cb, op_ok);
 }
 
+/* load the address of @entry for the executing vCPU */
+static TCGv_ptr gen_plugin_u64_ptr(qemu_plugin_u64 entry)
+{
+    struct qemu_plugin_scoreboard *score = entry.score;
+    TCGv_ptr ptr = tcg_const_ptr(&score->data);
+    TCGv_ptr offset = tcg_temp_new_ptr();
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+
+    tcg_gen_ld_ptr(ptr, ptr, 0);
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_muli_i32(cpu_index, cpu_index, score->element_size);
+    tcg_gen_ext_i32_ptr(offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, offset);
+
+    tcg_temp_free_i32(cpu_index);
+    tcg_temp_free_ptr(offset);
+    return ptr;
+}
+
+static void gen_inline_op(const struct qemu_plugin_dyn_cb *cb)
+{
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr;
+
+    if (entry.score) {
+        ptr = gen_plugin_u64_ptr(entry);
+    } else {
+        ptr = tcg_const_ptr(cb->userp);
+    }
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        tcg_gen_ld_i64(val, ptr, entry.offset);
+        tcg_gen_addi_i64(val, val, cb->inline_insn.imm);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        tcg_gen_movi_i64(val, cb->inline_insn.imm);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_gen_st_i64(val, ptr, entry.offset);
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+}
+
+/* the last op emitted while tcg_ctx->emit_before_op is in effect */
+static TCGOp *last_emitted_op(void)
+{
+    TCGOp *next = tcg_ctx->emit_before_op;
+
+    return next ? QTAILQ_PREV(next, link) : tcg_last_op();
+}
+
+static void gen_cond_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    enum qemu_plugin_cond cond = cb->cond.cond;
+    TCGv_i32 cpu_index;
+    TCGv_ptr udata;
+    void *helper;
+    TCGOp *op;
+    int i;
+
+    if (cond == QEMU_PLUGIN_COND_NEVER) {
+        return;
+    }
+
+    cpu_index = tcg_temp_new_i32();
+    udata = tcg_const_ptr(cb->userp);
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    if (cond == QEMU_PLUGIN_COND_ALWAYS) {
+        helper = HELPER(plugin_vcpu_udata_cb);
+        gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    } else {
+        TCGv_ptr f = tcg_const_ptr(cb->f.vcpu_udata);
+        TCGv_ptr ptr = gen_plugin_u64_ptr(cb->cond.entry);
+        TCGv_i64 imm = tcg_const_i64(cb->cond.imm);
+        TCGv_i32 cond_arg = tcg_const_i32(cond);
+
+        helper = HELPER(plugin_vcpu_cond_udata_cb);
+        tcg_gen_addi_ptr(ptr, ptr, cb->cond.entry.offset);
+        gen_helper_plugin_vcpu_cond_udata_cb(cpu_index, f, udata, ptr, imm,
+                                             cond_arg);
+        tcg_temp_free_i32(cond_arg);
+        tcg_temp_free_i64(imm);
+        tcg_temp_free_ptr(ptr);
+        tcg_temp_free_ptr(f);
+    }
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+
+    /*
+     * Give the call the plugin's TCG flags, as copy_call() does, and for
+     * an unconditional callback call the plugin directly.
+     */
+    op = last_emitted_op();
+    tcg_debug_assert(op->opc == INDEX_op_call);
+    for (i = 0; i < MAX_OPC_PARAM_ARGS; i++) {
+        if ((uintptr_t)op->args[i] == (uintptr_t)helper) {
+            if (cond == QEMU_PLUGIN_COND_ALWAYS) {
+                op->args[i] = (uintptr_t)cb->f.vcpu_udata;
+            }
+            op->args[i + 1] = cb->tcg_flags;
+            break;
+        }
+    }
+    tcg_debug_assert(i < MAX_OPC_PARAM_ARGS);
+}
+
+/*
+ * Unlike the other callback types, inline ops and conditional callbacks do
+ * not go through a copy of the empty callback's ops: they are emitted with
+ * the regular TCG generators, right after the empty callback, which is then
+ * removed. This makes it possible to use per-vCPU addressing.
+ */
 static void
 inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
 {
-    inject_cb_type(cbs, begin_op, append_inline_cb, ok);
+    TCGOp *end_op;
+    int i;
+
+    if (!cbs || cbs->len == 0) {
+        rm_ops(begin_op);
+        return;
+    }
+
+    end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    tcg_debug_assert(end_op);
+
+    tcg_ctx->emit_before_op = QTAILQ_NEXT(end_op, link);
+    for (i = 0; i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (!ok(begin_op, cb)) {
+            continue;
+        }
+        switch (cb->type) {
+        case PLUGIN_CB_INLINE:
+            gen_inline_op(cb);
+            break;
+        case PLUGIN_CB_COND:
+            gen_cond_cb(cb);
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+    tcg_ctx->emit_before_op = NULL;
+
+    rm_ops_range(begin_op, end_op);
 }
 
 static void
@@ -29,6 +29,7 @@
 #include "qom/object.h"
 #include "cpu.h"
 #include "sysemu/cpus.h"
+#include "exec/exec-all.h"
 #include "qemu/main-loop.h"
 #include "tcg/tcg.h"
 #include "qapi/error.h"
@@ -41,6 +42,9 @@ typedef struct TCGState {
 
     bool mttcg_enabled;
     unsigned long tb_size;
+    uint64_t halt_poll_ns;
+    bool rr_adaptive;
+    bool spin_yield;
 } TCGState;
 
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
@@ -129,6 +133,9 @@ static int tcg_init(MachineState *ms)
     tcg_exec_init(s->tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
     mttcg_enabled = s->mttcg_enabled;
+    tcg_halt_poll_ns = s->halt_poll_ns;
+    tcg_rr_adaptive = s->rr_adaptive;
+    tcg_spin_yield = s->spin_yield;
     return 0;
 }
 
@@ -194,6 +201,61 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint64_t value = s->halt_poll_ns;
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void tcg_set_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    Error *error = NULL;
+    uint64_t value;
+
+    visit_type_uint64(v, name, &value, &error);
+    if (error) {
+        error_propagate(errp, error);
+        return;
+    }
+
+    s->halt_poll_ns = value;
+}
+
+static bool tcg_get_rr_adaptive(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->rr_adaptive;
+}
+
+static void tcg_set_rr_adaptive(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->rr_adaptive = value;
+}
+
+static bool tcg_get_spin_yield(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->spin_yield;
+}
+
+static void tcg_set_spin_yield(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->spin_yield = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -212,6 +274,24 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size", &error_abort);
 
+    object_class_property_add(oc, "halt-poll-ns", "int",
+        tcg_get_halt_poll_ns, tcg_set_halt_poll_ns,
+        NULL, NULL, &error_abort);
+    object_class_property_set_description(oc, "halt-poll-ns",
+        "Maximum time a halted vCPU polls for work before sleeping",
+        &error_abort);
+
+    object_class_property_add_bool(oc, "rr-adaptive",
+        tcg_get_rr_adaptive, tcg_set_rr_adaptive, &error_abort);
+    object_class_property_set_description(oc, "rr-adaptive",
+        "Adapt single-threaded TCG timeslices to vCPU behaviour",
+        &error_abort);
+
+    object_class_property_add_bool(oc, "spin-yield",
+        tcg_get_spin_yield, tcg_set_spin_yield, &error_abort);
+    object_class_property_set_description(oc, "spin-yield",
+        "Yield the host CPU when a multi-threaded TCG vCPU busy-waits",
+        &error_abort);
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -49,6 +49,7 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/perf.h"
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
@@ -215,6 +216,8 @@ TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
+bool tcg_spin_yield;
+bool tcg_rr_adaptive;
 
 static void page_table_config_init(void)
 {
@@ -1138,6 +1141,7 @@ void tcg_exec_init(unsigned long tb_size)
        initialize the prologue now.  */
     tcg_prologue_init(tcg_ctx);
 #endif
+    perf_init();
 }
 
 /* call with @p->lock held */
@@ -1718,6 +1722,20 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     gen_intermediate_code(cpu, tb, max_insns);
     tcg_ctx->cpu = NULL;
 
+    /*
+     * Lets the vCPU schedulers recognise busy-wait loops.  Only they look
+     * at these flags, so skip walking the ops when neither is enabled.
+     */
+    tb->cflags &= ~(CF_NO_STORE | CF_HAS_LOAD);
+    if (tcg_spin_yield || tcg_rr_adaptive) {
+        if (!tcg_op_list_may_write_memory(tcg_ctx)) {
+            tb->cflags |= CF_NO_STORE;
+        }
+        if (tcg_op_list_reads_memory(tcg_ctx)) {
+            tb->cflags |= CF_HAS_LOAD;
+        }
+    }
+
     trace_translate_block(tb, tb->pc, tb->tc.ptr);
 
     /* generate machine code */
@@ -1857,6 +1875,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         return existing_tb;
     }
     tcg_tb_insert(tb);
+    perf_report_code(pc, tb->tc.ptr, tb->tc.size);
     return tb;
 }
 
@@ -2306,6 +2325,8 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    uint64_t atomic_steps = 0;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2347,6 +2368,12 @@ void dump_exec_info(void)
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+
+    CPU_FOREACH(cpu) {
+        atomic_steps += cpu->atomic_steps;
+    }
+    qemu_printf("exclusive sections  %" PRIu64 " (serial atomic steps %"
+                PRIu64 ")\n", exclusive_section_count(), atomic_steps);
     tcg_dump_info();
 }
 
@@ -14,6 +14,7 @@
 #include "sysemu/hostmem.h"
 #include "sysemu/sysemu.h"
 #include "hw/boards.h"
+#include "hw/qdev-core.h"
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qapi/visitor.h"
@@ -243,6 +244,39 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 }
 
+static bool host_memory_backend_get_prealloc_async(Object *obj, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    return backend->prealloc_async;
+}
+
+static void host_memory_backend_set_prealloc_async(Object *obj, bool value,
+                                                   Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    backend->prealloc_async = value;
+}
+
+static void host_memory_backend_get_prealloc_progress(Object *obj, Visitor *v,
+    const char *name, void *opaque, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+    uint64_t value = 0;
+
+    if (backend->prealloc_ctx) {
+        value = os_mem_prealloc_progress(backend->prealloc_ctx);
+    } else if (backend->prealloc && host_memory_backend_mr_inited(backend)) {
+        value = memory_region_size(&backend->mr);
+    }
+    visit_type_uint64(v, name, &value, errp);
+}
+
 static void host_memory_backend_get_prealloc_threads(Object *obj, Visitor *v,
     const char *name, void *opaque, Error **errp)
 {
@@ -329,6 +363,42 @@ size_t host_memory_backend_pagesize(HostMemoryBackend *memdev)
 }
 #endif
 
+static void host_memory_backend_prealloc_wait(HostMemoryBackend *backend,
+                                              Error **errp)
+{
+    MemPreallocContext *ctx = backend->prealloc_ctx;
+
+    backend->prealloc_ctx = NULL;
+    os_mem_prealloc_finish(ctx, errp);
+}
+
+static int host_memory_backend_prealloc_wait_one(Object *obj, void *opaque)
+{
+    Error **errp = opaque;
+    HostMemoryBackend *backend;
+
+    if (!object_dynamic_cast(obj, TYPE_MEMORY_BACKEND)) {
+        return 0;
+    }
+    backend = MEMORY_BACKEND(obj);
+    if (backend->prealloc_ctx) {
+        host_memory_backend_prealloc_wait(backend, errp);
+        if (*errp) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void host_memory_backend_prealloc_wait_all(Error **errp)
+{
+    Error *local_err = NULL;
+
+    object_child_foreach(object_get_objects_root(),
+                         host_memory_backend_prealloc_wait_one, &local_err);
+    error_propagate(errp, local_err);
+}
+
 static void
 host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
 {
@@ -337,6 +407,8 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
     Error *local_err = NULL;
     void *ptr;
     uint64_t sz;
+    const unsigned long *host_nodes = NULL;
+    unsigned long nr_host_nodes = 0;
 
     if (bc->alloc) {
         bc->alloc(backend, &local_err);
@@ -391,16 +463,32 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
                 return;
             }
         }
+        if (maxnode) {
+            host_nodes = backend->host_nodes;
+            nr_host_nodes = maxnode;
+        }
 #endif
         /* Preallocate memory after the NUMA policy has been instantiated.
          * This is necessary to guarantee memory is allocated with
          * specified NUMA policy in place.
          */
         if (backend->prealloc) {
-            os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            backend->prealloc_threads, &local_err);
-            if (local_err) {
-                goto out;
+            /*
+             * Backends created on the command line may finish preallocating
+             * while devices are created, see
+             * host_memory_backend_prealloc_wait_all().
+             */
+            bool async = backend->prealloc_async && !qdev_hotplug;
+
+            backend->prealloc_ctx =
+                os_mem_prealloc_start(memory_region_get_fd(&backend->mr),
+                                      ptr, sz, backend->prealloc_threads,
+                                      host_nodes, nr_host_nodes, async);
+            if (!async) {
+                host_memory_backend_prealloc_wait(backend, &local_err);
+                if (local_err) {
+                    goto out;
+                }
             }
         }
     }
@@ -482,6 +570,17 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         NULL, NULL, &error_abort);
     object_class_property_set_description(oc, "prealloc-threads",
         "Number of CPU threads to use for prealloc", &error_abort);
+    object_class_property_add_bool(oc, "prealloc-async",
+        host_memory_backend_get_prealloc_async,
+        host_memory_backend_set_prealloc_async, &error_abort);
+    object_class_property_set_description(oc, "prealloc-async",
+        "Let device creation overlap with preallocation at startup",
+        &error_abort);
+    object_class_property_add(oc, "prealloc-progress", "int",
+        host_memory_backend_get_prealloc_progress,
+        NULL, NULL, NULL, &error_abort);
+    object_class_property_set_description(oc, "prealloc-progress",
+        "Number of bytes preallocated so far", &error_abort);
     object_class_property_add(oc, "size", "int",
         host_memory_backend_get_size,
         host_memory_backend_set_size,
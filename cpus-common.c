@@ -19,6 +19,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qemu/stats64.h"
 #include "exec/cpu-common.h"
 #include "hw/core/cpu.h"
 #include "sysemu/cpus.h"
@@ -33,6 +34,9 @@ static QemuCond qemu_work_cond;
  */
 static int pending_cpus;
 
+/* Number of exclusive sections started.  */
+static Stat64 exclusive_count;
+
 void qemu_init_cpu_list(void)
 {
     /* This is needed because qemu_init_cpu_list is also called by the
@@ -176,6 +180,7 @@ void start_exclusive(void)
 
     qemu_mutex_lock(&qemu_cpu_list_lock);
     exclusive_idle();
+    stat64_add(&exclusive_count, 1);
 
     /* Make all other cpus stop executing.  */
     atomic_set(&pending_cpus, 1);
@@ -204,6 +209,11 @@ void start_exclusive(void)
     current_cpu->in_exclusive_context = true;
 }
 
+uint64_t exclusive_section_count(void)
+{
+    return stat64_get(&exclusive_count);
+}
+
 /* Finish an exclusive operation.  */
 void end_exclusive(void)
 {
@@ -53,6 +53,8 @@
 #include "qemu/bitmap.h"
 #include "qemu/seqlock.h"
 #include "qemu/guest-random.h"
+#include "qemu/processor.h"
+#include "qemu/rcu.h"
 #include "tcg/tcg.h"
 #include "hw/nmi.h"
 #include "sysemu/replay.h"
@@ -165,6 +167,7 @@ typedef struct TimersState {
 
 static TimersState timers_state;
 bool mttcg_enabled;
+uint64_t tcg_halt_poll_ns;
 
 
 /* The current number of executed instructions is based on what we
@@ -712,17 +715,21 @@ static const VMStateDescription vmstate_timers = {
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
     double pct;
-    double throttle_ratio;
     int64_t sleeptime_ns, endtime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    pct = (double)cpu_throttle_get_vcpu_percentage(cpu) / 100;
+    if (!pct) {
+        atomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
-    throttle_ratio = pct / (1 - pct);
-    /* Add 1ns to fix double's rounding error (like 0.9999999...) */
-    sleeptime_ns = (int64_t)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS + 1);
+    /*
+     * Sleep for our share of the period the timer runs with, which is set
+     * by the most throttled vCPU.  With a single percentage for all vCPUs,
+     * this is pct / (1 - pct) timeslices.
+     * Add 1ns to fix double's rounding error (like 0.9999999...)
+     */
+    sleeptime_ns = (int64_t)(pct * opaque.host_ulong + 1);
     endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
     while (sleeptime_ns > 0 && !cpu->stop) {
         if (sleeptime_ns > SCALE_MS) {
@@ -738,25 +745,44 @@ static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
     atomic_set(&cpu->throttle_thread_scheduled, 0);
 }
 
+/* Highest throttle percentage of any vCPU */
+static int cpu_throttle_get_max_percentage(void)
+{
+    CPUState *cpu;
+    int pct = cpu_throttle_get_percentage();
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        pct = MAX(pct, atomic_read(&cpu->throttle_percentage));
+    }
+    return pct;
+}
+
 static void cpu_throttle_timer_tick(void *opaque)
 {
     CPUState *cpu;
     double pct;
+    unsigned long period_ns;
 
     /* Stop the timer if needed */
-    if (!cpu_throttle_get_percentage()) {
+    pct = (double)cpu_throttle_get_max_percentage() / 100;
+    if (!pct) {
         return;
     }
+    period_ns = CPU_THROTTLE_TIMESLICE_NS / (1 - pct);
+
     CPU_FOREACH(cpu) {
+        if (!cpu_throttle_get_vcpu_percentage(cpu)) {
+            continue;
+        }
         if (!atomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
-                             RUN_ON_CPU_NULL);
+                             RUN_ON_CPU_HOST_ULONG(period_ns));
         }
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
-                                   CPU_THROTTLE_TIMESLICE_NS / (1-pct));
+                                   period_ns);
 }
 
 void cpu_throttle_set(int new_throttle_pct)
@@ -771,14 +797,36 @@ void cpu_throttle_set(int new_throttle_pct)
                                        CPU_THROTTLE_TIMESLICE_NS);
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    if (new_throttle_pct) {
+        new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+        new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
+    }
+
+    atomic_set(&cpu->throttle_percentage, new_throttle_pct);
+
+    if (new_throttle_pct && !timer_pending(throttle_timer)) {
+        timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                                           CPU_THROTTLE_TIMESLICE_NS);
+    }
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     atomic_set(&throttle_percentage, 0);
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->throttle_percentage, 0);
+    }
 }
 
 bool cpu_throttle_active(void)
 {
-    return (cpu_throttle_get_percentage() != 0);
+    return (cpu_throttle_get_max_percentage() != 0);
 }
 
 int cpu_throttle_get_percentage(void)
@@ -786,6 +834,12 @@ int cpu_throttle_get_percentage(void)
     return atomic_read(&throttle_percentage);
 }
 
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    return MAX(cpu_throttle_get_percentage(),
+               atomic_read(&cpu->throttle_percentage));
+}
+
 void cpu_ticks_init(void)
 {
     seqlock_init(&timers_state.vm_clock_seqlock);
@@ -866,16 +920,34 @@ void configure_icount(QemuOpts *opts, Error **errp)
  *
  * The timer is removed if all vCPUs are idle and restarted again once
  * idleness is complete.
+ *
+ * With adaptive timeslices (-accel tcg,rr-adaptive=on) the timer ticks at
+ * TCG_RR_SLICE_MIN_US and each vCPU keeps running until its own timeslice,
+ * measured in QEMU_CLOCK_VIRTUAL so that it is deterministic with icount,
+ * has elapsed.  A vCPU that is found in a busy-wait loop when its slice
+ * expires gets a shorter slice next time; any other vCPU that uses up
+ * its slice gets a longer one.
  */
 
 static QEMUTimer *tcg_kick_vcpu_timer;
 static CPUState *tcg_current_rr_cpu;
 
 #define TCG_KICK_PERIOD (NANOSECONDS_PER_SECOND / 10)
+#define TCG_RR_SLICE_MIN_US (TCG_KICK_PERIOD / SCALE_US / 32)
+#define TCG_RR_SLICE_MAX_US (TCG_KICK_PERIOD / SCALE_US * 4)
+
+/*
+ * vCPU whose timeslice is running, and when the slice started.  The kick
+ * timer and the round-robin thread only touch these with the BQL held.
+ */
+static CPUState *tcg_rr_slice_cpu;
+static int64_t tcg_rr_slice_start;
+static bool tcg_rr_slice_expired;
 
 static inline int64_t qemu_tcg_next_kick(void)
 {
-    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_PERIOD;
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+           (tcg_rr_adaptive ? TCG_RR_SLICE_MIN_US * SCALE_US : TCG_KICK_PERIOD);
 }
 
 /* Kick the currently round-robin scheduled vCPU to next */
@@ -932,9 +1004,81 @@ void qemu_timer_notify_cb(void *opaque, QEMUClockType type)
 static void kick_tcg_thread(void *opaque)
 {
     timer_mod(tcg_kick_vcpu_timer, qemu_tcg_next_kick());
+
+    if (tcg_rr_adaptive) {
+        CPUState *cpu = tcg_rr_slice_cpu;
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+        if (cpu && now - tcg_rr_slice_start <
+                   (int64_t)cpu->rr_slice_us * SCALE_US) {
+            return;
+        }
+        tcg_rr_slice_expired = true;
+    }
     qemu_cpu_kick_rr_next_cpu();
 }
 
+/* Called by the round-robin thread before running @cpu.  */
+static void qemu_tcg_rr_begin_slice(CPUState *cpu)
+{
+    if (!tcg_rr_adaptive || cpu == tcg_rr_slice_cpu) {
+        return;
+    }
+    if (!cpu->rr_slice_us) {
+        cpu->rr_slice_us = TCG_KICK_PERIOD / SCALE_US;
+    }
+    cpu->in_spin_loop = false;
+    tcg_rr_slice_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    tcg_rr_slice_expired = false;
+    tcg_rr_slice_cpu = cpu;
+}
+
+static bool qemu_tcg_rr_other_cpu_interrupted(CPUState *cpu)
+{
+    CPUState *other;
+
+    CPU_FOREACH(other) {
+        if (other != cpu && other->interrupt_request) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Called by the round-robin thread after @cpu returned from cpu_exec()
+ * with @ret.  Returns true if @cpu should keep running.
+ */
+static bool qemu_tcg_rr_end_exec(CPUState *cpu, int ret)
+{
+    if (!tcg_rr_adaptive) {
+        return false;
+    }
+
+    if (tcg_rr_slice_expired) {
+        if (cpu->in_spin_loop) {
+            cpu->rr_slice_us = MAX(cpu->rr_slice_us / 2, TCG_RR_SLICE_MIN_US);
+        } else {
+            cpu->rr_slice_us = MIN(cpu->rr_slice_us * 2, TCG_RR_SLICE_MAX_US);
+        }
+        tcg_rr_slice_cpu = NULL;
+        return false;
+    }
+
+    /*
+     * The vCPU stopped before its slice expired, e.g. because its icount
+     * budget ran out at a timer deadline.  Let it continue unless it
+     * cannot, or another vCPU has an interrupt to handle.
+     */
+    if (ret == EXCP_HALTED || cpu->halted || cpu->stop ||
+        cpu->queued_work_first ||
+        qemu_tcg_rr_other_cpu_interrupted(cpu)) {
+        tcg_rr_slice_cpu = NULL;
+        return false;
+    }
+    return true;
+}
+
 static void start_tcg_kick_timer(void)
 {
     assert(!mttcg_enabled);
@@ -1175,15 +1319,137 @@ static void qemu_wait_io_event_common(CPUState *cpu)
     process_queued_cpu_work(cpu);
 }
 
+/*
+ * TCG halt polling
+ *
+ * Like KVM's halt_poll_ns, a halted vCPU thread spins for a while without
+ * the BQL before sleeping on its halt_cond, so that an interrupt arriving
+ * shortly afterwards does not pay for a futex wakeup.  The window grows
+ * while wakeups come soon after the vCPU halts and shrinks when they do
+ * not.  In round-robin mode the single thread polls for any vCPU to
+ * become runnable and uses first_cpu's window and statistics.
+ */
+#define HALT_POLL_NS_GROW_START 10000
+#define HALT_POLL_NS_GROW       2
+#define HALT_POLL_NS_SHRINK     2
+
+static uint64_t tcg_halt_poll_max(CPUState *cpu)
+{
+    if (use_icount) {
+        return 0;
+    }
+    return cpu->halt_poll_ns_max >= 0 ? cpu->halt_poll_ns_max
+                                      : tcg_halt_poll_ns;
+}
+
+static bool tcg_halt_poll_idle(CPUState *cpu)
+{
+    return qemu_tcg_mttcg_enabled() ? cpu_thread_is_idle(cpu)
+                                    : all_cpu_threads_idle();
+}
+
+/*
+ * Called with the BQL held when the vCPU thread is about to sleep.
+ * Returns true if work showed up within the polling window.
+ */
+static bool qemu_tcg_halt_poll(CPUState *cpu)
+{
+    int64_t start, now;
+    bool woken = false;
+
+    if (!cpu->halt_poll_ns) {
+        return false;
+    }
+
+    qemu_mutex_unlock_iothread();
+    start = now = get_clock();
+    WITH_RCU_READ_LOCK_GUARD() {
+        while (now - start < cpu->halt_poll_ns) {
+            /* Racy without the BQL; the caller checks again.  */
+            if (!tcg_halt_poll_idle(cpu)) {
+                woken = true;
+                break;
+            }
+            cpu_relax();
+            now = get_clock();
+        }
+    }
+    qemu_mutex_lock_iothread();
+
+    cpu->halt_poll_time_ns += now - start;
+    return woken;
+}
+
+/* Adapt the polling window to how long the vCPU was halted.  */
+static void qemu_tcg_halt_poll_update(CPUState *cpu, int64_t block_ns,
+                                      bool polled)
+{
+    uint64_t max = tcg_halt_poll_max(cpu);
+
+    if (polled) {
+        cpu->halt_poll_success++;
+        return;
+    }
+    if (cpu->halt_poll_ns) {
+        cpu->halt_poll_fail++;
+    }
+
+    if (block_ns > max) {
+        cpu->halt_poll_ns /= HALT_POLL_NS_SHRINK;
+    } else if (cpu->halt_poll_ns < max) {
+        cpu->halt_poll_ns = MAX(cpu->halt_poll_ns * HALT_POLL_NS_GROW,
+                                HALT_POLL_NS_GROW_START);
+    }
+    cpu->halt_poll_ns = MIN(cpu->halt_poll_ns, max);
+}
+
+void dump_halt_poll_info(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!tcg_halt_poll_max(cpu) && !cpu->halt_poll_time_ns) {
+            continue;
+        }
+        qemu_printf("CPU %d halt polling: window %" PRIu64 " ns, "
+                    "%" PRIu64 " successful, %" PRIu64 " failed, "
+                    "%" PRIu64 " us polled\n",
+                    cpu->cpu_index, cpu->halt_poll_ns,
+                    cpu->halt_poll_success, cpu->halt_poll_fail,
+                    cpu->halt_poll_time_ns / SCALE_US);
+    }
+    CPU_FOREACH(cpu) {
+        if (cpu->spin_yields) {
+            qemu_printf("CPU %d busy-wait yields: %" PRIu64 "\n",
+                        cpu->cpu_index, cpu->spin_yields);
+        }
+    }
+}
+
 static void qemu_tcg_rr_wait_io_event(void)
 {
     CPUState *cpu;
+    int64_t block_start = 0;
+    bool slept = false, polled = false;
 
     while (all_cpu_threads_idle()) {
+        if (!slept) {
+            slept = true;
+            block_start = get_clock();
+            if (qemu_tcg_halt_poll(first_cpu) && !all_cpu_threads_idle()) {
+                polled = true;
+                break;
+            }
+        }
         stop_tcg_kick_timer();
         qemu_cond_wait(first_cpu->halt_cond, &qemu_global_mutex);
     }
 
+    if (slept) {
+        qemu_tcg_halt_poll_update(first_cpu, get_clock() - block_start,
+                                  polled);
+    }
+
     start_tcg_kick_timer();
 
     CPU_FOREACH(cpu) {
@@ -1193,16 +1459,27 @@ static void qemu_tcg_rr_wait_io_event(void)
 
 static void qemu_wait_io_event(CPUState *cpu)
 {
-    bool slept = false;
+    int64_t block_start = 0;
+    bool slept = false, polled = false;
 
     while (cpu_thread_is_idle(cpu)) {
         if (!slept) {
             slept = true;
             qemu_plugin_vcpu_idle_cb(cpu);
+            if (tcg_enabled()) {
+                block_start = get_clock();
+                if (qemu_tcg_halt_poll(cpu) && !cpu_thread_is_idle(cpu)) {
+                    polled = true;
+                    break;
+                }
+            }
         }
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
     if (slept) {
+        if (tcg_enabled()) {
+            qemu_tcg_halt_poll_update(cpu, get_clock() - block_start, polled);
+        }
         qemu_plugin_vcpu_resume_cb(cpu);
     }
 
@@ -1501,6 +1778,17 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
             if (cpu_can_run(cpu)) {
                 int r;
 
+                /*
+                 * Skip halted vCPUs without the round trip through
+                 * cpu_exec().  Replay needs cpu_exec() to see them.
+                 */
+                if (replay_mode == REPLAY_MODE_NONE &&
+                    cpu->halted && !cpu_has_work(cpu)) {
+                    cpu = CPU_NEXT(cpu);
+                    continue;
+                }
+
+                qemu_tcg_rr_begin_slice(cpu);
                 qemu_mutex_unlock_iothread();
                 prepare_icount_for_run(cpu);
 
@@ -1518,6 +1806,10 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
                     qemu_mutex_lock_iothread();
                     break;
                 }
+                if (qemu_tcg_rr_end_exec(cpu, r)) {
+                    /* Go back through the main loop and resume @cpu.  */
+                    break;
+                }
             } else if (cpu->stop) {
                 if (cpu->unplug) {
                     cpu = CPU_NEXT(cpu);
@@ -84,6 +84,9 @@ typedef struct {
     void *io_func_opaque;
 } DMAAIOCB;
 
+/* Number of host buffers mapped per address_space_map_vectored() call */
+#define DMA_MAP_BATCH 64
+
 static void dma_blk_cb(void *opaque, int ret);
 
 static void reschedule_dma(void *opaque)
@@ -98,14 +101,26 @@ static void reschedule_dma(void *opaque)
 
 static void dma_blk_unmap(DMAAIOCB *dbs)
 {
-    int i;
+    dma_memory_unmap_vectored(dbs->sg->as, dbs->iov.iov, dbs->iov.niov,
+                              dbs->dir, dbs->iov.size);
+    qemu_iovec_reset(&dbs->iov);
+}
 
-    for (i = 0; i < dbs->iov.niov; ++i) {
-        dma_memory_unmap(dbs->sg->as, dbs->iov.iov[i].iov_base,
-                         dbs->iov.iov[i].iov_len, dbs->dir,
-                         dbs->iov.iov[i].iov_len);
+/* Move the current position in the scatter/gather list forward by @len */
+static void dma_blk_advance(DMAAIOCB *dbs, dma_addr_t len)
+{
+    while (dbs->sg_cur_index < dbs->sg->nsg) {
+        dma_addr_t rest = dbs->sg->sg[dbs->sg_cur_index].len -
+                          dbs->sg_cur_byte;
+
+        if (len < rest) {
+            dbs->sg_cur_byte += len;
+            return;
+        }
+        len -= rest;
+        dbs->sg_cur_byte = 0;
+        ++dbs->sg_cur_index;
     }
-    qemu_iovec_reset(&dbs->iov);
 }
 
 static void dma_complete(DMAAIOCB *dbs, int ret)
@@ -124,8 +139,9 @@ static void dma_complete(DMAAIOCB *dbs, int ret)
 static void dma_blk_cb(void *opaque, int ret)
 {
     DMAAIOCB *dbs = (DMAAIOCB *)opaque;
-    dma_addr_t cur_addr, cur_len;
-    void *mem;
+    struct iovec iov[DMA_MAP_BATCH];
+    dma_addr_t len;
+    int i, niov;
 
     trace_dma_blk_cb(dbs, ret);
 
@@ -139,16 +155,18 @@ static void dma_blk_cb(void *opaque, int ret)
     dma_blk_unmap(dbs);
 
     while (dbs->sg_cur_index < dbs->sg->nsg) {
-        cur_addr = dbs->sg->sg[dbs->sg_cur_index].base + dbs->sg_cur_byte;
-        cur_len = dbs->sg->sg[dbs->sg_cur_index].len - dbs->sg_cur_byte;
-        mem = dma_memory_map(dbs->sg->as, cur_addr, &cur_len, dbs->dir);
-        if (!mem)
+        niov = dma_memory_map_vectored(dbs->sg->as,
+                                       &dbs->sg->sg[dbs->sg_cur_index],
+                                       dbs->sg->nsg - dbs->sg_cur_index,
+                                       dbs->sg_cur_byte,
+                                       iov, ARRAY_SIZE(iov), &len, dbs->dir);
+        for (i = 0; i < niov; i++) {
+            qemu_iovec_add(&dbs->iov, iov[i].iov_base, iov[i].iov_len);
+        }
+        dma_blk_advance(dbs, len);
+        if (niov < ARRAY_SIZE(iov)) {
+            /* Either done, or out of bounce buffers.  */
             break;
-        qemu_iovec_add(&dbs->iov, mem, cur_len);
-        dbs->sg_cur_byte += cur_len;
-        if (dbs->sg_cur_byte == dbs->sg->sg[dbs->sg_cur_index].len) {
-            dbs->sg_cur_byte = 0;
-            ++dbs->sg_cur_index;
         }
     }
 
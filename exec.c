@@ -915,6 +915,7 @@ Property cpu_common_props[] = {
      */
     DEFINE_PROP_LINK("memory", CPUState, memory, TYPE_MEMORY_REGION,
                      MemoryRegion *),
+    DEFINE_PROP_INT64("halt-poll-ns", CPUState, halt_poll_ns_max, -1),
 #endif
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -3360,15 +3361,27 @@ void cpu_flush_icache_range(hwaddr start, hwaddr len)
                                      NULL, len, FLUSH_CACHE);
 }
 
-typedef struct {
+/*
+ * Accesses to non-RAM regions are bounced through temporary buffers.
+ * Several of them may be live at once, up to BOUNCE_BUFFER_MAX_SIZE bytes
+ * in total, so that scatter/gather DMA to MMIO does not serialize on a
+ * single buffer.
+ */
+#define BOUNCE_BUFFER_MAX_SIZE (64 * TARGET_PAGE_SIZE)
+
+typedef struct BounceBuffer {
     MemoryRegion *mr;
     void *buffer;
     hwaddr addr;
     hwaddr len;
-    bool in_use;
+    QLIST_ENTRY(BounceBuffer) link;
 } BounceBuffer;
 
-static BounceBuffer bounce;
+static QemuMutex bounce_lock;
+static QLIST_HEAD(, BounceBuffer) bounce_list
+    = QLIST_HEAD_INITIALIZER(bounce_list);
+/* Total length of the buffers in bounce_list, updated atomically */
+static size_t bounce_size;
 
 typedef struct MapClient {
     QEMUBH *bh;
@@ -3403,7 +3416,8 @@ void cpu_register_map_client(QEMUBH *bh)
     qemu_mutex_lock(&map_client_list_lock);
     client->bh = bh;
     QLIST_INSERT_HEAD(&map_client_list, client, link);
-    if (!atomic_read(&bounce.in_use)) {
+    if (atomic_read(&bounce_size) + TARGET_PAGE_SIZE <=
+        BOUNCE_BUFFER_MAX_SIZE) {
         cpu_notify_map_clients_locked();
     }
     qemu_mutex_unlock(&map_client_list_lock);
@@ -3423,6 +3437,7 @@ void cpu_exec_init_all(void)
     io_mem_init();
     memory_map_init();
     qemu_mutex_init(&map_client_list_lock);
+    qemu_mutex_init(&bounce_lock);
 }
 
 void cpu_unregister_map_client(QEMUBH *bh)
@@ -3508,6 +3523,65 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
     }
 }
 
+static void *flatview_map_bounce(FlatView *fv, MemoryRegion *mr,
+                                 hwaddr addr, hwaddr *plen, bool is_write)
+{
+    BounceBuffer *bounce;
+    /* Avoid unbounded allocations */
+    size_t l = MIN(*plen, TARGET_PAGE_SIZE);
+
+    if (atomic_fetch_add(&bounce_size, l) + l > BOUNCE_BUFFER_MAX_SIZE) {
+        /*
+         * Give the space back.  A concurrent mapping may have failed
+         * because of it in the meantime, so let it retry.
+         */
+        atomic_fetch_sub(&bounce_size, l);
+        cpu_notify_map_clients();
+        return NULL;
+    }
+
+    bounce = g_new(BounceBuffer, 1);
+    bounce->buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
+    bounce->addr = addr;
+    bounce->len = l;
+
+    memory_region_ref(mr);
+    bounce->mr = mr;
+    if (!is_write) {
+        flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
+                      bounce->buffer, l);
+    }
+
+    qemu_mutex_lock(&bounce_lock);
+    QLIST_INSERT_HEAD(&bounce_list, bounce, link);
+    qemu_mutex_unlock(&bounce_lock);
+
+    *plen = l;
+    return bounce->buffer;
+}
+
+/* Called within RCU critical section.  */
+static void *flatview_map(FlatView *fv, hwaddr addr, hwaddr *plen,
+                          bool is_write, MemTxAttrs attrs)
+{
+    hwaddr len = *plen;
+    hwaddr l, xlat;
+    MemoryRegion *mr;
+
+    l = len;
+    mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
+
+    if (!memory_access_is_direct(mr, is_write)) {
+        *plen = l;
+        return flatview_map_bounce(fv, mr, addr, plen, is_write);
+    }
+
+    memory_region_ref(mr);
+    *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
+                                        l, is_write, attrs);
+    return qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+}
+
 /* Map a physical memory region into a host virtual address.
  * May map a subset of the requested range, given by and returned in *plen.
  * May return NULL if resources needed to perform the mapping are exhausted.
@@ -3521,49 +3595,75 @@ void *address_space_map(AddressSpace *as,
                         bool is_write,
                         MemTxAttrs attrs)
 {
-    hwaddr len = *plen;
-    hwaddr l, xlat;
-    MemoryRegion *mr;
-    void *ptr;
-    FlatView *fv;
-
-    if (len == 0) {
+    if (*plen == 0) {
         return NULL;
     }
 
-    l = len;
+    RCU_READ_LOCK_GUARD();
+    return flatview_map(address_space_to_flatview(as), addr, plen,
+                        is_write, attrs);
+}
+
+/* Map a scatter/gather list with a single flatview lookup.  Stops at the
+ * first range that cannot be mapped; the caller can retry from there once
+ * a map client is notified.
+ */
+int address_space_map_vectored(AddressSpace *as,
+                               const AddressSpaceMapSegment *segs, int nsegs,
+                               hwaddr offset, struct iovec *iov, int max_iov,
+                               hwaddr *plen, bool is_write, MemTxAttrs attrs)
+{
+    FlatView *fv;
+    hwaddr done = 0;
+    int i, niov = 0;
+
     RCU_READ_LOCK_GUARD();
     fv = address_space_to_flatview(as);
-    mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
+    for (i = 0; i < nsegs && niov < max_iov; i++) {
+        hwaddr addr = segs[i].base + offset;
+        hwaddr len = segs[i].len - offset;
 
-    if (!memory_access_is_direct(mr, is_write)) {
-        if (atomic_xchg(&bounce.in_use, true)) {
-            return NULL;
-        }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
+        offset = 0;
+        while (len > 0 && niov < max_iov) {
+            hwaddr l = len;
+            void *ptr = flatview_map(fv, addr, &l, is_write, attrs);
 
-        memory_region_ref(mr);
-        bounce.mr = mr;
-        if (!is_write) {
-            flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
-        }
+            if (!ptr) {
+                goto out;
+            }
+            iov[niov].iov_base = ptr;
+            iov[niov].iov_len = l;
+            niov++;
 
-        *plen = l;
-        return bounce.buffer;
+            done += l;
+            addr += l;
+            len -= l;
+        }
     }
 
+out:
+    *plen = done;
+    return niov;
+}
+
+static BounceBuffer *bounce_buffer_take(void *buffer)
+{
+    BounceBuffer *bounce;
 
-    memory_region_ref(mr);
-    *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
-                                        l, is_write, attrs);
-    ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+    /* Only look at the list if some access to MMIO is in flight.  */
+    if (!atomic_read(&bounce_size)) {
+        return NULL;
+    }
 
-    return ptr;
+    qemu_mutex_lock(&bounce_lock);
+    QLIST_FOREACH(bounce, &bounce_list, link) {
+        if (bounce->buffer == buffer) {
+            QLIST_REMOVE(bounce, link);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&bounce_lock);
+    return bounce;
 }
 
 /* Unmaps a memory region previously mapped by address_space_map().
@@ -3573,7 +3673,9 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          bool is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
+    BounceBuffer *bounce = bounce_buffer_take(buffer);
+
+    if (!bounce) {
         MemoryRegion *mr;
         ram_addr_t addr1;
 
@@ -3589,16 +3691,31 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         return;
     }
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
+        address_space_write(as, bounce->addr, MEMTXATTRS_UNSPECIFIED,
+                            bounce->buffer, access_len);
     }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    atomic_mb_set(&bounce.in_use, false);
+    qemu_vfree(bounce->buffer);
+    memory_region_unref(bounce->mr);
+
+    atomic_fetch_sub(&bounce_size, bounce->len);
+    g_free(bounce);
     cpu_notify_map_clients();
 }
 
+void address_space_unmap_vectored(AddressSpace *as, const struct iovec *iov,
+                                  int niov, bool is_write, hwaddr access_len)
+{
+    int i;
+
+    for (i = 0; i < niov; i++) {
+        hwaddr l = MIN(access_len, iov[i].iov_len);
+
+        address_space_unmap(as, iov[i].iov_base, iov[i].iov_len,
+                            is_write, l);
+        access_len -= l;
+    }
+}
+
 void *cpu_physical_memory_map(hwaddr addr,
                               hwaddr *plen,
                               bool is_write)
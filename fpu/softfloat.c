@@ -232,13 +232,30 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
-static inline bool can_use_fpu(const float_status *s)
+/*
+ * Like can_use_fpu() below, for operations whose result does not
+ * depend on the rounding mode (e.g. conversions that truncate).
+ */
+static inline bool can_use_fpu_any_rmode(float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
-                  s->float_rounding_mode == float_round_nearest_even);
+    if (likely(s->float_exception_flags & float_flag_inexact)) {
+        return true;
+    }
+    if (s->lazy_inexact) {
+        /* Do not work out whether the result is exact: assume it isn't. */
+        s->float_exception_flags |= float_flag_inexact;
+        return true;
+    }
+    return false;
+}
+
+static inline bool can_use_fpu(float_status *s)
+{
+    return likely(s->float_rounding_mode == float_round_nearest_even) &&
+           can_use_fpu_any_rmode(s);
 }
 
 /*
@@ -1952,13 +1969,41 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts p = float64_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float32_params, s);
     return float32_round_pack_canonical(pr, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = ua.h;
+    if (unlikely(f32_is_inf(ur))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !float64_is_zero(ua.s)) {
+        /* Possible underflow: let softfloat raise the right flags.  */
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 /*
  * Rounds the floating-point value `a' to an integer, and returns the
  * result as a floating-point value. The operation is performed
@@ -2208,6 +2253,55 @@ int64_t float64_to_int64_scalbn(float64 a, int rmode, int scale,
                                  rmode, scale, INT64_MIN, INT64_MAX, s);
 }
 
+/*
+ * Hardfloat float to integer conversion.  The caller has checked that
+ * inexact is already raised and that rounding, unless truncating, is to
+ * nearest even.  Only NaNs and values that may not fit, which must
+ * raise invalid, are left to the soft path.
+ */
+static inline bool hard_float_to_int(double d, double limit,
+                                     bool round_to_zero, int64_t *r)
+{
+    if (unlikely(!(fabs(d) < limit))) {
+        return false;
+    }
+    *r = round_to_zero ? (int64_t)d : (int64_t)rint(d);
+    return true;
+}
+
+#define HARD_INT32_LIMIT_RTZ    0x1p31
+#define HARD_INT32_LIMIT_RNE    (0x1p31 - 0.5)
+/* Every double below 2^63 in magnitude is an integer or rounds below it.  */
+#define HARD_INT64_LIMIT        0x1p63
+
+static inline bool f32_to_int_hard(float32 *a, double limit, bool rtz,
+                                   int64_t *r, float_status *s)
+{
+    union_float32 ua;
+
+    if (rtz ? !can_use_fpu_any_rmode(s) : !can_use_fpu(s)) {
+        return false;
+    }
+    ua.s = *a;
+    float32_input_flush1(&ua.s, s);
+    *a = ua.s;
+    return hard_float_to_int(ua.h, limit, rtz, r);
+}
+
+static inline bool f64_to_int_hard(float64 *a, double limit, bool rtz,
+                                   int64_t *r, float_status *s)
+{
+    union_float64 ua;
+
+    if (rtz ? !can_use_fpu_any_rmode(s) : !can_use_fpu(s)) {
+        return false;
+    }
+    ua.s = *a;
+    float64_input_flush1(&ua.s, s);
+    *a = ua.s;
+    return hard_float_to_int(ua.h, limit, rtz, r);
+}
+
 int16_t float16_to_int16(float16 a, float_status *s)
 {
     return float16_to_int16_scalbn(a, s->float_rounding_mode, 0, s);
@@ -2230,11 +2324,21 @@ int16_t float32_to_int16(float32 a, float_status *s)
 
 int32_t float32_to_int32(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int_hard(&a, HARD_INT32_LIMIT_RNE, false, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int_hard(&a, HARD_INT64_LIMIT, false, &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2245,11 +2349,21 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int_hard(&a, HARD_INT32_LIMIT_RNE, false, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int_hard(&a, HARD_INT64_LIMIT, false, &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2275,11 +2389,21 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int_hard(&a, HARD_INT32_LIMIT_RTZ, true, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int_hard(&a, HARD_INT64_LIMIT, true, &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2290,11 +2414,21 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int_hard(&a, HARD_INT32_LIMIT_RTZ, true, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int_hard(&a, HARD_INT64_LIMIT, true, &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2574,6 +2708,30 @@ float16 int16_to_float16(int16_t a, float_status *status)
     return int64_to_float16_scalbn(a, 0, status);
 }
 
+/*
+ * Integer to float conversions are exact, whatever the rounding mode,
+ * when the integer fits in the significand.  Larger values can still be
+ * rounded by the host under the usual hardfloat conditions.
+ */
+static inline bool int_to_float_can_use_fpu(int64_t a, int bits,
+                                            float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return (a >= -(INT64_C(1) << bits) && a <= (INT64_C(1) << bits)) ||
+           can_use_fpu(s);
+}
+
+static inline bool uint_to_float_can_use_fpu(uint64_t a, int bits,
+                                             float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return a <= (UINT64_C(1) << bits) || can_use_fpu(s);
+}
+
 float32 int64_to_float32_scalbn(int64_t a, int scale, float_status *status)
 {
     FloatParts pa = int_to_float(a, scale, status);
@@ -2592,11 +2750,23 @@ float32 int16_to_float32_scalbn(int16_t a, int scale, float_status *status)
 
 float32 int64_to_float32(int64_t a, float_status *status)
 {
+    if (int_to_float_can_use_fpu(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
+    if (int_to_float_can_use_fpu(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2623,11 +2793,23 @@ float64 int16_to_float64_scalbn(int16_t a, int scale, float_status *status)
 
 float64 int64_to_float64(int64_t a, float_status *status)
 {
+    if (int_to_float_can_use_fpu(a, 53, status)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
+    if (int_to_float_can_use_fpu(a, 53, status)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
@@ -2717,11 +2899,23 @@ float32 uint16_to_float32_scalbn(uint16_t a, int scale, float_status *status)
 
 float32 uint64_to_float32(uint64_t a, float_status *status)
 {
+    if (uint_to_float_can_use_fpu(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float32_scalbn(a, 0, status);
 }
 
 float32 uint32_to_float32(uint32_t a, float_status *status)
 {
+    if (uint_to_float_can_use_fpu(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2748,11 +2942,23 @@ float64 uint16_to_float64_scalbn(uint16_t a, int scale, float_status *status)
 
 float64 uint64_to_float64(uint64_t a, float_status *status)
 {
+    if (uint_to_float_can_use_fpu(a, 53, status)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float64_scalbn(a, 0, status);
 }
 
 float64 uint32_to_float64(uint32_t a, float_status *status)
 {
+    if (uint_to_float_can_use_fpu(a, 53, status)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float64_scalbn(a, 0, status);
 }
 
@@ -843,12 +843,37 @@ static CPUState *gdb_get_cpu(uint32_t pid, uint32_t tid)
     }
 }
 
+/* look up the XML description called @name (@len bytes long) */
+static const char *gdb_find_feature_xml(CPUState *cpu, const char *name,
+                                        size_t len)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    const char *xml_name;
+    int i;
+
+    if (cc->gdb_get_dynamic_xml) {
+        char *xmlname = g_strndup(name, len);
+        const char *xml = cc->gdb_get_dynamic_xml(cpu, xmlname);
+
+        g_free(xmlname);
+        if (xml) {
+            return xml;
+        }
+    }
+    for (i = 0; ; i++) {
+        xml_name = xml_builtin[i][0];
+        if (!xml_name ||
+            (strncmp(xml_name, name, len) == 0 && strlen(xml_name) == len)) {
+            break;
+        }
+    }
+    return xml_name ? xml_builtin[i][1] : NULL;
+}
+
 static const char *get_feature_xml(const char *p, const char **newp,
                                    GDBProcess *process)
 {
     size_t len;
-    int i;
-    const char *name;
     CPUState *cpu = get_first_cpu_in_process(process);
     CPUClass *cc = CPU_GET_CLASS(cpu);
 
@@ -857,7 +882,6 @@ static const char *get_feature_xml(const char *p, const char **newp,
         len++;
     *newp = p + len;
 
-    name = NULL;
     if (strncmp(p, "target.xml", len) == 0) {
         char *buf = process->target_xml;
         const size_t buf_sz = sizeof(process->target_xml);
@@ -889,24 +913,94 @@ static const char *get_feature_xml(const char *p, const char **newp,
         }
         return buf;
     }
-    if (cc->gdb_get_dynamic_xml) {
-        char *xmlname = g_strndup(p, len);
-        const char *xml = cc->gdb_get_dynamic_xml(cpu, xmlname);
+    return gdb_find_feature_xml(cpu, p, len);
+}
 
-        g_free(xmlname);
-        if (xml) {
-            return xml;
+/*
+ * Minimal scan of a feature description: report the name attribute of
+ * the <feature> element and of each <reg> element, numbering registers
+ * from @base_reg unless they carry an explicit regnum attribute.
+ */
+static char *xml_get_attr(const char *tag, const char *end, const char *attr)
+{
+    size_t attr_len = strlen(attr);
+    const char *p;
+
+    for (p = tag; p && p < end; p = strchr(p + 1, ' ')) {
+        const char *start, *stop;
+
+        if (strncmp(p + 1, attr, attr_len) != 0 ||
+            strncmp(p + 1 + attr_len, "=\"", 2) != 0) {
+            continue;
+        }
+        start = p + 1 + attr_len + 2;
+        stop = strchr(start, '"');
+        if (!stop || stop > end) {
+            return NULL;
         }
+        return g_strndup(start, stop - start);
     }
-    for (i = 0; ; i++) {
-        name = xml_builtin[i][0];
-        if (!name || (strncmp(name, p, len) == 0 && strlen(name) == len))
+    return NULL;
+}
+
+static void gdb_foreach_feature_reg(const char *xml, int base_reg,
+                                    int num_regs, gdb_reg_desc_fn fn,
+                                    void *opaque)
+{
+    g_autofree char *feature = NULL;
+    const char *p, *end;
+    int regnum = base_reg;
+
+    p = strstr(xml, "<feature ");
+    if (p) {
+        end = strchr(p, '>');
+        if (end) {
+            feature = xml_get_attr(p, end, "name");
+        }
+    }
+
+    for (p = strstr(xml, "<reg "); p; p = strstr(end, "<reg ")) {
+        g_autofree char *name = NULL;
+        g_autofree char *num = NULL;
+
+        end = strchr(p, '>');
+        if (!end) {
             break;
+        }
+        name = xml_get_attr(p, end, "name");
+        num = xml_get_attr(p, end, "regnum");
+        if (num) {
+            regnum = atoi(num);
+        }
+        if (name && regnum >= base_reg && regnum < base_reg + num_regs) {
+            fn(regnum, name, feature ? feature : "", opaque);
+        }
+        regnum++;
+    }
+}
+
+void gdb_foreach_register(CPUState *cpu, gdb_reg_desc_fn fn, void *opaque)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    GDBRegisterState *r;
+    const char *xml;
+
+    if (cc->gdb_core_xml_file) {
+        xml = gdb_find_feature_xml(cpu, cc->gdb_core_xml_file,
+                                   strlen(cc->gdb_core_xml_file));
+        if (xml) {
+            gdb_foreach_feature_reg(xml, 0, cc->gdb_num_core_regs, fn, opaque);
+        }
+    }
+    for (r = cpu->gdb_regs; r; r = r->next) {
+        xml = gdb_find_feature_xml(cpu, r->xml, strlen(r->xml));
+        if (xml) {
+            gdb_foreach_feature_reg(xml, r->base_reg, r->num_regs, fn, opaque);
+        }
     }
-    return name ? xml_builtin[i][1] : NULL;
 }
 
-static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu->env_ptr;
@@ -1293,50 +1293,116 @@ int virtqueue_avail_bytes(VirtQueue *vq, unsigned int in_bytes,
     return in_bytes <= in_total && out_bytes <= out_total;
 }
 
-static bool virtqueue_map_desc(VirtIODevice *vdev, unsigned int *p_num_sg,
-                               hwaddr *addr, struct iovec *iov,
-                               unsigned int max_num_sg, bool is_write,
+/*
+ * Append the buffer at @pa of @sz bytes to the descriptor chain in @segs,
+ * which holds *@p_out_segs device-readable buffers followed by *@p_in_segs
+ * device-writable ones.
+ */
+static bool virtqueue_add_desc(VirtIODevice *vdev, ScatterGatherEntry *segs,
+                               unsigned int *p_out_segs,
+                               unsigned int *p_in_segs, bool is_write,
                                hwaddr pa, size_t sz)
 {
-    bool ok = false;
-    unsigned num_sg = *p_num_sg;
-    assert(num_sg <= max_num_sg);
+    unsigned int nsegs = *p_out_segs + *p_in_segs;
 
     if (!sz) {
         virtio_error(vdev, "virtio: zero sized buffers are not allowed");
-        goto out;
+        return false;
+    }
+    if (nsegs == VIRTQUEUE_MAX_SIZE) {
+        virtio_error(vdev, "virtio: too many descriptors in indirect table");
+        return false;
+    }
+    if (is_write) {
+        (*p_in_segs)++;
+    } else {
+        if (*p_in_segs) {
+            virtio_error(vdev, "Incorrect order for descriptors");
+            return false;
+        }
+        (*p_out_segs)++;
+    }
+    segs[nsegs].base = pa;
+    segs[nsegs].len = sz;
+    return true;
+}
+
+/*
+ * Map the @nsegs buffers in @segs, which all go in the same direction,
+ * with a single vectored mapping and append them to @iov and @addr.
+ */
+static bool virtqueue_map_descs(VirtIODevice *vdev, unsigned int *p_num_sg,
+                                hwaddr *addr, struct iovec *iov,
+                                unsigned int max_num_sg, bool is_write,
+                                const ScatterGatherEntry *segs,
+                                unsigned int nsegs)
+{
+    unsigned num_sg = *p_num_sg;
+    dma_addr_t len, total = 0;
+    hwaddr pa, end;
+    unsigned int i, seg;
+    int n;
+
+    assert(num_sg <= max_num_sg);
+
+    if (!nsegs) {
+        return true;
+    }
+    for (i = 0; i < nsegs; i++) {
+        total += segs[i].len;
     }
 
-    while (sz) {
-        hwaddr len = sz;
+    n = dma_memory_map_vectored(vdev->dma_as, segs, nsegs, 0,
+                                &iov[num_sg], max_num_sg - num_sg, &len,
+                                is_write ? DMA_DIRECTION_FROM_DEVICE :
+                                           DMA_DIRECTION_TO_DEVICE);
 
+    /* A descriptor may be split across several memory regions.  */
+    seg = 0;
+    pa = segs[0].base;
+    end = pa + segs[0].len;
+    for (i = 0; i < n; i++, num_sg++) {
+        if (pa == end) {
+            seg++;
+            pa = segs[seg].base;
+            end = pa + segs[seg].len;
+        }
+        addr[num_sg] = pa;
+        pa += iov[num_sg].iov_len;
+    }
+    *p_num_sg = num_sg;
+
+    if (len != total) {
         if (num_sg == max_num_sg) {
             virtio_error(vdev, "virtio: too many write descriptors in "
                                "indirect table");
-            goto out;
-        }
-
-        iov[num_sg].iov_base = dma_memory_map(vdev->dma_as, pa, &len,
-                                              is_write ?
-                                              DMA_DIRECTION_FROM_DEVICE :
-                                              DMA_DIRECTION_TO_DEVICE);
-        if (!iov[num_sg].iov_base) {
+        } else {
             virtio_error(vdev, "virtio: bogus descriptor or out of resources");
-            goto out;
         }
-
-        iov[num_sg].iov_len = len;
-        addr[num_sg] = pa;
-
-        sz -= len;
-        pa += len;
-        num_sg++;
+        return false;
     }
-    ok = true;
+    return true;
+}
 
-out:
-    *p_num_sg = num_sg;
-    return ok;
+/*
+ * Map a whole descriptor chain collected by virtqueue_add_desc(): one
+ * vectored mapping for the device-readable buffers and one for the
+ * device-writable ones.
+ */
+static bool virtqueue_map_chain(VirtIODevice *vdev, unsigned int *p_out_num,
+                                unsigned int *p_in_num, hwaddr *addr,
+                                struct iovec *iov,
+                                const ScatterGatherEntry *segs,
+                                unsigned int out_segs, unsigned int in_segs)
+{
+    if (!virtqueue_map_descs(vdev, p_out_num, addr, iov, VIRTQUEUE_MAX_SIZE,
+                             false, segs, out_segs)) {
+        return false;
+    }
+    return virtqueue_map_descs(vdev, p_in_num, addr + *p_out_num,
+                               iov + *p_out_num,
+                               VIRTQUEUE_MAX_SIZE - *p_out_num, true,
+                               segs + out_segs, in_segs);
 }
 
 /* Only used by error code paths before we have a VirtQueueElement (therefore
@@ -1419,6 +1485,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     VirtIODevice *vdev = vq->vdev;
     VirtQueueElement *elem = NULL;
     unsigned out_num, in_num, elem_entries;
+    unsigned out_segs, in_segs;
+    ScatterGatherEntry segs[VIRTQUEUE_MAX_SIZE];
     hwaddr addr[VIRTQUEUE_MAX_SIZE];
     struct iovec iov[VIRTQUEUE_MAX_SIZE];
     VRingDesc desc;
@@ -1434,6 +1502,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
 
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
+    out_segs = in_segs = 0;
 
     max = vq->vring.num;
 
@@ -1487,32 +1556,18 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
 
     /* Collect all the descriptors */
     do {
-        bool map_ok;
-
-        if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
-                                        iov + out_num,
-                                        VIRTQUEUE_MAX_SIZE - out_num, true,
-                                        desc.addr, desc.len);
-        } else {
-            if (in_num) {
-                virtio_error(vdev, "Incorrect order for descriptors");
-                goto err_undo_map;
-            }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
-                                        VIRTQUEUE_MAX_SIZE, false,
-                                        desc.addr, desc.len);
-        }
-        if (!map_ok) {
-            goto err_undo_map;
-        }
-
         /* If we've got too many, that implies a descriptor loop. */
         if (++elem_entries > max) {
             virtio_error(vdev, "Looped descriptor");
             goto err_undo_map;
         }
 
+        if (!virtqueue_add_desc(vdev, segs, &out_segs, &in_segs,
+                                desc.flags & VRING_DESC_F_WRITE,
+                                desc.addr, desc.len)) {
+            goto err_undo_map;
+        }
+
         rc = virtqueue_split_read_next_desc(vdev, &desc, desc_cache, max, &i);
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
@@ -1520,6 +1575,11 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto err_undo_map;
     }
 
+    if (!virtqueue_map_chain(vdev, &out_num, &in_num, addr, iov,
+                             segs, out_segs, in_segs)) {
+        goto err_undo_map;
+    }
+
     /* Now copy what we have collected and mapped */
     elem = virtqueue_alloc_element(sz, out_num, in_num);
     elem->index = head;
@@ -1556,6 +1616,8 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     VirtIODevice *vdev = vq->vdev;
     VirtQueueElement *elem = NULL;
     unsigned out_num, in_num, elem_entries;
+    unsigned out_segs, in_segs;
+    ScatterGatherEntry segs[VIRTQUEUE_MAX_SIZE];
     hwaddr addr[VIRTQUEUE_MAX_SIZE];
     struct iovec iov[VIRTQUEUE_MAX_SIZE];
     VRingPackedDesc desc;
@@ -1569,6 +1631,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
+    out_segs = in_segs = 0;
 
     max = vq->vring.num;
 
@@ -1615,37 +1678,28 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 
     /* Collect all the descriptors */
     do {
-        bool map_ok;
-
-        if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
-                                        iov + out_num,
-                                        VIRTQUEUE_MAX_SIZE - out_num, true,
-                                        desc.addr, desc.len);
-        } else {
-            if (in_num) {
-                virtio_error(vdev, "Incorrect order for descriptors");
-                goto err_undo_map;
-            }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
-                                        VIRTQUEUE_MAX_SIZE, false,
-                                        desc.addr, desc.len);
-        }
-        if (!map_ok) {
-            goto err_undo_map;
-        }
-
         /* If we've got too many, that implies a descriptor loop. */
         if (++elem_entries > max) {
             virtio_error(vdev, "Looped descriptor");
             goto err_undo_map;
         }
 
+        if (!virtqueue_add_desc(vdev, segs, &out_segs, &in_segs,
+                                desc.flags & VRING_DESC_F_WRITE,
+                                desc.addr, desc.len)) {
+            goto err_undo_map;
+        }
+
         rc = virtqueue_packed_read_next_desc(vq, &desc, desc_cache, max, &i,
                                              desc_cache ==
                                              &indirect_desc_cache);
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
+    if (!virtqueue_map_chain(vdev, &out_num, &in_num, addr, iov,
+                             segs, out_segs, in_segs)) {
+        goto err_undo_map;
+    }
+
     /* Now copy what we have collected and mapped */
     elem = virtqueue_alloc_element(sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
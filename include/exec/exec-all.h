@@ -383,6 +383,8 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_NO_STORE    0x00100000 /* TB does not write guest memory */
+#define CF_HAS_LOAD    0x00200000 /* TB reads guest memory */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
@@ -439,6 +441,10 @@ struct TranslationBlock {
 };
 
 extern bool parallel_cpus;
+/* Back off vCPUs that busy-wait in parallel TCG */
+extern bool tcg_spin_yield;
+/* Adapt round-robin TCG timeslices to vCPU behaviour */
+extern bool tcg_rr_adaptive;
 
 /* Hide the atomic_read to make code a little easier on the eyes */
 static inline uint32_t tb_cflags(const TranslationBlock *tb)
@@ -74,6 +74,30 @@ void gdb_register_coprocessor(CPUState *cpu,
                               gdb_get_reg_cb get_reg, gdb_set_reg_cb set_reg,
                               int num_regs, const char *xml, int g_pos);
 
+/**
+ * gdb_read_register() - read a register as gdb would
+ * @cpu: the CPU
+ * @buf: array the value is appended to, in target byte order
+ * @reg: gdb register number
+ *
+ * Returns the size of the register, or 0 if @reg does not exist.
+ */
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg);
+
+typedef void (*gdb_reg_desc_fn)(int regnum, const char *name,
+                                const char *feature, void *opaque);
+
+/**
+ * gdb_foreach_register() - enumerate the described registers of a CPU
+ * @cpu: the CPU
+ * @fn: called with the gdb number, name and feature name of each register
+ * @opaque: passed to @fn
+ *
+ * Only registers that have a name in the CPU's XML descriptions are
+ * reported. The strings passed to @fn are only valid during the call.
+ */
+void gdb_foreach_register(CPUState *cpu, gdb_reg_desc_fn fn, void *opaque);
+
 /*
  * The GDB remote protocol transfers values in target byte order. As
  * the gdbstub may be batching up several register values we always
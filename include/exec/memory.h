@@ -2331,6 +2331,60 @@ void *address_space_map(AddressSpace *as, hwaddr addr,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          bool is_write, hwaddr access_len);
 
+/**
+ * AddressSpaceMapSegment: one guest physical range of a scatter/gather
+ * list passed to address_space_map_vectored()
+ *
+ * @base: start address within the address space
+ * @len: length of the range in bytes
+ */
+typedef struct AddressSpaceMapSegment {
+    hwaddr base;
+    hwaddr len;
+} AddressSpaceMapSegment;
+
+/* address_space_map_vectored: map a scatter/gather list into host memory
+ *
+ * Translates @segs in a single RCU critical section, starting @offset bytes
+ * into the first segment, and stores the resulting host buffers in @iov.
+ * A segment that crosses a region boundary produces more than one #iovec.
+ * Mapping stops when @max_iov entries have been filled or when a mapping
+ * fails because bounce buffers are exhausted; in the latter case use
+ * cpu_register_map_client() to know when retrying is likely to succeed.
+ * Returns the number of #iovec entries filled; the number of bytes mapped
+ * is returned in @plen.
+ *
+ * @as: #AddressSpace to be accessed
+ * @segs: guest physical ranges to map
+ * @nsegs: number of entries in @segs
+ * @offset: number of bytes of @segs[0] to skip
+ * @iov: array receiving the host buffers
+ * @max_iov: number of entries available in @iov
+ * @plen: set to the total length mapped
+ * @is_write: indicates the transfer direction
+ * @attrs: memory attributes
+ */
+int address_space_map_vectored(AddressSpace *as,
+                               const AddressSpaceMapSegment *segs, int nsegs,
+                               hwaddr offset, struct iovec *iov, int max_iov,
+                               hwaddr *plen, bool is_write, MemTxAttrs attrs);
+
+/* address_space_unmap_vectored: Unmaps buffers previously mapped by
+ * address_space_map_vectored()
+ *
+ * @access_len bytes are accounted to the entries of @iov in order; see
+ * address_space_unmap().
+ *
+ * @as: #AddressSpace used
+ * @iov: host buffers as returned by address_space_map_vectored()
+ * @niov: number of entries in @iov
+ * @is_write: indicates the transfer direction
+ * @access_len: amount of data actually transferred
+ */
+void address_space_unmap_vectored(AddressSpace *as, const struct iovec *iov,
+                                  int niov, bool is_write,
+                                  hwaddr access_len);
+
 
 /* Internal functions, part of the implementation of address_space_read.  */
 MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
@@ -0,0 +1,63 @@
+/*
+ * Export translated code symbols to host profilers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_PERF_H
+#define EXEC_PERF_H
+
+#ifdef CONFIG_LINUX
+
+/**
+ * perf_enable_perfmap: write /tmp/perf-<pid>.map
+ *
+ * The map lists the host address range of every translation block
+ * together with the guest symbol (or guest PC) it was translated from.
+ */
+void perf_enable_perfmap(void);
+
+/**
+ * perf_enable_jitdump: write jit-<pid>.dump in the current directory
+ *
+ * Unlike the perf map, the jitdump file also carries the generated code,
+ * so "perf inject --jit" can annotate it even after the code buffer has
+ * been flushed and reused.
+ */
+void perf_enable_jitdump(void);
+
+/**
+ * perf_init: start exporting symbols
+ *
+ * Called once the translator is set up, which is after -daemonize has
+ * forked, so that the file names match the pid perf sees.
+ */
+void perf_init(void);
+
+/**
+ * perf_report_code: record a freshly translated block
+ * @guest_pc: guest virtual address the block was translated from
+ * @start: start of the host code
+ * @size: size of the host code
+ *
+ * The record is handed to a background thread, which looks up the guest
+ * symbol and writes it out, so that translation is not slowed down by
+ * file I/O.
+ */
+void perf_report_code(uint64_t guest_pc, const void *start, size_t size);
+
+#else
+
+static inline void perf_init(void)
+{
+}
+
+static inline void perf_report_code(uint64_t guest_pc, const void *start,
+                                    size_t size)
+{
+}
+
+#endif
+
+#endif /* EXEC_PERF_H */
@@ -94,6 +94,17 @@ static inline void set_snan_bit_is_one(flag val, float_status *status)
     status->snan_bit_is_one = val;
 }
 
+/*
+ * Frontends whose guests rarely look at the inexact flag can opt in to
+ * using the host FPU even while inexact is clear.  The price is that any
+ * operation taking the fast path raises inexact, exact result or not,
+ * so turn the mode off again once the guest reads or clears the flag.
+ */
+static inline void set_float_lazy_inexact(flag val, float_status *status)
+{
+    status->lazy_inexact = val;
+}
+
 static inline int get_float_detect_tininess(float_status *status)
 {
     return status->float_detect_tininess;
@@ -129,4 +140,9 @@ static inline flag get_default_nan_mode(float_status *status)
     return status->default_nan_mode;
 }
 
+static inline flag get_float_lazy_inexact(float_status *status)
+{
+    return status->lazy_inexact;
+}
+
 #endif /* _SOFTFLOAT_HELPERS_H_ */
@@ -175,6 +175,11 @@ typedef struct float_status {
     flag default_nan_mode;
     /* not always used -- see snan_bit_is_one() in softfloat-specialize.h */
     flag snan_bit_is_one;
+    /*
+     * may hardfloat be used before inexact is raised, raising it
+     * pessimistically instead?
+     */
+    flag lazy_inexact;
 } float_status;
 
 #endif /* SOFTFLOAT_TYPES_H */
@@ -337,9 +337,27 @@ struct qemu_work_item;
  *                        to @trace_dstate).
  * @trace_dstate: Dynamic tracing state of events for this vCPU (bitmask).
  * @plugin_mask: Plugin event bitmap. Modified only via async work.
+ * @plugin_sample_pending: Set by the plugin sampler, which then forces the
+ *    vCPU out of its TB chain; the sample is taken at the next TB boundary.
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
  *    CPU do_transaction_failed hook function.
+ * @halt_poll_ns_max: Upper bound of the TCG halt-polling window, or -1 to
+ *    use the value of the tcg accelerator's halt-poll-ns property.
+ * @halt_poll_ns: Current TCG halt-polling window.
+ * @halt_poll_success: Number of halts ended by work found while polling.
+ * @halt_poll_fail: Number of halts that polled and then slept.
+ * @halt_poll_time_ns: Total time spent polling.
+ * @in_spin_loop: Set if the vCPU was last asked to exit while executing a
+ *    busy-wait loop.
+ * @rr_slice_us: Current round-robin TCG timeslice of this vCPU, in
+ *    microseconds.
+ * @spin_count: Consecutive iterations of the current busy-wait loop.
+ * @spin_hash: Hash of the vCPU state after the first of those iterations.
+ * @spin_yields: Number of times the vCPU gave up the host CPU while
+ *    busy-waiting.
+ * @atomic_steps: Number of instructions this vCPU had to execute with
+ *    all other vCPUs stopped, because the host could not do them atomically.
  *
  * State of one CPU core or thread.
  */
@@ -418,6 +436,7 @@ struct CPUState {
     DECLARE_BITMAP(plugin_mask, QEMU_PLUGIN_EV_MAX);
 
     GArray *plugin_mem_cbs;
+    bool plugin_sample_pending;
 
     /* TODO Move common fields from CPUArchState here. */
     int cpu_index;
@@ -433,9 +452,34 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Throttle percentage of this vCPU only, see cpu_throttle_set_vcpu() */
+    int throttle_percentage;
+
+    /*
+     * Pages whose migration dirty bit was set by a write from this vCPU,
+     * TCG only.  The counter wraps; only differences are meaningful.
+     */
+    uint32_t dirty_pages;
 
     bool ignore_memory_transaction_failures;
 
+    /* TCG halt polling, accessed by the vCPU thread with the BQL held */
+    int64_t halt_poll_ns_max;
+    uint64_t halt_poll_ns;
+    uint64_t halt_poll_success;
+    uint64_t halt_poll_fail;
+    uint64_t halt_poll_time_ns;
+
+    /* Round-robin TCG scheduling */
+    bool in_spin_loop;
+    int rr_slice_us;
+
+    /* Parallel TCG busy-wait backoff */
+    unsigned int spin_count;
+    uint64_t spin_hash;
+    uint64_t spin_yields;
+    uint64_t atomic_steps;
+
     struct hax_vcpu_state *hax_vcpu;
 
     int hvf_fd;
@@ -854,6 +898,27 @@ bool cpu_throttle_active(void);
  */
 int cpu_throttle_get_percentage(void);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vCPU to throttle.
+ * @new_throttle_pct: Percent of sleep time. Valid range is 1 to 99, or 0
+ * to stop throttling @cpu.
+ *
+ * Like cpu_throttle_set, but only for @cpu.  When both are set, the vCPU
+ * is throttled by the higher of the two percentages.  cpu_throttle_stop
+ * also resets the percentage of each vCPU.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
+/**
+ * cpu_throttle_get_vcpu_percentage:
+ * @cpu: The vCPU to query.
+ *
+ * Returns: The percentage by which @cpu is currently throttled, 0 if it
+ * is not throttled.
+ */
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu);
+
 #ifndef CONFIG_USER_ONLY
 
 typedef void (*CPUInterruptHandler)(CPUState *, int);
@@ -1006,6 +1071,15 @@ void start_exclusive(void);
  */
 void end_exclusive(void);
 
+/**
+ * exclusive_section_count:
+ *
+ * Returns the number of exclusive sections started so far.  Every one
+ * of them stops all running vCPUs, so a steadily growing count points
+ * at guest code that keeps falling back to serial execution.
+ */
+uint64_t exclusive_section_count(void);
+
 /**
  * qemu_init_vcpu:
  * @cpu: The vCPU to initialize.
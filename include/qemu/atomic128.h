@@ -41,21 +41,10 @@
  * Therefore, special case each platform.
  */
 
-#if defined(CONFIG_ATOMIC128)
-static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
-{
-    return atomic_cmpxchg__nocheck(ptr, cmp, new);
-}
-# define HAVE_CMPXCHG128 1
-#elif defined(CONFIG_CMPXCHG128)
-static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
-{
-    return __sync_val_compare_and_swap_16(ptr, cmp, new);
-}
-# define HAVE_CMPXCHG128 1
-#elif defined(__aarch64__)
-/* Through gcc 8, aarch64 has no support for 128-bit at all.  */
-static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+#if defined(__aarch64__)
+/* cmpxchg with an exclusive pair loop, which any ARMv8.0 host can do */
+static inline Int128 atomic16_cmpxchg_exclusive(Int128 *ptr, Int128 cmp,
+                                                Int128 new)
 {
     uint64_t cmpl = int128_getlo(cmp), cmph = int128_gethi(cmp);
     uint64_t newl = int128_getlo(new), newh = int128_gethi(new);
@@ -77,6 +66,54 @@ static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
 
     return int128_make128(oldl, oldh);
 }
+#endif
+
+#if defined(CONFIG_ATOMIC128)
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    return atomic_cmpxchg__nocheck(ptr, cmp, new);
+}
+# define HAVE_CMPXCHG128 1
+#elif defined(__aarch64__) && !defined(__ARM_FEATURE_ATOMICS)
+/*
+ * The compiler may not assume LSE, so look for it at run time: unlike an
+ * exclusive pair loop, a single CASPAL cannot be starved by other CPUs
+ * hammering the same line.  Set up by util/cacheinfo.c.
+ */
+extern bool have_lse_atomics;
+
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    if (likely(have_lse_atomics)) {
+        /* CASP requires consecutive register pairs from an even one. */
+        register uint64_t oldl asm("x0") = int128_getlo(cmp);
+        register uint64_t oldh asm("x1") = int128_gethi(cmp);
+        register uint64_t newl asm("x2") = int128_getlo(new);
+        register uint64_t newh asm("x3") = int128_gethi(new);
+
+        asm(".arch_extension lse\n\t"
+            "caspal %[oldl], %[oldh], %[newl], %[newh], %[mem]"
+            : [mem] "+Q"(*ptr), [oldl] "+r"(oldl), [oldh] "+r"(oldh)
+            : [newl] "r"(newl), [newh] "r"(newh)
+            : "memory");
+
+        return int128_make128(oldl, oldh);
+    }
+    return atomic16_cmpxchg_exclusive(ptr, cmp, new);
+}
+# define HAVE_CMPXCHG128 1
+#elif defined(CONFIG_CMPXCHG128)
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    return __sync_val_compare_and_swap_16(ptr, cmp, new);
+}
+# define HAVE_CMPXCHG128 1
+#elif defined(__aarch64__)
+/* Through gcc 8, aarch64 has no support for 128-bit at all.  */
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    return atomic16_cmpxchg_exclusive(ptr, cmp, new);
+}
 # define HAVE_CMPXCHG128 1
 #else
 /* Fallback definition that must be optimized away, or error.  */
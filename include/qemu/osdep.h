@@ -557,6 +557,47 @@ void qemu_set_tty_echo(int fd, bool echo);
 void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
                      Error **errp);
 
+typedef struct MemPreallocContext MemPreallocContext;
+
+/**
+ * os_mem_prealloc_start:
+ * @fd: file descriptor backing @area, or -1
+ * @area: start of the memory to preallocate
+ * @sz: size of the memory to preallocate
+ * @max_threads: maximum number of threads to use
+ * @host_nodes: bitmap of host NUMA nodes the memory is bound to, or %NULL
+ * @maxnode: number of valid bits in @host_nodes
+ * @async: whether to return before preallocation completes
+ *
+ * Start preallocating @area.  If @host_nodes is not %NULL, the threads
+ * are bound to the host CPUs of those nodes.  Preallocation only runs in
+ * the background if @async is true and the host can populate memory
+ * without writing to it; otherwise it is complete when this returns.
+ * Either way, os_mem_prealloc_finish() must be called to collect the
+ * result.
+ */
+MemPreallocContext *os_mem_prealloc_start(int fd, char *area, size_t sz,
+                                          int max_threads,
+                                          const unsigned long *host_nodes,
+                                          unsigned long maxnode, bool async);
+
+/**
+ * os_mem_prealloc_progress:
+ * @ctx: context returned by os_mem_prealloc_start()
+ *
+ * Returns the number of bytes preallocated so far.
+ */
+uint64_t os_mem_prealloc_progress(MemPreallocContext *ctx);
+
+/**
+ * os_mem_prealloc_finish:
+ * @ctx: context returned by os_mem_prealloc_start()
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait for preallocation to complete and free @ctx.
+ */
+void os_mem_prealloc_finish(MemPreallocContext *ctx, Error **errp);
+
 /**
  * qemu_get_pid_name:
  * @pid: pid of a process
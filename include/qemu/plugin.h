@@ -58,6 +58,7 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_RESUME,
     QEMU_PLUGIN_EV_VCPU_SYSCALL,
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
+    QEMU_PLUGIN_EV_VCPU_SAMPLE,
     QEMU_PLUGIN_EV_FLUSH,
     QEMU_PLUGIN_EV_ATEXIT,
     QEMU_PLUGIN_EV_MAX, /* total number of plugin events we support */
@@ -72,6 +73,7 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_sample_cb_t     vcpu_sample;
     void *generic;
 };
 
@@ -85,6 +87,22 @@ enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
     PLUGIN_N_CB_SUBTYPES,
+    /*
+     * Conditional callbacks are kept in the PLUGIN_CB_INLINE arrays, so
+     * that they are ordered with respect to the inline ops they test.
+     */
+    PLUGIN_CB_COND = PLUGIN_N_CB_SUBTYPES,
+};
+
+/*
+ * @data holds one @element_size entry for each of the vCPUs accounted for
+ * in the plugin state. Translated code loads @data on every access, so that
+ * the array can be grown (with all vCPUs stopped) when vCPUs are created.
+ */
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
 /*
@@ -101,10 +119,17 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* @entry.score is NULL for inline ops on the plain pointer @userp */
         struct {
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
     };
 };
 
@@ -194,6 +219,7 @@ qemu_plugin_vcpu_syscall(CPUState *cpu, int64_t num, uint64_t a1,
                          uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5,
                          uint64_t a6, uint64_t a7, uint64_t a8);
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
+void qemu_plugin_vcpu_sample(CPUState *cpu);
 
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t meminfo);
 
@@ -233,6 +259,9 @@ static inline
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
 { }
 
+static inline void qemu_plugin_vcpu_sample(CPUState *cpu)
+{ }
+
 static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                            uint32_t meminfo)
 { }
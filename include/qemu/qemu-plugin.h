@@ -12,6 +12,7 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /*
  * For best performance, build the plugin with -fvisibility=hidden so that
@@ -51,7 +52,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 0
+#define QEMU_PLUGIN_VERSION 1
 
 typedef struct {
     /* string describing architecture */
@@ -232,8 +233,91 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
 };
 
+/*
+ * Conditions for qemu_plugin_register_vcpu_*_exec_cond_cb(). The
+ * comparisons are unsigned and performed as "entry <cond> imm".
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
+/*
+ * Scoreboards
+ *
+ * A scoreboard is an array of fixed-size entries, one per vCPU, that
+ * is managed by QEMU. Since each vCPU only ever touches its own entry,
+ * inline ops against a scoreboard need no locking and do not suffer
+ * from cache line ping-pong between vCPUs.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of an entry in a scoreboard
+ * @score: the scoreboard
+ * @offset: offset of the uint64_t within each entry
+ *
+ * This is what inline ops and conditional callbacks operate on.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a new scoreboard
+ * @element_size: size (in bytes) of each vCPU's entry
+ *
+ * Entries are zero-initialized, including those of vCPUs created later.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * No translated code referring to @score may execute after this call,
+ * so this is normally only done from the atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get the entry of a given vCPU
+ * @score: scoreboard to query
+ * @vcpu_index: index of the vCPU
+ *
+ * Note that for user-mode emulation the scoreboard is reallocated as
+ * new vCPUs are created, so the returned pointer must not be cached.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* build a qemu_plugin_u64 from a scoreboard of uint64_t */
+#define qemu_plugin_scoreboard_u64(score) \
+    ((qemu_plugin_u64) {score, 0})
+
+/* build a qemu_plugin_u64 from a member of a scoreboard of structs */
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    ((qemu_plugin_u64) {score, offsetof(type, member)})
+
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/* returns the sum of @entry over all vCPUs */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * qemu_plugin_register_vcpu_tb_trans_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -249,6 +333,44 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of the scoreboard to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies
+ * to the executing vCPU's entry of a scoreboard.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check
+ * @entry: entry of the scoreboard to compare
+ * @imm: value to compare @entry against
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called every time a translated unit executes and
+ * the executing vCPU's @entry satisfies @cond with respect to @imm. The
+ * check is done inline, so the cost of a helper call is only paid when
+ * the condition holds. Inline ops and conditional callbacks registered
+ * on the same unit run in registration order.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -278,6 +400,37 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of the scoreboard to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op applies
+ * to the executing vCPU's entry of a scoreboard.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check
+ * @entry: entry of the scoreboard to compare
+ * @imm: value to compare @entry against
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * See qemu_plugin_register_vcpu_tb_exec_cond_cb().
+ */
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn, qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags, enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry, uint64_t imm, void *userdata);
+
 /*
  * Helpers to query information about the instructions in a block
  */
@@ -350,6 +503,10 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op, qemu_plugin_u64 entry, uint64_t imm);
+
 
 
 typedef void
@@ -370,6 +527,89 @@ qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_syscall_ret_cb_t cb);
 
 
+/*
+ * Register and memory access
+ *
+ * Registers are described by the same XML used by the gdbstub, and read
+ * back in gdb's format, i.e. in target byte order.
+ *
+ * Guest state can only be read from vCPU callbacks: the value of a
+ * register is only up to date if the callback was registered with
+ * QEMU_PLUGIN_CB_R_REGS or QEMU_PLUGIN_CB_RW_REGS. Note that translated
+ * code does not keep the program counter up to date for every
+ * instruction; use qemu_plugin_insn_vaddr() at translation time instead.
+ */
+struct qemu_plugin_register;
+
+/**
+ * typedef qemu_plugin_reg_descriptor - register description
+ * @handle: opaque handle for the read functions
+ * @name: register name, as in the gdb XML description
+ * @feature: name of the gdb feature the register belongs to
+ *
+ * The strings are owned by QEMU and live as long as the plugin.
+ */
+typedef struct {
+    struct qemu_plugin_register *handle;
+    const char *name;
+    const char *feature;
+} qemu_plugin_reg_descriptor;
+
+/**
+ * qemu_plugin_get_registers() - describe the registers of a vCPU
+ * @vcpu_index: the vCPU to query
+ * @descs: array to fill
+ * @max: number of elements in @descs
+ *
+ * Returns the number of registers the vCPU has, which may be larger
+ * than @max; only the first @max are filled in. The handles are only
+ * valid for vCPUs of the same type as the one queried.
+ *
+ * Note: some targets only register their coprocessor registers after
+ * the vcpu_init callbacks have run, so the full list is best queried
+ * once the vCPU is running, e.g. from the first translation callback.
+ */
+int qemu_plugin_get_registers(unsigned int vcpu_index,
+                              qemu_plugin_reg_descriptor *descs, int max);
+
+/**
+ * qemu_plugin_read_register() - read a register of the current vCPU
+ * @handle: the register, from qemu_plugin_get_registers()
+ * @buf: buffer for the value
+ * @buf_size: size of @buf
+ *
+ * Returns the size of the register, or -1 if @handle is invalid or the
+ * value does not fit in @buf.
+ */
+int qemu_plugin_read_register(struct qemu_plugin_register *handle,
+                              void *buf, size_t buf_size);
+
+/**
+ * qemu_plugin_read_registers() - read several registers of the current vCPU
+ * @handles: the registers
+ * @n: number of elements in @handles
+ * @buf: buffer for the values, which are stored back to back
+ * @buf_size: size of @buf
+ * @sizes: if not NULL, receives the size of each register
+ *
+ * Returns the total number of bytes stored in @buf, or -1 if any of the
+ * handles is invalid or the values do not fit in @buf.
+ */
+int qemu_plugin_read_registers(struct qemu_plugin_register *const *handles,
+                               int n, void *buf, size_t buf_size, int *sizes);
+
+/**
+ * qemu_plugin_read_memory_vaddr() - read guest virtual memory
+ * @vaddr: guest virtual address
+ * @buf: buffer for the data
+ * @len: number of bytes to read
+ *
+ * Reads through the current vCPU's MMU, without side effects on the
+ * guest (no faults are raised and no TLB entries are filled in).
+ * Returns false if any part of the range is not mapped.
+ */
+bool qemu_plugin_read_memory_vaddr(uint64_t vaddr, void *buf, size_t len);
+
 /**
  * qemu_plugin_insn_disas() - return disassembly string for instruction
  * @insn: instruction reference
@@ -379,6 +619,44 @@ qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
 
 char *qemu_plugin_insn_disas(const struct qemu_plugin_insn *insn);
 
+/*
+ * Sampling
+ *
+ * Instead of instrumenting code, a plugin can ask QEMU to periodically
+ * interrupt running vCPUs. The vCPU stops at the next TB boundary, where
+ * the whole guest state is synchronized, so the register and memory read
+ * functions can be used from the sample callback.
+ */
+enum qemu_plugin_sample_clock {
+    /* host monotonic time */
+    QEMU_PLUGIN_SAMPLE_HOST,
+    /*
+     * guest virtual clock; with -icount this is an instruction budget.
+     * Falls back to host time for user-mode emulation.
+     */
+    QEMU_PLUGIN_SAMPLE_VIRTUAL,
+};
+
+typedef void (*qemu_plugin_vcpu_sample_cb_t)(qemu_plugin_id_t id,
+                                             unsigned int vcpu_index,
+                                             uint64_t pc, int mmu_idx);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - register a sampling callback
+ * @id: plugin ID
+ * @cb: callback function, passed the guest PC and MMU index
+ * @clock: clock the sampling period is measured against
+ * @period_ns: sampling period in nanoseconds
+ *
+ * Every @period_ns each running vCPU is asked to call @cb at its next
+ * TB boundary; halted vCPUs are not sampled. If several plugins register
+ * sampling callbacks, the shortest period applies to all of them.
+ */
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         enum qemu_plugin_sample_clock clock,
+                                         uint64_t period_ns);
+
 /**
  * qemu_plugin_vcpu_for_each() - iterate over the existing vCPU
  * @id: plugin ID
@@ -20,6 +20,10 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 void dump_drift_info(void);
 
+/* Default upper bound of the TCG halt-polling window, 0 to disable */
+extern uint64_t tcg_halt_poll_ns;
+void dump_halt_poll_info(void);
+
 /* Unblock cpu */
 void qemu_cpu_kick_self(void);
 void qemu_timer_notify_cb(void *opaque, QEMUClockType type);
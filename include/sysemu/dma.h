@@ -15,7 +15,12 @@
 #include "block/block.h"
 #include "block/accounting.h"
 
-typedef struct ScatterGatherEntry ScatterGatherEntry;
+/*
+ * A scatter/gather entry has the same layout as the segments taken by
+ * address_space_map_vectored(), so that a whole QEMUSGList can be mapped
+ * without copying it.
+ */
+typedef AddressSpaceMapSegment ScatterGatherEntry;
 
 typedef enum {
     DMA_DIRECTION_TO_DEVICE = 0,
@@ -146,6 +151,33 @@ static inline void dma_memory_unmap(AddressSpace *as,
                         dir == DMA_DIRECTION_FROM_DEVICE, access_len);
 }
 
+static inline int dma_memory_map_vectored(AddressSpace *as,
+                                          const ScatterGatherEntry *sg,
+                                          int nsg, dma_addr_t offset,
+                                          struct iovec *iov, int max_iov,
+                                          dma_addr_t *len, DMADirection dir)
+{
+    hwaddr xlen;
+    int niov;
+
+    niov = address_space_map_vectored(as, sg, nsg, offset, iov, max_iov,
+                                      &xlen,
+                                      dir == DMA_DIRECTION_FROM_DEVICE,
+                                      MEMTXATTRS_UNSPECIFIED);
+    *len = xlen;
+    return niov;
+}
+
+static inline void dma_memory_unmap_vectored(AddressSpace *as,
+                                             const struct iovec *iov,
+                                             int niov, DMADirection dir,
+                                             dma_addr_t access_len)
+{
+    address_space_unmap_vectored(as, iov, niov,
+                                 dir == DMA_DIRECTION_FROM_DEVICE,
+                                 access_len);
+}
+
 #define DEFINE_LDST_DMA(_lname, _sname, _bits, _end) \
     static inline uint##_bits##_t ld##_lname##_##_end##_dma(AddressSpace *as, \
                                                             dma_addr_t addr) \
@@ -184,11 +216,6 @@ DEFINE_LDST_DMA(q, q, 64, be);
 
 #undef DEFINE_LDST_DMA
 
-struct ScatterGatherEntry {
-    dma_addr_t base;
-    dma_addr_t len;
-};
-
 void qemu_sglist_init(QEMUSGList *qsg, DeviceState *dev, int alloc_hint,
                       AddressSpace *as);
 void qemu_sglist_add(QEMUSGList *qsg, dma_addr_t base, dma_addr_t len);
@@ -62,6 +62,8 @@ struct HostMemoryBackendClass {
  * @size: amount of memory backend provides
  * @mr: MemoryRegion representing host memory belonging to backend
  * @prealloc_threads: number of threads to be used for preallocatining RAM
+ * @prealloc_async: whether preallocation at startup may run in the background
+ * @prealloc_ctx: preallocation still in progress, or %NULL
  */
 struct HostMemoryBackend {
     /* private */
@@ -72,6 +74,8 @@ struct HostMemoryBackend {
     bool merge, dump, use_canonical_path;
     bool prealloc, is_mapped, share;
     uint32_t prealloc_threads;
+    bool prealloc_async;
+    MemPreallocContext *prealloc_ctx;
     DECLARE_BITMAP(host_nodes, MAX_NODES + 1);
     HostMemPolicy policy;
 
@@ -86,4 +90,13 @@ bool host_memory_backend_is_mapped(HostMemoryBackend *backend);
 size_t host_memory_backend_pagesize(HostMemoryBackend *memdev);
 char *host_memory_backend_get_name(HostMemoryBackend *backend);
 
+/**
+ * host_memory_backend_prealloc_wait_all:
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait for the preallocation of all memory backends created with
+ * prealloc-async=on to complete.
+ */
+void host_memory_backend_prealloc_wait_all(Error **errp);
+
 #endif
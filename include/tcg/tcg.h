@@ -175,7 +175,8 @@ typedef uint64_t TCGRegSet;
 
 #if !defined(TCG_TARGET_HAS_v64) \
     && !defined(TCG_TARGET_HAS_v128) \
-    && !defined(TCG_TARGET_HAS_v256)
+    && !defined(TCG_TARGET_HAS_v256) \
+    && !defined(TCG_TARGET_HAS_v512)
 #define TCG_TARGET_MAYBE_vec            0
 #define TCG_TARGET_HAS_abs_vec          0
 #define TCG_TARGET_HAS_neg_vec          0
@@ -202,6 +203,9 @@ typedef uint64_t TCGRegSet;
 #ifndef TCG_TARGET_HAS_v256
 #define TCG_TARGET_HAS_v256             0
 #endif
+#ifndef TCG_TARGET_HAS_v512
+#define TCG_TARGET_HAS_v512             0
+#endif
 
 #ifndef TARGET_INSN_START_EXTRA_WORDS
 # define TARGET_INSN_START_WORDS 1
@@ -286,6 +290,7 @@ typedef enum TCGType {
     TCG_TYPE_V64,
     TCG_TYPE_V128,
     TCG_TYPE_V256,
+    TCG_TYPE_V512,
 
     TCG_TYPE_COUNT, /* number of different types */
 
@@ -658,6 +663,13 @@ struct TCGContext {
 
     /* list to quickly access the injected ops */
     QSIMPLEQ_HEAD(, TCGOp) plugin_ops;
+
+    /*
+     * When non-NULL, newly emitted ops are inserted before this op
+     * instead of at the end of the list. Used to expand plugin
+     * instrumentation in place once translation is complete.
+     */
+    TCGOp *emit_before_op;
 #endif
 
     TCGTempSet free_temps[TCG_TYPE_COUNT * 2];
@@ -853,6 +865,8 @@ void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb);
+bool tcg_op_list_may_write_memory(TCGContext *s);
+bool tcg_op_list_reads_memory(TCGContext *s);
 
 void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size);
 
@@ -0,0 +1,404 @@
+/*
+ * In-memory VM checkpoints
+ *
+ * A checkpoint is a copy of guest RAM in host memory, plus the device
+ * state in the format of qemu_save_device_state().  Dirty logging stays
+ * enabled while the checkpoint exists, so that a later save or restore
+ * only copies the pages that were written in the meantime; resetting a
+ * VM that ran for a short while is then a matter of milliseconds.
+ *
+ * Zero pages are not copied on the first save, and since the copy lives
+ * in anonymous memory they do not take any host memory either.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qmp/qerror.h"
+#include "exec/ram_addr.h"
+#include "io/channel-buffer.h"
+#include "sysemu/cpus.h"
+#include "sysemu/replay.h"
+#include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
+#include "migration.h"
+#include "qemu-file.h"
+#include "qemu-file-channel.h"
+#include "savevm.h"
+#include "checkpoint.h"
+#include "dirtyrate.h"
+#include "trace.h"
+
+typedef struct CheckpointBlock {
+    char idstr[256];
+    ram_addr_t length;
+    uint8_t *copy;
+} CheckpointBlock;
+
+typedef struct Checkpoint {
+    CheckpointBlock *blocks;
+    int nr_blocks;
+    uint8_t *devices;
+    size_t devices_len;
+    /* statistics of the last save or restore */
+    uint64_t pages;
+    int64_t time_us;
+} Checkpoint;
+
+static Checkpoint *checkpoint;
+
+bool checkpoint_exists(void)
+{
+    return checkpoint != NULL;
+}
+
+static bool checkpoint_block_matches(CheckpointBlock *cb, RAMBlock *block)
+{
+    return block && qemu_ram_is_migratable(block) &&
+           block->used_length == cb->length;
+}
+
+/*
+ * Copy the pages of @block that were written since the last save or
+ * restore, to the checkpoint if @restore is false and back to guest RAM
+ * otherwise.  Returns the number of pages copied.
+ */
+static uint64_t checkpoint_copy_dirty(CheckpointBlock *cb, RAMBlock *block,
+                                      bool restore)
+{
+    DirtyBitmapSnapshot *snap;
+    ram_addr_t offset;
+    uint64_t pages = 0;
+
+    if (!cb->length) {
+        return 0;
+    }
+
+    snap = cpu_physical_memory_snapshot_and_clear_dirty(block->mr, 0,
+                                                        cb->length,
+                                                        DIRTY_MEMORY_MIGRATION);
+    for (offset = 0; offset < cb->length; offset += TARGET_PAGE_SIZE) {
+        ram_addr_t addr = block->offset + offset;
+        uint8_t *host = ramblock_ptr(block, offset);
+
+        if (!cpu_physical_memory_snapshot_get_dirty(snap, addr,
+                                                    TARGET_PAGE_SIZE)) {
+            continue;
+        }
+        if (restore) {
+            memcpy(host, cb->copy + offset, TARGET_PAGE_SIZE);
+            /* the page changed behind the back of the translator */
+            if (tcg_enabled()) {
+                tb_invalidate_phys_range(addr, addr + TARGET_PAGE_SIZE);
+            }
+        } else {
+            memcpy(cb->copy + offset, host, TARGET_PAGE_SIZE);
+        }
+        pages++;
+    }
+    g_free(snap);
+
+    return pages;
+}
+
+/* Copy all non-zero pages of @block to a new checkpoint */
+static uint64_t checkpoint_copy_all(CheckpointBlock *cb, RAMBlock *block)
+{
+    ram_addr_t offset;
+    uint64_t pages = 0;
+
+    for (offset = 0; offset < cb->length; offset += TARGET_PAGE_SIZE) {
+        uint8_t *host = ramblock_ptr(block, offset);
+
+        if (!buffer_is_zero(host, TARGET_PAGE_SIZE)) {
+            memcpy(cb->copy + offset, host, TARGET_PAGE_SIZE);
+            pages++;
+        }
+    }
+    return pages;
+}
+
+static void checkpoint_free(Checkpoint *cp)
+{
+    int i;
+
+    for (i = 0; i < cp->nr_blocks; i++) {
+        if (cp->blocks[i].copy) {
+            qemu_anon_ram_free(cp->blocks[i].copy, cp->blocks[i].length);
+        }
+    }
+    g_free(cp->blocks);
+    g_free(cp->devices);
+    g_free(cp);
+}
+
+static Checkpoint *checkpoint_new(Error **errp)
+{
+    Checkpoint *cp = g_new0(Checkpoint, 1);
+    RAMBlock *block;
+    int i = 0;
+
+    RAMBLOCK_FOREACH(block) {
+        if (qemu_ram_is_migratable(block)) {
+            cp->nr_blocks++;
+        }
+    }
+    cp->blocks = g_new0(CheckpointBlock, cp->nr_blocks);
+
+    RAMBLOCK_FOREACH(block) {
+        CheckpointBlock *cb;
+
+        if (!qemu_ram_is_migratable(block)) {
+            continue;
+        }
+        cb = &cp->blocks[i++];
+        pstrcpy(cb->idstr, sizeof(cb->idstr), block->idstr);
+        cb->length = block->used_length;
+        if (!cb->length) {
+            continue;
+        }
+        cb->copy = qemu_anon_ram_alloc(cb->length, NULL, false);
+        if (!cb->copy) {
+            error_setg(errp, "Cannot allocate %" PRIu64 " bytes for the "
+                       "checkpoint of RAM block %s", (uint64_t)cb->length,
+                       cb->idstr);
+            checkpoint_free(cp);
+            return NULL;
+        }
+    }
+    return cp;
+}
+
+/* Check that the RAM blocks did not change since @cp was taken */
+static bool checkpoint_check_blocks(Checkpoint *cp, Error **errp)
+{
+    int i;
+
+    for (i = 0; i < cp->nr_blocks; i++) {
+        CheckpointBlock *cb = &cp->blocks[i];
+
+        if (!checkpoint_block_matches(cb, qemu_ram_block_by_name(cb->idstr))) {
+            error_setg(errp, "RAM block %s changed since the checkpoint was "
+                       "saved", cb->idstr);
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t checkpoint_copy_ram(Checkpoint *cp, bool first, bool restore)
+{
+    uint64_t pages = 0;
+    int i;
+
+    memory_global_dirty_log_sync();
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < cp->nr_blocks; i++) {
+        CheckpointBlock *cb = &cp->blocks[i];
+        RAMBlock *block = qemu_ram_block_by_name(cb->idstr);
+
+        if (first) {
+            /* start tracking from now on, the VM is stopped */
+            g_free(cpu_physical_memory_snapshot_and_clear_dirty(
+                       block->mr, 0, cb->length, DIRTY_MEMORY_MIGRATION));
+            pages += checkpoint_copy_all(cb, block);
+        } else {
+            pages += checkpoint_copy_dirty(cb, block, restore);
+        }
+    }
+    return pages;
+}
+
+static int checkpoint_save_devices(Checkpoint *cp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    bioc = qio_channel_buffer_new(MAX(cp->devices_len, 4096));
+    qio_channel_set_name(QIO_CHANNEL(bioc), "checkpoint-save");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = qemu_save_device_state(f);
+    qemu_fflush(f);
+    if (!ret) {
+        ret = qemu_file_get_error(f);
+    }
+    if (!ret) {
+        g_free(cp->devices);
+        cp->devices = g_memdup(bioc->data, bioc->usage);
+        cp->devices_len = bioc->usage;
+    }
+    qemu_fclose(f);
+
+    return ret;
+}
+
+static int checkpoint_load_devices(Checkpoint *cp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    bioc = qio_channel_buffer_new(cp->devices_len);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "checkpoint-restore");
+    memcpy(bioc->data, cp->devices, cp->devices_len);
+    bioc->usage = cp->devices_len;
+    f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    if (qemu_get_be32(f) != QEMU_VM_FILE_MAGIC ||
+        qemu_get_be32(f) != QEMU_VM_FILE_VERSION) {
+        ret = -EINVAL;
+    } else {
+        cpu_synchronize_all_pre_loadvm();
+        ret = qemu_load_device_state(f);
+    }
+    qemu_fclose(f);
+
+    return ret;
+}
+
+void qmp_checkpoint_save(Error **errp)
+{
+    MigrationState *s = migrate_get_current();
+    bool first = !checkpoint;
+    Checkpoint *cp = checkpoint;
+    int saved_vm_running;
+    int64_t start;
+    int ret;
+
+    if (migration_is_blocked(errp)) {
+        return;
+    }
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow making a checkpoint "
+                   "right now. Try once more later.");
+        return;
+    }
+    if (migration_is_running(s->state) ||
+        runstate_check(RUN_STATE_INMIGRATE)) {
+        error_setg(errp, QERR_MIGRATION_ACTIVE);
+        return;
+    }
+    if (dirtyrate_measuring()) {
+        error_setg(errp, "The guest dirty rate is being measured, "
+                   "try again later");
+        return;
+    }
+    if (!first && !checkpoint_check_blocks(cp, errp)) {
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_SAVE_VM);
+    start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    if (first) {
+        WITH_RCU_READ_LOCK_GUARD() {
+            cp = checkpoint_new(errp);
+        }
+        if (!cp) {
+            goto out;
+        }
+        memory_global_dirty_log_start();
+    }
+
+    cp->pages = checkpoint_copy_ram(cp, first, false);
+    ret = checkpoint_save_devices(cp);
+    if (ret < 0) {
+        error_setg(errp, "Error %d while saving the device state", ret);
+        /* an old checkpoint has new RAM now, it cannot be restored anymore */
+        memory_global_dirty_log_stop();
+        checkpoint_free(cp);
+        checkpoint = NULL;
+        goto out;
+    }
+
+    cp->time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start;
+    checkpoint = cp;
+    trace_checkpoint_save(first, cp->pages, cp->devices_len, cp->time_us);
+
+out:
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
+
+void qmp_checkpoint_restore(Error **errp)
+{
+    Checkpoint *cp = checkpoint;
+    int saved_vm_running;
+    int64_t start;
+    int ret;
+
+    if (!cp) {
+        error_setg(errp, "There is no checkpoint to restore");
+        return;
+    }
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow restoring a checkpoint "
+                   "right now. Try once more later.");
+        return;
+    }
+    if (!checkpoint_check_blocks(cp, errp)) {
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_RESTORE_VM);
+    start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    /* Reset first, ROM reset handlers write to guest RAM */
+    qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    cp->pages = checkpoint_copy_ram(cp, false, true);
+    ret = checkpoint_load_devices(cp);
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading the device state", ret);
+        return;
+    }
+
+    cp->time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start;
+    trace_checkpoint_restore(cp->pages, cp->time_us);
+
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
+
+void qmp_checkpoint_delete(Error **errp)
+{
+    if (!checkpoint) {
+        error_setg(errp, "There is no checkpoint to delete");
+        return;
+    }
+
+    memory_global_dirty_log_stop();
+    checkpoint_free(checkpoint);
+    checkpoint = NULL;
+}
+
+CheckpointInfo *qmp_query_checkpoint(Error **errp)
+{
+    CheckpointInfo *info;
+
+    if (!checkpoint) {
+        error_setg(errp, "There is no checkpoint");
+        return NULL;
+    }
+
+    info = g_new0(CheckpointInfo, 1);
+    info->device_state = checkpoint->devices_len;
+    info->dirty_pages = checkpoint->pages;
+    info->time = checkpoint->time_us;
+    return info;
+}
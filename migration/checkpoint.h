@@ -0,0 +1,19 @@
+/*
+ * In-memory VM checkpoints
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_CHECKPOINT_H
+#define QEMU_MIGRATION_CHECKPOINT_H
+
+/*
+ * A checkpoint keeps dirty logging enabled to track the pages written
+ * since it was saved or restored, so nothing else that uses the
+ * migration dirty bitmap can run while it exists.  Called with the BQL
+ * held.
+ */
+bool checkpoint_exists(void);
+
+#endif
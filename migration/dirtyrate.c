@@ -0,0 +1,231 @@
+/*
+ * Guest dirty page rate measurement
+ *
+ * The guest is left running with dirty logging enabled for a while, and
+ * the pages whose migration dirty bit got set in the meantime are
+ * counted.  With TCG, the pages are also accounted to the vCPU that
+ * dirtied them (see notdirty_write()).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qapi-visit-migration.h"
+#include "qapi/qmp/qerror.h"
+#include "exec/ram_addr.h"
+#include "hw/core/cpu.h"
+#include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
+#include "migration.h"
+#include "dirtyrate.h"
+#include "checkpoint.h"
+#include "trace.h"
+
+#define DIRTYRATE_MIN_CALC_TIME 1
+#define DIRTYRATE_MAX_CALC_TIME 60
+
+/* Protected by the BQL */
+static DirtyRateStatus dirtyrate_status = DIRTY_RATE_STATUS_UNSTARTED;
+static int64_t dirtyrate_start_time;
+static int64_t dirtyrate_calc_time;
+static int64_t dirtyrate_result;
+static DirtyRateVcpuList *dirtyrate_vcpu_result;
+
+bool dirtyrate_measuring(void)
+{
+    return dirtyrate_status == DIRTY_RATE_STATUS_MEASURING;
+}
+
+static int64_t dirtyrate_mbps(uint64_t pages, int64_t time_ms)
+{
+    return pages * TARGET_PAGE_SIZE * 1000 / MAX(time_ms, 1) / MiB;
+}
+
+/*
+ * Clear the migration dirty bits of @block and return how many pages
+ * were dirty.  Called with the BQL held, in an RCU critical section.
+ */
+static uint64_t dirtyrate_take_block(RAMBlock *block)
+{
+    DirtyBitmapSnapshot *snap;
+    ram_addr_t addr;
+    uint64_t pages = 0;
+
+    if (!block->used_length) {
+        return 0;
+    }
+
+    snap = cpu_physical_memory_snapshot_and_clear_dirty(block->mr, 0,
+                                                        block->used_length,
+                                                        DIRTY_MEMORY_MIGRATION);
+    for (addr = 0; addr < block->used_length; addr += TARGET_PAGE_SIZE) {
+        if (cpu_physical_memory_snapshot_get_dirty(snap, block->offset + addr,
+                                                   TARGET_PAGE_SIZE)) {
+            pages++;
+        }
+    }
+    g_free(snap);
+
+    return pages;
+}
+
+static uint64_t dirtyrate_take(void)
+{
+    RAMBlock *block;
+    uint64_t pages = 0;
+
+    memory_global_dirty_log_sync();
+
+    RCU_READ_LOCK_GUARD();
+    RAMBLOCK_FOREACH(block) {
+        pages += dirtyrate_take_block(block);
+    }
+    return pages;
+}
+
+/* Current CPUState::dirty_pages of each vCPU, indexed by cpu_index */
+static uint32_t *dirtyrate_vcpu_pages(int *nr)
+{
+    CPUState *cpu;
+    uint32_t *pages;
+
+    *nr = 0;
+    CPU_FOREACH(cpu) {
+        *nr = MAX(*nr, cpu->cpu_index + 1);
+    }
+
+    pages = g_new0(uint32_t, *nr);
+    CPU_FOREACH(cpu) {
+        pages[cpu->cpu_index] = atomic_read(&cpu->dirty_pages);
+    }
+    return pages;
+}
+
+static DirtyRateVcpuList *dirtyrate_vcpu_list(uint32_t *start, int nr,
+                                              int64_t time_ms)
+{
+    DirtyRateVcpuList *list = NULL, **tail = &list;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        uint32_t pages;
+
+        /* skip vCPUs that were hotplugged during the measurement */
+        if (cpu->cpu_index >= nr) {
+            continue;
+        }
+        pages = atomic_read(&cpu->dirty_pages) - start[cpu->cpu_index];
+
+        *tail = g_new0(DirtyRateVcpuList, 1);
+        (*tail)->value = g_new0(DirtyRateVcpu, 1);
+        (*tail)->value->id = cpu->cpu_index;
+        (*tail)->value->dirty_rate = dirtyrate_mbps(pages, time_ms);
+        tail = &(*tail)->next;
+    }
+    return list;
+}
+
+static void *dirtyrate_thread(void *opaque)
+{
+    g_autofree uint32_t *vcpu_start = NULL;
+    int64_t start_ms, time_ms;
+    uint64_t pages;
+    int nr_vcpus;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock_iothread();
+    memory_global_dirty_log_start();
+    /* forget whatever was dirtied before */
+    dirtyrate_take();
+    vcpu_start = dirtyrate_vcpu_pages(&nr_vcpus);
+    start_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    qemu_mutex_unlock_iothread();
+
+    g_usleep(dirtyrate_calc_time * G_USEC_PER_SEC);
+
+    qemu_mutex_lock_iothread();
+    pages = dirtyrate_take();
+    time_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) - start_ms;
+    memory_global_dirty_log_stop();
+
+    dirtyrate_result = dirtyrate_mbps(pages, time_ms);
+    if (tcg_enabled()) {
+        dirtyrate_vcpu_result = dirtyrate_vcpu_list(vcpu_start, nr_vcpus,
+                                                    time_ms);
+    }
+    dirtyrate_status = DIRTY_RATE_STATUS_MEASURED;
+    trace_dirtyrate_measured(pages, time_ms, dirtyrate_result);
+    qemu_mutex_unlock_iothread();
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+void qmp_calc_dirty_rate(int64_t calc_time, Error **errp)
+{
+    MigrationState *s = migrate_get_current();
+    QemuThread thread;
+
+    if (calc_time < DIRTYRATE_MIN_CALC_TIME ||
+        calc_time > DIRTYRATE_MAX_CALC_TIME) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "calc-time",
+                   "an integer in the range of 1 to 60");
+        return;
+    }
+
+    if (dirtyrate_measuring()) {
+        error_setg(errp, "The dirty rate is already being measured");
+        return;
+    }
+
+    if (checkpoint_exists()) {
+        error_setg(errp, "An in-memory checkpoint exists, delete it first");
+        return;
+    }
+
+    if (migration_is_running(s->state) ||
+        runstate_check(RUN_STATE_INMIGRATE)) {
+        error_setg(errp, QERR_MIGRATION_ACTIVE);
+        return;
+    }
+
+    qapi_free_DirtyRateVcpuList(dirtyrate_vcpu_result);
+    dirtyrate_vcpu_result = NULL;
+    dirtyrate_status = DIRTY_RATE_STATUS_MEASURING;
+    dirtyrate_start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) / 1000;
+    dirtyrate_calc_time = calc_time;
+
+    trace_dirtyrate_start(calc_time);
+    qemu_thread_create(&thread, "dirtyrate", dirtyrate_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+}
+
+DirtyRateInfo *qmp_query_dirty_rate(Error **errp)
+{
+    DirtyRateInfo *info = g_new0(DirtyRateInfo, 1);
+
+    info->status = dirtyrate_status;
+    info->start_time = dirtyrate_start_time;
+    info->calc_time = dirtyrate_calc_time;
+
+    if (dirtyrate_status == DIRTY_RATE_STATUS_MEASURED) {
+        info->has_dirty_rate = true;
+        info->dirty_rate = dirtyrate_result;
+        if (dirtyrate_vcpu_result) {
+            info->has_vcpu_dirty_rate = true;
+            info->vcpu_dirty_rate = QAPI_CLONE(DirtyRateVcpuList,
+                                               dirtyrate_vcpu_result);
+        }
+    }
+
+    return info;
+}
@@ -0,0 +1,17 @@
+/*
+ * Guest dirty page rate measurement
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_DIRTYRATE_H
+#define QEMU_MIGRATION_DIRTYRATE_H
+
+/*
+ * A measurement uses the migration dirty bitmap, so it cannot run at the
+ * same time as a migration.  Called with the BQL held.
+ */
+bool dirtyrate_measuring(void);
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "channel.h"
+#include "file.h"
+#include "migration.h"
+#include "io/channel-file.h"
+#include "trace.h"
+
+typedef struct FileIOJob {
+    QSIMPLEQ_ENTRY(FileIOJob) next;
+    uint8_t *host;
+    size_t len;
+    off_t offset;
+} FileIOJob;
+
+typedef struct {
+    bool write;
+    /* descriptor for unaligned I/O, and one with O_DIRECT if possible */
+    int fd;
+    int direct_fd;
+    QemuThread *threads;
+    int nthreads;
+    QemuMutex lock;
+    /* signalled when a job is queued or the threads have to quit */
+    QemuCond job_cond;
+    /* signalled when the last queued job is done */
+    QemuCond done_cond;
+    QSIMPLEQ_HEAD(, FileIOJob) jobs;
+    /* jobs that were queued but are not done yet */
+    int pending;
+    /* first error hit by a thread, reported by file_io_sync() */
+    int error;
+    bool quit;
+} FileIOState;
+
+/* path of the last file: migration, where mapped-ram pages go */
+static char *file_path;
+static FileIOState *file_io;
+
+static int file_io_open(bool write, bool direct, Error **errp)
+{
+    int flags = write ? O_WRONLY : O_RDONLY;
+    int fd;
+
+#ifdef O_DIRECT
+    if (direct) {
+        flags |= O_DIRECT;
+    }
+#else
+    if (direct) {
+        return -1;
+    }
+#endif
+
+    fd = qemu_open(file_path, flags);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Failed to open migration file '%s'",
+                         file_path);
+    }
+    return fd;
+}
+
+static int file_io_rw(int fd, bool write, uint8_t *buf, size_t len,
+                      off_t offset)
+{
+    while (len) {
+        ssize_t ret;
+
+        if (write) {
+            ret = pwrite(fd, buf, len, offset);
+        } else {
+            ret = pread(fd, buf, len, offset);
+        }
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            /* the file is shorter than its header says */
+            return -EIO;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+static int file_io_do_job(FileIOJob *job)
+{
+    int ret = -EINVAL;
+
+    if (file_io->direct_fd >= 0) {
+        ret = file_io_rw(file_io->direct_fd, file_io->write,
+                         job->host, job->len, job->offset);
+    }
+    /* O_DIRECT wants aligned buffers and sizes, fall back if they aren't */
+    if (ret == -EINVAL) {
+        ret = file_io_rw(file_io->fd, file_io->write,
+                         job->host, job->len, job->offset);
+    }
+    return ret;
+}
+
+static void *file_io_thread(void *opaque)
+{
+    FileIOJob *job;
+    int ret;
+
+    qemu_mutex_lock(&file_io->lock);
+    for (;;) {
+        while (!file_io->quit && QSIMPLEQ_EMPTY(&file_io->jobs)) {
+            qemu_cond_wait(&file_io->job_cond, &file_io->lock);
+        }
+        if (file_io->quit) {
+            break;
+        }
+        job = QSIMPLEQ_FIRST(&file_io->jobs);
+        QSIMPLEQ_REMOVE_HEAD(&file_io->jobs, next);
+
+        /* once something failed, the remaining jobs are just dropped */
+        if (!file_io->error) {
+            qemu_mutex_unlock(&file_io->lock);
+            ret = file_io_do_job(job);
+            qemu_mutex_lock(&file_io->lock);
+            if (ret && !file_io->error) {
+                file_io->error = ret;
+            }
+        }
+        g_free(job);
+
+        if (--file_io->pending == 0) {
+            qemu_cond_broadcast(&file_io->done_cond);
+        }
+    }
+    qemu_mutex_unlock(&file_io->lock);
+
+    return NULL;
+}
+
+/**
+ * file_io_start: start the threads that do the mapped-ram page I/O
+ *
+ * Returns 0 on success, -1 with @errp set on failure
+ *
+ * @write: whether the pages are saved or loaded
+ * @threads: number of threads
+ * @errp: pointer to an error
+ */
+int file_io_start(bool write, int threads, Error **errp)
+{
+    int i;
+
+    if (!file_path) {
+        error_setg(errp, "mapped-ram requires a file: migration URI");
+        return -1;
+    }
+
+    file_io = g_new0(FileIOState, 1);
+    file_io->write = write;
+    file_io->fd = file_io_open(write, false, errp);
+    if (file_io->fd < 0) {
+        g_free(file_io);
+        file_io = NULL;
+        return -1;
+    }
+    /* not every file system supports O_DIRECT, and that's fine */
+    file_io->direct_fd = file_io_open(write, true, NULL);
+
+    qemu_mutex_init(&file_io->lock);
+    qemu_cond_init(&file_io->job_cond);
+    qemu_cond_init(&file_io->done_cond);
+    QSIMPLEQ_INIT(&file_io->jobs);
+
+    file_io->nthreads = MAX(threads, 1);
+    file_io->threads = g_new0(QemuThread, file_io->nthreads);
+    for (i = 0; i < file_io->nthreads; i++) {
+        g_autofree char *name = g_strdup_printf("fileio_%d", i);
+
+        qemu_thread_create(file_io->threads + i, name, file_io_thread,
+                           NULL, QEMU_THREAD_JOINABLE);
+    }
+    trace_file_io_start(write, file_io->nthreads, file_io->direct_fd >= 0);
+    return 0;
+}
+
+/**
+ * file_io_queue: read or write guest memory at a file offset
+ *
+ * The I/O is done by one of the threads at some later point; use
+ * file_io_sync() to wait for it.  @host must stay valid until then.
+ *
+ * @host: start of the guest memory
+ * @len: length in bytes
+ * @offset: offset in the migration file
+ */
+void file_io_queue(uint8_t *host, size_t len, off_t offset)
+{
+    FileIOJob *job = g_new(FileIOJob, 1);
+
+    job->host = host;
+    job->len = len;
+    job->offset = offset;
+
+    qemu_mutex_lock(&file_io->lock);
+    QSIMPLEQ_INSERT_TAIL(&file_io->jobs, job, next);
+    file_io->pending++;
+    qemu_cond_signal(&file_io->job_cond);
+    qemu_mutex_unlock(&file_io->lock);
+}
+
+/**
+ * file_io_sync: wait until all queued I/O is done
+ *
+ * Jobs for the same file range may be handled by different threads in
+ * any order, so callers must sync before queueing a range again.
+ *
+ * Returns 0 on success, -err for the first I/O error
+ */
+int file_io_sync(void)
+{
+    int ret;
+
+    qemu_mutex_lock(&file_io->lock);
+    while (file_io->pending) {
+        qemu_cond_wait(&file_io->done_cond, &file_io->lock);
+    }
+    ret = file_io->error;
+    qemu_mutex_unlock(&file_io->lock);
+    return ret;
+}
+
+void file_io_finish(void)
+{
+    int i;
+
+    if (!file_io) {
+        return;
+    }
+
+    qemu_mutex_lock(&file_io->lock);
+    file_io->quit = true;
+    qemu_cond_broadcast(&file_io->job_cond);
+    qemu_mutex_unlock(&file_io->lock);
+
+    for (i = 0; i < file_io->nthreads; i++) {
+        qemu_thread_join(file_io->threads + i);
+    }
+
+    /* the threads may have quit with jobs left over */
+    while (!QSIMPLEQ_EMPTY(&file_io->jobs)) {
+        FileIOJob *job = QSIMPLEQ_FIRST(&file_io->jobs);
+
+        QSIMPLEQ_REMOVE_HEAD(&file_io->jobs, next);
+        g_free(job);
+    }
+
+    if (file_io->direct_fd >= 0) {
+        qemu_close(file_io->direct_fd);
+    }
+    qemu_close(file_io->fd);
+    qemu_cond_destroy(&file_io->done_cond);
+    qemu_cond_destroy(&file_io->job_cond);
+    qemu_mutex_destroy(&file_io->lock);
+    g_free(file_io->threads);
+    g_free(file_io);
+    file_io = NULL;
+}
+
+int file_io_pwrite(const void *buf, size_t len, off_t offset)
+{
+    return file_io_rw(file_io->fd, true, (uint8_t *)buf, len, offset);
+}
+
+int file_io_pread(void *buf, size_t len, off_t offset)
+{
+    return file_io_rw(file_io->fd, false, buf, len, offset);
+}
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    trace_migration_file_outgoing(filename);
+    fioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY | O_TRUNC,
+                                     0600, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(file_path);
+    file_path = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-outgoing");
+    migration_channel_connect(s, QIO_CHANNEL(fioc), NULL, NULL);
+    object_unref(OBJECT(fioc));
+}
+
+static gboolean file_accept_incoming_migration(QIOChannel *ioc,
+                                               GIOCondition condition,
+                                               gpointer opaque)
+{
+    migration_channel_process_incoming(ioc);
+    object_unref(OBJECT(ioc));
+    return G_SOURCE_REMOVE;
+}
+
+void file_start_incoming_migration(const char *filename, Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    trace_migration_file_incoming(filename);
+    fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(file_path);
+    file_path = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-incoming");
+    qio_channel_add_watch_full(QIO_CHANNEL(fioc), G_IO_IN,
+                               file_accept_incoming_migration,
+                               NULL, NULL,
+                               g_main_context_get_thread_default());
+}
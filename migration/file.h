@@ -0,0 +1,31 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_FILE_H
+#define QEMU_MIGRATION_FILE_H
+
+void file_start_incoming_migration(const char *filename, Error **errp);
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp);
+
+/*
+ * With mapped-ram, guest pages are not part of the migration stream but
+ * sit at fixed offsets of the migration file.  They are read and written
+ * by a pool of threads that use their own file descriptors, so that
+ * they can bypass the page cache.
+ */
+int file_io_start(bool write, int threads, Error **errp);
+void file_io_queue(uint8_t *host, size_t len, off_t offset);
+int file_io_sync(void);
+void file_io_finish(void);
+
+/* Synchronous I/O on the migration file, for metadata */
+int file_io_pwrite(const void *buf, size_t len, off_t offset);
+int file_io_pread(void *buf, size_t len, off_t offset);
+
+#endif
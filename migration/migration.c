@@ -19,10 +19,15 @@
 #include "qemu/main-loop.h"
 #include "migration/blocker.h"
 #include "exec.h"
+#include "dirtyrate.h"
+#include "checkpoint.h"
+#include "timeline.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/tcg.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -82,6 +87,11 @@
 #define DEFAULT_MIGRATE_CPU_THROTTLE_INITIAL 20
 #define DEFAULT_MIGRATE_CPU_THROTTLE_INCREMENT 10
 #define DEFAULT_MIGRATE_MAX_CPU_THROTTLE 99
+/* Dirty page rate (MB/s) above which dirty-limit throttles a vCPU */
+#define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT 1024
+/* 0: load RAM pages on the migration thread */
+#define DEFAULT_MIGRATE_LOAD_THREADS 0
+#define MIGRATE_LOAD_THREADS_MAX 255
 
 /* Migration XBZRLE default cache size */
 #define DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE (64 * 1024 * 1024)
@@ -94,6 +104,10 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+/* 0: no zstd dictionary */
+#define DEFAULT_MIGRATE_MULTIFD_ZSTD_DICT_SIZE 0
+/* 0: keep the configured compression level */
+#define DEFAULT_MIGRATE_MULTIFD_COMPRESSION_CPU_BUDGET 0
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -124,6 +138,7 @@ enum mig_rp_message_type {
     MIG_RP_MSG_REQ_PAGES,    /* data (start: be64, len: be32) */
     MIG_RP_MSG_RECV_BITMAP,  /* send recved_bitmap back to source */
     MIG_RP_MSG_RESUME_ACK,   /* tell source that we are ready to resume */
+    MIG_RP_MSG_REQ_PREFETCH, /* data (start: be64, len: be32, id: string) */
 
     MIG_RP_MSG_MAX
 };
@@ -330,6 +345,29 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis, const char *rbname,
     return migrate_send_rp_message(mis, msg_type, msglen, bufc);
 }
 
+/*
+ * Ask the source for pages that the guest is likely to touch soon.  The
+ * source sends them after the pages requested with
+ * migrate_send_rp_req_pages(), which vCPUs are waiting for.
+ */
+int migrate_send_rp_req_prefetch(MigrationIncomingState *mis,
+                                 const char *rbname, ram_addr_t start,
+                                 size_t len)
+{
+    uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
+    size_t msglen = 12; /* start + len */
+    int rbname_len = strlen(rbname);
+
+    assert(rbname_len < 256);
+    *(uint64_t *)bufc = cpu_to_be64((uint64_t)start);
+    *(uint32_t *)(bufc + 8) = cpu_to_be32((uint32_t)len);
+    bufc[msglen++] = rbname_len;
+    memcpy(bufc + msglen, rbname, rbname_len);
+    msglen += rbname_len;
+
+    return migrate_send_rp_message(mis, MIG_RP_MSG_REQ_PREFETCH, msglen, bufc);
+}
+
 static bool migration_colo_enabled;
 bool migration_incoming_colo_enabled(void)
 {
@@ -376,6 +414,8 @@ void qemu_start_incoming_migration(const char *uri, Error **errp)
         unix_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -808,12 +848,21 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->multifd_zlib_level = s->parameters.multifd_zlib_level;
     params->has_multifd_zstd_level = true;
     params->multifd_zstd_level = s->parameters.multifd_zstd_level;
+    params->has_multifd_zstd_dict_size = true;
+    params->multifd_zstd_dict_size = s->parameters.multifd_zstd_dict_size;
+    params->has_multifd_compression_cpu_budget = true;
+    params->multifd_compression_cpu_budget =
+        s->parameters.multifd_compression_cpu_budget;
     params->has_xbzrle_cache_size = true;
     params->xbzrle_cache_size = s->parameters.xbzrle_cache_size;
     params->has_max_postcopy_bandwidth = true;
     params->max_postcopy_bandwidth = s->parameters.max_postcopy_bandwidth;
     params->has_max_cpu_throttle = true;
     params->max_cpu_throttle = s->parameters.max_cpu_throttle;
+    params->has_vcpu_dirty_limit = true;
+    params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
+    params->has_load_threads = true;
+    params->load_threads = s->parameters.load_threads;
     params->has_announce_initial = true;
     params->announce_initial = s->parameters.announce_initial;
     params->has_announce_max = true;
@@ -894,6 +943,11 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
         info->total_time = s->total_time;
         info->has_downtime = true;
         info->downtime = s->downtime;
+        if (s->device_downtime) {
+            info->has_device_downtime = true;
+            info->device_downtime = QAPI_CLONE(DeviceDowntimeList,
+                                               s->device_downtime);
+        }
     } else {
         info->has_total_time = true;
         info->total_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
@@ -950,6 +1004,21 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->cpu_throttle_percentage = cpu_throttle_get_percentage();
     }
 
+    if (migrate_dirty_limit()) {
+        intList *list = NULL, **tail = &list;
+        CPUState *cpu;
+
+        WITH_RCU_READ_LOCK_GUARD() {
+            CPU_FOREACH(cpu) {
+                *tail = g_new0(intList, 1);
+                (*tail)->value = cpu_throttle_get_vcpu_percentage(cpu);
+                tail = &(*tail)->next;
+            }
+        }
+        info->has_vcpu_throttle_percentage = true;
+        info->vcpu_throttle_percentage = list;
+    }
+
     if (s->state != MIGRATION_STATUS_COMPLETED) {
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate = ram_counters.dirty_pages_rate;
@@ -1079,6 +1148,43 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ENCODE_PAGES] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd page encoding requires multifd");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH] &&
+        !cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+        error_setg(errp, "Postcopy prefetch requires postcopy-ram");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+            cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_RDMA_PIN_ALL]) {
+            error_setg(errp, "Mapped-ram is not compatible with multifd, "
+                       "xbzrle, compress, postcopy-ram or rdma-pin-all");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        if (!tcg_enabled()) {
+            /* KVM has no per-vCPU dirty tracking to base the limit on */
+            error_setg(errp, "Dirty-limit is only supported with TCG");
+            return false;
+        }
+        if (cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "Dirty-limit is not compatible with "
+                       "auto-converge");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1238,6 +1344,25 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_multifd_zstd_dict_size &&
+        params->multifd_zstd_dict_size &&
+        (params->multifd_zstd_dict_size < MULTIFD_ZSTD_DICT_SIZE_MIN ||
+         params->multifd_zstd_dict_size > MULTIFD_ZSTD_DICT_SIZE_MAX)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "multifd_zstd_dict_size",
+                   "is invalid, it should be 0 or in the range of 1 KiB"
+                   " to 1 MiB");
+        return false;
+    }
+
+    if (params->has_multifd_compression_cpu_budget &&
+        (params->multifd_compression_cpu_budget > 100)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "multifd_compression_cpu_budget",
+                   "is invalid, it should be in the range of 0 to 100");
+        return false;
+    }
+
     if (params->has_xbzrle_cache_size &&
         (params->xbzrle_cache_size < qemu_target_page_size() ||
          !is_power_of_2(params->xbzrle_cache_size))) {
@@ -1257,6 +1382,13 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_vcpu_dirty_limit && params->vcpu_dirty_limit < 1) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "vcpu_dirty_limit",
+                   "is invalid, it must be at least 1 MB/s");
+        return false;
+    }
+
     if (params->has_announce_initial &&
         params->announce_initial > 100000) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
@@ -1355,6 +1487,13 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_multifd_compression) {
         dest->multifd_compression = params->multifd_compression;
     }
+    if (params->has_multifd_zstd_dict_size) {
+        dest->multifd_zstd_dict_size = params->multifd_zstd_dict_size;
+    }
+    if (params->has_multifd_compression_cpu_budget) {
+        dest->multifd_compression_cpu_budget =
+            params->multifd_compression_cpu_budget;
+    }
     if (params->has_xbzrle_cache_size) {
         dest->xbzrle_cache_size = params->xbzrle_cache_size;
     }
@@ -1364,6 +1503,12 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_max_cpu_throttle) {
         dest->max_cpu_throttle = params->max_cpu_throttle;
     }
+    if (params->has_vcpu_dirty_limit) {
+        dest->vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_load_threads) {
+        dest->load_threads = params->load_threads;
+    }
     if (params->has_announce_initial) {
         dest->announce_initial = params->announce_initial;
     }
@@ -1458,6 +1603,13 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_multifd_compression) {
         s->parameters.multifd_compression = params->multifd_compression;
     }
+    if (params->has_multifd_zstd_dict_size) {
+        s->parameters.multifd_zstd_dict_size = params->multifd_zstd_dict_size;
+    }
+    if (params->has_multifd_compression_cpu_budget) {
+        s->parameters.multifd_compression_cpu_budget =
+            params->multifd_compression_cpu_budget;
+    }
     if (params->has_xbzrle_cache_size) {
         s->parameters.xbzrle_cache_size = params->xbzrle_cache_size;
         xbzrle_cache_resize(params->xbzrle_cache_size, errp);
@@ -1472,6 +1624,12 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_max_cpu_throttle) {
         s->parameters.max_cpu_throttle = params->max_cpu_throttle;
     }
+    if (params->has_vcpu_dirty_limit) {
+        s->parameters.vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_load_threads) {
+        s->parameters.load_threads = params->load_threads;
+    }
     if (params->has_announce_initial) {
         s->parameters.announce_initial = params->announce_initial;
     }
@@ -1505,6 +1663,26 @@ void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
         params->tls_hostname->u.s = strdup("");
     }
 
+    /*
+     * MigrationParameters only has 8 bits for these, so they have to be
+     * checked before migrate_params_test_apply() truncates them.
+     */
+    if (params->has_load_threads &&
+        (params->load_threads < 0 ||
+         params->load_threads > MIGRATE_LOAD_THREADS_MAX)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "load_threads",
+                   "is invalid, it should be in the range of 0 to 255");
+        return;
+    }
+    if (params->has_multifd_compression_cpu_budget &&
+        (params->multifd_compression_cpu_budget < 0 ||
+         params->multifd_compression_cpu_budget > 100)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "multifd_compression_cpu_budget",
+                   "is invalid, it should be in the range of 0 to 100");
+        return;
+    }
+
     migrate_params_test_apply(params, &tmp);
 
     if (!migrate_params_check(&tmp, errp)) {
@@ -1811,6 +1989,9 @@ void migrate_init(MigrationState *s)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    qapi_free_DeviceDowntimeList(s->device_downtime);
+    s->device_downtime = NULL;
+    migration_timeline_reset();
     s->setup_time = 0;
     s->start_postcopy = false;
     s->postcopy_after_devices = false;
@@ -1985,6 +2166,17 @@ static bool migrate_prepare(MigrationState *s, bool blk, bool blk_inc,
         return false;
     }
 
+    if (dirtyrate_measuring()) {
+        error_setg(errp, "The guest dirty rate is being measured, "
+                   "try again later");
+        return false;
+    }
+
+    if (checkpoint_exists()) {
+        error_setg(errp, "An in-memory checkpoint exists, delete it first");
+        return false;
+    }
+
     if (runstate_check(RUN_STATE_INMIGRATE)) {
         error_setg(errp, "Guest is waiting for an incoming migration");
         return false;
@@ -2036,6 +2228,14 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         return;
     }
 
+    if (migrate_mapped_ram() && !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "mapped-ram requires a file: migration URI");
+        migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
+                          MIGRATION_STATUS_FAILED);
+        block_cleanup_parameters(s);
+        return;
+    }
+
     if (strstart(uri, "tcp:", &p)) {
         tcp_start_outgoing_migration(s, p, &local_err);
 #ifdef CONFIG_RDMA
@@ -2048,6 +2248,8 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         unix_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "uri",
                    "a valid migration protocol");
@@ -2156,6 +2358,15 @@ bool migrate_auto_converge(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_AUTO_CONVERGE];
 }
 
+bool migrate_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
+}
+
 bool migrate_zero_blocks(void)
 {
     MigrationState *s;
@@ -2219,6 +2430,15 @@ int migrate_decompress_threads(void)
     return s->parameters.decompress_threads;
 }
 
+int migrate_load_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.load_threads;
+}
+
 bool migrate_dirty_bitmaps(void)
 {
     MigrationState *s;
@@ -2264,6 +2484,33 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_encode_pages(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_ENCODE_PAGES];
+}
+
+bool migrate_postcopy_prefetch(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH];
+}
+
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2310,6 +2557,24 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+uint64_t migrate_multifd_zstd_dict_size(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_zstd_dict_size;
+}
+
+int migrate_multifd_compression_cpu_budget(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_compression_cpu_budget;
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -2385,6 +2650,7 @@ static struct rp_cmd_args {
     [MIG_RP_MSG_REQ_PAGES_ID]   = { .len = -1, .name = "REQ_PAGES_ID" },
     [MIG_RP_MSG_RECV_BITMAP]    = { .len = -1, .name = "RECV_BITMAP" },
     [MIG_RP_MSG_RESUME_ACK]     = { .len =  4, .name = "RESUME_ACK" },
+    [MIG_RP_MSG_REQ_PREFETCH]   = { .len = -1, .name = "REQ_PREFETCH" },
     [MIG_RP_MSG_MAX]            = { .len = -1, .name = "MAX" },
 };
 
@@ -2394,7 +2660,8 @@ static struct rp_cmd_args {
  * and we don't need to send pages that have already been sent.
  */
 static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
-                                       ram_addr_t start, size_t len)
+                                       ram_addr_t start, size_t len,
+                                       bool prefetch)
 {
     long our_host_ps = qemu_real_host_page_size;
 
@@ -2412,7 +2679,7 @@ static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
         return;
     }
 
-    if (ram_save_queue_pages(rbname, start, len)) {
+    if (ram_save_queue_pages(rbname, start, len, prefetch)) {
         mark_source_rp_bad(ms);
     }
 }
@@ -2545,10 +2812,11 @@ retry:
         case MIG_RP_MSG_REQ_PAGES:
             start = ldq_be_p(buf);
             len = ldl_be_p(buf + 8);
-            migrate_handle_rp_req_pages(ms, NULL, start, len);
+            migrate_handle_rp_req_pages(ms, NULL, start, len, false);
             break;
 
         case MIG_RP_MSG_REQ_PAGES_ID:
+        case MIG_RP_MSG_REQ_PREFETCH:
             expected_len = 12 + 1; /* header + termination */
 
             if (header_len >= expected_len) {
@@ -2565,7 +2833,8 @@ retry:
                 mark_source_rp_bad(ms);
                 goto out;
             }
-            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len);
+            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len,
+                                        header_type == MIG_RP_MSG_REQ_PREFETCH);
             break;
 
         case MIG_RP_MSG_RECV_BITMAP:
@@ -2901,9 +3170,11 @@ static void migration_completion(MigrationState *s)
 {
     int ret;
     int current_active_state = s->state;
+    int64_t start = migration_timeline_now();
 
     if (s->state == MIGRATION_STATUS_ACTIVE) {
         qemu_mutex_lock_iothread();
+        migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE, "lock", start);
         s->downtime_start = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
         qemu_system_wakeup_request(QEMU_WAKEUP_REASON_OTHER, NULL);
         s->vm_was_running = runstate_is_running();
@@ -2911,10 +3182,16 @@ static void migration_completion(MigrationState *s)
 
         if (!ret) {
             bool inactivate = !migrate_colo_enabled();
+            start = migration_timeline_now();
             ret = vm_stop_force_state(RUN_STATE_FINISH_MIGRATE);
+            migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE, "vm-stop",
+                                   start);
             if (ret >= 0) {
+                start = migration_timeline_now();
                 ret = migration_maybe_pause(s, &current_active_state,
                                             MIGRATION_STATUS_DEVICE);
+                migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE,
+                                       "pause-before-device", start);
             }
             if (ret >= 0) {
                 qemu_file_set_rate_limit(s->to_dst_file, INT64_MAX);
@@ -2934,6 +3211,8 @@ static void migration_completion(MigrationState *s)
         trace_migration_completion_postcopy_end();
 
         qemu_savevm_state_complete_postcopy(s->to_dst_file);
+        migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE,
+                               "complete-postcopy", start);
         trace_migration_completion_postcopy_end_after_complete();
     }
 
@@ -2946,7 +3225,10 @@ static void migration_completion(MigrationState *s)
     if (s->rp_state.from_dst_file) {
         int rp_error;
         trace_migration_return_path_end_before();
+        start = migration_timeline_now();
         rp_error = await_return_path_close_on_source(s);
+        migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE, "return-path",
+                               start);
         trace_migration_return_path_end_after(rp_error);
         if (rp_error) {
             goto fail_invalidate;
@@ -3160,7 +3442,8 @@ static MigThrError migration_detect_error(MigrationState *s)
 /* How many bytes have we transferred since the beginning of the migration */
 static uint64_t migration_total_bytes(MigrationState *s)
 {
-    return qemu_ftell(s->to_dst_file) + ram_counters.multifd_bytes;
+    return qemu_ftell(s->to_dst_file) + ram_counters.multifd_bytes +
+        ram_mapped_ram_bytes();
 }
 
 static void migration_calculate_complete(MigrationState *s)
@@ -3231,6 +3514,7 @@ static void migration_update_counters(MigrationState *s,
     qemu_file_reset_rate_limit(s->to_dst_file);
 
     update_iteration_initial_status(s);
+    migration_timeline_throughput(current_bytes, s->mbps);
 
     trace_migrate_transferred(transferred, time_spent,
                               bandwidth, s->threshold_size);
@@ -3379,6 +3663,7 @@ static void *migration_thread(void *opaque)
     int64_t setup_start = qemu_clock_get_ms(QEMU_CLOCK_HOST);
     MigThrError thr_error;
     bool urgent = false;
+    int64_t start;
 
     rcu_register_thread();
 
@@ -3413,7 +3698,9 @@ static void *migration_thread(void *opaque)
         qemu_savevm_send_colo_enable(s->to_dst_file);
     }
 
+    start = migration_timeline_now();
     qemu_savevm_state_setup(s->to_dst_file);
+    migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE, "setup", start);
 
     if (qemu_savevm_state_guest_unplug_pending()) {
         migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
@@ -3614,6 +3901,12 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("multifd-zstd-level", MigrationState,
                       parameters.multifd_zstd_level,
                       DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL),
+    DEFINE_PROP_SIZE("multifd-zstd-dict-size", MigrationState,
+                      parameters.multifd_zstd_dict_size,
+                      DEFAULT_MIGRATE_MULTIFD_ZSTD_DICT_SIZE),
+    DEFINE_PROP_UINT8("multifd-compression-cpu-budget", MigrationState,
+                      parameters.multifd_compression_cpu_budget,
+                      DEFAULT_MIGRATE_MULTIFD_COMPRESSION_CPU_BUDGET),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -3623,6 +3916,12 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("max-cpu-throttle", MigrationState,
                       parameters.max_cpu_throttle,
                       DEFAULT_MIGRATE_MAX_CPU_THROTTLE),
+    DEFINE_PROP_UINT64("vcpu-dirty-limit", MigrationState,
+                      parameters.vcpu_dirty_limit,
+                      DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT),
+    DEFINE_PROP_UINT8("load-threads", MigrationState,
+                      parameters.load_threads,
+                      DEFAULT_MIGRATE_LOAD_THREADS),
     DEFINE_PROP_SIZE("announce-initial", MigrationState,
                       parameters.announce_initial,
                       DEFAULT_MIGRATE_ANNOUNCE_INITIAL),
@@ -3677,6 +3976,7 @@ static void migration_instance_finalize(Object *obj)
     qemu_sem_destroy(&ms->postcopy_pause_rp_sem);
     qemu_sem_destroy(&ms->rp_state.rp_sem);
     error_free(ms->error);
+    qapi_free_DeviceDowntimeList(ms->device_downtime);
 }
 
 static void migration_instance_init(Object *obj)
@@ -3708,9 +4008,13 @@ static void migration_instance_init(Object *obj)
     params->has_multifd_compression = true;
     params->has_multifd_zlib_level = true;
     params->has_multifd_zstd_level = true;
+    params->has_multifd_zstd_dict_size = true;
+    params->has_multifd_compression_cpu_budget = true;
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
     params->has_max_cpu_throttle = true;
+    params->has_vcpu_dirty_limit = true;
+    params->has_load_threads = true;
     params->has_announce_initial = true;
     params->has_announce_max = true;
     params->has_announce_rounds = true;
@@ -0,0 +1,284 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "multifd.h"
+
+/*
+ * Levels go from the fastest to the best compression, and pick the lz4
+ * acceleration: 1 for the best level, doubling for each level below.
+ */
+#define LZ4_LEVEL_MIN 1
+#define LZ4_LEVEL_MAX 7
+
+struct lz4_data {
+    /* state of the compressor */
+    void *state;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->state = g_try_malloc(LZ4_sizeofState());
+    /* Each page is preceded by its be16 size */
+    z->zbuff_len = page_count * (qemu_target_page_size() + 2);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->state || !z->zbuff) {
+        g_free(z->state);
+        g_free(z->zbuff);
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for lz4", p->id);
+        return -1;
+    }
+    p->data = z;
+    p->level = LZ4_LEVEL_MAX;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->state);
+    z->state = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare data to be able to send
+ *
+ * Compress each page on its own: guest memory keeps changing while it
+ * is compressed, so a page can't be used to compress the next ones the
+ * way a stream does.  A page that doesn't get smaller is sent as it is,
+ * with a size of 0.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct iovec *iov = p->pages->iov;
+    struct lz4_data *z = p->data;
+    int acceleration = 1 << (LZ4_LEVEL_MAX - p->level);
+    uint32_t out_size = 0;
+    uint32_t i;
+
+    for (i = 0; i < used; i++) {
+        uint8_t *out = z->zbuff + out_size;
+        int ret;
+
+        ret = LZ4_compress_fast_extState(z->state, iov[i].iov_base,
+                                         (char *)out + 2, iov[i].iov_len,
+                                         iov[i].iov_len - 1, acceleration);
+        if (ret > 0) {
+            stw_be_p(out, ret);
+        } else {
+            stw_be_p(out, 0);
+            memcpy(out + 2, iov[i].iov_base, iov[i].iov_len);
+            ret = iov[i].iov_len;
+        }
+        out_size += 2 + ret;
+    }
+    p->next_packet_size = out_size;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return qio_channel_write_all(p->c, (void *)z->zbuff, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = page_count * (qemu_target_page_size() + 2);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t in_pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %d: packet size received %d size max %d",
+                   p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < used; i++) {
+        struct iovec *iov = &p->pages->iov[i];
+        uint32_t size;
+
+        if (in_size - in_pos < 2) {
+            error_setg(errp, "multifd %d: packet too small for page %d",
+                       p->id, i);
+            return -1;
+        }
+        size = lduw_be_p(z->zbuff + in_pos);
+        in_pos += 2;
+        if (!size) {
+            size = iov->iov_len;
+        }
+        if (in_size - in_pos < size) {
+            error_setg(errp, "multifd %d: packet too small for page %d",
+                       p->id, i);
+            return -1;
+        }
+
+        if (size == iov->iov_len) {
+            memcpy(iov->iov_base, z->zbuff + in_pos, size);
+        } else {
+            ret = LZ4_decompress_safe((char *)z->zbuff + in_pos,
+                                      iov->iov_base, size, iov->iov_len);
+            if (ret != iov->iov_len) {
+                error_setg(errp, "multifd %d: decompress returned %d size "
+                           "expected %zu", p->id, ret, iov->iov_len);
+                return -1;
+            }
+        }
+        in_pos += size;
+    }
+    if (in_pos != in_size) {
+        error_setg(errp, "multifd %d: packet size received %d size used %d",
+                   p->id, in_size, in_pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .min_level = LZ4_LEVEL_MIN,
+    .max_level = LZ4_LEVEL_MAX,
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -26,6 +26,8 @@ struct zlib_data {
     uint8_t *zbuff;
     /* size of compressed buffer */
     uint32_t zbuff_len;
+    /* compression level of the stream */
+    int level;
 };
 
 /* Multifd zlib compression */
@@ -49,11 +51,13 @@ static int zlib_send_setup(MultiFDSendParams *p, Error **errp)
     zs->zalloc = Z_NULL;
     zs->zfree = Z_NULL;
     zs->opaque = Z_NULL;
-    if (deflateInit(zs, migrate_multifd_zlib_level()) != Z_OK) {
+    z->level = migrate_multifd_zlib_level();
+    if (deflateInit(zs, z->level) != Z_OK) {
         g_free(z);
         error_setg(errp, "multifd %d: deflate init failed", p->id);
         return -1;
     }
+    p->level = z->level;
     /* We will never have more than page_count pages */
     z->zbuff_len = page_count * qemu_target_page_size();
     z->zbuff_len *= 2;
@@ -106,6 +110,26 @@ static int zlib_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
     int ret;
     uint32_t i;
 
+    if (p->level != z->level) {
+        /*
+         * The last packet ended with a sync flush, so anything that
+         * deflateParams() writes out is the start of this packet.
+         * Older zlib versions return Z_BUF_ERROR when there was nothing
+         * left to flush, which is fine.
+         */
+        zs->avail_in = 0;
+        zs->avail_out = z->zbuff_len;
+        zs->next_out = z->zbuff;
+        ret = deflateParams(zs, p->level, Z_DEFAULT_STRATEGY);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            error_setg(errp, "multifd %d: deflateParams returned %d",
+                       p->id, ret);
+            return -1;
+        }
+        out_size = z->zbuff_len - zs->avail_out;
+        z->level = p->level;
+    }
+
     for (i = 0; i < used; i++) {
         uint32_t available = z->zbuff_len - out_size;
         int flush = Z_NO_FLUSH;
@@ -308,6 +332,8 @@ static int zlib_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
 }
 
 static MultiFDMethods multifd_zlib_ops = {
+    .min_level = 1,
+    .max_level = 9,
     .send_setup = zlib_send_setup,
     .send_cleanup = zlib_send_cleanup,
     .send_prepare = zlib_send_prepare,
@@ -12,7 +12,13 @@
 
 #include "qemu/osdep.h"
 #include <zstd.h>
+#include <zdict.h>
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "exec/cpu-common.h"
 #include "exec/target_page.h"
 #include "qapi/error.h"
 #include "migration.h"
@@ -31,8 +37,157 @@ struct zstd_data {
     uint8_t *zbuff;
     /* size of compressed buffer */
     uint32_t zbuff_len;
+    /* compression level of the stream */
+    int level;
+    /* the channel holds a reference to zstd_dict */
+    bool dict_ref;
+    /* the dictionary has to be loaded before the first packet */
+    bool dict_pending;
+    /* the dictionary goes with the next packet */
+    bool send_dict;
 };
 
+/* Guest memory sampled to train the dictionary, in dictionary sizes */
+#define ZSTD_DICT_SAMPLE_RATIO 100
+#define ZSTD_DICT_SAMPLE_MAX (16 * MiB)
+
+/*
+ * Dictionary shared by the sending channels.  It is trained by a thread
+ * of its own, so that the main thread doesn't copy guest memory and run
+ * the training with the BQL held.  @refs and @thread are only touched by
+ * send_setup and send_cleanup, which run on the main thread; @data and
+ * @len are written by the training thread before it sets @done.
+ */
+static struct {
+    QemuThread thread;
+    QemuEvent done;
+    /* requested size of the dictionary */
+    size_t size;
+    void *data;
+    size_t len;
+    int refs;
+} zstd_dict;
+
+typedef struct {
+    /* distance between two sampled pages */
+    uint64_t stride;
+    /* sampled pages, and the size of each of them */
+    uint8_t *samples;
+    size_t *sizes;
+    unsigned nr_samples;
+    unsigned max_samples;
+} ZstdDictSampler;
+
+static int zstd_dict_ram_size(RAMBlock *block, void *opaque)
+{
+    uint64_t *size = opaque;
+
+    if (qemu_ram_is_migratable(block)) {
+        *size += qemu_ram_get_used_length(block);
+    }
+    return 0;
+}
+
+static int zstd_dict_sample(RAMBlock *block, void *opaque)
+{
+    ZstdDictSampler *s = opaque;
+    size_t page_size = qemu_target_page_size();
+    uint8_t *host = qemu_ram_get_host_addr(block);
+    ram_addr_t offset;
+
+    if (!qemu_ram_is_migratable(block)) {
+        return 0;
+    }
+    for (offset = 0; offset < qemu_ram_get_used_length(block);
+         offset += s->stride) {
+        if (s->nr_samples == s->max_samples) {
+            return 1;
+        }
+        /* zero pages are not sent, nothing to learn from them */
+        if (buffer_is_zero(host + offset, page_size)) {
+            continue;
+        }
+        memcpy(s->samples + s->nr_samples * page_size, host + offset,
+               page_size);
+        s->sizes[s->nr_samples++] = page_size;
+    }
+    return 0;
+}
+
+/**
+ * zstd_dict_train: train the dictionary on pages spread over guest RAM
+ *
+ * Guest pages share a lot of content that a single packet is too small
+ * to find, like page tables, code, and the structures of the guest
+ * kernel.  A dictionary trained on a sample of the guest memory lets
+ * zstd find it in every packet.  Failing to train one is not an error,
+ * the channels just compress without a dictionary.
+ */
+static void zstd_dict_train(void)
+{
+    size_t dict_size = zstd_dict.size;
+    size_t page_size = qemu_target_page_size();
+    ZstdDictSampler s = {};
+    uint64_t ram_size = 0;
+    size_t ret;
+
+    qemu_ram_foreach_block(zstd_dict_ram_size, &ram_size);
+    s.max_samples = MIN(dict_size * ZSTD_DICT_SAMPLE_RATIO,
+                        ZSTD_DICT_SAMPLE_MAX) / page_size;
+    s.max_samples = MAX(s.max_samples, 1);
+    s.stride = ROUND_UP(MAX(ram_size / s.max_samples, 1), page_size);
+    s.samples = g_malloc(s.max_samples * page_size);
+    s.sizes = g_new(size_t, s.max_samples);
+    qemu_ram_foreach_block(zstd_dict_sample, &s);
+
+    zstd_dict.data = g_malloc(dict_size);
+    ret = ZDICT_trainFromBuffer(zstd_dict.data, dict_size, s.samples,
+                                s.sizes, s.nr_samples);
+    if (ZDICT_isError(ret)) {
+        warn_report("multifd: could not train a zstd dictionary on %u "
+                    "pages: %s", s.nr_samples, ZDICT_getErrorName(ret));
+        g_free(zstd_dict.data);
+        zstd_dict.data = NULL;
+        zstd_dict.len = 0;
+    } else {
+        zstd_dict.len = ret;
+    }
+    trace_multifd_zstd_dict_train(s.nr_samples, zstd_dict.len);
+
+    g_free(s.samples);
+    g_free(s.sizes);
+}
+
+static void *zstd_dict_thread(void *opaque)
+{
+    rcu_register_thread();
+    zstd_dict_train();
+    rcu_unregister_thread();
+    qemu_event_set(&zstd_dict.done);
+    return NULL;
+}
+
+static void zstd_dict_ref(void)
+{
+    if (!zstd_dict.refs++) {
+        zstd_dict.size = migrate_multifd_zstd_dict_size();
+        qemu_event_init(&zstd_dict.done, false);
+        qemu_thread_create(&zstd_dict.thread, "multifd-zstd-dict",
+                           zstd_dict_thread, NULL, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void zstd_dict_unref(void)
+{
+    if (!--zstd_dict.refs) {
+        qemu_thread_join(&zstd_dict.thread);
+        qemu_event_destroy(&zstd_dict.done);
+        g_free(zstd_dict.data);
+        zstd_dict.data = NULL;
+        zstd_dict.len = 0;
+    }
+}
+
 /* Multifd zstd compression */
 
 /**
@@ -59,7 +214,8 @@ static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
         return -1;
     }
 
-    res = ZSTD_initCStream(z->zcs, migrate_multifd_zstd_level());
+    z->level = migrate_multifd_zstd_level();
+    res = ZSTD_initCStream(z->zcs, z->level);
     if (ZSTD_isError(res)) {
         ZSTD_freeCStream(z->zcs);
         g_free(z);
@@ -67,11 +223,21 @@ static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
                    p->id, ZSTD_getErrorName(res));
         return -1;
     }
+    p->level = z->level;
+
+    if (migrate_multifd_zstd_dict_size()) {
+        zstd_dict_ref();
+        z->dict_ref = true;
+        z->dict_pending = true;
+    }
     /* We will never have more than page_count pages */
     z->zbuff_len = page_count * qemu_target_page_size();
     z->zbuff_len *= 2;
     z->zbuff = g_try_malloc(z->zbuff_len);
     if (!z->zbuff) {
+        if (z->dict_ref) {
+            zstd_dict_unref();
+        }
         ZSTD_freeCStream(z->zcs);
         g_free(z);
         error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
@@ -91,6 +257,9 @@ static void zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
 {
     struct zstd_data *z = p->data;
 
+    if (z->dict_ref) {
+        zstd_dict_unref();
+    }
     ZSTD_freeCStream(z->zcs);
     z->zcs = NULL;
     g_free(z->zbuff);
@@ -99,6 +268,39 @@ static void zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
     p->data = NULL;
 }
 
+/**
+ * zstd_send_load_dict: start using the dictionary
+ *
+ * Wait for the dictionary to be trained, and load it before the first
+ * packet of the channel is compressed.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int zstd_send_load_dict(MultiFDSendParams *p, Error **errp)
+{
+    struct zstd_data *z = p->data;
+    size_t ret;
+
+    qemu_event_wait(&zstd_dict.done);
+    z->dict_pending = false;
+    if (!zstd_dict.data) {
+        /* training failed, go on without a dictionary */
+        return 0;
+    }
+
+    ret = ZSTD_CCtx_loadDictionary(z->zcs, zstd_dict.data, zstd_dict.len);
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %d: loadDictionary failed with error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    z->send_dict = true;
+    return 0;
+}
+
 /**
  * zstd_send_prepare: prepare date to be able to send
  *
@@ -117,10 +319,38 @@ static int zstd_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
     int ret;
     uint32_t i;
 
+    if (z->dict_pending && zstd_send_load_dict(p, errp)) {
+        return -1;
+    }
+
     z->out.dst = z->zbuff;
     z->out.size = z->zbuff_len;
     z->out.pos = 0;
 
+    if (p->level != z->level) {
+        /*
+         * The level is only applied to new frames, so end the current
+         * one at the start of this packet.
+         */
+        z->in.src = NULL;
+        z->in.size = 0;
+        z->in.pos = 0;
+        ret = ZSTD_compressStream2(z->zcs, &z->out, &z->in, ZSTD_e_end);
+        if (ZSTD_isError(ret)) {
+            error_setg(errp, "multifd %d: compressStream error %s",
+                       p->id, ZSTD_getErrorName(ret));
+            return -1;
+        }
+        ret = ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel,
+                                     p->level);
+        if (ZSTD_isError(ret)) {
+            error_setg(errp, "multifd %d: setting level %d failed with "
+                       "error %s", p->id, p->level, ZSTD_getErrorName(ret));
+            return -1;
+        }
+        z->level = p->level;
+    }
+
     for (i = 0; i < used; i++) {
         ZSTD_EndDirective flush = ZSTD_e_continue;
 
@@ -156,6 +386,10 @@ static int zstd_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
     }
     p->next_packet_size = z->out.pos;
     p->flags |= MULTIFD_FLAG_ZSTD;
+    if (z->send_dict) {
+        p->next_packet_size += sizeof(uint32_t) + zstd_dict.len;
+        p->flags |= MULTIFD_FLAG_ZSTD_DICT;
+    }
 
     return 0;
 }
@@ -175,6 +409,18 @@ static int zstd_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
     struct zstd_data *z = p->data;
 
+    if (z->send_dict) {
+        uint32_t dict_len = cpu_to_be32(zstd_dict.len);
+        struct iovec iov[] = {
+            { .iov_base = &dict_len, .iov_len = sizeof(dict_len) },
+            { .iov_base = zstd_dict.data, .iov_len = zstd_dict.len },
+            { .iov_base = z->zbuff, .iov_len = z->out.pos },
+        };
+
+        z->send_dict = false;
+        return qio_channel_writev_all(p->c, iov, ARRAY_SIZE(iov), errp);
+    }
+
     return qio_channel_write_all(p->c, (void *)z->zbuff, p->next_packet_size,
                                  errp);
 }
@@ -245,6 +491,55 @@ static void zstd_recv_cleanup(MultiFDRecvParams *p)
     p->data = NULL;
 }
 
+/**
+ * zstd_recv_dict: read the dictionary sent before the compressed pages
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @in_size: size of the packet data, the dictionary is taken out of it
+ * @errp: pointer to an error
+ */
+static int zstd_recv_dict(MultiFDRecvParams *p, uint32_t *in_size,
+                          Error **errp)
+{
+    struct zstd_data *z = p->data;
+    g_autofree void *dict = NULL;
+    uint32_t dict_len;
+    size_t ret;
+
+    if (*in_size < sizeof(dict_len)) {
+        error_setg(errp, "multifd %d: packet too small for a dictionary",
+                   p->id);
+        return -1;
+    }
+    if (qio_channel_read_all(p->c, (void *)&dict_len, sizeof(dict_len),
+                             errp)) {
+        return -1;
+    }
+    dict_len = be32_to_cpu(dict_len);
+    if (dict_len > MULTIFD_ZSTD_DICT_SIZE_MAX ||
+        dict_len > *in_size - sizeof(dict_len)) {
+        error_setg(errp, "multifd %d: invalid dictionary size %u",
+                   p->id, dict_len);
+        return -1;
+    }
+    dict = g_malloc(dict_len);
+    if (qio_channel_read_all(p->c, dict, dict_len, errp)) {
+        return -1;
+    }
+
+    ret = ZSTD_DCtx_loadDictionary(z->zds, dict, dict_len);
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %d: loadDictionary failed with error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    *in_size -= sizeof(dict_len) + dict_len;
+    trace_multifd_zstd_dict_recv(p->id, dict_len);
+    return 0;
+}
+
 /**
  * zstd_recv_pages: read the data from the channel into actual pages
  *
@@ -272,6 +567,10 @@ static int zstd_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
                    p->id, flags, MULTIFD_FLAG_ZSTD);
         return -1;
     }
+    if ((p->flags & MULTIFD_FLAG_ZSTD_DICT) &&
+        zstd_recv_dict(p, &in_size, errp)) {
+        return -1;
+    }
     ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
 
     if (ret != 0) {
@@ -293,24 +592,26 @@ static int zstd_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
          * Welcome to decompressStream semantics
          *
          * We need to loop while:
-         * - return is > 0
+         * - return is not an error; 0 is the end of a frame, which
+         *   happens when the sender changed the compression level,
+         *   and the next one follows
          * - there is input available
          * - we haven't put out a full page
          */
         do {
             ret = ZSTD_decompressStream(z->zds, &z->out, &z->in);
-        } while (ret > 0 && (z->in.size - z->in.pos > 0)
-                         && (z->out.pos < iov->iov_len));
-        if (ret > 0 && (z->out.pos < iov->iov_len)) {
-            error_setg(errp, "multifd %d: decompressStream buffer too small",
-                       p->id);
-            return -1;
-        }
+        } while (!ZSTD_isError(ret) && (z->in.size - z->in.pos > 0)
+                                    && (z->out.pos < iov->iov_len));
         if (ZSTD_isError(ret)) {
             error_setg(errp, "multifd %d: decompressStream returned %s",
                        p->id, ZSTD_getErrorName(ret));
             return ret;
         }
+        if (z->out.pos < iov->iov_len) {
+            error_setg(errp, "multifd %d: decompressStream buffer too small",
+                       p->id);
+            return -1;
+        }
         out_size += z->out.pos;
     }
     if (out_size != expected_size) {
@@ -322,6 +623,8 @@ static int zstd_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
 }
 
 static MultiFDMethods multifd_zstd_ops = {
+    .min_level = 1,
+    .max_level = 19,
     .send_setup = zstd_send_setup,
     .send_cleanup = zstd_send_cleanup,
     .send_prepare = zstd_send_prepare,
@@ -12,16 +12,19 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "ram.h"
 #include "migration.h"
 #include "socket.h"
 #include "qemu-file.h"
 #include "trace.h"
+#include "xbzrle.h"
 #include "multifd.h"
 
 /* Multiple fd's */
@@ -29,6 +32,9 @@
 #define MULTIFD_MAGIC 0x11223344U
 #define MULTIFD_VERSION 1
 
+/* Packets a channel sends between two changes of its compression level */
+#define MULTIFD_ADAPT_PACKETS 16
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
@@ -268,6 +274,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->pages_used = cpu_to_be32(p->pages->used);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
+    packet->xbzrle_size = cpu_to_be32(p->xbzrle_size);
 
     if (p->pages->block) {
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
@@ -336,6 +343,8 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
 
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
+    p->xbzrle_size = be32_to_cpu(packet->xbzrle_size);
+    p->pages->normal = 0;
 
     if (p->pages->used == 0) {
         return 0;
@@ -352,17 +361,38 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
 
     for (i = 0; i < p->pages->used; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
+        int type = offset & MULTIFD_PAGE_MASK;
 
+        offset &= ~(uint64_t)MULTIFD_PAGE_MASK;
         if (offset > (block->used_length - qemu_target_page_size())) {
             error_setg(errp, "multifd: offset too long %" PRIu64
                        " (max " RAM_ADDR_FMT ")",
                        offset, block->max_length);
             return -1;
         }
+        if (type == MULTIFD_PAGE_NORMAL) {
+            if (i != p->pages->normal) {
+                error_setg(errp, "multifd: normal page after encoded pages");
+                return -1;
+            }
+            p->pages->normal++;
+        } else if (!migrate_multifd_encode_pages() ||
+                   type > MULTIFD_PAGE_XBZRLE) {
+            error_setg(errp, "multifd: unexpected page encoding %d", type);
+            return -1;
+        }
+        p->pages->offset[i] = offset | type;
         p->pages->iov[i].iov_base = block->host + offset;
         p->pages->iov[i].iov_len = qemu_target_page_size();
     }
 
+    if (p->xbzrle_size > (p->pages->used - p->pages->normal) *
+                         (qemu_target_page_size() + 2)) {
+        error_setg(errp, "multifd: XBZRLE data too long %u",
+                   p->xbzrle_size);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -380,6 +410,10 @@ struct {
      * We will use atomic operations.  Only valid values are 0 and 1.
      */
     int exiting;
+    /* look for zero pages and XBZRLE encode in the channels */
+    bool encode;
+    /* percentage of the channel time that may go to compression, or 0 */
+    int cpu_budget;
     /* multifd ops */
     MultiFDMethods *ops;
 } *multifd_send_state;
@@ -435,6 +469,7 @@ static int multifd_send_pages(QEMUFile *f)
     assert(!p->pages->block);
 
     p->packet_num = multifd_send_state->packet_num++;
+    pages->age = ram_counters.dirty_sync_count;
     multifd_send_state->pages = p->pages;
     p->pages = pages;
     transferred = ((uint64_t) pages->used) * qemu_target_page_size()
@@ -448,15 +483,17 @@ static int multifd_send_pages(QEMUFile *f)
     return 1;
 }
 
-int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
+int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset,
+                       bool xbzrle)
 {
     MultiFDPages_t *pages = multifd_send_state->pages;
 
     if (!pages->block) {
         pages->block = block;
+        pages->xbzrle = xbzrle;
     }
 
-    if (pages->block == block) {
+    if (pages->block == block && pages->xbzrle == xbzrle) {
         pages->offset[pages->used] = offset;
         pages->iov[pages->used].iov_base = block->host + offset;
         pages->iov[pages->used].iov_len = qemu_target_page_size();
@@ -471,8 +508,8 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
         return -1;
     }
 
-    if (pages->block != block) {
-        return  multifd_queue_page(f, block, offset);
+    if (pages->block != block || pages->xbzrle != xbzrle) {
+        return  multifd_queue_page(f, block, offset, xbzrle);
     }
 
     return 1;
@@ -547,6 +584,12 @@ void multifd_save_cleanup(void)
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
+        g_free(p->xbzrle_pages);
+        p->xbzrle_pages = NULL;
+        g_free(p->xbzrle_buf);
+        p->xbzrle_buf = NULL;
+        g_free(p->encoded_offset);
+        p->encoded_offset = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -561,6 +604,40 @@ void multifd_save_cleanup(void)
     multifd_send_state = NULL;
 }
 
+/*
+ * The migration thread accounts every queued page as a normal page.
+ * Correct that with what the channels did with them since the last
+ * sync; the channels are idle, so their counters can be read safely.
+ */
+static void multifd_send_update_counters(void)
+{
+    size_t page_size = qemu_target_page_size();
+    int i;
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        uint64_t encoded = p->zero_pages + p->xbzrle_pages_sent +
+                           p->xbzrle_skipped;
+        uint64_t saved = encoded * page_size - p->xbzrle_bytes;
+
+        ram_counters.normal -= encoded;
+        ram_counters.duplicate += p->zero_pages;
+        ram_counters.multifd_bytes -= saved;
+        ram_counters.transferred -= saved;
+        xbzrle_counters.pages += p->xbzrle_pages_sent;
+        xbzrle_counters.bytes += p->xbzrle_bytes;
+        xbzrle_counters.cache_miss += p->xbzrle_cache_miss;
+        xbzrle_counters.overflow += p->xbzrle_overflow;
+
+        p->zero_pages = 0;
+        p->xbzrle_pages_sent = 0;
+        p->xbzrle_bytes = 0;
+        p->xbzrle_skipped = 0;
+        p->xbzrle_cache_miss = 0;
+        p->xbzrle_overflow = 0;
+    }
+}
+
 void multifd_send_sync_main(QEMUFile *f)
 {
     int i;
@@ -602,9 +679,133 @@ void multifd_send_sync_main(QEMUFile *f)
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
     }
+    if (multifd_send_state->encode) {
+        multifd_send_update_counters();
+    }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/**
+ * multifd_send_encode_pages: look for zero pages and XBZRLE encode pages
+ *
+ * Moves the pages that are still sent as they are to the start of
+ * p->pages and tags the others in their offset.  Pages identical to
+ * the XBZRLE cache are dropped, the destination already has them.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_encode_pages(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t normal = 0, encoded = 0;
+    uint32_t i;
+
+    p->xbzrle_size = 0;
+    for (i = 0; i < pages->used; i++) {
+        ram_addr_t offset = pages->offset[i];
+        ram_addr_t addr = pages->block->offset + offset;
+        uint8_t *page = pages->block->host + offset;
+
+        if (pages->xbzrle) {
+            /*
+             * Work on a copy, the guest could otherwise change the page
+             * between updating the cache and sending the page.  The copy
+             * is placed where the page would go if it is sent as is.
+             */
+            memcpy(p->xbzrle_pages + normal * page_size, page, page_size);
+            page = p->xbzrle_pages + normal * page_size;
+        }
+
+        if (buffer_is_zero(page, page_size)) {
+            if (pages->xbzrle) {
+                xbzrle_cache_zero_multifd_page(addr, pages->age);
+            }
+            p->encoded_offset[encoded++] = offset | MULTIFD_PAGE_ZERO;
+            p->zero_pages++;
+            continue;
+        }
+
+        if (pages->xbzrle) {
+            uint8_t *out = p->xbzrle_buf + p->xbzrle_size;
+            bool cache_miss;
+            int len;
+
+            len = xbzrle_encode_multifd_page(addr, page, out + 2, pages->age,
+                                             &cache_miss);
+            if (len == 0) {
+                p->xbzrle_skipped++;
+                continue;
+            }
+            if (len > 0) {
+                stw_be_p(out, len);
+                p->xbzrle_size += len + 2;
+                p->encoded_offset[encoded++] = offset | MULTIFD_PAGE_XBZRLE;
+                p->xbzrle_pages_sent++;
+                p->xbzrle_bytes += len + 2;
+                continue;
+            }
+            if (cache_miss) {
+                p->xbzrle_cache_miss++;
+            } else {
+                p->xbzrle_overflow++;
+            }
+        }
+
+        pages->offset[normal] = offset;
+        pages->iov[normal].iov_base = page;
+        pages->iov[normal].iov_len = page_size;
+        normal++;
+    }
+
+    memcpy(&pages->offset[normal], p->encoded_offset,
+           encoded * sizeof(ram_addr_t));
+    pages->normal = normal;
+    pages->used = normal + encoded;
+    trace_multifd_send_encode_pages(p->id, normal, encoded, p->xbzrle_size);
+}
+
+/**
+ * multifd_send_adapt_level: pick the compression level of a channel
+ *
+ * A channel compresses a packet and then writes it, so the share of
+ * its time spent compressing tells whether the CPU or the network is
+ * what holds it back.  Compress better while it mostly waits for the
+ * network, and faster when compression takes more than its budget.
+ *
+ * @p: Params for the channel that we are using
+ * @compress_ns: time spent preparing the last packet
+ * @write_ns: time spent writing the last packet
+ */
+static void multifd_send_adapt_level(MultiFDSendParams *p,
+                                     uint64_t compress_ns, uint64_t write_ns)
+{
+    MultiFDMethods *ops = multifd_send_state->ops;
+    int budget = multifd_send_state->cpu_budget;
+    uint64_t share;
+    int level = p->level;
+
+    p->compress_ns += compress_ns;
+    p->write_ns += write_ns;
+    if (++p->adapt_packets < MULTIFD_ADAPT_PACKETS) {
+        return;
+    }
+
+    share = p->compress_ns * 100 / MAX(p->compress_ns + p->write_ns, 1);
+    if (share > budget) {
+        level--;
+    } else if (share < budget / 2) {
+        level++;
+    }
+    level = MIN(MAX(level, ops->min_level), ops->max_level);
+    trace_multifd_send_adapt_level(p->id, share, p->level, level);
+
+    p->level = level;
+    p->adapt_packets = 0;
+    p->compress_ns = 0;
+    p->write_ns = 0;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -632,16 +833,31 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint32_t used = p->pages->used;
+            uint32_t normal = used;
             uint64_t packet_num = p->packet_num;
+            int64_t start = 0, prepared = 0;
             flags = p->flags;
 
-            if (used) {
-                ret = multifd_send_state->ops->send_prepare(p, used,
+            if (used && multifd_send_state->encode) {
+                multifd_send_encode_pages(p);
+                used = p->pages->used;
+                normal = p->pages->normal;
+            }
+            if (normal) {
+                if (multifd_send_state->cpu_budget) {
+                    start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+                }
+                ret = multifd_send_state->ops->send_prepare(p, normal,
                                                             &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
+                if (multifd_send_state->cpu_budget) {
+                    prepared = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+                }
+            } else {
+                p->next_packet_size = 0;
             }
             multifd_send_fill_packet(p);
             p->flags = 0;
@@ -660,13 +876,28 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
-            if (used) {
-                ret = multifd_send_state->ops->send_write(p, used, &local_err);
+            if (normal) {
+                ret = multifd_send_state->ops->send_write(p, normal,
+                                                          &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+
+            if (p->xbzrle_size) {
+                ret = qio_channel_write_all(p->c, (void *)p->xbzrle_buf,
+                                            p->xbzrle_size, &local_err);
+                p->xbzrle_size = 0;
                 if (ret != 0) {
                     break;
                 }
             }
 
+            if (prepared) {
+                multifd_send_adapt_level(p, prepared - start,
+                    qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - prepared);
+            }
+
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
@@ -751,7 +982,13 @@ int multifd_save_setup(Error **errp)
     multifd_send_state->pages = multifd_pages_init(page_count);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     atomic_set(&multifd_send_state->exiting, 0);
+    multifd_send_state->encode = migrate_multifd_encode_pages();
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    if (multifd_send_state->ops->max_level >
+        multifd_send_state->ops->min_level) {
+        multifd_send_state->cpu_budget =
+            migrate_multifd_compression_cpu_budget();
+    }
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -768,6 +1005,15 @@ int multifd_save_setup(Error **errp)
         p->packet = g_malloc0(p->packet_len);
         p->packet->magic = cpu_to_be32(MULTIFD_MAGIC);
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
+        if (multifd_send_state->encode) {
+            if (migrate_use_xbzrle()) {
+                p->xbzrle_pages = g_malloc(page_count *
+                                           qemu_target_page_size());
+            }
+            p->xbzrle_buf = g_malloc(page_count *
+                                     (qemu_target_page_size() + 2));
+            p->encoded_offset = g_new(ram_addr_t, page_count);
+        }
         p->name = g_strdup_printf("multifdsend_%d", i);
         socket_send_channel_create(multifd_new_send_channel_async, p);
     }
@@ -867,6 +1113,9 @@ int multifd_load_cleanup(Error **errp)
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
+        g_free(p->xbzrle_buf);
+        p->xbzrle_buf = NULL;
+        p->xbzrle_buf_len = 0;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
@@ -905,6 +1154,63 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+/**
+ * multifd_recv_decode_pages: handle the pages that were not sent as is
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int multifd_recv_decode_pages(MultiFDRecvParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t pos = 0;
+    uint32_t i;
+
+    if (p->xbzrle_size > p->xbzrle_buf_len) {
+        g_free(p->xbzrle_buf);
+        p->xbzrle_buf = g_malloc(p->xbzrle_size);
+        p->xbzrle_buf_len = p->xbzrle_size;
+    }
+    if (p->xbzrle_size &&
+        qio_channel_read_all(p->c, (void *)p->xbzrle_buf, p->xbzrle_size,
+                             errp)) {
+        return -1;
+    }
+
+    for (i = pages->normal; i < pages->used; i++) {
+        void *host = pages->iov[i].iov_base;
+        uint32_t len;
+
+        if ((pages->offset[i] & MULTIFD_PAGE_MASK) == MULTIFD_PAGE_ZERO) {
+            ram_handle_compressed(host, 0, page_size);
+            continue;
+        }
+
+        if (pos + 2 > p->xbzrle_size) {
+            error_setg(errp, "multifd %d: XBZRLE data truncated", p->id);
+            return -1;
+        }
+        len = lduw_be_p(p->xbzrle_buf + pos);
+        pos += 2;
+        if (len > page_size || pos + len > p->xbzrle_size) {
+            error_setg(errp, "multifd %d: XBZRLE page too long %u",
+                       p->id, len);
+            return -1;
+        }
+        if (xbzrle_decode_buffer(p->xbzrle_buf + pos, len, host,
+                                 page_size) == -1) {
+            error_setg(errp, "multifd %d: XBZRLE decode error", p->id);
+            return -1;
+        }
+        pos += len;
+    }
+
+    return 0;
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
@@ -916,6 +1222,7 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t normal;
         uint32_t flags;
 
         if (p->quit) {
@@ -939,6 +1246,7 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->used;
+        normal = p->pages->normal;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
@@ -948,8 +1256,15 @@ static void *multifd_recv_thread(void *opaque)
         p->num_pages += used;
         qemu_mutex_unlock(&p->mutex);
 
-        if (used) {
-            ret = multifd_recv_state->ops->recv_pages(p, used, &local_err);
+        if (normal) {
+            ret = multifd_recv_state->ops->recv_pages(p, normal, &local_err);
+            if (ret != 0) {
+                break;
+            }
+        }
+
+        if (used != normal) {
+            ret = multifd_recv_decode_pages(p, &local_err);
             if (ret != 0) {
                 break;
             }
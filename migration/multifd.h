@@ -21,7 +21,8 @@ bool multifd_recv_all_channels_created(void);
 bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
 void multifd_send_sync_main(QEMUFile *f);
-int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
+int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset,
+                       bool xbzrle);
 
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
@@ -32,10 +33,26 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+/* The packet data starts with the be32 size and the zstd dictionary */
+#define MULTIFD_FLAG_ZSTD_DICT (1 << 4)
+
+/* Limits of multifd-zstd-dict-size */
+#define MULTIFD_ZSTD_DICT_SIZE_MIN (1 << 10)
+#define MULTIFD_ZSTD_DICT_SIZE_MAX (1 << 20)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
+/*
+ * With multifd-encode-pages, the low bits of the packet offsets say how
+ * each page is sent.  Normal pages come first, then the others.
+ */
+#define MULTIFD_PAGE_NORMAL 0
+#define MULTIFD_PAGE_ZERO 1
+#define MULTIFD_PAGE_XBZRLE 2
+#define MULTIFD_PAGE_MASK 3
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
@@ -46,7 +63,10 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* size of the XBZRLE encoded pages, sent after the normal pages */
+    uint32_t xbzrle_size;
+    uint32_t unused32;     /* Reserved for future use */
+    uint64_t unused[3];    /* Reserved for future use */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
@@ -56,6 +76,8 @@ typedef struct {
     uint32_t used;
     /* number of allocated pages */
     uint32_t allocated;
+    /* number of pages sent as they are, at the start of iov */
+    uint32_t normal;
     /* global number of generated multifd packets */
     uint64_t packet_num;
     /* offset of each page */
@@ -63,6 +85,10 @@ typedef struct {
     /* pointer to each page */
     struct iovec *iov;
     RAMBlock *block;
+    /* XBZRLE encode the pages */
+    bool xbzrle;
+    /* dirty bitmap generation of the pages, used by the XBZRLE cache */
+    uint64_t age;
 } MultiFDPages_t;
 
 typedef struct {
@@ -106,6 +132,35 @@ typedef struct {
     QemuSemaphore sem_sync;
     /* used for compression methods */
     void *data;
+    /* compression level the next packets are compressed with */
+    int level;
+    /* used for multifd-compression-cpu-budget */
+    /* packets since the level was last adapted */
+    uint32_t adapt_packets;
+    /* time spent compressing and writing these packets */
+    uint64_t compress_ns;
+    uint64_t write_ns;
+    /* used for multifd-encode-pages */
+    /* copies of the pages, so that the XBZRLE cache matches the wire */
+    uint8_t *xbzrle_pages;
+    /* XBZRLE encoded pages, each preceded by its be16 length */
+    uint8_t *xbzrle_buf;
+    /* size of xbzrle_buf used by the current packet */
+    uint32_t xbzrle_size;
+    /* offsets of the encoded pages while they are sorted */
+    ram_addr_t *encoded_offset;
+    /* pages found to be zero since the last sync */
+    uint64_t zero_pages;
+    /* pages XBZRLE encoded since the last sync */
+    uint64_t xbzrle_pages_sent;
+    /* bytes of XBZRLE encoded pages since the last sync */
+    uint64_t xbzrle_bytes;
+    /* pages identical to the XBZRLE cache since the last sync */
+    uint64_t xbzrle_skipped;
+    /* XBZRLE cache misses since the last sync */
+    uint64_t xbzrle_cache_miss;
+    /* pages XBZRLE could not shrink since the last sync */
+    uint64_t xbzrle_overflow;
 }  MultiFDSendParams;
 
 typedef struct {
@@ -145,9 +200,23 @@ typedef struct {
     QemuSemaphore sem_sync;
     /* used for de-compression methods */
     void *data;
+    /* XBZRLE encoded pages of the current packet */
+    uint8_t *xbzrle_buf;
+    /* allocated size of xbzrle_buf */
+    uint32_t xbzrle_buf_len;
+    /* size of the XBZRLE encoded pages of the current packet */
+    uint32_t xbzrle_size;
 } MultiFDRecvParams;
 
 typedef struct {
+    /*
+     * Range of compression levels of the method, from the fastest to
+     * the best compression, or 0 and 0 if it has no levels.  The sending
+     * side sets MultiFDSendParams.level in send_setup, and send_prepare
+     * applies it when it changed.
+     */
+    int min_level;
+    int max_level;
     /* Setup for sending side */
     int (*send_setup)(MultiFDSendParams *p, Error **errp);
     /* Cleanup for sending side */
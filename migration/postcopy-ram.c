@@ -25,6 +25,8 @@
 #include "ram.h"
 #include "qapi/error.h"
 #include "qemu/notify.h"
+#include "qemu/host-utils.h"
+#include "qemu/units.h"
 #include "qemu/rcu.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/balloon.h"
@@ -159,6 +161,98 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
     return list;
 }
 
+/*
+ * Time from a guest page fault until the page is placed, as a histogram
+ * with log2 buckets in microseconds.  The start times are kept by host
+ * page address, since faults are seen by the fault thread, while pages
+ * are placed by the listen thread.
+ */
+#define POSTCOPY_FAULT_LATENCY_BUCKETS 20
+
+typedef struct PostcopyFaultLatency {
+    QemuMutex lock;
+    /* host page address -> time of the first fault on it */
+    GHashTable *pending;
+    /* size of pending, to skip the lock for pages nobody waits for */
+    int npending;
+    uint64_t buckets[POSTCOPY_FAULT_LATENCY_BUCKETS];
+} PostcopyFaultLatency;
+
+static PostcopyFaultLatency fault_latency;
+
+static void postcopy_fault_latency_init(void)
+{
+    if (!fault_latency.pending) {
+        qemu_mutex_init(&fault_latency.lock);
+        fault_latency.pending = g_hash_table_new(NULL, NULL);
+    }
+
+    qemu_mutex_lock(&fault_latency.lock);
+    g_hash_table_remove_all(fault_latency.pending);
+    atomic_set(&fault_latency.npending, 0);
+    memset(fault_latency.buckets, 0, sizeof(fault_latency.buckets));
+    qemu_mutex_unlock(&fault_latency.lock);
+}
+
+static void postcopy_fault_latency_begin(RAMBlock *rb, void *host)
+{
+    int64_t now = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    qemu_mutex_lock(&fault_latency.lock);
+    if (!g_hash_table_contains(fault_latency.pending, host)) {
+        g_hash_table_insert(fault_latency.pending, host,
+                            (gpointer)(uintptr_t)now);
+        atomic_inc(&fault_latency.npending);
+    }
+    /* the page may have been placed before we got to see the fault */
+    if (ramblock_recv_bitmap_test(rb, host) &&
+        g_hash_table_remove(fault_latency.pending, host)) {
+        atomic_dec(&fault_latency.npending);
+    }
+    qemu_mutex_unlock(&fault_latency.lock);
+}
+
+static void postcopy_fault_latency_end(void *host)
+{
+    gpointer start;
+    uint64_t us;
+    int bucket;
+
+    if (!atomic_read(&fault_latency.npending)) {
+        return;
+    }
+
+    qemu_mutex_lock(&fault_latency.lock);
+    if (g_hash_table_lookup_extended(fault_latency.pending, host,
+                                     NULL, &start)) {
+        g_hash_table_remove(fault_latency.pending, host);
+        atomic_dec(&fault_latency.npending);
+
+        us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - (uintptr_t)start;
+        bucket = us ? 63 - clz64(us) : 0;
+        bucket = MIN(bucket, POSTCOPY_FAULT_LATENCY_BUCKETS - 1);
+        fault_latency.buckets[bucket]++;
+    }
+    qemu_mutex_unlock(&fault_latency.lock);
+}
+
+static uint64List *get_fault_latency_list(void)
+{
+    uint64List *list = NULL, *entry;
+    int i;
+
+    qemu_mutex_lock(&fault_latency.lock);
+    for (i = POSTCOPY_FAULT_LATENCY_BUCKETS - 1; i >= 0; i--) {
+        entry = g_new0(uint64List, 1);
+        entry->value = fault_latency.buckets[i];
+        entry->next = list;
+        list = entry;
+    }
+    qemu_mutex_unlock(&fault_latency.lock);
+
+    return list;
+}
+
 /*
  * This function just populates MigrationInfo from postcopy's
  * blocktime context. It will not populate MigrationInfo,
@@ -171,6 +265,11 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *bc = mis->blocktime_ctx;
 
+    if (fault_latency.pending) {
+        info->has_postcopy_fault_latency = true;
+        info->postcopy_fault_latency = get_fault_latency_list();
+    }
+
     if (!bc) {
         return;
     }
@@ -858,6 +957,52 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
                                       affected_cpu);
 }
 
+/*
+ * With postcopy-prefetch, each fault also asks for a window of the pages
+ * after the faulting one.  A fault that lands in the previous window, or
+ * soon after it, means that the guest is walking through memory: the
+ * window doubles and continues where the previous one ended.  Any other
+ * fault starts over with the smallest window.
+ */
+#define POSTCOPY_PREFETCH_MIN_WINDOW (16 * KiB)
+#define POSTCOPY_PREFETCH_MAX_WINDOW (1 * MiB)
+
+static void postcopy_request_prefetch(MigrationIncomingState *mis,
+                                      RAMBlock *rb, ram_addr_t rb_offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t start = rb_offset + pagesize;
+    ram_addr_t end;
+
+    if (rb == mis->prefetch_rb && rb_offset > mis->prefetch_fault &&
+        rb_offset < mis->prefetch_end + mis->prefetch_window) {
+        mis->prefetch_window = MIN(mis->prefetch_window * 2,
+                                   POSTCOPY_PREFETCH_MAX_WINDOW);
+        start = MAX(start, mis->prefetch_end);
+    } else {
+        mis->prefetch_window = POSTCOPY_PREFETCH_MIN_WINDOW;
+    }
+
+    end = MIN(start + MAX(mis->prefetch_window, pagesize), rb->used_length);
+    mis->prefetch_rb = rb;
+    mis->prefetch_fault = rb_offset;
+    mis->prefetch_end = end;
+
+    /* no need to ask for what has arrived in the meantime */
+    while (start < end && ramblock_recv_bitmap_test_byte_offset(rb, start)) {
+        start += pagesize;
+    }
+    if (start >= end) {
+        return;
+    }
+
+    trace_postcopy_request_prefetch(qemu_ram_get_idstr(rb), start,
+                                    end - start, mis->prefetch_window);
+    /* a failure shows up again when the next fault is requested */
+    migrate_send_rp_req_prefetch(mis, qemu_ram_get_idstr(rb), start,
+                                 end - start);
+}
+
 static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
@@ -997,6 +1142,8 @@ static void *postcopy_ram_fault_thread(void *opaque)
             mark_postcopy_blocktime_begin(
                     (uintptr_t)(msg.arg.pagefault.address),
                                 msg.arg.pagefault.feat.ptid, rb);
+            postcopy_fault_latency_begin(rb,
+                    (uint8_t *)qemu_ram_get_host_addr(rb) + rb_offset);
 
 retry:
             /*
@@ -1030,6 +1177,10 @@ retry:
                     break;
                 }
             }
+
+            if (migrate_postcopy_prefetch()) {
+                postcopy_request_prefetch(mis, rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1096,6 +1247,9 @@ retry:
 
 int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
 {
+    postcopy_fault_latency_init();
+    mis->prefetch_rb = NULL;
+
     /* Open the fd for the kernel to give us userfaults */
     mis->userfault_fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
     if (mis->userfault_fd == -1) {
@@ -1193,6 +1347,7 @@ static int qemu_ufd_copy_ioctl(int userfault_fd, void *host_addr,
         ramblock_recv_bitmap_set_range(rb, host_addr,
                                        pagesize / qemu_target_page_size());
         mark_postcopy_blocktime_end((uintptr_t)host_addr);
+        postcopy_fault_latency_end(host_addr);
 
     }
     return ret;
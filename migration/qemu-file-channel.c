@@ -146,6 +146,16 @@ static int channel_set_blocking(void *opaque,
     return 0;
 }
 
+static off_t channel_seek(void *opaque, off_t offset, int whence,
+                          Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    off_t ret;
+
+    ret = qio_channel_io_seek(ioc, offset, whence, errp);
+    return ret < 0 ? -EIO : ret;
+}
+
 static QEMUFile *channel_get_input_return_path(void *opaque)
 {
     QIOChannel *ioc = QIO_CHANNEL(opaque);
@@ -166,6 +176,7 @@ static const QEMUFileOps channel_input_ops = {
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_input_return_path,
+    .seek = channel_seek,
 };
 
 
@@ -175,6 +186,7 @@ static const QEMUFileOps channel_output_ops = {
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_output_return_path,
+    .seek = channel_seek,
 };
 
 
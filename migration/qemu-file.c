@@ -657,6 +657,57 @@ int64_t qemu_ftell(QEMUFile *f)
     return f->pos;
 }
 
+/*
+ * Get the position of the stream in the underlying file.  Unlike
+ * qemu_ftell(), which counts the bytes that went through the QEMUFile,
+ * this takes seeks into account.
+ *
+ * Returns -ENOTSUP if the transport can't seek, -err on error
+ */
+off_t qemu_file_get_offset(QEMUFile *f)
+{
+    off_t ret;
+
+    if (!f->ops->seek) {
+        return -ENOTSUP;
+    }
+
+    qemu_fflush(f);
+    ret = f->ops->seek(f->opaque, 0, SEEK_CUR, NULL);
+    if (ret >= 0 && !qemu_file_is_writable(f)) {
+        /* data that was read ahead but not consumed yet */
+        ret -= f->buf_size - f->buf_index;
+    }
+    return ret;
+}
+
+/*
+ * Continue the stream at @offset of the underlying file.  Pending
+ * output is flushed first, input that was read ahead is dropped.
+ *
+ * Returns 0 on success, -err on error
+ */
+int qemu_file_set_offset(QEMUFile *f, off_t offset)
+{
+    Error *local_error = NULL;
+    off_t ret;
+
+    if (!f->ops->seek) {
+        return -ENOTSUP;
+    }
+
+    qemu_fflush(f);
+    f->buf_index = 0;
+    f->buf_size = 0;
+
+    ret = f->ops->seek(f->opaque, offset, SEEK_SET, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+        return ret;
+    }
+    return 0;
+}
+
 int qemu_file_rate_limit(QEMUFile *f)
 {
     if (f->shutdown) {
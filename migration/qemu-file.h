@@ -103,6 +103,14 @@ typedef QEMUFile *(QEMURetPathFunc)(void *opaque);
 typedef int (QEMUFileShutdownFunc)(void *opaque, bool rd, bool wr,
                                    Error **errp);
 
+/*
+ * Move the position of the underlying transport, as lseek() does.
+ * Only seekable transports (plain files) implement it.
+ * Returns the new position on success, -err on error
+ */
+typedef off_t (QEMUFileSeekFunc)(void *opaque, off_t offset, int whence,
+                                 Error **errp);
+
 typedef struct QEMUFileOps {
     QEMUFileGetBufferFunc *get_buffer;
     QEMUFileCloseFunc *close;
@@ -110,6 +118,7 @@ typedef struct QEMUFileOps {
     QEMUFileWritevBufferFunc *writev_buffer;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    QEMUFileSeekFunc *seek;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -125,6 +134,8 @@ int qemu_get_fd(QEMUFile *f);
 int qemu_fclose(QEMUFile *f);
 int64_t qemu_ftell(QEMUFile *f);
 int64_t qemu_ftell_fast(QEMUFile *f);
+off_t qemu_file_get_offset(QEMUFile *f);
+int qemu_file_set_offset(QEMUFile *f, off_t offset);
 /*
  * put_buffer without copying the buffer.
  * The buffer should be available till it is sent asynchronously.
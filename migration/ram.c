@@ -29,6 +29,7 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -55,6 +56,8 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
+#include "timeline.h"
 
 /***********************************************************/
 /* ram save/restore */
@@ -82,6 +85,9 @@ static inline bool is_zero_range(uint8_t *p, uint64_t size)
 
 XBZRLECacheStats xbzrle_counters;
 
+/* Number of locks the multifd channels use for the XBZRLE cache */
+#define XBZRLE_PAGE_LOCKS 64
+
 /* struct contains XBZRLE cache and a static page
    used by the compression */
 static struct {
@@ -96,6 +102,14 @@ static struct {
     uint8_t *zero_target_page;
     /* buffer used for XBZRLE decoding */
     uint8_t *decoded_buf;
+    /*
+     * The multifd channels encode pages concurrently, so they do not
+     * take lock but page_lock[page number & page_lock_mask].  Pages that
+     * share a cache bucket share the lock too.  Replacing or freeing the
+     * cache requires lock and all of page_lock[].
+     */
+    QemuMutex page_lock[XBZRLE_PAGE_LOCKS];
+    unsigned int page_lock_mask;
 } XBZRLE;
 
 static void XBZRLE_cache_lock(void)
@@ -110,6 +124,57 @@ static void XBZRLE_cache_unlock(void)
         qemu_mutex_unlock(&XBZRLE.lock);
 }
 
+/**
+ * xbzrle_set_cache: replace the XBZRLE cache
+ *
+ * Must be called with XBZRLE.lock held.  Returns the old cache.
+ *
+ * @cache: new cache, or NULL
+ * @cache_size: size of the new cache in bytes
+ */
+static PageCache *xbzrle_set_cache(PageCache *cache, int64_t cache_size)
+{
+    PageCache *old = XBZRLE.cache;
+    int i;
+
+    for (i = 0; i < XBZRLE_PAGE_LOCKS; i++) {
+        qemu_mutex_lock(&XBZRLE.page_lock[i]);
+    }
+    XBZRLE.cache = cache;
+    atomic_set(&XBZRLE.page_lock_mask,
+               cache ? MIN(XBZRLE_PAGE_LOCKS,
+                           cache_size / TARGET_PAGE_SIZE) - 1 : 0);
+    for (i = 0; i < XBZRLE_PAGE_LOCKS; i++) {
+        qemu_mutex_unlock(&XBZRLE.page_lock[i]);
+    }
+    return old;
+}
+
+/**
+ * xbzrle_page_lock: lock the XBZRLE cache bucket of a page
+ *
+ * Returns the cache, which is NULL if XBZRLE was torn down.
+ *
+ * @addr: ram address of the page
+ * @lock: set to the lock to release when done
+ */
+static PageCache *xbzrle_page_lock(ram_addr_t addr, QemuMutex **lock)
+{
+    unsigned long page = addr >> TARGET_PAGE_BITS;
+
+    for (;;) {
+        unsigned int mask = atomic_read(&XBZRLE.page_lock_mask);
+
+        *lock = &XBZRLE.page_lock[page & mask];
+        qemu_mutex_lock(*lock);
+        /* the cache might have been resized in the meantime */
+        if (atomic_read(&XBZRLE.page_lock_mask) == mask) {
+            return XBZRLE.cache;
+        }
+        qemu_mutex_unlock(*lock);
+    }
+}
+
 /**
  * xbzrle_cache_resize: resize the xbzrle cache
  *
@@ -149,8 +214,7 @@ int xbzrle_cache_resize(int64_t new_size, Error **errp)
             goto out;
         }
 
-        cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        cache_fini(xbzrle_set_cache(new_cache, new_size));
     }
 out:
     XBZRLE_cache_unlock();
@@ -318,6 +382,9 @@ struct RAMState {
     bool fpo_enabled;
     /* How many times we have dirty too many pages */
     int dirty_rate_high_cnt;
+    /* dirty-limit: CPUState::dirty_pages of each vCPU at the last period */
+    uint32_t *vcpu_dirty_pages_prev;
+    int vcpu_dirty_pages_len;
     /* these variables are used for bitmap sync */
     /* last time we did a full bitmap_sync */
     int64_t time_last_bitmap_sync;
@@ -349,11 +416,24 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /*
+     * Pages the destination expects to fault on soon; sent once
+     * src_page_requests is empty.  Also protected by src_page_req_mutex.
+     */
+    QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_prefetch_requests;
+    unsigned int src_prefetch_count;
+    /* mapped-ram: contiguous pages not handed to the I/O threads yet */
+    RAMBlock *mapped_ram_block;
+    ram_addr_t mapped_ram_start;
+    size_t mapped_ram_len;
 };
 typedef struct RAMState RAMState;
 
 static RAMState *ram_state;
 
+/* bytes of guest RAM written to the migration file with mapped-ram */
+static uint64_t mapped_ram_bytes;
+
 static NotifierWithReturnList precopy_notifier_list;
 
 void precopy_infrastructure_init(void)
@@ -743,6 +823,67 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
     return 1;
 }
 
+/**
+ * xbzrle_encode_multifd_page: XBZRLE encode a page for a multifd channel
+ *
+ * Returns the length of the encoded page, 0 if the page is identical to
+ * the cached copy, or -1 if it has to be sent whole.  As in
+ * save_xbzrle_page, the cache is updated to match what the destination
+ * will have.
+ *
+ * @addr: ram address of the page
+ * @page: copy of the page contents, which the guest cannot change
+ * @encoded: buffer of TARGET_PAGE_SIZE bytes for the encoded page
+ * @age: dirty bitmap generation of the page
+ * @cache_miss: set to whether the page was missing from the cache
+ */
+int xbzrle_encode_multifd_page(ram_addr_t addr, uint8_t *page,
+                               uint8_t *encoded, uint64_t age,
+                               bool *cache_miss)
+{
+    QemuMutex *lock;
+    PageCache *cache = xbzrle_page_lock(addr, &lock);
+    uint8_t *prev_cached_page;
+    int encoded_len = -1;
+
+    *cache_miss = !cache || !cache_is_cached(cache, addr, age);
+    if (*cache_miss) {
+        if (cache) {
+            cache_insert(cache, addr, page, age);
+        }
+        goto out;
+    }
+
+    prev_cached_page = get_cached_data(cache, addr);
+    encoded_len = xbzrle_encode_buffer(prev_cached_page, page,
+                                       TARGET_PAGE_SIZE, encoded,
+                                       TARGET_PAGE_SIZE);
+    if (encoded_len != 0) {
+        memcpy(prev_cached_page, page, TARGET_PAGE_SIZE);
+    }
+
+out:
+    qemu_mutex_unlock(lock);
+    return encoded_len;
+}
+
+/**
+ * xbzrle_cache_zero_multifd_page: xbzrle_cache_zero_page for multifd
+ *
+ * @addr: ram address of the zero page
+ * @age: dirty bitmap generation of the page
+ */
+void xbzrle_cache_zero_multifd_page(ram_addr_t addr, uint64_t age)
+{
+    QemuMutex *lock;
+    PageCache *cache = xbzrle_page_lock(addr, &lock);
+
+    if (cache) {
+        cache_insert(cache, addr, XBZRLE.zero_target_page, age);
+    }
+    qemu_mutex_unlock(lock);
+}
+
 /**
  * migration_bitmap_find_dirty: find the next dirty page from start
  *
@@ -850,6 +991,11 @@ uint64_t ram_pagesize_summary(void)
     return summary;
 }
 
+uint64_t ram_mapped_ram_bytes(void)
+{
+    return mapped_ram_bytes;
+}
+
 uint64_t ram_get_total_transferred_pages(void)
 {
     return  ram_counters.normal + ram_counters.duplicate +
@@ -924,9 +1070,63 @@ static void migration_trigger_throttle(RAMState *rs)
     }
 }
 
+/**
+ * migration_dirty_limit: throttle the vCPUs that dirty memory too fast
+ *
+ * Unlike auto-converge, only the vCPUs whose own dirty page rate is
+ * above the vcpu-dirty-limit parameter are throttled; the throttle of
+ * the others decays again once they are well below it.
+ *
+ * @rs: current RAM state
+ * @period_ms: time since the last period started
+ */
+static void migration_dirty_limit(RAMState *rs, int64_t period_ms)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t limit = s->parameters.vcpu_dirty_limit;
+    int pct_initial = s->parameters.cpu_throttle_initial;
+    int pct_increment = s->parameters.cpu_throttle_increment;
+    int pct_max = s->parameters.max_cpu_throttle;
+    CPUState *cpu;
+
+    if (blk_mig_bulk_active()) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        uint32_t pages = atomic_read(&cpu->dirty_pages);
+        int pct = cpu_throttle_get_vcpu_percentage(cpu);
+        uint64_t rate;
+
+        if (cpu->cpu_index >= rs->vcpu_dirty_pages_len) {
+            /* first period, or a hotplugged vCPU: nothing to compare to */
+            rs->vcpu_dirty_pages_prev = g_renew(uint32_t,
+                                                rs->vcpu_dirty_pages_prev,
+                                                cpu->cpu_index + 1);
+            rs->vcpu_dirty_pages_len = cpu->cpu_index + 1;
+            rs->vcpu_dirty_pages_prev[cpu->cpu_index] = pages;
+            continue;
+        }
+
+        rate = (uint64_t)(pages - rs->vcpu_dirty_pages_prev[cpu->cpu_index]) *
+               TARGET_PAGE_SIZE * 1000 / period_ms / MiB;
+        rs->vcpu_dirty_pages_prev[cpu->cpu_index] = pages;
+
+        if (rate > limit) {
+            pct = pct ? MIN(pct + pct_increment, pct_max) : pct_initial;
+        } else if (pct && rate < limit / 2) {
+            pct = MAX(pct - pct_increment, 0);
+        }
+        trace_migration_dirty_limit(cpu->cpu_index, rate, pct);
+        cpu_throttle_set_vcpu(cpu, pct);
+    }
+}
+
 static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
+    int64_t start = migration_timeline_now();
     int64_t end_time;
 
     ram_counters.dirty_sync_count++;
@@ -949,12 +1149,16 @@ static void migration_bitmap_sync(RAMState *rs)
 
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    migration_timeline_add(MIGRATION_TIMELINE_KIND_BITMAP_SYNC, "ram", start);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
         migration_trigger_throttle(rs);
+        if (migrate_dirty_limit()) {
+            migration_dirty_limit(rs, end_time - rs->time_last_bitmap_sync);
+        }
 
         migration_update_rates(rs, end_time);
 
@@ -1162,7 +1366,11 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss, bool last_stage)
 static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
                                  ram_addr_t offset)
 {
-    if (multifd_queue_page(rs->f, block, offset) < 0) {
+    /* like ram_save_page, XBZRLE is not used during the bulk stage */
+    bool xbzrle = migrate_multifd_encode_pages() && migrate_use_xbzrle() &&
+                  !rs->ram_bulk_stage;
+
+    if (multifd_queue_page(rs->f, block, offset, xbzrle) < 0) {
         return -1;
     }
     ram_counters.normal++;
@@ -1170,6 +1378,220 @@ static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
     return 1;
 }
 
+/*
+ * Mapped-ram gives each RAMBlock a fixed region of the migration file.
+ * The stream carries a header for each block, after its entry in the
+ * RAM_SAVE_FLAG_MEM_SIZE list:
+ *
+ *   be32 version
+ *   be64 page size, the granularity of the bitmap
+ *   be64 bitmap_offset: one bit per page, set if the page is in the file
+ *   be64 pages_offset: the pages, each at its offset inside the block
+ *
+ * The bitmap follows the header directly, the pages start at the next
+ * MAPPED_RAM_FILE_ALIGN boundary, and the stream resumes right after the
+ * pages.  Pages are written while the migration runs, the bitmaps only
+ * once it completes.  Pages that are zero are not in the file.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+#define MAPPED_RAM_HDR_SIZE    (4 + 3 * 8)
+/* suitable for O_DIRECT, and keeps huge pages aligned in the file */
+#define MAPPED_RAM_FILE_ALIGN  (1 * MiB)
+/* the largest chunk handed to one I/O thread at a time */
+#define MAPPED_RAM_MAX_IO      (1 * MiB)
+
+/* the bitmap in the file is an array of bits, padded to 64 bits */
+static size_t mapped_ram_bitmap_size(unsigned long pages)
+{
+    return DIV_ROUND_UP(pages, 64) * 8;
+}
+
+static int mapped_ram_setup_block(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    off_t pos = qemu_file_get_offset(f);
+
+    if (pos < 0) {
+        error_report("mapped-ram: migration file is not seekable");
+        return pos;
+    }
+
+    block->bitmap_offset = pos + MAPPED_RAM_HDR_SIZE;
+    block->pages_offset = ROUND_UP(block->bitmap_offset +
+                                   mapped_ram_bitmap_size(pages),
+                                   MAPPED_RAM_FILE_ALIGN);
+    block->file_bmap = bitmap_new(DIV_ROUND_UP(pages, 64) * 64);
+
+    qemu_put_be32(f, MAPPED_RAM_HDR_VERSION);
+    qemu_put_be64(f, TARGET_PAGE_SIZE);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    return qemu_file_set_offset(f, block->pages_offset + block->used_length);
+}
+
+static void mapped_ram_flush(RAMState *rs)
+{
+    RAMBlock *block = rs->mapped_ram_block;
+
+    if (rs->mapped_ram_len) {
+        file_io_queue(block->host + rs->mapped_ram_start, rs->mapped_ram_len,
+                      block->pages_offset + rs->mapped_ram_start);
+        rs->mapped_ram_len = 0;
+    }
+}
+
+/*
+ * Wait for the pages written so far.  Must be done before the dirty
+ * bitmap is synced again, so that the same page never has two writes in
+ * flight.
+ */
+static int mapped_ram_sync(RAMState *rs)
+{
+    int ret;
+
+    mapped_ram_flush(rs);
+    ret = file_io_sync();
+    if (ret) {
+        error_report("mapped-ram: failed to write guest RAM: %s",
+                     strerror(-ret));
+        qemu_file_set_error(rs->f, ret);
+    }
+    return ret;
+}
+
+/**
+ * ram_save_mapped_ram_page: write a page to its place in the file
+ *
+ * Returns the number of pages written.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int ram_save_mapped_ram_page(RAMState *rs, RAMBlock *block,
+                                    ram_addr_t offset)
+{
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+
+    /* a zero page only needs to be dropped from the file */
+    if (buffer_is_zero(block->host + offset, TARGET_PAGE_SIZE)) {
+        clear_bit(page, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    set_bit(page, block->file_bmap);
+
+    if (rs->mapped_ram_len &&
+        (rs->mapped_ram_block != block ||
+         rs->mapped_ram_start + rs->mapped_ram_len != offset ||
+         rs->mapped_ram_len >= MAPPED_RAM_MAX_IO)) {
+        mapped_ram_flush(rs);
+    }
+    if (!rs->mapped_ram_len) {
+        rs->mapped_ram_block = block;
+        rs->mapped_ram_start = offset;
+    }
+    rs->mapped_ram_len += TARGET_PAGE_SIZE;
+
+    ram_counters.normal++;
+    ram_counters.transferred += TARGET_PAGE_SIZE;
+    mapped_ram_bytes += TARGET_PAGE_SIZE;
+    /* the page doesn't go through the QEMUFile, but is rate limited */
+    qemu_file_update_transfer(rs->f, TARGET_PAGE_SIZE);
+
+    return 1;
+}
+
+/* Called with rcu_read_lock held */
+static int mapped_ram_save_complete(RAMState *rs)
+{
+    RAMBlock *block;
+    int ret;
+
+    ret = mapped_ram_sync(rs);
+    if (ret) {
+        return ret;
+    }
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t size = mapped_ram_bitmap_size(pages);
+        g_autofree unsigned long *le_bitmap = bitmap_new(size * 8);
+
+        bitmap_to_le(le_bitmap, block->file_bmap, size * 8);
+        ret = file_io_pwrite(le_bitmap, size, block->bitmap_offset);
+        if (ret) {
+            error_report("mapped-ram: failed to write bitmap of %s: %s",
+                         block->idstr, strerror(-ret));
+            qemu_file_set_error(rs->f, ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the header of @block, and queue reads for the pages that are in
+ * the file.  The caller waits for them with file_io_sync().
+ */
+static int mapped_ram_load_block(QEMUFile *f, RAMBlock *block,
+                                 ram_addr_t length)
+{
+    unsigned long pages = length >> TARGET_PAGE_BITS;
+    unsigned long chunk = MAPPED_RAM_MAX_IO >> TARGET_PAGE_BITS;
+    size_t size = mapped_ram_bitmap_size(pages);
+    g_autofree unsigned long *le_bitmap = NULL;
+    g_autofree unsigned long *bitmap = NULL;
+    uint64_t page_size, bitmap_offset, pages_offset;
+    unsigned long start, end, page;
+    uint32_t version;
+    int ret;
+
+    version = qemu_get_be32(f);
+    page_size = qemu_get_be64(f);
+    bitmap_offset = qemu_get_be64(f);
+    pages_offset = qemu_get_be64(f);
+
+    if (version != MAPPED_RAM_HDR_VERSION) {
+        error_report("mapped-ram: unsupported version %" PRIu32
+                     " for block %s", version, block->idstr);
+        return -EINVAL;
+    }
+    if (page_size != TARGET_PAGE_SIZE) {
+        error_report("mapped-ram: page size %" PRIu64 " of block %s "
+                     "differs from %d", page_size, block->idstr,
+                     TARGET_PAGE_SIZE);
+        return -EINVAL;
+    }
+
+    le_bitmap = bitmap_new(size * 8);
+    bitmap = bitmap_new(size * 8);
+    ret = file_io_pread(le_bitmap, size, bitmap_offset);
+    if (ret) {
+        error_report("mapped-ram: failed to read bitmap of %s: %s",
+                     block->idstr, strerror(-ret));
+        return ret;
+    }
+    bitmap_from_le(bitmap, le_bitmap, size * 8);
+
+    /* long runs are split so that all threads get a share */
+    for (start = find_first_bit(bitmap, pages); start < pages;
+         start = find_next_bit(bitmap, pages, end)) {
+        end = find_next_zero_bit(bitmap, pages, start);
+        for (page = start; page < end; page += chunk) {
+            ram_addr_t offset = (ram_addr_t)page << TARGET_PAGE_BITS;
+
+            file_io_queue(block->host + offset,
+                          MIN(end - page, chunk) << TARGET_PAGE_BITS,
+                          pages_offset + offset);
+        }
+    }
+
+    return qemu_file_set_offset(f, pages_offset + length);
+}
+
 static bool do_compress_ram_page(QEMUFile *f, z_stream *stream, RAMBlock *block,
                                  ram_addr_t offset, uint8_t *source_buf)
 {
@@ -1363,16 +1785,23 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
  */
 static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 {
+    struct RAMSrcPageRequest *entry;
     RAMBlock *block = NULL;
+    bool urgent;
 
-    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests)) {
+    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests) &&
+        QSIMPLEQ_EMPTY_ATOMIC(&rs->src_prefetch_requests)) {
         return NULL;
     }
 
     qemu_mutex_lock(&rs->src_page_req_mutex);
-    if (!QSIMPLEQ_EMPTY(&rs->src_page_requests)) {
-        struct RAMSrcPageRequest *entry =
-                                QSIMPLEQ_FIRST(&rs->src_page_requests);
+    /* Pages that vCPUs are blocked on go before the prefetched ones */
+    entry = QSIMPLEQ_FIRST(&rs->src_page_requests);
+    urgent = entry != NULL;
+    if (!urgent) {
+        entry = QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+    }
+    if (entry) {
         block = entry->rb;
         *offset = entry->offset;
 
@@ -1381,9 +1810,16 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
             entry->offset += TARGET_PAGE_SIZE;
         } else {
             memory_region_unref(block->mr);
-            QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+            if (urgent) {
+                QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+            } else {
+                QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+                rs->src_prefetch_count--;
+            }
             g_free(entry);
-            migration_consume_urgent_request();
+            if (urgent) {
+                migration_consume_urgent_request();
+            }
         }
     }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
@@ -1477,8 +1913,21 @@ static void migration_page_queue_free(RAMState *rs)
         QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
         g_free(mspr);
     }
+    QSIMPLEQ_FOREACH_SAFE(mspr, &rs->src_prefetch_requests, next_req,
+                          next_mspr) {
+        memory_region_unref(mspr->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(mspr);
+    }
+    rs->src_prefetch_count = 0;
 }
 
+/*
+ * Prefetch requests that the source has not got to yet are dropped,
+ * oldest first, beyond this many: the guest has moved on since.
+ */
+#define RAM_PREFETCH_QUEUE_MAX 16
+
 /**
  * ram_save_queue_pages: queue the page for transmission
  *
@@ -1490,13 +1939,18 @@ static void migration_page_queue_free(RAMState *rs)
  *          same that last one.
  * @start: starting address from the start of the RAMBlock
  * @len: length (in bytes) to send
+ * @prefetch: nothing waits for the pages yet, send them after the
+ *            other requests
  */
-int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
+int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
+                         bool prefetch)
 {
     RAMBlock *ramblock;
     RAMState *rs = ram_state;
 
-    ram_counters.postcopy_requests++;
+    if (!prefetch) {
+        ram_counters.postcopy_requests++;
+    }
     RCU_READ_LOCK_GUARD();
 
     if (!rbname) {
@@ -1519,9 +1973,12 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
             error_report("ram_save_queue_pages no block '%s'", rbname);
             return -1;
         }
-        rs->last_req_rb = ramblock;
+        /* prefetch requests always name their block */
+        if (!prefetch) {
+            rs->last_req_rb = ramblock;
+        }
     }
-    trace_ram_save_queue_pages(ramblock->idstr, start, len);
+    trace_ram_save_queue_pages(ramblock->idstr, start, len, prefetch);
     if (start+len > ramblock->used_length) {
         error_report("%s request overrun start=" RAM_ADDR_FMT " len="
                      RAM_ADDR_FMT " blocklen=" RAM_ADDR_FMT,
@@ -1537,8 +1994,22 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
 
     memory_region_ref(ramblock->mr);
     qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
+    if (prefetch) {
+        if (rs->src_prefetch_count == RAM_PREFETCH_QUEUE_MAX) {
+            struct RAMSrcPageRequest *old =
+                QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+
+            QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+            memory_region_unref(old->rb->mr);
+            g_free(old);
+            rs->src_prefetch_count--;
+        }
+        QSIMPLEQ_INSERT_TAIL(&rs->src_prefetch_requests, new_entry, next_req);
+        rs->src_prefetch_count++;
+    } else {
+        QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+        migration_make_urgent_request();
+    }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
 
     return 0;
@@ -1610,16 +2081,33 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    /*
+     * Do not use multifd for:
+     * 1. Compression as the first page in the new block should be posted out
+     *    before sending the compressed page
+     * 2. In postcopy as one whole host page should be placed
+     */
+    bool use_multifd = !save_page_use_compression(rs) &&
+                       migrate_use_multifd() && !migration_in_postcopy();
     int res;
 
     if (control_save_page(rs, block, offset, &res)) {
         return res;
     }
 
+    if (migrate_mapped_ram()) {
+        return ram_save_mapped_ram_page(rs, block, offset);
+    }
+
     if (save_compress_page(rs, block, offset)) {
         return 1;
     }
 
+    /* the multifd channels look for zero pages themselves */
+    if (use_multifd && migrate_multifd_encode_pages()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -1634,14 +2122,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
-    /*
-     * Do not use multifd for:
-     * 1. Compression as the first page in the new block should be posted out
-     *    before sending the compressed page
-     * 2. In postcopy as one whole host page should be placed
-     */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
@@ -1809,6 +2290,7 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        g_free((*rsp)->vcpu_dirty_pages_prev);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -1820,11 +2302,10 @@ static void xbzrle_cleanup(void)
 {
     XBZRLE_cache_lock();
     if (XBZRLE.cache) {
-        cache_fini(XBZRLE.cache);
+        cache_fini(xbzrle_set_cache(NULL, 0));
         g_free(XBZRLE.encoded_buf);
         g_free(XBZRLE.current_buf);
         g_free(XBZRLE.zero_target_page);
-        XBZRLE.cache = NULL;
         XBZRLE.encoded_buf = NULL;
         XBZRLE.current_buf = NULL;
         XBZRLE.zero_target_page = NULL;
@@ -1847,8 +2328,11 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
+    file_io_finish();
     xbzrle_cleanup();
     compress_threads_save_cleanup();
     ram_state_cleanup(rsp);
@@ -2181,6 +2665,7 @@ int ram_discard_range(const char *rbname, uint64_t start, size_t length)
 static int xbzrle_init(void)
 {
     Error *local_err = NULL;
+    PageCache *cache;
 
     if (!migrate_use_xbzrle()) {
         return 0;
@@ -2194,9 +2679,9 @@ static int xbzrle_init(void)
         goto err_out;
     }
 
-    XBZRLE.cache = cache_init(migrate_xbzrle_cache_size(),
-                              TARGET_PAGE_SIZE, &local_err);
-    if (!XBZRLE.cache) {
+    cache = cache_init(migrate_xbzrle_cache_size(), TARGET_PAGE_SIZE,
+                       &local_err);
+    if (!cache) {
         error_report_err(local_err);
         goto free_zero_page;
     }
@@ -2214,6 +2699,7 @@ static int xbzrle_init(void)
     }
 
     /* We are all good */
+    xbzrle_set_cache(cache, migrate_xbzrle_cache_size());
     XBZRLE_cache_unlock();
     return 0;
 
@@ -2221,8 +2707,7 @@ free_encoded_buf:
     g_free(XBZRLE.encoded_buf);
     XBZRLE.encoded_buf = NULL;
 free_cache:
-    cache_fini(XBZRLE.cache);
-    XBZRLE.cache = NULL;
+    cache_fini(cache);
 free_zero_page:
     g_free(XBZRLE.zero_target_page);
     XBZRLE.zero_target_page = NULL;
@@ -2243,6 +2728,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    QSIMPLEQ_INIT(&(*rsp)->src_prefetch_requests);
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -2440,6 +2926,16 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     }
     (*rsp)->f = f;
 
+    if (migrate_mapped_ram()) {
+        Error *local_err = NULL;
+
+        if (file_io_start(true, migrate_multifd_channels(), &local_err)) {
+            error_report_err(local_err);
+            return -1;
+        }
+        mapped_ram_bytes = 0;
+    }
+
     WITH_RCU_READ_LOCK_GUARD() {
         qemu_put_be64(f, ram_bytes_total_common(true) | RAM_SAVE_FLAG_MEM_SIZE);
 
@@ -2454,6 +2950,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram() && mapped_ram_setup_block(f, block)) {
+                return -1;
+            }
         }
     }
 
@@ -2558,6 +3057,9 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
     ram_control_after_iterate(f, RAM_CONTROL_ROUND);
 
 out:
+    if (ret >= 0 && migrate_mapped_ram()) {
+        ret = mapped_ram_sync(rs);
+    }
     if (ret >= 0
         && migration_is_setup_or_active(migrate_get_current()->state)) {
         multifd_send_sync_main(rs->f);
@@ -2616,6 +3118,10 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
         flush_compressed_data(rs);
         ram_control_after_iterate(f, RAM_CONTROL_FINISH);
+
+        if (ret >= 0 && migrate_mapped_ram()) {
+            ret = mapped_ram_save_complete(rs);
+        }
     }
 
     if (ret >= 0) {
@@ -2656,7 +3162,227 @@ static void ram_save_pending(QEMUFile *f, void *opaque, uint64_t max_size,
     }
 }
 
-static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
+/*
+ * Load threads: the migration thread only parses the stream and copies
+ * the page data into per-thread batches; the threads write the pages
+ * to guest memory, which is where the destination spends most of its
+ * time (first-touch page faults, XBZRLE decoding).  A page always goes
+ * to the same thread, so updates to it are applied in stream order.
+ */
+#define RAM_LOAD_BATCH_PAGES 64
+
+typedef struct {
+    void *host;
+    /* RAM_SAVE_FLAG_ZERO, RAM_SAVE_FLAG_PAGE or RAM_SAVE_FLAG_XBZRLE */
+    int type;
+    /* length of the data in the batch, or the fill byte of a zero page */
+    uint32_t len;
+    uint32_t offset;
+} RAMLoadPage;
+
+typedef struct {
+    RAMLoadPage pages[RAM_LOAD_BATCH_PAGES];
+    int num;
+    uint32_t used;
+    uint8_t *buf;
+} RAMLoadBatch;
+
+typedef struct {
+    QemuThread thread;
+    QemuMutex mutex;
+    QemuCond cond;
+    bool quit;
+    /* one batch is filled by the migration thread ... */
+    int fill;
+    /* ... while the thread loads the other one, if todo is set */
+    RAMLoadBatch *todo;
+    RAMLoadBatch batch[2];
+} RAMLoadParam;
+
+static QEMUFile *ram_load_file;
+static RAMLoadParam *ram_load_param;
+static int ram_load_thread_count;
+
+static int ram_load_batch(RAMLoadBatch *batch)
+{
+    int i;
+
+    for (i = 0; i < batch->num; i++) {
+        RAMLoadPage *page = &batch->pages[i];
+        uint8_t *data = batch->buf + page->offset;
+
+        switch (page->type) {
+        case RAM_SAVE_FLAG_ZERO:
+            ram_handle_compressed(page->host, page->len, TARGET_PAGE_SIZE);
+            break;
+        case RAM_SAVE_FLAG_PAGE:
+            memcpy(page->host, data, TARGET_PAGE_SIZE);
+            break;
+        case RAM_SAVE_FLAG_XBZRLE:
+            if (xbzrle_decode_buffer(data, page->len, page->host,
+                                     TARGET_PAGE_SIZE) == -1) {
+                error_report("Failed to load XBZRLE page - decode error!");
+                return -EINVAL;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+static void *do_ram_load(void *opaque)
+{
+    RAMLoadParam *p = opaque;
+    RAMLoadBatch *batch;
+
+    qemu_mutex_lock(&p->mutex);
+    while (!p->quit) {
+        if (p->todo) {
+            batch = p->todo;
+            qemu_mutex_unlock(&p->mutex);
+
+            if (ram_load_batch(batch) < 0) {
+                qemu_file_set_error(ram_load_file, -EINVAL);
+            }
+            batch->num = 0;
+            batch->used = 0;
+
+            qemu_mutex_lock(&p->mutex);
+            p->todo = NULL;
+            qemu_cond_signal(&p->cond);
+        } else {
+            qemu_cond_wait(&p->cond, &p->mutex);
+        }
+    }
+    qemu_mutex_unlock(&p->mutex);
+
+    return NULL;
+}
+
+/* Hand the batch being filled to the thread */
+static void ram_load_threads_submit(RAMLoadParam *p)
+{
+    qemu_mutex_lock(&p->mutex);
+    while (p->todo) {
+        qemu_cond_wait(&p->cond, &p->mutex);
+    }
+    p->todo = &p->batch[p->fill];
+    p->fill ^= 1;
+    qemu_cond_signal(&p->cond);
+    qemu_mutex_unlock(&p->mutex);
+}
+
+/**
+ * ram_load_threads_queue: queue a page for the load threads
+ *
+ * @f: QEMUFile where to read the page data from
+ * @host: host address of the page
+ * @type: RAM_SAVE_FLAG_ZERO, RAM_SAVE_FLAG_PAGE or RAM_SAVE_FLAG_XBZRLE
+ * @len: length of the page data in the stream, or for zero pages the
+ *       fill byte
+ */
+static void ram_load_threads_queue(QEMUFile *f, void *host, int type,
+                                   uint32_t len)
+{
+    int idx = ((uintptr_t)host >> TARGET_PAGE_BITS) % ram_load_thread_count;
+    RAMLoadParam *p = &ram_load_param[idx];
+    RAMLoadBatch *batch = &p->batch[p->fill];
+    RAMLoadPage *page = &batch->pages[batch->num++];
+
+    page->host = host;
+    page->type = type;
+    page->len = len;
+    page->offset = batch->used;
+    if (type != RAM_SAVE_FLAG_ZERO) {
+        /* no page takes more than TARGET_PAGE_SIZE, so this always fits */
+        qemu_get_buffer(f, batch->buf + batch->used, len);
+        batch->used += len;
+    }
+
+    if (batch->num == RAM_LOAD_BATCH_PAGES) {
+        ram_load_threads_submit(p);
+    }
+}
+
+/* Wait until all queued pages are in guest memory */
+static int wait_for_ram_load_done(void)
+{
+    int i;
+
+    if (!ram_load_thread_count) {
+        return 0;
+    }
+
+    for (i = 0; i < ram_load_thread_count; i++) {
+        RAMLoadParam *p = &ram_load_param[i];
+
+        if (p->batch[p->fill].num) {
+            ram_load_threads_submit(p);
+        }
+    }
+    for (i = 0; i < ram_load_thread_count; i++) {
+        RAMLoadParam *p = &ram_load_param[i];
+
+        qemu_mutex_lock(&p->mutex);
+        while (p->todo) {
+            qemu_cond_wait(&p->cond, &p->mutex);
+        }
+        qemu_mutex_unlock(&p->mutex);
+    }
+    return qemu_file_get_error(ram_load_file);
+}
+
+static void ram_load_threads_cleanup(void)
+{
+    int i;
+
+    for (i = 0; i < ram_load_thread_count; i++) {
+        qemu_mutex_lock(&ram_load_param[i].mutex);
+        ram_load_param[i].quit = true;
+        qemu_cond_signal(&ram_load_param[i].cond);
+        qemu_mutex_unlock(&ram_load_param[i].mutex);
+    }
+    for (i = 0; i < ram_load_thread_count; i++) {
+        RAMLoadParam *p = &ram_load_param[i];
+
+        qemu_thread_join(&p->thread);
+        qemu_mutex_destroy(&p->mutex);
+        qemu_cond_destroy(&p->cond);
+        g_free(p->batch[0].buf);
+        g_free(p->batch[1].buf);
+    }
+    g_free(ram_load_param);
+    ram_load_param = NULL;
+    ram_load_thread_count = 0;
+    ram_load_file = NULL;
+}
+
+static void ram_load_threads_setup(QEMUFile *f)
+{
+    int i;
+
+    ram_load_thread_count = migrate_load_threads();
+    if (!ram_load_thread_count) {
+        return;
+    }
+
+    ram_load_param = g_new0(RAMLoadParam, ram_load_thread_count);
+    ram_load_file = f;
+    for (i = 0; i < ram_load_thread_count; i++) {
+        RAMLoadParam *p = &ram_load_param[i];
+
+        p->batch[0].buf = g_malloc(RAM_LOAD_BATCH_PAGES * TARGET_PAGE_SIZE);
+        p->batch[1].buf = g_malloc(RAM_LOAD_BATCH_PAGES * TARGET_PAGE_SIZE);
+        qemu_mutex_init(&p->mutex);
+        qemu_cond_init(&p->cond);
+        qemu_thread_create(&p->thread, "ramload", do_ram_load, p,
+                           QEMU_THREAD_JOINABLE);
+    }
+    trace_ram_load_threads_setup(ram_load_thread_count);
+}
+
+static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host,
+                       bool threaded)
 {
     unsigned int xh_len;
     int xh_flags;
@@ -2675,6 +3401,10 @@ static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
         error_report("Failed to load XBZRLE page - len overflow!");
         return -1;
     }
+    if (threaded) {
+        ram_load_threads_queue(f, host, RAM_SAVE_FLAG_XBZRLE, xh_len);
+        return 0;
+    }
     loaded_data = XBZRLE.decoded_buf;
     /* load data and decode */
     /* it can change loaded_data to point to an internal buffer */
@@ -3075,6 +3805,7 @@ static int ram_load_setup(QEMUFile *f, void *opaque)
         return -1;
     }
 
+    ram_load_threads_setup(f);
     xbzrle_load_setup();
     ramblock_recv_map_init();
 
@@ -3091,6 +3822,7 @@ static int ram_load_cleanup(void *opaque)
 
     xbzrle_load_cleanup();
     compress_threads_load_cleanup();
+    ram_load_threads_cleanup();
 
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
@@ -3373,6 +4105,7 @@ static int ram_load_precopy(QEMUFile *f)
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
         ram_addr_t addr, total_ram_bytes;
         void *host = NULL, *host_bak = NULL;
+        bool threaded = false;
         uint8_t ch;
 
         /*
@@ -3435,6 +4168,8 @@ static int ram_load_precopy(QEMUFile *f)
             if (!migration_incoming_in_colo_state()) {
                 ramblock_recv_bitmap_set(block, host);
             }
+            /* the backup copy below needs the page right away */
+            threaded = ram_load_thread_count && !host_bak;
 
             trace_ram_load_loop(block->idstr, (uint64_t)addr, flags, host);
         }
@@ -3443,6 +4178,16 @@ static int ram_load_precopy(QEMUFile *f)
         case RAM_SAVE_FLAG_MEM_SIZE:
             /* Synchronize RAM block list */
             total_ram_bytes = addr;
+            if (migrate_mapped_ram()) {
+                Error *local_err = NULL;
+
+                if (file_io_start(false, migrate_multifd_channels(),
+                                  &local_err)) {
+                    error_report_err(local_err);
+                    ret = -EINVAL;
+                    break;
+                }
+            }
             while (!ret && total_ram_bytes) {
                 RAMBlock *block;
                 char id[256];
@@ -3492,6 +4237,9 @@ static int ram_load_precopy(QEMUFile *f)
                     }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
+                    if (!ret && migrate_mapped_ram()) {
+                        ret = mapped_ram_load_block(f, block, length);
+                    }
                 } else {
                     error_report("Unknown ramblock \"%s\", cannot "
                                  "accept migration", id);
@@ -3500,15 +4248,34 @@ static int ram_load_precopy(QEMUFile *f)
 
                 total_ram_bytes -= length;
             }
+            if (migrate_mapped_ram()) {
+                int io_ret = file_io_sync();
+
+                if (io_ret && !ret) {
+                    error_report("mapped-ram: failed to read guest RAM: %s",
+                                 strerror(-io_ret));
+                    ret = io_ret;
+                }
+                file_io_finish();
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
             ch = qemu_get_byte(f);
-            ram_handle_compressed(host, ch, TARGET_PAGE_SIZE);
+            if (threaded) {
+                ram_load_threads_queue(f, host, RAM_SAVE_FLAG_ZERO, ch);
+            } else {
+                ram_handle_compressed(host, ch, TARGET_PAGE_SIZE);
+            }
             break;
 
         case RAM_SAVE_FLAG_PAGE:
-            qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+            if (threaded) {
+                ram_load_threads_queue(f, host, RAM_SAVE_FLAG_PAGE,
+                                       TARGET_PAGE_SIZE);
+            } else {
+                qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+            }
             break;
 
         case RAM_SAVE_FLAG_COMPRESS_PAGE:
@@ -3522,7 +4289,7 @@ static int ram_load_precopy(QEMUFile *f)
             break;
 
         case RAM_SAVE_FLAG_XBZRLE:
-            if (load_xbzrle(f, addr, host) < 0) {
+            if (load_xbzrle(f, addr, host, threaded) < 0) {
                 error_report("Failed to decompress XBZRLE page at "
                              RAM_ADDR_FMT, addr);
                 ret = -EINVAL;
@@ -3551,6 +4318,7 @@ static int ram_load_precopy(QEMUFile *f)
     }
 
     ret |= wait_for_decompress_done();
+    ret |= wait_for_ram_load_done();
     return ret;
 }
 
@@ -3754,6 +4522,11 @@ static SaveVMHandlers savevm_ram_handlers = {
 
 void ram_mig_init(void)
 {
+    int i;
+
     qemu_mutex_init(&XBZRLE.lock);
+    for (i = 0; i < XBZRLE_PAGE_LOCKS; i++) {
+        qemu_mutex_init(&XBZRLE.page_lock[i]);
+    }
     register_savevm_live("ram", 0, 4, &savevm_ram_handlers, &ram_state);
 }
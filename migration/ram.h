@@ -38,11 +38,17 @@ extern XBZRLECacheStats xbzrle_counters;
 extern CompressionStats compression_counters;
 
 int xbzrle_cache_resize(int64_t new_size, Error **errp);
+int xbzrle_encode_multifd_page(ram_addr_t addr, uint8_t *page,
+                               uint8_t *encoded, uint64_t age,
+                               bool *cache_miss);
+void xbzrle_cache_zero_multifd_page(ram_addr_t addr, uint64_t age);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
+uint64_t ram_mapped_ram_bytes(void);
 
 uint64_t ram_pagesize_summary(void);
-int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len);
+int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
+                         bool prefetch);
 void acct_update_position(QEMUFile *f, size_t size, bool zero);
 void ram_debug_dump_bitmap(unsigned long *todump, bool expected,
                            unsigned long pages);
@@ -63,6 +63,8 @@
 #include "migration/colo.h"
 #include "qemu/bitmap.h"
 #include "net/announce.h"
+#include "checkpoint.h"
+#include "timeline.h"
 
 const unsigned int postcopy_ram_discard_version = 0;
 
@@ -1318,10 +1320,19 @@ void qemu_savevm_state_complete_postcopy(QEMUFile *f)
     qemu_fflush(f);
 }
 
+static void savevm_timeline_add_device(SaveStateEntry *se, int64_t start)
+{
+    g_autofree char *name = g_strdup_printf("%s/%" PRIu32, se->idstr,
+                                            se->instance_id);
+
+    migration_timeline_add(MIGRATION_TIMELINE_KIND_DEVICE, name, start);
+}
+
 static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
     SaveStateEntry *se;
+    int64_t start;
     int ret;
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
@@ -1341,7 +1352,9 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 
         save_section_header(f, se, QEMU_VM_SECTION_END);
 
+        start = migration_timeline_now();
         ret = se->ops->save_live_complete_precopy(f, se->opaque);
+        savevm_timeline_add_device(se, start);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
         save_section_footer(f, se);
         if (ret < 0) {
@@ -1353,16 +1366,63 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     return 0;
 }
 
+/* number of devices reported in query-migrate's device-downtime */
+#define DEVICE_DOWNTIME_MAX 10
+
+/*
+ * Keep the DEVICE_DOWNTIME_MAX slowest devices of the migration's
+ * downtime in @ms, sorted by time.  Called with the BQL held.
+ */
+static void savevm_record_device_downtime(MigrationState *ms,
+                                          SaveStateEntry *se, int64_t time)
+{
+    DeviceDowntimeList **prev = &ms->device_downtime;
+    DeviceDowntimeList *entry;
+    int n = 0;
+
+    while (*prev && (*prev)->value->time >= time) {
+        prev = &(*prev)->next;
+        if (++n == DEVICE_DOWNTIME_MAX) {
+            return;
+        }
+    }
+
+    entry = g_new0(DeviceDowntimeList, 1);
+    entry->value = g_new0(DeviceDowntime, 1);
+    entry->value->name = g_strdup(se->idstr);
+    entry->value->instance_id = se->instance_id;
+    entry->value->time = time;
+    entry->next = *prev;
+    *prev = entry;
+
+    /* drop whatever fell off the end */
+    for (n = 0, prev = &ms->device_downtime; *prev; prev = &(*prev)->next) {
+        if (++n == DEVICE_DOWNTIME_MAX) {
+            qapi_free_DeviceDowntimeList((*prev)->next);
+            (*prev)->next = NULL;
+            break;
+        }
+    }
+}
+
 static
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
+    MigrationState *ms = migrate_get_current();
+    bool record_downtime = migration_is_setup_or_active(ms->state);
     g_autoptr(QJSON) vmdesc = NULL;
     int vmdesc_len;
     SaveStateEntry *se;
+    int64_t start;
     int ret;
 
+    if (record_downtime) {
+        qapi_free_DeviceDowntimeList(ms->device_downtime);
+        ms->device_downtime = NULL;
+    }
+
     vmdesc = qjson_new();
     json_prop_int(vmdesc, "page_size", qemu_target_page_size());
     json_start_array(vmdesc, "devices");
@@ -1383,11 +1443,17 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         json_prop_int(vmdesc, "instance_id", se->instance_id);
 
         save_section_header(f, se, QEMU_VM_SECTION_FULL);
+        start = migration_timeline_now();
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
             qemu_file_set_error(f, ret);
             return ret;
         }
+        if (record_downtime) {
+            savevm_record_device_downtime(ms, se,
+                                          migration_timeline_now() - start);
+        }
+        savevm_timeline_add_device(se, start);
         trace_savevm_section_end(se->idstr, se->section_id, 0);
         save_section_footer(f, se);
 
@@ -1397,7 +1463,10 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     if (inactivate_disks) {
         /* Inactivate before sending QEMU_VM_EOF so that the
          * bdrv_invalidate_cache_all() on the other end won't fail. */
+        start = migration_timeline_now();
         ret = bdrv_inactivate_all();
+        migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE,
+                               "block-inactivate", start);
         if (ret) {
             error_report("%s: bdrv_inactivate_all() failed (%d)",
                          __func__, ret);
@@ -1429,6 +1498,7 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     int ret;
     Error *local_err = NULL;
     bool in_postcopy = migration_in_postcopy();
+    int64_t start;
 
     if (precopy_notify(PRECOPY_NOTIFY_COMPLETE, &local_err)) {
         error_report_err(local_err);
@@ -1456,7 +1526,9 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     }
 
 flush:
+    start = migration_timeline_now();
     qemu_fflush(f);
+    migration_timeline_add(MIGRATION_TIMELINE_KIND_STAGE, "flush", start);
     return 0;
 }
 
@@ -2646,6 +2718,11 @@ int save_snapshot(const char *name, Error **errp)
         return ret;
     }
 
+    if (checkpoint_exists()) {
+        error_setg(errp, "An in-memory checkpoint exists, delete it first");
+        return ret;
+    }
+
     if (!bdrv_all_can_snapshot(&bs)) {
         error_setg(errp, "Device '%s' is writable but does not support "
                    "snapshots", bdrv_get_device_name(bs));
@@ -2843,6 +2920,12 @@ int load_snapshot(const char *name, Error **errp)
         return -EINVAL;
     }
 
+    /* the checkpoint would not see the pages written by the load */
+    if (checkpoint_exists()) {
+        error_setg(errp, "An in-memory checkpoint exists, delete it first");
+        return -EINVAL;
+    }
+
     if (!bdrv_all_can_snapshot(&bs)) {
         error_setg(errp,
                    "Device '%s' is writable but does not support snapshots",
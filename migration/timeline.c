@@ -0,0 +1,164 @@
+/*
+ * Migration timeline
+ *
+ * The total downtime of a migration says little about what the time was
+ * spent on.  This records when each stage of the completion started and
+ * how long it took, along with the time spent on each device, each dirty
+ * bitmap sync, and throughput samples taken while RAM is sent, so that
+ * query-migrate-timeline can show them on a common time axis.
+ *
+ * Only the latest MIGRATION_TIMELINE_SIZE events and samples are kept:
+ * the end of the migration is what matters most for the downtime.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "migration.h"
+#include "timeline.h"
+#include "trace.h"
+
+#define MIGRATION_TIMELINE_SIZE 4096
+
+typedef struct TimelineEvent {
+    MigrationTimelineKind kind;
+    char *name;
+    int64_t start;
+    int64_t duration;
+} TimelineEvent;
+
+typedef struct TimelineSample {
+    int64_t time;
+    uint64_t bytes;
+    double mbps;
+} TimelineSample;
+
+static struct {
+    QemuMutex lock;
+    /* the migration started at this time, all times are relative to it */
+    int64_t start;
+    /* rings of the latest events and samples */
+    TimelineEvent events[MIGRATION_TIMELINE_SIZE];
+    TimelineSample samples[MIGRATION_TIMELINE_SIZE];
+    uint64_t nr_events;
+    uint64_t nr_samples;
+} timeline;
+
+static void __attribute__((constructor)) migration_timeline_init(void)
+{
+    qemu_mutex_init(&timeline.lock);
+}
+
+int64_t migration_timeline_now(void)
+{
+    return qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+}
+
+void migration_timeline_reset(void)
+{
+    int i;
+
+    qemu_mutex_lock(&timeline.lock);
+    for (i = 0; i < MIGRATION_TIMELINE_SIZE; i++) {
+        g_free(timeline.events[i].name);
+        timeline.events[i].name = NULL;
+    }
+    timeline.nr_events = 0;
+    timeline.nr_samples = 0;
+    timeline.start = migration_timeline_now();
+    qemu_mutex_unlock(&timeline.lock);
+}
+
+static bool migration_timeline_active(void)
+{
+    return migration_is_setup_or_active(migrate_get_current()->state);
+}
+
+void migration_timeline_add(MigrationTimelineKind kind, const char *name,
+                            int64_t start)
+{
+    int64_t duration = migration_timeline_now() - start;
+    TimelineEvent *ev;
+
+    if (!migration_timeline_active()) {
+        return;
+    }
+
+    qemu_mutex_lock(&timeline.lock);
+    ev = &timeline.events[timeline.nr_events++ % MIGRATION_TIMELINE_SIZE];
+    g_free(ev->name);
+    ev->kind = kind;
+    ev->name = g_strdup(name);
+    ev->start = start - timeline.start;
+    ev->duration = duration;
+    trace_migration_timeline_event(MigrationTimelineKind_str(kind), name,
+                                   ev->start, duration);
+    qemu_mutex_unlock(&timeline.lock);
+}
+
+void migration_timeline_throughput(uint64_t bytes, double mbps)
+{
+    TimelineSample *sample;
+
+    if (!migration_timeline_active()) {
+        return;
+    }
+
+    qemu_mutex_lock(&timeline.lock);
+    sample = &timeline.samples[timeline.nr_samples++ %
+                               MIGRATION_TIMELINE_SIZE];
+    sample->time = migration_timeline_now() - timeline.start;
+    sample->bytes = bytes;
+    sample->mbps = mbps;
+    trace_migration_timeline_throughput(sample->time, bytes, mbps);
+    qemu_mutex_unlock(&timeline.lock);
+}
+
+MigrationTimeline *qmp_query_migrate_timeline(Error **errp)
+{
+    MigrationTimeline *info = g_new0(MigrationTimeline, 1);
+    MigrationTimelineEventList **next_event = &info->events;
+    MigrationThroughputSampleList **next_sample = &info->throughput;
+    uint64_t i;
+
+    qemu_mutex_lock(&timeline.lock);
+    i = timeline.nr_events > MIGRATION_TIMELINE_SIZE ?
+        timeline.nr_events - MIGRATION_TIMELINE_SIZE : 0;
+    info->dropped = i;
+    for (; i < timeline.nr_events; i++) {
+        TimelineEvent *ev = &timeline.events[i % MIGRATION_TIMELINE_SIZE];
+        MigrationTimelineEvent *value = g_new0(MigrationTimelineEvent, 1);
+
+        value->kind = ev->kind;
+        value->name = g_strdup(ev->name);
+        value->start = ev->start;
+        value->duration = ev->duration;
+        *next_event = g_new0(MigrationTimelineEventList, 1);
+        (*next_event)->value = value;
+        next_event = &(*next_event)->next;
+    }
+
+    i = timeline.nr_samples > MIGRATION_TIMELINE_SIZE ?
+        timeline.nr_samples - MIGRATION_TIMELINE_SIZE : 0;
+    info->dropped += i;
+    for (; i < timeline.nr_samples; i++) {
+        TimelineSample *sample =
+            &timeline.samples[i % MIGRATION_TIMELINE_SIZE];
+        MigrationThroughputSample *value = g_new0(MigrationThroughputSample, 1);
+
+        value->time = sample->time;
+        value->bytes = sample->bytes;
+        value->mbps = sample->mbps;
+        *next_sample = g_new0(MigrationThroughputSampleList, 1);
+        (*next_sample)->value = value;
+        next_sample = &(*next_sample)->next;
+    }
+    qemu_mutex_unlock(&timeline.lock);
+
+    return info;
+}
@@ -0,0 +1,39 @@
+/*
+ * Migration timeline
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_TIMELINE_H
+#define QEMU_MIGRATION_TIMELINE_H
+
+#include "qapi/qapi-types-migration.h"
+
+/* Forget the events of the previous migration */
+void migration_timeline_reset(void);
+
+/* Current time in microseconds, to be passed to migration_timeline_add() */
+int64_t migration_timeline_now(void);
+
+/**
+ * migration_timeline_add: record something that just finished
+ *
+ * Nothing is recorded unless an outgoing migration is running.
+ *
+ * @kind: what finished
+ * @name: name of the stage or device
+ * @start: when it started, as returned by migration_timeline_now()
+ */
+void migration_timeline_add(MigrationTimelineKind kind, const char *name,
+                            int64_t start);
+
+/**
+ * migration_timeline_throughput: record a throughput sample
+ *
+ * @bytes: bytes transferred since the migration started
+ * @mbps: throughput since the last sample, in Mbps
+ */
+void migration_timeline_throughput(uint64_t bytes, double mbps);
+
+#endif
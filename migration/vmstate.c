@@ -16,7 +16,12 @@
 #include "savevm.h"
 #include "qemu-file.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
 #include "trace.h"
 #include "qjson.h"
 
@@ -75,6 +80,295 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+static int vmstate_load_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              int version_id)
+{
+    int ret = 0;
+
+    trace_vmstate_load_state_field(vmsd->name, field->name);
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+
+        vmstate_handle_alloc(first_elem, field, opaque);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer check placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->vmsd->version_id);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->struct_version_id);
+            } else {
+                ret = field->info->get(f, curr_elem, size, field);
+            }
+            if (ret >= 0) {
+                ret = qemu_file_get_error(f);
+            }
+            if (ret < 0) {
+                qemu_file_set_error(f, ret);
+                error_report("Failed to load %s:%s", vmsd->name,
+                             field->name);
+                trace_vmstate_load_field_error(field->name, ret);
+                return ret;
+            }
+        }
+    } else if (field->flags & VMS_MUST_EXIST) {
+        error_report("Input validation failed: %s/%s",
+                     vmsd->name, field->name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Compiled field lists
+ *
+ * Most fields are integers or byte buffers at a fixed offset, and going
+ * through the interpreter and an info callback for each of them is what
+ * makes saving the device state slow for machines with many devices.
+ * The first time a description is saved or loaded at its own version,
+ * its fields are compiled into a list of runs: fields of the same
+ * element size that sit next to each other in memory are merged into a
+ * single run, which is byte swapped and copied in one go.  Everything
+ * else (pointers, structs, callbacks, field_exists) is left to the
+ * interpreter.  The stream format does not change.
+ */
+
+/* bytes byte swapped at a time */
+#define VMSTATE_RUN_CHUNK 256
+
+typedef struct VMStateRun {
+    /* first field of the run, or the field left to the interpreter */
+    const VMStateField *field;
+    /* number of fields merged into the run, 0 for the interpreter */
+    int nr_fields;
+    size_t offset;
+    size_t len;
+    /* element size: 1, 2, 4 or 8 */
+    int width;
+} VMStateRun;
+
+/* the key of a program is everything it was compiled from */
+typedef struct VMStateProgram {
+    const VMStateDescription *vmsd;
+    const VMStateField *fields;
+    int version_id;
+    int nr_runs;
+    VMStateRun runs[];
+} VMStateProgram;
+
+/*
+ * Programs are looked up for every struct that is saved or loaded,
+ * including each element of a VMS_STRUCT array, so lookups must be
+ * cheap: they go through a QHT and take no lock.  Programs are never
+ * removed, so a pointer that was found stays valid.
+ */
+static struct qht vmstate_programs;
+
+static bool vmstate_program_cmp(const void *a, const void *b)
+{
+    const VMStateProgram *pa = a;
+    const VMStateProgram *pb = b;
+
+    return pa->vmsd == pb->vmsd && pa->fields == pb->fields &&
+           pa->version_id == pb->version_id;
+}
+
+static bool vmstate_program_lookup_cmp(const void *obj, const void *userp)
+{
+    const VMStateProgram *prog = obj;
+    const VMStateDescription *vmsd = userp;
+
+    return prog->vmsd == vmsd && prog->fields == vmsd->fields &&
+           prog->version_id == vmsd->version_id;
+}
+
+static void __attribute__((constructor)) vmstate_program_init(void)
+{
+    qht_init(&vmstate_programs, vmstate_program_cmp, 1 << 10,
+             QHT_MODE_AUTO_RESIZE);
+}
+
+/* Element size of a field that can be part of a run, 0 otherwise */
+static int vmstate_field_width(const VMStateDescription *vmsd,
+                               const VMStateField *field)
+{
+    const VMStateInfo *info = field->info;
+    int width;
+
+    if (field->field_exists || field->version_id > vmsd->version_id ||
+        (field->flags & ~(VMS_SINGLE | VMS_ARRAY | VMS_BUFFER |
+                          VMS_MUST_EXIST))) {
+        return 0;
+    }
+
+    if (info == &vmstate_info_buffer) {
+        return 1;
+    } else if (info == &vmstate_info_uint8 || info == &vmstate_info_int8) {
+        width = 1;
+    } else if (info == &vmstate_info_uint16 || info == &vmstate_info_int16) {
+        width = 2;
+    } else if (info == &vmstate_info_uint32 || info == &vmstate_info_int32) {
+        width = 4;
+    } else if (info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+        width = 8;
+    } else {
+        return 0;
+    }
+
+    return field->size == width ? width : 0;
+}
+
+static VMStateProgram *vmstate_compile(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    VMStateProgram *prog;
+    VMStateRun *run = NULL;
+    int n = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        n++;
+    }
+    prog = g_malloc0(sizeof(*prog) + n * sizeof(VMStateRun));
+    prog->vmsd = vmsd;
+    prog->fields = vmsd->fields;
+    prog->version_id = vmsd->version_id;
+
+    for (field = vmsd->fields; field->name; field++) {
+        int width = vmstate_field_width(vmsd, field);
+        size_t len = field->size;
+
+        if (field->flags & VMS_ARRAY) {
+            len *= field->num;
+        }
+        if (!width || !len) {
+            run = &prog->runs[prog->nr_runs++];
+            run->field = field;
+            run = NULL;
+            continue;
+        }
+
+        if (run && run->width == width &&
+            run->offset + run->len == field->offset) {
+            run->nr_fields++;
+            run->len += len;
+            continue;
+        }
+
+        run = &prog->runs[prog->nr_runs++];
+        run->field = field;
+        run->nr_fields = 1;
+        run->offset = field->offset;
+        run->len = len;
+        run->width = width;
+    }
+
+    trace_vmstate_compile(vmsd->name, n, prog->nr_runs);
+    return prog;
+}
+
+static const VMStateProgram *vmstate_get_program(const VMStateDescription *vmsd)
+{
+    uint32_t hash = qemu_xxhash5((uintptr_t)vmsd, (uintptr_t)vmsd->fields,
+                                 vmsd->version_id);
+    VMStateProgram *prog;
+    void *existing = NULL;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        prog = qht_lookup_custom(&vmstate_programs, vmsd, hash,
+                                 vmstate_program_lookup_cmp);
+    }
+    if (likely(prog)) {
+        return prog;
+    }
+
+    /* if another thread compiled it in the meantime, use theirs */
+    prog = vmstate_compile(vmsd);
+    if (!qht_insert(&vmstate_programs, prog, hash, &existing)) {
+        g_free(prog);
+        prog = existing;
+    }
+    return prog;
+}
+
+static int vmstate_load_run(QEMUFile *f, const VMStateRun *run, void *opaque)
+{
+    uint8_t *dst = opaque + run->offset;
+    uint8_t buf[VMSTATE_RUN_CHUNK];
+    size_t done, i, n;
+
+    if (run->width == 1) {
+        qemu_get_buffer(f, dst, run->len);
+        return qemu_file_get_error(f);
+    }
+
+    for (done = 0; done < run->len; done += n) {
+        n = MIN(run->len - done, sizeof(buf));
+        if (qemu_get_buffer(f, buf, n) != n) {
+            break;
+        }
+        for (i = 0; i < n; i += run->width) {
+            switch (run->width) {
+            case 2:
+                stw_he_p(dst + done + i, lduw_be_p(buf + i));
+                break;
+            case 4:
+                stl_he_p(dst + done + i, ldl_be_p(buf + i));
+                break;
+            case 8:
+                stq_he_p(dst + done + i, ldq_be_p(buf + i));
+                break;
+            }
+        }
+    }
+    return qemu_file_get_error(f);
+}
+
+static int vmstate_load_program(QEMUFile *f, const VMStateDescription *vmsd,
+                                void *opaque)
+{
+    const VMStateProgram *prog = vmstate_get_program(vmsd);
+    int i, ret;
+
+    for (i = 0; i < prog->nr_runs; i++) {
+        const VMStateRun *run = &prog->runs[i];
+
+        if (!run->nr_fields) {
+            ret = vmstate_load_field(f, vmsd, run->field, opaque,
+                                     vmsd->version_id);
+        } else {
+            ret = vmstate_load_run(f, run, opaque);
+            if (ret < 0) {
+                error_report("Failed to load %s:%s", vmsd->name,
+                             run->field->name);
+                trace_vmstate_load_field_error(run->field->name, ret);
+            }
+        }
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
@@ -108,57 +402,19 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             return ret;
         }
     }
-    while (field->name) {
-        trace_vmstate_load_state_field(vmsd->name, field->name);
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-
-            vmstate_handle_alloc(first_elem, field, opaque);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer check placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->vmsd->version_id);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->struct_version_id);
-                } else {
-                    ret = field->info->get(f, curr_elem, size, field);
-                }
-                if (ret >= 0) {
-                    ret = qemu_file_get_error(f);
-                }
-                if (ret < 0) {
-                    qemu_file_set_error(f, ret);
-                    error_report("Failed to load %s:%s", vmsd->name,
-                                 field->name);
-                    trace_vmstate_load_field_error(field->name, ret);
-                    return ret;
-                }
+    if (version_id == vmsd->version_id) {
+        ret = vmstate_load_program(f, vmsd, opaque);
+        if (ret) {
+            return ret;
+        }
+    } else {
+        while (field->name) {
+            ret = vmstate_load_field(f, vmsd, field, opaque, version_id);
+            if (ret) {
+                return ret;
             }
-        } else if (field->flags & VMS_MUST_EXIST) {
-            error_report("Input validation failed: %s/%s",
-                         vmsd->name, field->name);
-            return -1;
+            field++;
         }
-        field++;
     }
     ret = vmstate_subsection_load(f, vmsd, opaque);
     if (ret != 0) {
@@ -315,6 +571,146 @@ bool vmstate_save_needed(const VMStateDescription *vmsd, void *opaque)
 }
 
 
+static int vmstate_save_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              QJSON *vmdesc, int version_id)
+{
+    int ret = 0;
+
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+        int64_t old_offset, written_bytes;
+        QJSON *vmdesc_loop = vmdesc;
+
+        trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
+            old_offset = qemu_ftell_fast(f);
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                assert(curr_elem);
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer write placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
+                                               NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_save_state(f, field->vmsd, curr_elem,
+                                         vmdesc_loop);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
+                                           vmdesc_loop,
+                                           field->struct_version_id);
+            } else {
+                ret = field->info->put(f, curr_elem, size, field,
+                                 vmdesc_loop);
+            }
+            if (ret) {
+                error_report("Save of field %s/%s failed",
+                             vmsd->name, field->name);
+                return ret;
+            }
+
+            written_bytes = qemu_ftell_fast(f) - old_offset;
+            vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
+
+            /* Compressed arrays only care about the first element */
+            if (vmdesc_loop && vmsd_can_compress(field)) {
+                vmdesc_loop = NULL;
+            }
+        }
+    } else {
+        if (field->flags & VMS_MUST_EXIST) {
+            error_report("Output state validation failed: %s/%s",
+                    vmsd->name, field->name);
+            assert(!(field->flags & VMS_MUST_EXIST));
+        }
+    }
+    return 0;
+}
+
+static void vmstate_save_run(QEMUFile *f, const VMStateRun *run, void *opaque)
+{
+    uint8_t *src = opaque + run->offset;
+    uint8_t buf[VMSTATE_RUN_CHUNK];
+    size_t done, i, n;
+
+    if (run->width == 1) {
+        qemu_put_buffer(f, src, run->len);
+        return;
+    }
+
+    for (done = 0; done < run->len; done += n) {
+        n = MIN(run->len - done, sizeof(buf));
+        for (i = 0; i < n; i += run->width) {
+            switch (run->width) {
+            case 2:
+                stw_be_p(buf + i, lduw_he_p(src + done + i));
+                break;
+            case 4:
+                stl_be_p(buf + i, ldl_he_p(src + done + i));
+                break;
+            case 8:
+                stq_be_p(buf + i, ldq_he_p(src + done + i));
+                break;
+            }
+        }
+        qemu_put_buffer(f, buf, n);
+    }
+}
+
+/* Describe the fields of a run as the interpreter would have done */
+static void vmstate_desc_run(const VMStateDescription *vmsd, QJSON *vmdesc,
+                             const VMStateRun *run)
+{
+    const VMStateField *field = run->field;
+    int i;
+
+    for (i = 0; i < run->nr_fields; i++, field++) {
+        int n_elems = field->flags & VMS_ARRAY ? field->num : 1;
+
+        vmsd_desc_field_start(vmsd, vmdesc, field, 0, n_elems);
+        vmsd_desc_field_end(vmsd, vmdesc, field, field->size, 0);
+    }
+}
+
+static int vmstate_save_program(QEMUFile *f, const VMStateDescription *vmsd,
+                                void *opaque, QJSON *vmdesc)
+{
+    const VMStateProgram *prog = vmstate_get_program(vmsd);
+    int i, ret;
+
+    for (i = 0; i < prog->nr_runs; i++) {
+        const VMStateRun *run = &prog->runs[i];
+
+        if (!run->nr_fields) {
+            ret = vmstate_save_field(f, vmsd, run->field, opaque, vmdesc,
+                                     vmsd->version_id);
+            if (ret) {
+                return ret;
+            }
+        } else {
+            vmstate_save_run(f, run, opaque);
+            if (vmdesc) {
+                vmstate_desc_run(vmsd, vmdesc, run);
+            }
+        }
+    }
+    return 0;
+}
+
 int vmstate_save_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, QJSON *vmdesc_id)
 {
@@ -344,72 +740,23 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
         json_start_array(vmdesc, "fields");
     }
 
-    while (field->name) {
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-            int64_t old_offset, written_bytes;
-            QJSON *vmdesc_loop = vmdesc;
-
-            trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
-                old_offset = qemu_ftell_fast(f);
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    assert(curr_elem);
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer write placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
-                                                   NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_save_state(f, field->vmsd, curr_elem,
-                                             vmdesc_loop);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
-                                               vmdesc_loop,
-                                               field->struct_version_id);
-                } else {
-                    ret = field->info->put(f, curr_elem, size, field,
-                                     vmdesc_loop);
-                }
-                if (ret) {
-                    error_report("Save of field %s/%s failed",
-                                 vmsd->name, field->name);
-                    if (vmsd->post_save) {
-                        vmsd->post_save(opaque);
-                    }
-                    return ret;
-                }
-
-                written_bytes = qemu_ftell_fast(f) - old_offset;
-                vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
-
-                /* Compressed arrays only care about the first element */
-                if (vmdesc_loop && vmsd_can_compress(field)) {
-                    vmdesc_loop = NULL;
-                }
-            }
-        } else {
-            if (field->flags & VMS_MUST_EXIST) {
-                error_report("Output state validation failed: %s/%s",
-                        vmsd->name, field->name);
-                assert(!(field->flags & VMS_MUST_EXIST));
+    if (version_id == vmsd->version_id) {
+        ret = vmstate_save_program(f, vmsd, opaque, vmdesc);
+    } else {
+        while (field->name) {
+            ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc,
+                                     version_id);
+            if (ret) {
+                break;
             }
+            field++;
         }
-        field++;
+    }
+    if (ret) {
+        if (vmsd->post_save) {
+            vmsd->post_save(opaque);
+        }
+        return ret;
     }
 
     if (vmdesc) {
@@ -17,5 +17,15 @@
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
 
+/* The plain C encoder, which the accelerated ones must match */
+int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                             uint8_t *dst, int dlen);
+
+/*
+ * Switch xbzrle_encode_buffer to the next slower implementation.
+ * Returns false once the plain C encoder is in use.  Only for tests.
+ */
+bool test_xbzrle_next_accel(void);
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 #endif
@@ -340,6 +340,38 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+
+    if (info->has_postcopy_fault_latency) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->postcopy_fault_latency, NULL);
+        visit_complete(v, &str);
+        monitor_printf(mon, "postcopy fault latency (log2 us): %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
+
+    if (info->has_vcpu_throttle_percentage) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_intList(v, NULL, &info->vcpu_throttle_percentage, NULL);
+        visit_complete(v, &str);
+        monitor_printf(mon, "vcpu throttle percentage: %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
+    if (info->has_device_downtime) {
+        DeviceDowntimeList *dev;
+
+        monitor_printf(mon, "device downtime:\n");
+        for (dev = info->device_downtime; dev; dev = dev->next) {
+            monitor_printf(mon, "\t%s/%" PRIu32 ": %" PRId64 " us\n",
+                           dev->value->name, dev->value->instance_id,
+                           dev->value->time);
+        }
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -423,6 +455,14 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %u\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MAX_CPU_THROTTLE),
             params->max_cpu_throttle);
+        assert(params->has_vcpu_dirty_limit);
+        monitor_printf(mon, "%s: %" PRIu64 " MB/s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT),
+            params->vcpu_dirty_limit);
+        assert(params->has_load_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_LOAD_THREADS),
+            params->load_threads);
         assert(params->has_tls_creds);
         monitor_printf(mon, "%s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_CREDS),
@@ -453,6 +493,13 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_COMPRESSION),
             MultiFDCompression_str(params->multifd_compression));
+        monitor_printf(mon, "%s: %" PRIu64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_ZSTD_DICT_SIZE),
+            params->multifd_zstd_dict_size);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(
+                MIGRATION_PARAMETER_MULTIFD_COMPRESSION_CPU_BUDGET),
+            params->multifd_compression_cpu_budget);
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -1275,6 +1322,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_max_cpu_throttle = true;
         visit_type_int(v, param, &p->max_cpu_throttle, &err);
         break;
+    case MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT:
+        p->has_vcpu_dirty_limit = true;
+        visit_type_uint64(v, param, &p->vcpu_dirty_limit, &err);
+        break;
+    case MIGRATION_PARAMETER_LOAD_THREADS:
+        p->has_load_threads = true;
+        visit_type_int(v, param, &p->load_threads, &err);
+        break;
     case MIGRATION_PARAMETER_TLS_CREDS:
         p->has_tls_creds = true;
         p->tls_creds = g_new0(StrOrNull, 1);
@@ -1339,6 +1394,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_multifd_zstd_level = true;
         visit_type_int(v, param, &p->multifd_zstd_level, &err);
         break;
+    case MIGRATION_PARAMETER_MULTIFD_ZSTD_DICT_SIZE:
+        p->has_multifd_zstd_dict_size = true;
+        visit_type_size(v, param, &p->multifd_zstd_dict_size, &err);
+        break;
+    case MIGRATION_PARAMETER_MULTIFD_COMPRESSION_CPU_BUDGET:
+        p->has_multifd_compression_cpu_budget = true;
+        visit_type_int(v, param, &p->multifd_compression_cpu_budget, &err);
+        break;
     case MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE:
         p->has_xbzrle_cache_size = true;
         visit_type_size(v, param, &cache_size, &err);
@@ -347,6 +347,7 @@ static void hmp_info_jit(Monitor *mon, const QDict *qdict)
 
     dump_exec_info();
     dump_drift_info();
+    dump_halt_poll_info();
 }
 
 static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
@@ -41,6 +41,7 @@
 #include "tcg/tcg.h"
 #include "exec/exec-all.h"
 #include "disas/disas.h"
+#include "exec/gdbstub.h"
 #include "plugin.h"
 #ifndef CONFIG_USER_ONLY
 #include "qemu/plugin-memory.h"
@@ -95,6 +96,26 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
     plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr, imm);
 }
 
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm)
+{
+    plugin_register_inline_op_on_entry(&tb->cbs[PLUGIN_CB_INLINE], 0, op,
+                                       entry, imm);
+}
+
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *udata)
+{
+    plugin_register_dyn_cond_cb__udata(&tb->cbs[PLUGIN_CB_INLINE], cb, flags,
+                                       cond, entry, imm, udata);
+}
+
 void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             qemu_plugin_vcpu_udata_cb_t cb,
                                             enum qemu_plugin_cb_flags flags,
@@ -112,6 +133,24 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                               0, op, ptr, imm);
 }
 
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm)
+{
+    plugin_register_inline_op_on_entry(
+        &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE], 0, op, entry, imm);
+}
+
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn, qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags, enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry, uint64_t imm, void *udata)
+{
+    plugin_register_dyn_cond_cb__udata(
+        &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE], cb, flags, cond,
+        entry, imm, udata);
+}
+
 
 
 void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
@@ -133,6 +172,14 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
         rw, op, ptr, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op, qemu_plugin_u64 entry, uint64_t imm)
+{
+    plugin_register_inline_op_on_entry(
+        &insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE], rw, op, entry, imm);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -220,6 +267,100 @@ char *qemu_plugin_insn_disas(const struct qemu_plugin_insn *insn)
     return plugin_disas(cpu, insn->vaddr, insn->data->len);
 }
 
+/*
+ * Register and memory access
+ *
+ * Registers are identified by their gdb number; handles are that
+ * number plus one so that a NULL handle is never valid.
+ */
+
+struct plugin_reg_list {
+    qemu_plugin_reg_descriptor *descs;
+    int max;
+    int n;
+};
+
+static void plugin_add_reg_desc(int regnum, const char *name,
+                                const char *feature, void *opaque)
+{
+    struct plugin_reg_list *list = opaque;
+
+    if (list->n < list->max) {
+        qemu_plugin_reg_descriptor *desc = &list->descs[list->n];
+
+        desc->handle = GINT_TO_POINTER(regnum + 1);
+        desc->name = g_intern_string(name);
+        desc->feature = g_intern_string(feature);
+    }
+    list->n++;
+}
+
+int qemu_plugin_get_registers(unsigned int vcpu_index,
+                              qemu_plugin_reg_descriptor *descs, int max)
+{
+    CPUState *cpu = qemu_get_cpu(vcpu_index);
+    struct plugin_reg_list list = {
+        .descs = descs,
+        .max = max,
+    };
+
+    if (cpu == NULL) {
+        return 0;
+    }
+    gdb_foreach_register(cpu, plugin_add_reg_desc, &list);
+    return list.n;
+}
+
+/* scratch space for register reads, to avoid an allocation per call */
+static __thread GByteArray *plugin_reg_buf;
+
+int qemu_plugin_read_registers(struct qemu_plugin_register *const *handles,
+                               int n, void *buf, size_t buf_size, int *sizes)
+{
+    CPUState *cpu = current_cpu;
+    int i;
+
+    g_assert(cpu);
+    if (unlikely(plugin_reg_buf == NULL)) {
+        plugin_reg_buf = g_byte_array_new();
+    }
+    g_byte_array_set_size(plugin_reg_buf, 0);
+
+    for (i = 0; i < n; i++) {
+        int regnum = GPOINTER_TO_INT(handles[i]) - 1;
+        int size;
+
+        if (regnum < 0 || regnum >= cpu->gdb_num_regs) {
+            return -1;
+        }
+        size = gdb_read_register(cpu, plugin_reg_buf, regnum);
+        if (size <= 0) {
+            return -1;
+        }
+        if (sizes) {
+            sizes[i] = size;
+        }
+    }
+
+    if (plugin_reg_buf->len > buf_size) {
+        return -1;
+    }
+    memcpy(buf, plugin_reg_buf->data, plugin_reg_buf->len);
+    return plugin_reg_buf->len;
+}
+
+int qemu_plugin_read_register(struct qemu_plugin_register *handle,
+                              void *buf, size_t buf_size)
+{
+    return qemu_plugin_read_registers(&handle, 1, buf, buf_size, NULL);
+}
+
+bool qemu_plugin_read_memory_vaddr(uint64_t vaddr, void *buf, size_t len)
+{
+    g_assert(current_cpu);
+    return cpu_memory_rw_debug(current_cpu, vaddr, buf, len, 0) == 0;
+}
+
 /*
  * The memory queries allow the plugin to query information about a
  * memory access.
@@ -333,6 +474,65 @@ int qemu_plugin_n_max_vcpus(void)
 #endif
 }
 
+/*
+ * Scoreboards
+ *
+ * Per-vCPU storage that inline ops and conditional callbacks can
+ * operate on without any locking.
+ */
+
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size)
+{
+    return plugin_scoreboard_new(element_size);
+}
+
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    plugin_scoreboard_free(score);
+}
+
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < plugin_scoreboard_n_entries());
+    return score->data + vcpu_index * score->element_size;
+}
+
+static uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
+                                    unsigned int vcpu_index)
+{
+    return qemu_plugin_scoreboard_find(entry.score, vcpu_index) + entry.offset;
+}
+
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added)
+{
+    *plugin_u64_address(entry, vcpu_index) += added;
+}
+
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val)
+{
+    *plugin_u64_address(entry, vcpu_index) = val;
+}
+
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index)
+{
+    return *plugin_u64_address(entry, vcpu_index);
+}
+
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry)
+{
+    size_t n = plugin_scoreboard_n_entries();
+    uint64_t total = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        total += qemu_plugin_u64_get(entry, i);
+    }
+    return total;
+}
+
 /*
  * Plugin output
  */
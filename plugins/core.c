@@ -20,6 +20,7 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "hw/core/cpu.h"
 #include "exec/cpu-common.h"
 
@@ -31,6 +32,9 @@
 #include "tcg/tcg-op.h"
 #include "trace/mem-internal.h" /* mem_info macros */
 #include "plugin.h"
+#ifndef CONFIG_USER_ONLY
+#include "hw/boards.h"
+#endif
 
 struct qemu_plugin_cb {
     struct qemu_plugin_ctx *ctx;
@@ -73,6 +77,8 @@ static void plugin_cpu_update__locked(gpointer k, gpointer v, gpointer udata)
     }
 }
 
+static void plugin_sample_stop__locked(void);
+
 void plugin_unregister_cb__locked(struct qemu_plugin_ctx *ctx,
                                   enum qemu_plugin_event ev)
 {
@@ -87,6 +93,9 @@ void plugin_unregister_cb__locked(struct qemu_plugin_ctx *ctx,
     if (QLIST_EMPTY_RCU(&plugin.cb_lists[ev])) {
         clear_bit(ev, plugin.mask);
         g_hash_table_foreach(plugin.cpu_ht, plugin_cpu_update__locked, NULL);
+        if (ev == QEMU_PLUGIN_EV_VCPU_SAMPLE) {
+            plugin_sample_stop__locked();
+        }
     }
 }
 
@@ -194,10 +203,107 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/*
+ * Scoreboards
+ *
+ * For system emulation, scoreboards are sized for the maximum number of
+ * vCPUs from the start. For user-mode emulation, where threads come and go,
+ * they grow as vCPUs are created; translated code reloads the data pointer
+ * on every access, so it is enough to stop all vCPUs while reallocating.
+ */
+static size_t plugin_scoreboard_initial_size(void)
+{
+#ifdef CONFIG_USER_ONLY
+    return 1;
+#else
+    return MACHINE(qdev_get_machine())->smp.max_cpus;
+#endif
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->element_size = element_size;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    if (plugin.scoreboard_alloc_size == 0) {
+        plugin.scoreboard_alloc_size = plugin_scoreboard_initial_size();
+    }
+    score->data = g_malloc0(plugin.scoreboard_alloc_size * element_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_free(score->data);
+    g_free(score);
+}
+
+size_t plugin_scoreboard_n_entries(void)
+{
+    QEMU_LOCK_GUARD(&plugin.lock);
+    return plugin.scoreboard_alloc_size;
+}
+
+static void plugin_grow_scoreboards(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t old_size, new_size;
+    bool exclusive;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    old_size = plugin.scoreboard_alloc_size;
+    if (likely(cpu->cpu_index < old_size)) {
+        qemu_rec_mutex_unlock(&plugin.lock);
+        return;
+    }
+    new_size = MAX(pow2ceil(cpu->cpu_index + 1),
+                   plugin_scoreboard_initial_size());
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        plugin.scoreboard_alloc_size = new_size;
+        qemu_rec_mutex_unlock(&plugin.lock);
+        return;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    /*
+     * Do not hold the plugin lock while waiting for the other vCPUs to
+     * stop; they might need it to get to a quiescent point.
+     */
+    exclusive = current_cpu != NULL;
+    if (exclusive) {
+        start_exclusive();
+    }
+    qemu_rec_mutex_lock(&plugin.lock);
+    old_size = plugin.scoreboard_alloc_size;
+    if (old_size < new_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            score->data = g_realloc(score->data,
+                                    new_size * score->element_size);
+            memset(score->data + old_size * score->element_size, 0,
+                   (new_size - old_size) * score->element_size);
+        }
+        plugin.scoreboard_alloc_size = new_size;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+    if (exclusive) {
+        end_exclusive();
+    }
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_grow_scoreboards(cpu);
+
     qemu_rec_mutex_lock(&plugin.lock);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
@@ -274,6 +380,25 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->userp = ptr;
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry.score = NULL;
+    dyn_cb->inline_insn.entry.offset = 0;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
 }
@@ -309,6 +434,28 @@ plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm, void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    if (cond == QEMU_PLUGIN_COND_NEVER) {
+        return;
+    }
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    dyn_cb->tcg_flags = cb_to_tcg_flags(flags);
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -374,6 +521,144 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
     }
 }
 
+void qemu_plugin_vcpu_sample(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_SAMPLE;
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    int mmu_idx;
+
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    mmu_idx = cpu_mmu_index(env, false);
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_sample_cb_t func = cb->f.vcpu_sample;
+
+        func(cb->ctx->id, cpu->cpu_index, pc, mmu_idx);
+    }
+}
+
+/*
+ * Sampling
+ *
+ * The sampler flags every running vCPU and makes it leave its TB chain,
+ * the same way cpu_exit() does but without a trip to the outer loop;
+ * cpu_handle_interrupt() then delivers the sample.
+ */
+static void plugin_sample_kick_all(void)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        if (atomic_read(&cpu->running) &&
+            test_bit(QEMU_PLUGIN_EV_VCPU_SAMPLE, cpu->plugin_mask)) {
+            atomic_set(&cpu->plugin_sample_pending, true);
+            /* pairs with atomic_mb_set in cpu_handle_interrupt() */
+            smp_wmb();
+            atomic_set(&cpu_neg(cpu)->icount_decr.u16.high, -1);
+        }
+    }
+}
+
+static QemuThread plugin_sample_thread_id;
+static bool plugin_sample_thread_started;
+
+static void *plugin_sample_thread(void *arg)
+{
+    unsigned long period;
+
+    rcu_register_thread();
+    while ((period = atomic_read(&plugin.sample_period_us))) {
+        g_usleep(period);
+        plugin_sample_kick_all();
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+#ifndef CONFIG_USER_ONLY
+static QEMUTimer *plugin_sample_timer;
+
+static void plugin_sample_timer_cb(void *opaque)
+{
+    unsigned long period = atomic_read(&plugin.sample_period_us);
+
+    if (period) {
+        plugin_sample_kick_all();
+        timer_mod(plugin_sample_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  (int64_t)period * SCALE_US);
+    }
+}
+#endif
+
+static void plugin_sample_start(enum qemu_plugin_sample_clock clock,
+                                uint64_t period_ns)
+{
+    uint64_t us = MAX(DIV_ROUND_UP(period_ns, SCALE_US), 1);
+    unsigned long period_us = MIN(us, ULONG_MAX);
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    if (plugin.sample_period_us && plugin.sample_period_us < period_us) {
+        period_us = plugin.sample_period_us;
+    }
+    atomic_set(&plugin.sample_period_us, period_us);
+
+#ifndef CONFIG_USER_ONLY
+    if (clock == QEMU_PLUGIN_SAMPLE_VIRTUAL) {
+        if (!plugin_sample_timer) {
+            plugin_sample_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                               plugin_sample_timer_cb, NULL);
+        }
+        timer_mod(plugin_sample_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  (int64_t)period_us * SCALE_US);
+        return;
+    }
+#endif
+    if (!plugin_sample_thread_started) {
+        qemu_thread_create(&plugin_sample_thread_id, "plugin-sampler",
+                           plugin_sample_thread, NULL, QEMU_THREAD_JOINABLE);
+        plugin_sample_thread_started = true;
+    }
+}
+
+/*
+ * Called when the last sampling callback goes away and at exit.  The
+ * sampler does not take @lock, so it can be joined with @lock held; it
+ * notices the zero period after at most one more period.
+ */
+static void plugin_sample_stop__locked(void)
+{
+    atomic_set(&plugin.sample_period_us, 0);
+#ifndef CONFIG_USER_ONLY
+    if (plugin_sample_timer) {
+        timer_del(plugin_sample_timer);
+    }
+#endif
+    if (plugin_sample_thread_started) {
+        qemu_thread_join(&plugin_sample_thread_id);
+        plugin_sample_thread_started = false;
+    }
+}
+
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         enum qemu_plugin_sample_clock clock,
+                                         uint64_t period_ns)
+{
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_SAMPLE, cb);
+    if (cb) {
+        plugin_sample_start(clock, period_ns);
+    }
+}
+
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
@@ -416,14 +701,25 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
+    uint64_t *val;
+
+    if (entry.score) {
+        val = entry.score->data + cpu_index * entry.score->element_size +
+              entry.offset;
+    } else {
+        val = cb->userp;
+    }
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -450,7 +746,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t info)
             cb->f.vcpu_mem(cpu->cpu_index, info, vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
             break;
         default:
             g_assert_not_reached();
@@ -460,6 +756,9 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t info)
 
 void qemu_plugin_atexit_cb(void)
 {
+    WITH_QEMU_LOCK_GUARD(&plugin.lock) {
+        plugin_sample_stop__locked();
+    }
     plugin_cb__udata(QEMU_PLUGIN_EV_ATEXIT);
 }
 
@@ -498,5 +797,6 @@ static void __attribute__((__constructor__)) plugin_init(void)
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
+    QLIST_INIT(&plugin.scoreboards);
     atexit(qemu_plugin_atexit_cb);
 }
@@ -124,6 +124,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                halt-poll-ns=n (maximum TCG halt-polling time in ns)\n"
+    "                rr-adaptive=on|off (adaptive single-threaded TCG timeslices)\n"
+    "                spin-yield=on|off (yield host CPU when a TCG vCPU busy-waits)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -151,6 +154,32 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``halt-poll-ns=n``
+        Lets a halted TCG vCPU poll for new work for up to n nanoseconds
+        before going to sleep, which reduces interrupt wakeup latency at
+        the cost of host CPU time. The polling window adapts to the
+        guest's halt pattern. It can be changed per vCPU with the CPU's
+        ``halt-poll-ns`` property. The default, 0, disables polling.
+        Statistics are shown by ``info jit``. Polling is not used with
+        icount.
+
+    ``rr-adaptive=on|off``
+        With single-threaded TCG, give each vCPU its own timeslice
+        instead of switching vCPUs at a fixed period. The slice of a vCPU
+        that is busy-waiting when its slice ends is shortened, and the
+        slice of any other vCPU that uses its whole slice is lengthened.
+        Slices are measured in virtual time, so scheduling stays
+        deterministic with icount. The default is off.
+
+    ``spin-yield=on|off``
+        With multi-threaded TCG, detect vCPUs that busy-wait, for example
+        on a contended guest spinlock, and back them off: first with
+        pause-style delays and then by yielding the host CPU to other
+        threads. A busy-wait loop is a translation block that reads but
+        does not write guest memory and jumps back to itself without
+        changing the vCPU registers. This helps when vCPUs outnumber host
+        CPUs. The default is off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefor taking advantage of
@@ -4312,6 +4341,34 @@ SRST
     Enable synchronization profiling.
 ERST
 
+#ifdef CONFIG_LINUX
+DEF("perfmap", 0, QEMU_OPTION_perfmap,
+    "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
+    QEMU_ARCH_ALL)
+#endif
+SRST
+``-perfmap``
+    Generate a map file for Linux perf tools that will allow basic profiling
+    information to be broken down into guest functions.  Each translation
+    block is named after the guest symbol it was translated from, if the
+    guest image has symbols, or after its guest address otherwise.  Only
+    available on Linux hosts.
+ERST
+
+#ifdef CONFIG_LINUX
+DEF("jitdump", 0, QEMU_OPTION_jitdump,
+    "-jitdump        generate a jit-${pid}.dump file for perf\n",
+    QEMU_ARCH_ALL)
+#endif
+SRST
+``-jitdump``
+    Generate a dump file for Linux perf tools that maps translation blocks
+    to guest functions like ``-perfmap`` does, and also contains the
+    generated code so that it can be annotated.  Run ``perf record`` with
+    ``-k mono`` and then ``perf inject --jit`` on the recording.  Only
+    available on Linux hosts.
+ERST
+
 DEFHEADING()
 
 DEFHEADING(Generic object creation:)
@@ -4372,6 +4429,14 @@ SRST
 
         The ``prealloc`` boolean option enables memory preallocation.
 
+        The ``prealloc-async`` boolean option lets preallocation of a
+        backend created on the command line run in the background while
+        devices are created. QEMU waits for it to complete before the
+        guest starts. The number of bytes preallocated so far can be read
+        from the ``prealloc-progress`` property with ``qom-get``. If the
+        memory is bound to ``host-nodes``, the preallocation threads run
+        on the CPUs of those nodes.
+
         The ``host-nodes`` option binds the memory range to a list of
         NUMA host nodes.
 
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+#
+# Convert binary trace backend files to Chrome/Perfetto trace JSON
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# For help see docs/devel/tracing.txt
+
+import sys
+import json
+import struct
+from tracetool import read_events
+from tracetool.backend.simple import is_string
+
+bt_magic = 0x00525442554d4551
+bt_version = 1
+
+chunk_mapping = 0
+chunk_events = 1
+chunk_dropped = 2
+
+codec_none = 0
+codec_zstd = 1
+
+file_header_fmt = '=QII'
+chunk_header_fmt = '=IIIIII'
+rec_header_fmt = '=IIQ'
+
+def read_struct(fobj, fmt):
+    '''Read a fixed size header, None at end of file'''
+    size = struct.calcsize(fmt)
+    data = fobj.read(size)
+    if len(data) != size:
+        return None
+    return struct.unpack(fmt, data)
+
+def decompress(codec, data, raw_len):
+    if codec == codec_none:
+        return data
+    if codec == codec_zstd:
+        try:
+            import zstandard
+        except ImportError:
+            sys.stderr.write('this trace is compressed, install the python '
+                             'zstandard module to read it\n')
+            sys.exit(1)
+        return zstandard.ZstdDecompressor().decompress(data,
+                                                       max_output_size=raw_len)
+    raise ValueError('unknown chunk codec %d' % codec)
+
+def parse_mapping(data):
+    idtoname = {}
+    off = 0
+    while off < len(data):
+        (event_id, length) = struct.unpack_from('=II', data, off)
+        off += 8
+        idtoname[event_id] = data[off:off + length].decode()
+        off += length
+    return idtoname
+
+def parse_events(edict, idtoname, data):
+    '''Yield (name, timestamp_ns, args) for each record in a chunk'''
+    off = 0
+    while off < len(data):
+        (event_id, length, timestamp) = struct.unpack_from(rec_header_fmt,
+                                                           data, off)
+        name = idtoname[event_id]
+        try:
+            event = edict[name]
+        except KeyError as e:
+            sys.stderr.write('%s event is logged but is not declared '
+                             'in the trace events file, try using '
+                             'trace-events-all instead.\n' % str(e))
+            sys.exit(1)
+
+        args = {}
+        argoff = off + struct.calcsize(rec_header_fmt)
+        for type_, argname in event.args:
+            if is_string(type_):
+                (slen,) = struct.unpack_from('=I', data, argoff)
+                argoff += 4
+                args[argname] = data[argoff:argoff + slen].decode(
+                    errors='replace')
+                argoff += slen
+            else:
+                (value,) = struct.unpack_from('=Q', data, argoff)
+                argoff += 8
+                args[argname] = value
+        yield (name, timestamp, args)
+        off += length
+
+def convert(events, fobj, out):
+    '''Write the trace in fobj as Chrome trace event JSON to out'''
+    edict = {e.name: e for e in events}
+    header = read_struct(fobj, file_header_fmt)
+    if header is None or header[0] != bt_magic:
+        raise ValueError('not a binary trace file')
+    if header[1] != bt_version:
+        raise ValueError('unsupported binary trace version %d' % header[1])
+    pid = header[2]
+    idtoname = {}
+    first = True
+
+    out.write('{"displayTimeUnit": "ns", "traceEvents": [\n')
+    while True:
+        chunk = read_struct(fobj, chunk_header_fmt)
+        if chunk is None:
+            break
+        (type_, codec, tid, raw_len, stored_len, _) = chunk
+        data = fobj.read(stored_len)
+        if len(data) != stored_len:
+            break
+        data = decompress(codec, data, raw_len)
+
+        if type_ == chunk_mapping:
+            idtoname.update(parse_mapping(data))
+            continue
+        if type_ == chunk_dropped:
+            (timestamp, count) = struct.unpack('=QQ', data)
+            records = [('dropped', timestamp, {'count': count})]
+        else:
+            records = parse_events(edict, idtoname, data)
+
+        for (name, timestamp, args) in records:
+            ev = {
+                'name': name,
+                'cat': 'qemu',
+                'ph': 'i',
+                's': 't',
+                'ts': timestamp / 1000.0,
+                'pid': pid,
+                'tid': tid,
+                'args': args,
+            }
+            out.write(('' if first else ',\n') + json.dumps(ev))
+            first = False
+    out.write('\n]}\n')
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: %s <trace-events-file> <trace-file>\n'
+                         % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], 'r') as fobj:
+        events = read_events(fobj, sys.argv[1])
+    with open(sys.argv[2], 'rb') as fobj:
+        convert(events, fobj, sys.stdout)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# Render the timeline of a migration as text
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# Usage: migration-timeline.py [--width N] [--all] SOURCE
+#
+# SOURCE is either the QMP socket of the source QEMU, or a file holding
+# the reply to query-migrate-timeline ("-" for stdin).
+#
+
+import argparse
+import json
+import os
+import stat
+import sys
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', 'python'))
+
+
+def load_timeline(source):
+    if source != '-' and stat.S_ISSOCK(os.stat(source).st_mode):
+        from qemu.qmp import QEMUMonitorProtocol
+        qmp = QEMUMonitorProtocol(source)
+        qmp.connect()
+        try:
+            return qmp.command('query-migrate-timeline')
+        finally:
+            qmp.close()
+
+    if source == '-':
+        reply = json.load(sys.stdin)
+    else:
+        with open(source) as f:
+            reply = json.load(f)
+    return reply.get('return', reply)
+
+
+def fmt_us(us):
+    if us >= 1000000:
+        return '%.2f s' % (us / 1000000)
+    if us >= 1000:
+        return '%.2f ms' % (us / 1000)
+    return '%d us' % us
+
+
+def bar(start, duration, origin, span, width):
+    begin = int((start - origin) * width / span)
+    length = max(1, int(duration * width / span))
+    begin = min(begin, width - 1)
+    length = min(length, width - begin)
+    return ' ' * begin + '#' * length + ' ' * (width - begin - length)
+
+
+def render(timeline, width, show_all):
+    events = timeline['events']
+    if not events:
+        print('No events recorded')
+        return
+
+    # Zoom on what happened from the last bitmap sync on, which is what
+    # makes up the downtime; the earlier syncs are summarized
+    syncs = [e for e in events if e['kind'] == 'bitmap-sync']
+    shown = events
+    if syncs and not show_all:
+        last = syncs[-1]['start']
+        shown = [e for e in events if e['start'] >= last]
+        earlier = len(syncs) - 1
+        if earlier:
+            total = sum(e['duration'] for e in syncs[:-1])
+            longest = max(e['duration'] for e in syncs[:-1])
+            print('%d earlier bitmap syncs: %s total, %s longest' %
+                  (earlier, fmt_us(total), fmt_us(longest)))
+
+    origin = min(e['start'] for e in shown)
+    end = max(e['start'] + e['duration'] for e in shown)
+    span = max(end - origin, 1)
+
+    print('events from %s after the start of the migration:' %
+          fmt_us(origin))
+    print('%-12s %-24s %10s %10s  %s' %
+          ('kind', 'name', 'offset', 'duration', 'timeline'))
+    for e in sorted(shown, key=lambda e: e['start']):
+        print('%-12s %-24s %10s %10s |%s|' %
+              (e['kind'], e['name'][:24], fmt_us(e['start'] - origin),
+               fmt_us(e['duration']),
+               bar(e['start'], e['duration'], origin, span, width)))
+
+    samples = timeline['throughput']
+    if samples:
+        mbps = [s['mbps'] for s in samples]
+        print()
+        print('throughput: %d samples, %.1f Mbps average, %.1f min, '
+              '%.1f max, %.1f last' %
+              (len(mbps), sum(mbps) / len(mbps), min(mbps), max(mbps),
+               mbps[-1]))
+
+    if timeline.get('dropped'):
+        print('%d older events and samples were dropped' %
+              timeline['dropped'])
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Render the timeline of '
+                                     'a migration')
+    parser.add_argument('source', help='QMP socket, or file with the reply '
+                        'to query-migrate-timeline ("-" for stdin)')
+    parser.add_argument('--width', type=int, default=60,
+                        help='width of the timeline bars')
+    parser.add_argument('--all', action='store_true',
+                        help='show all events, not only those since the '
+                        'last bitmap sync')
+    args = parser.parse_args()
+
+    render(load_timeline(args.source), args.width, args.all)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+# Compare the TCG interpreter with native TCG
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+import os
+import sys
+import subprocess
+import time
+import simplebench
+
+
+# How tests/tcg/*/Makefile.softmmu-target runs the system tests
+SYSTEM_OPTS = {
+    'x86_64': ['-device', 'isa-debugcon,chardev=output',
+               '-device', 'isa-debug-exit,iobase=0xf4,iosize=0x4'],
+    'aarch64': ['-M', 'virt', '-cpu', 'max', '-semihosting-config',
+                'enable=on,target=native,chardev=output'],
+}
+
+
+def bench_func(env, case):
+    """ Run one guest test binary in linux-user or system mode """
+    target_dir = env['target'] + '-' + case['mode']
+    test = os.path.join(env['build_dir'], 'tests', 'tcg', target_dir,
+                        case['binary'])
+
+    if case['mode'] == 'softmmu':
+        qemu = os.path.join(env['build_dir'], target_dir,
+                            'qemu-system-' + env['target'])
+        cmd = [qemu, '-monitor', 'none', '-display', 'none',
+               '-chardev', 'file,path=/dev/null,id=output'] + \
+            SYSTEM_OPTS[env['target']] + ['-kernel', test]
+    else:
+        qemu = os.path.join(env['build_dir'], target_dir,
+                            'qemu-' + env['target'])
+        cmd = [qemu, test]
+
+    start = time.time()
+    res = subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                         stderr=subprocess.PIPE, universal_newlines=True)
+    seconds = time.time() - start
+
+    if res.returncode != 0:
+        return {'error': res.stderr.strip() or
+                'exit code {}'.format(res.returncode)}
+    return {'seconds': seconds}
+
+
+def main():
+    if len(sys.argv) < 3:
+        print('Usage: {} NATIVE-BUILD-DIR TCI-BUILD-DIR [TARGET]\n\n'
+              'Both build directories must have run "make check-tcg" '
+              'for TARGET-linux-user and TARGET-softmmu (default x86_64; '
+              'system tests are run for {}).'.format(
+                  sys.argv[0], ', '.join(SYSTEM_OPTS)))
+        sys.exit(1)
+
+    target = sys.argv[3] if len(sys.argv) > 3 else 'x86_64'
+
+    # Rows: test binaries from tests/tcg/multiarch
+    test_cases = [
+        {'id': 'sha1', 'binary': 'sha1', 'mode': 'linux-user'},
+        {'id': 'float_convs', 'binary': 'float_convs', 'mode': 'linux-user'},
+        {'id': 'linux-test', 'binary': 'linux-test', 'mode': 'linux-user'},
+        {'id': 'test-mmap', 'binary': 'test-mmap', 'mode': 'linux-user'},
+    ]
+    # The system tests go through the softmmu TLB on every access
+    if target in SYSTEM_OPTS:
+        test_cases.append({'id': 'system-memory', 'binary': 'memory',
+                           'mode': 'softmmu'})
+
+    # Columns: the same target built with native TCG and with TCI
+    test_envs = [
+        {'id': 'native', 'build_dir': sys.argv[1], 'target': target},
+        {'id': 'tci', 'build_dir': sys.argv[2], 'target': target},
+    ]
+
+    result = simplebench.bench(bench_func, test_envs, test_cases, count=3)
+    print(simplebench.ascii(result))
+
+
+if __name__ == '__main__':
+    main()
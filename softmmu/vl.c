@@ -59,6 +59,7 @@
 #include "sysemu/numa.h"
 #include "sysemu/hostmem.h"
 #include "exec/gdbstub.h"
+#include "exec/perf.h"
 #include "qemu/timer.h"
 #include "chardev/char.h"
 #include "qemu/bitmap.h"
@@ -3778,6 +3779,14 @@ void qemu_init(int argc, char **argv, char **envp)
             case QEMU_OPTION_enable_sync_profile:
                 qsp_enable();
                 break;
+#ifdef CONFIG_LINUX
+            case QEMU_OPTION_perfmap:
+                perf_enable_perfmap();
+                break;
+            case QEMU_OPTION_jitdump:
+                perf_enable_jitdump();
+                break;
+#endif
             case QEMU_OPTION_nouserconfig:
                 /* Nothing to be parsed here. Especially, do not error out below. */
                 break;
@@ -4412,6 +4421,8 @@ void qemu_init(int argc, char **argv, char **envp)
         exit(1);
     }
 
+    host_memory_backend_prealloc_wait_all(&error_fatal);
+
     qdev_machine_creation_done();
 
     /* TODO: once all bus devices are qdevified, this should be done
@@ -394,6 +394,10 @@ static void arm_cpu_reset(DeviceState *dev)
                               &env->vfp.standard_fp_status);
     set_float_detect_tininess(float_tininess_before_rounding,
                               &env->vfp.fp_status_f16);
+    /* Until the guest looks at FPSCR, see vfp_end_lazy_inexact().  */
+    set_float_lazy_inexact(1, &env->vfp.fp_status);
+    set_float_lazy_inexact(1, &env->vfp.fp_status_f16);
+    set_float_lazy_inexact(1, &env->vfp.standard_fp_status);
 #ifndef CONFIG_USER_ONLY
     if (kvm_enabled()) {
         kvm_arm_reset_vcpu(cpu);
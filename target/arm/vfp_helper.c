@@ -84,10 +84,25 @@ static inline int vfp_exceptbits_to_host(int target_bits)
     return host_bits;
 }
 
+/*
+ * arm_cpu_reset() lets the FP operations raise inexact pessimistically
+ * so that they can use the host FPU.  Once the guest reads or writes the
+ * cumulative flags it evidently cares about them, so compute inexact
+ * exactly from then on.
+ */
+static void vfp_end_lazy_inexact(CPUARMState *env)
+{
+    set_float_lazy_inexact(0, &env->vfp.fp_status);
+    set_float_lazy_inexact(0, &env->vfp.fp_status_f16);
+    set_float_lazy_inexact(0, &env->vfp.standard_fp_status);
+}
+
 static uint32_t vfp_get_fpscr_from_host(CPUARMState *env)
 {
     uint32_t i;
 
+    vfp_end_lazy_inexact(env);
+
     i = get_float_exception_flags(&env->vfp.fp_status);
     i |= get_float_exception_flags(&env->vfp.standard_fp_status);
     /* FZ16 does not generate an input denormal exception.  */
@@ -101,6 +116,8 @@ static void vfp_set_fpscr_to_host(CPUARMState *env, uint32_t val)
     int i;
     uint32_t changed = env->vfp.xregs[ARM_VFP_FPSCR];
 
+    vfp_end_lazy_inexact(env);
+
     changed ^= val;
     if (changed & (3 << 22)) {
         i = (val >> 22) & 3;
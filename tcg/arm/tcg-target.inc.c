@@ -30,6 +30,9 @@ int arm_arch = __ARM_ARCH;
 #ifndef use_idiv_instructions
 bool use_idiv_instructions;
 #endif
+#ifndef use_neon_instructions
+bool use_neon_instructions;
+#endif
 
 /* ??? Ought to think about changing CONFIG_SOFTMMU to always defined.  */
 #ifdef CONFIG_SOFTMMU
@@ -56,6 +59,22 @@ static const char * const tcg_target_reg_names[TCG_TARGET_NB_REGS] = {
     "%r13",
     "%r14",
     "%pc",
+    "%q0",
+    "%q1",
+    "%q2",
+    "%q3",
+    "%q4",
+    "%q5",
+    "%q6",
+    "%q7",
+    "%q8",
+    "%q9",
+    "%q10",
+    "%q11",
+    "%q12",
+    "%q13",
+    "%q14",
+    "%q15",
 };
 #endif
 
@@ -75,6 +94,20 @@ static const int tcg_target_reg_alloc_order[] = {
     TCG_REG_R3,
     TCG_REG_R12,
     TCG_REG_R14,
+
+    /* q4-q7 (d8-d15) are callee-saved and are never allocated.  */
+    TCG_REG_Q0,
+    TCG_REG_Q1,
+    TCG_REG_Q2,
+    TCG_REG_Q3,
+    TCG_REG_Q8,
+    TCG_REG_Q9,
+    TCG_REG_Q10,
+    TCG_REG_Q11,
+    TCG_REG_Q12,
+    TCG_REG_Q13,
+    TCG_REG_Q14,
+    TCG_REG_Q15,
 };
 
 static const int tcg_target_call_iarg_regs[4] = {
@@ -162,6 +195,56 @@ typedef enum {
     INSN_DMB_ISH   = 0xf57ff05b,
     INSN_DMB_MCR   = 0xee070fba,
 
+    /* Advanced SIMD (NEON), unconditional.  */
+    INSN_VADD      = 0xf2000800,
+    INSN_VSUB      = 0xf3000800,
+    INSN_VMUL      = 0xf2000910,
+    INSN_VQADD     = 0xf2000010,
+    INSN_VQADD_U   = 0xf3000010,
+    INSN_VQSUB     = 0xf2000210,
+    INSN_VQSUB_U   = 0xf3000210,
+    INSN_VMAX      = 0xf2000600,
+    INSN_VMAX_U    = 0xf3000600,
+    INSN_VMIN      = 0xf2000610,
+    INSN_VMIN_U    = 0xf3000610,
+
+    INSN_VAND      = 0xf2000110,
+    INSN_VBIC      = 0xf2100110,
+    INSN_VORR      = 0xf2200110,
+    INSN_VORN      = 0xf2300110,
+    INSN_VEOR      = 0xf3000110,
+    INSN_VBSL      = 0xf3100110,
+    INSN_VBIT      = 0xf3200110,
+    INSN_VBIF      = 0xf3300110,
+
+    INSN_VCEQ      = 0xf3000810,
+    INSN_VCGT      = 0xf2000300,
+    INSN_VCGE      = 0xf2000310,
+    INSN_VCGT_U    = 0xf3000300,
+    INSN_VCGE_U    = 0xf3000310,
+
+    INSN_VSHL_S    = 0xf2000400,  /* VSHL (register) */
+    INSN_VSHL_U    = 0xf3000400,
+    INSN_VSHLI     = 0xf2800510,  /* VSHL (immediate) */
+    INSN_VSHRI_S   = 0xf2800010,
+    INSN_VSHRI_U   = 0xf3800010,
+
+    INSN_VMVN      = 0xf3b00580,
+    INSN_VNEG      = 0xf3b10380,
+    INSN_VABS      = 0xf3b10300,
+
+    INSN_VMOVI     = 0xf2800010,  /* VMOV (immediate) */
+    INSN_VDUP_G    = 0xee800b10,  /* VDUP (ARM core register) */
+    INSN_VDUP_S    = 0xf3b00c00,  /* VDUP (scalar) */
+    INSN_VMOV_DRR  = 0xec400b10,  /* VMOV Dm, Rt, Rt2 */
+
+    INSN_VLDR_D    = 0xed900b00,
+    INSN_VSTR_D    = 0xed800b00,
+    INSN_VLD1_2D   = 0xf4200acf,  /* VLD1.64 {Dd, Dd+1}, [Rn] */
+    INSN_VST1_2D   = 0xf4000acf,
+    INSN_VLD1_1D   = 0xf42007cf,  /* VLD1.64 {Dd}, [Rn] */
+    INSN_VLD1R     = 0xf4a00c0f,  /* VLD1 {Dd[]}, [Rn] */
+
     /* Architected nop introduced in v6k.  */
     /* ??? This is an MSR (imm) 0,0,0 insn.  Anyone know if this
        also Just So Happened to do nothing on pre-v6k so that we
@@ -256,6 +339,11 @@ static const char *target_parse_constraint(TCGArgConstraint *ct,
         ct->ct |= TCG_CT_REG;
         ct->u.regs = 0xffff;
         break;
+    case 'w':
+        /* q0-q3 and q8-q15; q4-q7 are callee-saved.  */
+        ct->ct |= TCG_CT_REG;
+        ct->u.regs = 0xff0f0000;
+        break;
 
     /* qemu_ld address */
     case 'l':
@@ -2075,6 +2163,514 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
     }
 }
 
+/*
+ * Advanced SIMD.  TCG_REG_Qn always names the 128-bit register qn; for
+ * TCG_TYPE_V64 the same register number names its low half d(2n).
+ */
+
+static uint32_t encode_vd(TCGReg rd)
+{
+    tcg_debug_assert(rd >= TCG_REG_Q0);
+    return (extract32(rd, 3, 1) << 22) | (extract32(rd, 0, 3) << 13);
+}
+
+static uint32_t encode_vn(TCGReg rn)
+{
+    tcg_debug_assert(rn >= TCG_REG_Q0);
+    return (extract32(rn, 3, 1) << 7) | (extract32(rn, 0, 3) << 17);
+}
+
+static uint32_t encode_vm(TCGReg rm)
+{
+    tcg_debug_assert(rm >= TCG_REG_Q0);
+    return (extract32(rm, 3, 1) << 5) | (extract32(rm, 0, 3) << 1);
+}
+
+/* Three registers of the same length.  */
+static void tcg_out_vreg3(TCGContext *s, ARMInsn insn, int q, int vece,
+                          TCGReg d, TCGReg n, TCGReg m)
+{
+    tcg_out32(s, insn | (vece << 20) | (q << 6)
+              | encode_vd(d) | encode_vn(n) | encode_vm(m));
+}
+
+/* Two registers, miscellaneous.  */
+static void tcg_out_vreg2(TCGContext *s, ARMInsn insn, int q, int vece,
+                          TCGReg d, TCGReg m)
+{
+    tcg_out32(s, insn | (vece << 18) | (q << 6) | encode_vd(d) | encode_vm(m));
+}
+
+/* Two registers and a shift amount, already encoded as L:imm6.  */
+static void tcg_out_vshifti(TCGContext *s, ARMInsn insn, int q,
+                            TCGReg d, TCGReg m, int l_imm6)
+{
+    tcg_out32(s, insn | (q << 6) | encode_vd(d) | encode_vm(m)
+              | (extract32(l_imm6, 6, 1) << 7)
+              | (extract32(l_imm6, 0, 6) << 16));
+}
+
+/* VMOV Dd, Dm between arbitrary D registers, numbered 0-31.  */
+static void tcg_out_vmov_d(TCGContext *s, int dd, int dm)
+{
+    tcg_out32(s, INSN_VORR | (extract32(dd, 4, 1) << 22)
+              | (extract32(dd, 0, 4) << 12)
+              | (extract32(dm, 4, 1) << 7) | (extract32(dm, 0, 4) << 16)
+              | (extract32(dm, 4, 1) << 5) | extract32(dm, 0, 4));
+}
+
+static void tcg_out_vmovi(TCGContext *s, TCGReg rd, int q, int op,
+                          int cmode, uint8_t imm8)
+{
+    tcg_out32(s, INSN_VMOVI | encode_vd(rd) | (q << 6) | (op << 5)
+              | (cmode << 8) | (extract32(imm8, 7, 1) << 24)
+              | (extract32(imm8, 4, 3) << 16) | extract32(imm8, 0, 4));
+}
+
+/* Return the register holding BASE + OFFSET, using TMP if required.  */
+static TCGReg tcg_out_vaddr(TCGContext *s, TCGReg base, intptr_t offset)
+{
+    int rot;
+
+    if (offset == 0) {
+        return base;
+    }
+    rot = encode_imm(offset);
+    if (rot >= 0) {
+        tcg_out_dat_imm(s, COND_AL, ARITH_ADD, TCG_REG_TMP, base,
+                        rotl(offset, rot) | (rot << 7));
+        return TCG_REG_TMP;
+    }
+    rot = encode_imm(-offset);
+    if (rot >= 0) {
+        tcg_out_dat_imm(s, COND_AL, ARITH_SUB, TCG_REG_TMP, base,
+                        rotl(-offset, rot) | (rot << 7));
+        return TCG_REG_TMP;
+    }
+    tcg_out_movi32(s, COND_AL, TCG_REG_TMP, offset);
+    tcg_out_dat_reg(s, COND_AL, ARITH_ADD, TCG_REG_TMP, TCG_REG_TMP,
+                    base, SHIFT_IMM_LSL(0));
+    return TCG_REG_TMP;
+}
+
+static void tcg_out_vldst(TCGContext *s, TCGType type, bool is_ld,
+                          TCGReg rd, TCGReg base, intptr_t offset)
+{
+    if (type == TCG_TYPE_V64) {
+        ARMInsn insn = is_ld ? INSN_VLDR_D : INSN_VSTR_D;
+
+        /* VLDR/VSTR take a word-scaled 8-bit offset.  */
+        if ((offset & 3) || offset < -1020 || offset > 1020) {
+            base = tcg_out_vaddr(s, base, offset);
+            offset = 0;
+        }
+        if (offset < 0) {
+            insn &= ~(1 << 23);
+            offset = -offset;
+        }
+        tcg_out32(s, insn | encode_vd(rd) | (base << 16) | (offset >> 2));
+    } else {
+        tcg_debug_assert(type == TCG_TYPE_V128);
+        base = tcg_out_vaddr(s, base, offset);
+        tcg_out32(s, (is_ld ? INSN_VLD1_2D : INSN_VST1_2D)
+                  | encode_vd(rd) | (base << 16));
+    }
+}
+
+/* Return true if v16 is a valid 16-bit shifted immediate.  */
+static bool is_shimm16(uint16_t v16, int *cmode, int *imm8)
+{
+    if (v16 == (v16 & 0xff)) {
+        *cmode = 0x8;
+        *imm8 = v16 & 0xff;
+        return true;
+    } else if (v16 == (v16 & 0xff00)) {
+        *cmode = 0xa;
+        *imm8 = v16 >> 8;
+        return true;
+    }
+    return false;
+}
+
+/* Return true if v32 is a valid 32-bit shifted immediate.  */
+static bool is_shimm32(uint32_t v32, int *cmode, int *imm8)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (v32 == (v32 & (0xffu << (i * 8)))) {
+            *cmode = i * 2;
+            *imm8 = v32 >> (i * 8);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Return true if v32 is a valid 32-bit shifting ones immediate.  */
+static bool is_soimm32(uint32_t v32, int *cmode, int *imm8)
+{
+    if ((v32 & 0xffff00ff) == 0xff) {
+        *cmode = 0xc;
+        *imm8 = (v32 >> 8) & 0xff;
+        return true;
+    } else if ((v32 & 0xff00ffff) == 0xffff) {
+        *cmode = 0xd;
+        *imm8 = (v32 >> 16) & 0xff;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * The host is 32-bit, so ARG is always a 32-bit pattern replicated
+ * across the vector.
+ */
+static void tcg_out_dupi_vec(TCGContext *s, TCGType type,
+                             TCGReg rd, tcg_target_long arg)
+{
+    int q = type == TCG_TYPE_V128;
+    uint32_t v32 = arg;
+    int cmode, imm8, i;
+
+    if (v32 == dup_const(MO_8, v32)) {
+        tcg_out_vmovi(s, rd, q, 0, 0xe, v32);
+        return;
+    }
+
+    /* All bytes 0x00 or 0xff: the 64-bit form of VMOV.  */
+    for (i = imm8 = 0; i < 4; i++) {
+        uint8_t byte = v32 >> (i * 8);
+        if (byte == 0xff) {
+            imm8 |= 0x11 << i;
+        } else if (byte != 0) {
+            goto fail_bytes;
+        }
+    }
+    tcg_out_vmovi(s, rd, q, 1, 0xe, imm8);
+    return;
+ fail_bytes:
+
+    if (v32 == dup_const(MO_16, v32)) {
+        if (is_shimm16(v32, &cmode, &imm8)) {
+            tcg_out_vmovi(s, rd, q, 0, cmode, imm8);
+            return;
+        }
+        if (is_shimm16(~v32, &cmode, &imm8)) {
+            tcg_out_vmovi(s, rd, q, 1, cmode, imm8);
+            return;
+        }
+    }
+    if (is_shimm32(v32, &cmode, &imm8) || is_soimm32(v32, &cmode, &imm8)) {
+        tcg_out_vmovi(s, rd, q, 0, cmode, imm8);
+        return;
+    }
+    if (is_shimm32(~v32, &cmode, &imm8) || is_soimm32(~v32, &cmode, &imm8)) {
+        tcg_out_vmovi(s, rd, q, 1, cmode, imm8);
+        return;
+    }
+
+    /* Otherwise, go through a core register.  */
+    tcg_out_movi32(s, COND_AL, TCG_REG_TMP, v32);
+    tcg_out_dup_vec(s, type, MO_32, rd, TCG_REG_TMP);
+}
+
+static bool tcg_out_dup_vec(TCGContext *s, TCGType type, unsigned vece,
+                            TCGReg rd, TCGReg rs)
+{
+    int q = type == TCG_TYPE_V128;
+
+    if (rs < TCG_REG_Q0) {
+        /* b:e encodes the element size: 10 = 8, 01 = 16, 00 = 32.  */
+        static const uint32_t be[3] = { 1 << 22, 1 << 5, 0 };
+
+        if (vece == MO_64) {
+            return false;
+        }
+        tcg_out32(s, INSN_VDUP_G | be[vece] | (q << 21)
+                  | encode_vn(rd) | (rs << 12));
+        return true;
+    }
+
+    if (vece == MO_64) {
+        int dd = (rd - TCG_REG_Q0) * 2;
+        int dm = (rs - TCG_REG_Q0) * 2;
+
+        if (dd != dm) {
+            tcg_out_vmov_d(s, dd, dm);
+        }
+        if (q) {
+            tcg_out_vmov_d(s, dd + 1, dm);
+        }
+        return true;
+    }
+    tcg_out32(s, INSN_VDUP_S | (1 << (16 + vece)) | (q << 6)
+              | encode_vd(rd) | encode_vm(rs));
+    return true;
+}
+
+static bool tcg_out_dupm_vec(TCGContext *s, TCGType type, unsigned vece,
+                             TCGReg rd, TCGReg base, intptr_t offset)
+{
+    int q = type == TCG_TYPE_V128;
+
+    base = tcg_out_vaddr(s, base, offset);
+    if (vece == MO_64) {
+        int dd = (rd - TCG_REG_Q0) * 2;
+
+        tcg_out32(s, INSN_VLD1_1D | encode_vd(rd) | (base << 16));
+        if (q) {
+            tcg_out_vmov_d(s, dd + 1, dd);
+        }
+    } else {
+        tcg_out32(s, INSN_VLD1R | (vece << 6) | (q << 5)
+                  | encode_vd(rd) | (base << 16));
+    }
+    return true;
+}
+
+static void tcg_out_cmp_vec(TCGContext *s, int q, unsigned vece,
+                            TCGReg a0, TCGReg a1, TCGReg a2, TCGCond cond)
+{
+    static const ARMInsn cmp_insn[16] = {
+        [TCG_COND_EQ] = INSN_VCEQ,
+        [TCG_COND_GT] = INSN_VCGT,
+        [TCG_COND_GE] = INSN_VCGE,
+        [TCG_COND_GTU] = INSN_VCGT_U,
+        [TCG_COND_GEU] = INSN_VCGE_U,
+    };
+    bool need_inv = false;
+
+    switch (cond) {
+    case TCG_COND_NE:
+        cond = TCG_COND_EQ;
+        need_inv = true;
+        break;
+    case TCG_COND_LT:
+    case TCG_COND_LE:
+    case TCG_COND_LTU:
+    case TCG_COND_LEU:
+        cond = tcg_swap_cond(cond);
+        tcg_out_vreg3(s, cmp_insn[cond], q, vece, a0, a2, a1);
+        return;
+    default:
+        break;
+    }
+    tcg_out_vreg3(s, cmp_insn[cond], q, vece, a0, a1, a2);
+    if (need_inv) {
+        tcg_out_vreg2(s, INSN_VMVN, q, 0, a0, a0);
+    }
+}
+
+static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
+                           unsigned vecl, unsigned vece,
+                           const TCGArg *args, const int *const_args)
+{
+    TCGType type = vecl + TCG_TYPE_V64;
+    int q = vecl;
+    TCGArg a0, a1, a2, a3;
+
+    a0 = args[0];
+    a1 = args[1];
+    a2 = args[2];
+
+    switch (opc) {
+    case INDEX_op_ld_vec:
+        tcg_out_ld(s, type, a0, a1, a2);
+        break;
+    case INDEX_op_st_vec:
+        tcg_out_st(s, type, a0, a1, a2);
+        break;
+    case INDEX_op_dupm_vec:
+        tcg_out_dupm_vec(s, type, vece, a0, a1, a2);
+        break;
+    case INDEX_op_dup2_vec:
+        {
+            int dd = (a0 - TCG_REG_Q0) * 2;
+
+            tcg_out32(s, INSN_VMOV_DRR | encode_vm(a0) | (a2 << 16)
+                      | (a1 << 12));
+            if (q) {
+                tcg_out_vmov_d(s, dd + 1, dd);
+            }
+        }
+        break;
+
+    case INDEX_op_add_vec:
+        tcg_out_vreg3(s, INSN_VADD, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_sub_vec:
+        tcg_out_vreg3(s, INSN_VSUB, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_mul_vec:
+        tcg_out_vreg3(s, INSN_VMUL, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_ssadd_vec:
+        tcg_out_vreg3(s, INSN_VQADD, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_usadd_vec:
+        tcg_out_vreg3(s, INSN_VQADD_U, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_sssub_vec:
+        tcg_out_vreg3(s, INSN_VQSUB, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_ussub_vec:
+        tcg_out_vreg3(s, INSN_VQSUB_U, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_smax_vec:
+        tcg_out_vreg3(s, INSN_VMAX, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_umax_vec:
+        tcg_out_vreg3(s, INSN_VMAX_U, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_smin_vec:
+        tcg_out_vreg3(s, INSN_VMIN, q, vece, a0, a1, a2);
+        break;
+    case INDEX_op_umin_vec:
+        tcg_out_vreg3(s, INSN_VMIN_U, q, vece, a0, a1, a2);
+        break;
+
+    case INDEX_op_and_vec:
+        tcg_out_vreg3(s, INSN_VAND, q, 0, a0, a1, a2);
+        break;
+    case INDEX_op_or_vec:
+        tcg_out_vreg3(s, INSN_VORR, q, 0, a0, a1, a2);
+        break;
+    case INDEX_op_xor_vec:
+        tcg_out_vreg3(s, INSN_VEOR, q, 0, a0, a1, a2);
+        break;
+    case INDEX_op_andc_vec:
+        tcg_out_vreg3(s, INSN_VBIC, q, 0, a0, a1, a2);
+        break;
+    case INDEX_op_orc_vec:
+        tcg_out_vreg3(s, INSN_VORN, q, 0, a0, a1, a2);
+        break;
+    case INDEX_op_not_vec:
+        tcg_out_vreg2(s, INSN_VMVN, q, 0, a0, a1);
+        break;
+    case INDEX_op_neg_vec:
+        tcg_out_vreg2(s, INSN_VNEG, q, vece, a0, a1);
+        break;
+    case INDEX_op_abs_vec:
+        tcg_out_vreg2(s, INSN_VABS, q, vece, a0, a1);
+        break;
+
+    case INDEX_op_shli_vec:
+        tcg_out_vshifti(s, INSN_VSHLI, q, a0, a1, (8 << vece) + a2);
+        break;
+    case INDEX_op_shri_vec:
+        tcg_out_vshifti(s, INSN_VSHRI_U, q, a0, a1, (16 << vece) - a2);
+        break;
+    case INDEX_op_sari_vec:
+        tcg_out_vshifti(s, INSN_VSHRI_S, q, a0, a1, (16 << vece) - a2);
+        break;
+    /* VSHL (register) shifts Vm by Vn.  */
+    case INDEX_op_shlv_vec:
+    case INDEX_op_arm_ushl_vec:
+        tcg_out_vreg3(s, INSN_VSHL_U, q, vece, a0, a2, a1);
+        break;
+    case INDEX_op_arm_sshl_vec:
+        tcg_out_vreg3(s, INSN_VSHL_S, q, vece, a0, a2, a1);
+        break;
+
+    case INDEX_op_cmp_vec:
+        tcg_out_cmp_vec(s, q, vece, a0, a1, a2, args[3]);
+        break;
+
+    case INDEX_op_bitsel_vec:
+        /* a0 = (a1 & a2) | (~a1 & a3), choosing the form that needs
+           no extra move.  */
+        a3 = args[3];
+        if (a0 == a3) {
+            tcg_out_vreg3(s, INSN_VBIT, q, 0, a0, a2, a1);
+        } else if (a0 == a2) {
+            tcg_out_vreg3(s, INSN_VBIF, q, 0, a0, a3, a1);
+        } else {
+            if (a0 != a1) {
+                tcg_out_vreg3(s, INSN_VORR, q, 0, a0, a1, a1);
+            }
+            tcg_out_vreg3(s, INSN_VBSL, q, 0, a0, a2, a3);
+        }
+        break;
+
+    case INDEX_op_mov_vec:  /* Always emitted via tcg_out_mov.  */
+    case INDEX_op_dupi_vec: /* Always emitted via tcg_out_movi.  */
+    case INDEX_op_dup_vec:  /* Always emitted via tcg_out_dup_vec.  */
+    default:
+        g_assert_not_reached();
+    }
+}
+
+int tcg_can_emit_vec_op(TCGOpcode opc, TCGType type, unsigned vece)
+{
+    switch (opc) {
+    case INDEX_op_add_vec:
+    case INDEX_op_sub_vec:
+    case INDEX_op_and_vec:
+    case INDEX_op_or_vec:
+    case INDEX_op_xor_vec:
+    case INDEX_op_andc_vec:
+    case INDEX_op_orc_vec:
+    case INDEX_op_not_vec:
+    case INDEX_op_shli_vec:
+    case INDEX_op_shri_vec:
+    case INDEX_op_sari_vec:
+    case INDEX_op_shlv_vec:
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_ussub_vec:
+    case INDEX_op_bitsel_vec:
+        return 1;
+    /* There are no 64-bit element forms of these in AArch32.  */
+    case INDEX_op_neg_vec:
+    case INDEX_op_abs_vec:
+    case INDEX_op_mul_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_smin_vec:
+    case INDEX_op_umax_vec:
+    case INDEX_op_umin_vec:
+    case INDEX_op_cmp_vec:
+        return vece < MO_64;
+    case INDEX_op_shrv_vec:
+    case INDEX_op_sarv_vec:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+void tcg_expand_vec_op(TCGOpcode opc, TCGType type, unsigned vece,
+                       TCGArg a0, ...)
+{
+    va_list va;
+    TCGv_vec v0, v1, v2, t1;
+
+    va_start(va, a0);
+    v0 = temp_tcgv_vec(arg_temp(a0));
+    v1 = temp_tcgv_vec(arg_temp(va_arg(va, TCGArg)));
+    v2 = temp_tcgv_vec(arg_temp(va_arg(va, TCGArg)));
+
+    switch (opc) {
+    case INDEX_op_shrv_vec:
+    case INDEX_op_sarv_vec:
+        /* Right shifts are negative left shifts for NEON.  */
+        t1 = tcg_temp_new_vec(type);
+        tcg_gen_neg_vec(vece, t1, v2);
+        opc = (opc == INDEX_op_shrv_vec
+               ? INDEX_op_arm_ushl_vec : INDEX_op_arm_sshl_vec);
+        vec_gen_3(opc, type, vece, tcgv_vec_arg(v0),
+                  tcgv_vec_arg(v1), tcgv_vec_arg(t1));
+        tcg_temp_free_vec(t1);
+        break;
+
+    default:
+        g_assert_not_reached();
+    }
+
+    va_end(va);
+}
+
 static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
 {
     static const TCGTargetOpDef r = { .args_ct_str = { "r" } };
@@ -2113,6 +2709,13 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
         = { .args_ct_str = { "r", "r", "rI", "rI" } };
     static const TCGTargetOpDef setc2
         = { .args_ct_str = { "r", "r", "r", "rI", "rI" } };
+    static const TCGTargetOpDef w_w = { .args_ct_str = { "w", "w" } };
+    static const TCGTargetOpDef w_r = { .args_ct_str = { "w", "r" } };
+    static const TCGTargetOpDef w_wr = { .args_ct_str = { "w", "wr" } };
+    static const TCGTargetOpDef w_r_r = { .args_ct_str = { "w", "r", "r" } };
+    static const TCGTargetOpDef w_w_w = { .args_ct_str = { "w", "w", "w" } };
+    static const TCGTargetOpDef w_w_w_w
+        = { .args_ct_str = { "w", "w", "w", "w" } };
 
     switch (op) {
     case INDEX_op_goto_ptr:
@@ -2189,6 +2792,47 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     case INDEX_op_qemu_st_i64:
         return TARGET_LONG_BITS == 32 ? &s_s_s : &s_s_s_s;
 
+    case INDEX_op_add_vec:
+    case INDEX_op_sub_vec:
+    case INDEX_op_mul_vec:
+    case INDEX_op_and_vec:
+    case INDEX_op_or_vec:
+    case INDEX_op_xor_vec:
+    case INDEX_op_andc_vec:
+    case INDEX_op_orc_vec:
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_ussub_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_smin_vec:
+    case INDEX_op_umax_vec:
+    case INDEX_op_umin_vec:
+    case INDEX_op_shlv_vec:
+    case INDEX_op_shrv_vec:
+    case INDEX_op_sarv_vec:
+    case INDEX_op_arm_sshl_vec:
+    case INDEX_op_arm_ushl_vec:
+    case INDEX_op_cmp_vec:
+        return &w_w_w;
+    case INDEX_op_not_vec:
+    case INDEX_op_neg_vec:
+    case INDEX_op_abs_vec:
+    case INDEX_op_shli_vec:
+    case INDEX_op_shri_vec:
+    case INDEX_op_sari_vec:
+        return &w_w;
+    case INDEX_op_ld_vec:
+    case INDEX_op_st_vec:
+    case INDEX_op_dupm_vec:
+        return &w_r;
+    case INDEX_op_dup_vec:
+        return &w_wr;
+    case INDEX_op_dup2_vec:
+        return &w_r_r;
+    case INDEX_op_bitsel_vec:
+        return &w_w_w_w;
+
     default:
         return NULL;
     }
@@ -2198,10 +2842,15 @@ static void tcg_target_init(TCGContext *s)
 {
     /* Only probe for the platform and capabilities if we havn't already
        determined maximum values at compile time.  */
-#ifndef use_idiv_instructions
+#if !defined(use_idiv_instructions) || !defined(use_neon_instructions)
     {
         unsigned long hwcap = qemu_getauxval(AT_HWCAP);
+#ifndef use_idiv_instructions
         use_idiv_instructions = (hwcap & HWCAP_ARM_IDIVA) != 0;
+#endif
+#ifndef use_neon_instructions
+        use_neon_instructions = (hwcap & HWCAP_ARM_NEON) != 0;
+#endif
     }
 #endif
     if (__ARM_ARCH < 7) {
@@ -2212,6 +2861,10 @@ static void tcg_target_init(TCGContext *s)
     }
 
     tcg_target_available_regs[TCG_TYPE_I32] = 0xffff;
+    if (use_neon_instructions) {
+        tcg_target_available_regs[TCG_TYPE_V64] = 0xff0f0000;
+        tcg_target_available_regs[TCG_TYPE_V128] = 0xff0f0000;
+    }
 
     tcg_target_call_clobber_regs = 0;
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_R0);
@@ -2220,6 +2873,7 @@ static void tcg_target_init(TCGContext *s)
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_R3);
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_R12);
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_R14);
+    tcg_target_call_clobber_regs |= 0xff0f0000;  /* q0-q3, q8-q15 */
 
     s->reserved_regs = 0;
     tcg_regset_set_reg(s->reserved_regs, TCG_REG_CALL_STACK);
@@ -2230,13 +2884,21 @@ static void tcg_target_init(TCGContext *s)
 static inline void tcg_out_ld(TCGContext *s, TCGType type, TCGReg arg,
                               TCGReg arg1, intptr_t arg2)
 {
-    tcg_out_ld32u(s, COND_AL, arg, arg1, arg2);
+    if (type == TCG_TYPE_I32) {
+        tcg_out_ld32u(s, COND_AL, arg, arg1, arg2);
+    } else {
+        tcg_out_vldst(s, type, true, arg, arg1, arg2);
+    }
 }
 
 static inline void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg,
                               TCGReg arg1, intptr_t arg2)
 {
-    tcg_out_st32(s, COND_AL, arg, arg1, arg2);
+    if (type == TCG_TYPE_I32) {
+        tcg_out_st32(s, COND_AL, arg, arg1, arg2);
+    } else {
+        tcg_out_vldst(s, type, false, arg, arg1, arg2);
+    }
 }
 
 static inline bool tcg_out_sti(TCGContext *s, TCGType type, TCGArg val,
@@ -2248,6 +2910,17 @@ static inline bool tcg_out_sti(TCGContext *s, TCGType type, TCGArg val,
 static inline bool tcg_out_mov(TCGContext *s, TCGType type,
                                TCGReg ret, TCGReg arg)
 {
+    if (type != TCG_TYPE_I32) {
+        if (ret != arg) {
+            tcg_out_vreg3(s, INSN_VORR, type == TCG_TYPE_V128, 0,
+                          ret, arg, arg);
+        }
+        return true;
+    }
+    if (ret >= TCG_REG_Q0 || arg >= TCG_REG_Q0) {
+        /* Cross register class moves are done via memory.  */
+        return false;
+    }
     tcg_out_mov_reg(s, COND_AL, ret, arg);
     return true;
 }
@@ -2255,7 +2928,11 @@ static inline bool tcg_out_mov(TCGContext *s, TCGType type,
 static inline void tcg_out_movi(TCGContext *s, TCGType type,
                                 TCGReg ret, tcg_target_long arg)
 {
-    tcg_out_movi32(s, COND_AL, ret, arg);
+    if (type == TCG_TYPE_I32) {
+        tcg_out_movi32(s, COND_AL, ret, arg);
+    } else {
+        tcg_out_dupi_vec(s, type, ret, arg);
+    }
 }
 
 static void tcg_out_nop_fill(tcg_insn_unit *p, int count)
@@ -154,6 +154,7 @@ bool have_bmi1;
 bool have_popcnt;
 bool have_avx1;
 bool have_avx2;
+bool have_avx512;
 
 #ifdef CONFIG_CPUID_H
 static bool have_movbe;
@@ -323,6 +324,7 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define P_SIMDF3        0x20000         /* 0xf3 opcode prefix */
 #define P_SIMDF2        0x40000         /* 0xf2 opcode prefix */
 #define P_VEXL          0x80000         /* Set VEX.L = 1 */
+/* With an EVEX prefix, P_REXW sets EVEX.W.  */
 
 #define OPC_ARITH_EvIz	(0x81)
 #define OPC_ARITH_EvIb	(0x83)
@@ -484,6 +486,31 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define OPC_VPSRAVD     (0x46 | P_EXT38 | P_DATA16)
 #define OPC_VPSRLVD     (0x45 | P_EXT38 | P_DATA16)
 #define OPC_VPSRLVQ     (0x45 | P_EXT38 | P_DATA16 | P_REXW)
+/* AVX-512 only; these require an EVEX prefix.  */
+#define OPC_VPABSQ      (0x1f | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPCMPB      (0x3f | P_EXT3A | P_DATA16)
+#define OPC_VPCMPW      (0x3f | P_EXT3A | P_DATA16 | P_REXW)
+#define OPC_VPCMPD      (0x1f | P_EXT3A | P_DATA16)
+#define OPC_VPCMPQ      (0x1f | P_EXT3A | P_DATA16 | P_REXW)
+#define OPC_VPCMPUB     (0x3e | P_EXT3A | P_DATA16)
+#define OPC_VPCMPUW     (0x3e | P_EXT3A | P_DATA16 | P_REXW)
+#define OPC_VPCMPUD     (0x1e | P_EXT3A | P_DATA16)
+#define OPC_VPCMPUQ     (0x1e | P_EXT3A | P_DATA16 | P_REXW)
+#define OPC_VPMAXSQ     (0x3d | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPMAXUQ     (0x3f | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPMINSQ     (0x39 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPMINUQ     (0x3b | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPMOVM2B    (0x28 | P_EXT38 | P_SIMDF3)
+#define OPC_VPMOVM2W    (0x28 | P_EXT38 | P_SIMDF3 | P_REXW)
+#define OPC_VPMOVM2D    (0x38 | P_EXT38 | P_SIMDF3)
+#define OPC_VPMOVM2Q    (0x38 | P_EXT38 | P_SIMDF3 | P_REXW)
+#define OPC_VPMULLQ     (0x40 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPSLLVW     (0x12 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPSRAQ      (0xe2 | P_EXT | P_DATA16 | P_REXW)
+#define OPC_VPSRAVQ     (0x46 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPSRAVW     (0x11 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPSRLVW     (0x10 | P_EXT38 | P_DATA16 | P_REXW)
+#define OPC_VPTERNLOGD  (0x25 | P_EXT3A | P_DATA16)
 #define OPC_VZEROUPPER  (0x77 | P_EXT)
 #define OPC_XCHG_ax_r32	(0x90)
 
@@ -697,7 +724,7 @@ static void tcg_out_vex_modrm(TCGContext *s, int opc, int r, int v, int rm)
    that will follow the instruction.  */
 
 static void tcg_out_sib_offset(TCGContext *s, int r, int rm, int index,
-                               int shift, intptr_t offset)
+                               int shift, intptr_t offset, int disp8_n)
 {
     int mod, len;
 
@@ -739,7 +766,9 @@ static void tcg_out_sib_offset(TCGContext *s, int r, int rm, int index,
         mod = 0, len = 4, rm = 5;
     } else if (offset == 0 && LOWREGMASK(rm) != TCG_REG_EBP) {
         mod = 0, len = 0;
-    } else if (offset == (int8_t)offset) {
+    } else if (offset % disp8_n == 0
+               && offset / disp8_n == (int8_t)(offset / disp8_n)) {
+        /* EVEX scales an 8-bit displacement by the memory operand size.  */
         mod = 0x40, len = 1;
     } else {
         mod = 0x80, len = 4;
@@ -767,7 +796,7 @@ static void tcg_out_sib_offset(TCGContext *s, int r, int rm, int index,
     }
 
     if (len == 1) {
-        tcg_out8(s, offset);
+        tcg_out8(s, offset / disp8_n);
     } else if (len == 4) {
         tcg_out32(s, offset);
     }
@@ -777,7 +806,7 @@ static void tcg_out_modrm_sib_offset(TCGContext *s, int opc, int r, int rm,
                                      int index, int shift, intptr_t offset)
 {
     tcg_out_opc(s, opc, r, rm < 0 ? 0 : rm, index < 0 ? 0 : index);
-    tcg_out_sib_offset(s, r, rm, index, shift, offset);
+    tcg_out_sib_offset(s, r, rm, index, shift, offset, 1);
 }
 
 static void tcg_out_vex_modrm_sib_offset(TCGContext *s, int opc, int r, int v,
@@ -785,7 +814,7 @@ static void tcg_out_vex_modrm_sib_offset(TCGContext *s, int opc, int r, int v,
                                          intptr_t offset)
 {
     tcg_out_vex_opc(s, opc, r, v, rm < 0 ? 0 : rm, index < 0 ? 0 : index);
-    tcg_out_sib_offset(s, r, rm, index, shift, offset);
+    tcg_out_sib_offset(s, r, rm, index, shift, offset, 1);
 }
 
 /* A simplification of the above with no index or shift.  */
@@ -801,6 +830,64 @@ static inline void tcg_out_vex_modrm_offset(TCGContext *s, int opc, int r,
     tcg_out_vex_modrm_sib_offset(s, opc, r, v, rm, -1, 0, offset);
 }
 
+/* Output an EVEX prefix for a 512-bit operation, without opmask.  We only
+   use %zmm0-%zmm15, so EVEX.R' and EVEX.V' are always set.  */
+static void tcg_out_evex_opc(TCGContext *s, int opc, int r, int v,
+                             int rm, int index)
+{
+    int tmp;
+
+    tcg_out8(s, 0x62);
+
+    /* EVEX.mm */
+    if (opc & P_EXT3A) {
+        tmp = 3;
+    } else if (opc & P_EXT38) {
+        tmp = 2;
+    } else if (opc & P_EXT) {
+        tmp = 1;
+    } else {
+        g_assert_not_reached();
+    }
+    tmp |= (r & 8 ? 0 : 0x80);             /* EVEX.R */
+    tmp |= (index & 8 ? 0 : 0x40);         /* EVEX.X */
+    tmp |= (rm & 8 ? 0 : 0x20);            /* EVEX.B */
+    tmp |= 0x10;                           /* EVEX.R' */
+    tcg_out8(s, tmp);
+
+    tmp = (opc & P_REXW ? 0x80 : 0);       /* EVEX.W */
+    tmp |= (~v & 15) << 3;                 /* EVEX.vvvv */
+    tmp |= 0x04;
+    /* EVEX.pp */
+    if (opc & P_DATA16) {
+        tmp |= 1;                          /* 0x66 */
+    } else if (opc & P_SIMDF3) {
+        tmp |= 2;                          /* 0xf3 */
+    } else if (opc & P_SIMDF2) {
+        tmp |= 3;                          /* 0xf2 */
+    }
+    tcg_out8(s, tmp);
+
+    /* EVEX.L'L = 512 bits, EVEX.V', and no broadcast or masking.  */
+    tcg_out8(s, 0x48);
+    tcg_out8(s, opc);
+}
+
+static void tcg_out_evex_modrm(TCGContext *s, int opc, int r, int v, int rm)
+{
+    tcg_out_evex_opc(s, opc, r, v, rm, 0);
+    tcg_out8(s, 0xc0 | (LOWREGMASK(r) << 3) | LOWREGMASK(rm));
+}
+
+/* DISP8_N is the size of the memory operand, by which EVEX scales an
+   8-bit displacement.  */
+static void tcg_out_evex_modrm_offset(TCGContext *s, int opc, int r, int v,
+                                      int rm, intptr_t offset, int disp8_n)
+{
+    tcg_out_evex_opc(s, opc, r, v, rm, 0);
+    tcg_out_sib_offset(s, r, rm, -1, 0, offset, disp8_n);
+}
+
 /* Output an opcode with an expected reference to the constant pool.  */
 static inline void tcg_out_modrm_pool(TCGContext *s, int opc, int r)
 {
@@ -819,6 +906,15 @@ static inline void tcg_out_vex_modrm_pool(TCGContext *s, int opc, int r)
     tcg_out32(s, 0);
 }
 
+/* Output an opcode with an expected reference to the constant pool.  */
+static inline void tcg_out_evex_modrm_pool(TCGContext *s, int opc, int r)
+{
+    tcg_out_evex_opc(s, opc, r, 0, 0, 0);
+    /* Absolute for 32-bit, pc-relative for 64-bit.  */
+    tcg_out8(s, LOWREGMASK(r) << 3 | 5);
+    tcg_out32(s, 0);
+}
+
 /* Generate dest op= src.  Uses the same ARITH_* codes as tgen_arithi.  */
 static inline void tgen_arithr(TCGContext *s, int subop, int dest, int src)
 {
@@ -868,6 +964,11 @@ static bool tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
         tcg_debug_assert(ret >= 16 && arg >= 16);
         tcg_out_vex_modrm(s, OPC_MOVDQA_VxWx | P_VEXL, ret, 0, arg);
         break;
+    case TCG_TYPE_V512:
+        /* vmovdqa64 */
+        tcg_debug_assert(ret >= 16 && arg >= 16);
+        tcg_out_evex_modrm(s, OPC_MOVDQA_VxWx | P_REXW, ret, 0, arg);
+        break;
 
     default:
         g_assert_not_reached();
@@ -883,7 +984,10 @@ static const int avx2_dup_insn[4] = {
 static bool tcg_out_dup_vec(TCGContext *s, TCGType type, unsigned vece,
                             TCGReg r, TCGReg a)
 {
-    if (have_avx2) {
+    if (type == TCG_TYPE_V512) {
+        int evex_w = (vece == MO_64 ? P_REXW : 0);
+        tcg_out_evex_modrm(s, avx2_dup_insn[vece] | evex_w, r, 0, a);
+    } else if (have_avx2) {
         int vex_l = (type == TCG_TYPE_V256 ? P_VEXL : 0);
         tcg_out_vex_modrm(s, avx2_dup_insn[vece] + vex_l, r, 0, a);
     } else {
@@ -915,7 +1019,11 @@ static bool tcg_out_dup_vec(TCGContext *s, TCGType type, unsigned vece,
 static bool tcg_out_dupm_vec(TCGContext *s, TCGType type, unsigned vece,
                              TCGReg r, TCGReg base, intptr_t offset)
 {
-    if (have_avx2) {
+    if (type == TCG_TYPE_V512) {
+        int evex_w = (vece == MO_64 ? P_REXW : 0);
+        tcg_out_evex_modrm_offset(s, avx2_dup_insn[vece] | evex_w,
+                                  r, 0, base, offset, 1 << vece);
+    } else if (have_avx2) {
         int vex_l = (type == TCG_TYPE_V256 ? P_VEXL : 0);
         tcg_out_vex_modrm_offset(s, avx2_dup_insn[vece] + vex_l,
                                  r, 0, base, offset);
@@ -950,16 +1058,25 @@ static void tcg_out_dupi_vec(TCGContext *s, TCGType type,
     int vex_l = (type == TCG_TYPE_V256 ? P_VEXL : 0);
 
     if (arg == 0) {
+        /* The VEX encoding clears the whole register, including any
+           upper bits of a 512-bit vector.  */
         tcg_out_vex_modrm(s, OPC_PXOR, ret, ret, ret);
         return;
     }
     if (arg == -1) {
-        tcg_out_vex_modrm(s, OPC_PCMPEQB + vex_l, ret, ret, ret);
+        if (type == TCG_TYPE_V512) {
+            tcg_out_evex_modrm(s, OPC_VPTERNLOGD, ret, ret, ret);
+            tcg_out8(s, 0xff); /* imm8: all ones, for any inputs */
+        } else {
+            tcg_out_vex_modrm(s, OPC_PCMPEQB + vex_l, ret, ret, ret);
+        }
         return;
     }
 
     if (TCG_TARGET_REG_BITS == 64) {
-        if (type == TCG_TYPE_V64) {
+        if (type == TCG_TYPE_V512) {
+            tcg_out_evex_modrm_pool(s, OPC_VPBROADCASTQ | P_REXW, ret);
+        } else if (type == TCG_TYPE_V64) {
             tcg_out_vex_modrm_pool(s, OPC_MOVQ_VqWq, ret);
         } else if (have_avx2) {
             tcg_out_vex_modrm_pool(s, OPC_VPBROADCASTQ + vex_l, ret);
@@ -994,6 +1111,7 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         tcg_debug_assert(ret >= 16);
         tcg_out_dupi_vec(s, type, ret, arg);
         return;
@@ -1104,6 +1222,12 @@ static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret,
         tcg_out_vex_modrm_offset(s, OPC_MOVDQU_VxWx | P_VEXL,
                                  ret, 0, arg1, arg2);
         break;
+    case TCG_TYPE_V512:
+        /* vmovdqu64 */
+        tcg_debug_assert(ret >= 16);
+        tcg_out_evex_modrm_offset(s, OPC_MOVDQU_VxWx | P_REXW,
+                                  ret, 0, arg1, arg2, 64);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1149,6 +1273,12 @@ static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg,
         tcg_out_vex_modrm_offset(s, OPC_MOVDQU_WxVx | P_VEXL,
                                  arg, 0, arg1, arg2);
         break;
+    case TCG_TYPE_V512:
+        /* vmovdqu64 */
+        tcg_debug_assert(arg >= 16);
+        tcg_out_evex_modrm_offset(s, OPC_MOVDQU_WxVx | P_REXW,
+                                  arg, 0, arg1, arg2, 64);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -2688,6 +2818,41 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
 #undef OP_32_64
 }
 
+/* Compare into opmask register %k1, then expand each mask bit
+   to a whole lane of the result.  */
+static void tcg_out_cmp_vec512(TCGContext *s, unsigned vece, TCGReg ret,
+                               TCGReg a1, TCGReg a2, TCGCond cond)
+{
+    static int const cmp_insn[4] = {
+        OPC_VPCMPB, OPC_VPCMPW, OPC_VPCMPD, OPC_VPCMPQ
+    };
+    static int const cmpu_insn[4] = {
+        OPC_VPCMPUB, OPC_VPCMPUW, OPC_VPCMPUD, OPC_VPCMPUQ
+    };
+    static int const movm_insn[4] = {
+        OPC_VPMOVM2B, OPC_VPMOVM2W, OPC_VPMOVM2D, OPC_VPMOVM2Q
+    };
+    static uint8_t const cond_to_pred[] = {
+        [TCG_COND_NEVER] = 3,
+        [TCG_COND_ALWAYS] = 7,
+        [TCG_COND_EQ] = 0,
+        [TCG_COND_NE] = 4,
+        [TCG_COND_LT] = 1,
+        [TCG_COND_GE] = 5,
+        [TCG_COND_LE] = 2,
+        [TCG_COND_GT] = 6,
+        [TCG_COND_LTU] = 1,
+        [TCG_COND_GEU] = 5,
+        [TCG_COND_LEU] = 2,
+        [TCG_COND_GTU] = 6,
+    };
+    int insn = is_unsigned_cond(cond) ? cmpu_insn[vece] : cmp_insn[vece];
+
+    tcg_out_evex_modrm(s, insn, 1, a1, a2);
+    tcg_out8(s, cond_to_pred[cond]);
+    tcg_out_evex_modrm(s, movm_insn[vece], ret, 0, 1);
+}
+
 static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
                            unsigned vecl, unsigned vece,
                            const TCGArg *args, const int *const_args)
@@ -2711,7 +2876,7 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
         OPC_PSUBUB, OPC_PSUBUW, OPC_UD2, OPC_UD2
     };
     static int const mul_insn[4] = {
-        OPC_UD2, OPC_PMULLW, OPC_PMULLD, OPC_UD2
+        OPC_UD2, OPC_PMULLW, OPC_PMULLD, OPC_VPMULLQ
     };
     static int const shift_imm_insn[4] = {
         OPC_UD2, OPC_PSHIFTW_Ib, OPC_PSHIFTD_Ib, OPC_PSHIFTQ_Ib
@@ -2735,28 +2900,28 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
         OPC_PACKUSWB, OPC_PACKUSDW, OPC_UD2, OPC_UD2
     };
     static int const smin_insn[4] = {
-        OPC_PMINSB, OPC_PMINSW, OPC_PMINSD, OPC_UD2
+        OPC_PMINSB, OPC_PMINSW, OPC_PMINSD, OPC_VPMINSQ
     };
     static int const smax_insn[4] = {
-        OPC_PMAXSB, OPC_PMAXSW, OPC_PMAXSD, OPC_UD2
+        OPC_PMAXSB, OPC_PMAXSW, OPC_PMAXSD, OPC_VPMAXSQ
     };
     static int const umin_insn[4] = {
-        OPC_PMINUB, OPC_PMINUW, OPC_PMINUD, OPC_UD2
+        OPC_PMINUB, OPC_PMINUW, OPC_PMINUD, OPC_VPMINUQ
     };
     static int const umax_insn[4] = {
-        OPC_PMAXUB, OPC_PMAXUW, OPC_PMAXUD, OPC_UD2
+        OPC_PMAXUB, OPC_PMAXUW, OPC_PMAXUD, OPC_VPMAXUQ
     };
     static int const shlv_insn[4] = {
-        /* TODO: AVX512 adds support for MO_16.  */
-        OPC_UD2, OPC_UD2, OPC_VPSLLVD, OPC_VPSLLVQ
+        /* MO_16 requires AVX512BW.  */
+        OPC_UD2, OPC_VPSLLVW, OPC_VPSLLVD, OPC_VPSLLVQ
     };
     static int const shrv_insn[4] = {
-        /* TODO: AVX512 adds support for MO_16.  */
-        OPC_UD2, OPC_UD2, OPC_VPSRLVD, OPC_VPSRLVQ
+        /* MO_16 requires AVX512BW.  */
+        OPC_UD2, OPC_VPSRLVW, OPC_VPSRLVD, OPC_VPSRLVQ
     };
     static int const sarv_insn[4] = {
-        /* TODO: AVX512 adds support for MO_16, MO_64.  */
-        OPC_UD2, OPC_UD2, OPC_VPSRAVD, OPC_UD2
+        /* MO_16 and MO_64 require AVX512.  */
+        OPC_UD2, OPC_VPSRAVW, OPC_VPSRAVD, OPC_VPSRAVQ
     };
     static int const shls_insn[4] = {
         OPC_UD2, OPC_PSLLW, OPC_PSLLD, OPC_PSLLQ
@@ -2765,14 +2930,17 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
         OPC_UD2, OPC_PSRLW, OPC_PSRLD, OPC_PSRLQ
     };
     static int const sars_insn[4] = {
-        OPC_UD2, OPC_PSRAW, OPC_PSRAD, OPC_UD2
+        /* MO_64 requires AVX512.  */
+        OPC_UD2, OPC_PSRAW, OPC_PSRAD, OPC_VPSRAQ
     };
     static int const abs_insn[4] = {
-        /* TODO: AVX512 adds support for MO_64.  */
-        OPC_PABSB, OPC_PABSW, OPC_PABSD, OPC_UD2
+        /* MO_64 requires AVX512.  */
+        OPC_PABSB, OPC_PABSW, OPC_PABSD, OPC_VPABSQ
     };
 
     TCGType type = vecl + TCG_TYPE_V64;
+    /* With EVEX, element size 64 is selected by EVEX.W.  */
+    int evex_w = (vece == MO_64 ? P_REXW : 0);
     int insn, sub;
     TCGArg a0, a1, a2;
 
@@ -2870,6 +3038,10 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
         goto gen_simd;
     gen_simd:
         tcg_debug_assert(insn != OPC_UD2);
+        if (type == TCG_TYPE_V512) {
+            tcg_out_evex_modrm(s, insn | evex_w, a0, a1, a2);
+            break;
+        }
         if (type == TCG_TYPE_V256) {
             insn |= P_VEXL;
         }
@@ -2878,6 +3050,10 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
 
     case INDEX_op_cmp_vec:
         sub = args[3];
+        if (type == TCG_TYPE_V512) {
+            tcg_out_cmp_vec512(s, vece, a0, a1, a2, sub);
+            break;
+        }
         if (sub == TCG_COND_EQ) {
             insn = cmpeq_insn[vece];
         } else if (sub == TCG_COND_GT) {
@@ -2889,6 +3065,10 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
 
     case INDEX_op_andc_vec:
         insn = OPC_PANDN;
+        if (type == TCG_TYPE_V512) {
+            tcg_out_evex_modrm(s, insn | evex_w, a0, a2, a1);
+            break;
+        }
         if (type == TCG_TYPE_V256) {
             insn |= P_VEXL;
         }
@@ -2902,11 +3082,22 @@ static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc,
         sub = 2;
         goto gen_shift;
     case INDEX_op_sari_vec:
-        tcg_debug_assert(vece != MO_64);
         sub = 4;
+        if (vece == MO_64) {
+            /* vpsraq exists only with an EVEX prefix.  */
+            tcg_debug_assert(type == TCG_TYPE_V512);
+            tcg_out_evex_modrm(s, OPC_PSHIFTD_Ib | P_REXW, sub, a0, a1);
+            tcg_out8(s, a2);
+            break;
+        }
     gen_shift:
         tcg_debug_assert(vece != MO_8);
         insn = shift_imm_insn[vece];
+        if (type == TCG_TYPE_V512) {
+            tcg_out_evex_modrm(s, insn | evex_w, sub, a0, a1);
+            tcg_out8(s, a2);
+            break;
+        }
         if (type == TCG_TYPE_V256) {
             insn |= P_VEXL;
         }
@@ -3261,8 +3452,54 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
     return NULL;
 }
 
+/* With AVX512F, BW and DQ every element size is available directly,
+   so 512-bit operations never need expansion.  */
+static int tcg_can_emit_vec_op_512(TCGOpcode opc, unsigned vece)
+{
+    switch (opc) {
+    case INDEX_op_add_vec:
+    case INDEX_op_sub_vec:
+    case INDEX_op_and_vec:
+    case INDEX_op_or_vec:
+    case INDEX_op_xor_vec:
+    case INDEX_op_andc_vec:
+    case INDEX_op_cmp_vec:
+    case INDEX_op_smin_vec:
+    case INDEX_op_smax_vec:
+    case INDEX_op_umin_vec:
+    case INDEX_op_umax_vec:
+    case INDEX_op_abs_vec:
+        return 1;
+
+    case INDEX_op_shli_vec:
+    case INDEX_op_shri_vec:
+    case INDEX_op_sari_vec:
+    case INDEX_op_shls_vec:
+    case INDEX_op_shrs_vec:
+    case INDEX_op_sars_vec:
+    case INDEX_op_shlv_vec:
+    case INDEX_op_shrv_vec:
+    case INDEX_op_sarv_vec:
+    case INDEX_op_mul_vec:
+        return vece >= MO_16;
+
+    case INDEX_op_ssadd_vec:
+    case INDEX_op_usadd_vec:
+    case INDEX_op_sssub_vec:
+    case INDEX_op_ussub_vec:
+        return vece <= MO_16;
+
+    default:
+        return 0;
+    }
+}
+
 int tcg_can_emit_vec_op(TCGOpcode opc, TCGType type, unsigned vece)
 {
+    if (type == TCG_TYPE_V512) {
+        return tcg_can_emit_vec_op_512(opc, vece);
+    }
+
     switch (opc) {
     case INDEX_op_add_vec:
     case INDEX_op_sub_vec:
@@ -3813,6 +4050,15 @@ static void tcg_target_init(TCGContext *s)
                 have_avx1 = (c & bit_AVX) != 0;
                 have_avx2 = (b7 & bit_AVX2) != 0;
             }
+#if TCG_TARGET_REG_BITS == 64
+            /* AVX-512 also needs the OS to save opmask and ZMM state.  */
+            if ((xcrl & 0xe6) == 0xe6) {
+                have_avx512 = have_avx2
+                    && (b7 & bit_AVX512F) != 0
+                    && (b7 & bit_AVX512BW) != 0
+                    && (b7 & bit_AVX512DQ) != 0;
+            }
+#endif
         }
     }
 
@@ -3835,6 +4081,9 @@ static void tcg_target_init(TCGContext *s)
     if (have_avx2) {
         tcg_target_available_regs[TCG_TYPE_V256] = ALL_VECTOR_REGS;
     }
+    if (have_avx512) {
+        tcg_target_available_regs[TCG_TYPE_V512] = ALL_VECTOR_REGS;
+    }
 
     tcg_target_call_clobber_regs = ALL_VECTOR_REGS;
     tcg_regset_set_reg(tcg_target_call_clobber_regs, TCG_REG_EAX);
@@ -1304,6 +1304,9 @@ TCGv_vec tcg_temp_new_vec(TCGType type)
     case TCG_TYPE_V256:
         assert(TCG_TARGET_HAS_v256);
         break;
+    case TCG_TYPE_V512:
+        assert(TCG_TARGET_HAS_v512);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1403,7 +1406,8 @@ int tcg_check_temp_count(void)
 bool tcg_op_supported(TCGOpcode op)
 {
     const bool have_vec
-        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256;
+        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256
+        | TCG_TARGET_HAS_v512;
 
     switch (op) {
     case INDEX_op_discard:
@@ -2350,6 +2354,13 @@ static TCGOp *tcg_op_alloc(TCGOpcode opc)
 TCGOp *tcg_emit_op(TCGOpcode opc)
 {
     TCGOp *op = tcg_op_alloc(opc);
+
+#ifdef CONFIG_PLUGIN
+    if (tcg_ctx->emit_before_op) {
+        QTAILQ_INSERT_BEFORE(tcg_ctx->emit_before_op, op, link);
+        return op;
+    }
+#endif
     QTAILQ_INSERT_TAIL(&tcg_ctx->ops, op, link);
     return op;
 }
@@ -3084,20 +3095,38 @@ static void check_regs(TCGContext *s)
 
 static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
 {
+    tcg_target_long size, align;
+
+    switch (ts->type) {
+    case TCG_TYPE_V64:
+        size = align = 8;
+        break;
+    case TCG_TYPE_V128:
+        size = align = 16;
+        break;
+    case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
+        /* The wider types are stored with unaligned moves.  */
+        size = 16 << (ts->type - TCG_TYPE_V128);
+        align = 16;
+        break;
+    default:
+        size = align = sizeof(tcg_target_long);
+        break;
+    }
+
 #if !(defined(__sparc__) && TCG_TARGET_REG_BITS == 64)
     /* Sparc64 stack is accessed with offset of 2047 */
-    s->current_frame_offset = (s->current_frame_offset +
-                               (tcg_target_long)sizeof(tcg_target_long) - 1) &
-        ~(sizeof(tcg_target_long) - 1);
+    s->current_frame_offset = (s->current_frame_offset + align - 1) &
+        ~(align - 1);
 #endif
-    if (s->current_frame_offset + (tcg_target_long)sizeof(tcg_target_long) >
-        s->frame_end) {
+    if (s->current_frame_offset + size > s->frame_end) {
         tcg_abort();
     }
     ts->mem_offset = s->current_frame_offset;
     ts->mem_base = s->frame_temp;
     ts->mem_allocated = 1;
-    s->current_frame_offset += sizeof(tcg_target_long);
+    s->current_frame_offset += size;
 }
 
 static void temp_load(TCGContext *, TCGTemp *, TCGRegSet, TCGRegSet, TCGRegSet);
@@ -4018,6 +4047,46 @@ int64_t tcg_cpu_exec_time(void)
 #endif
 
 
+/*
+ * Return true if the ops emitted so far may write guest memory, either
+ * with a qemu_st op or from a helper that is not free of side effects.
+ */
+bool tcg_op_list_may_write_memory(TCGContext *s)
+{
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        switch (op->opc) {
+        case INDEX_op_qemu_st_i32:
+        case INDEX_op_qemu_st_i64:
+            return true;
+        case INDEX_op_call:
+            if (!(op->args[TCGOP_CALLO(op) + TCGOP_CALLI(op) + 1]
+                  & TCG_CALL_NO_SIDE_EFFECTS)) {
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+/* Return true if the ops emitted so far contain a guest memory load.  */
+bool tcg_op_list_reads_memory(TCGContext *s)
+{
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        if (op->opc == INDEX_op_qemu_ld_i32 ||
+            op->opc == INDEX_op_qemu_ld_i64) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 {
 #ifdef CONFIG_PROFILER
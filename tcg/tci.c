@@ -285,21 +285,6 @@ tci_read_ulong(const tcg_target_ulong *regs, uint8_t **tb_ptr)
     return taddr;
 }
 
-/* Read indexed register or constant (native size) from bytecode. */
-static tcg_target_ulong
-tci_read_ri(const tcg_target_ulong *regs, uint8_t **tb_ptr)
-{
-    tcg_target_ulong value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i(tb_ptr);
-    } else {
-        value = tci_read_reg(regs, r);
-    }
-    return value;
-}
-
 /* Read indexed register or constant (32 bit) from bytecode. */
 static uint32_t tci_read_ri32(const tcg_target_ulong *regs, uint8_t **tb_ptr)
 {
@@ -428,52 +413,214 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
     return result;
 }
 
+/* Load from host memory, sign or zero extending to 64 bits. */
+static uint64_t tci_ld_host(void *haddr, MemOp mop)
+{
+    switch (mop & (MO_BSWAP | MO_SSIZE)) {
+    case MO_UB:
+        return ldub_p(haddr);
+    case MO_SB:
+        return (int8_t)ldub_p(haddr);
+    case MO_LEUW:
+        return lduw_le_p(haddr);
+    case MO_LESW:
+        return (int16_t)lduw_le_p(haddr);
+    case MO_LEUL:
+        return (uint32_t)ldl_le_p(haddr);
+    case MO_LESL:
+        return (int32_t)ldl_le_p(haddr);
+    case MO_LEQ:
+        return ldq_le_p(haddr);
+    case MO_BEUW:
+        return lduw_be_p(haddr);
+    case MO_BESW:
+        return (int16_t)lduw_be_p(haddr);
+    case MO_BEUL:
+        return (uint32_t)ldl_be_p(haddr);
+    case MO_BESL:
+        return (int32_t)ldl_be_p(haddr);
+    case MO_BEQ:
+        return ldq_be_p(haddr);
+    default:
+        tcg_abort();
+    }
+}
+
+static void tci_st_host(void *haddr, MemOp mop, uint64_t val)
+{
+    switch (mop & (MO_BSWAP | MO_SIZE)) {
+    case MO_UB:
+        stb_p(haddr, val);
+        break;
+    case MO_LEUW:
+        stw_le_p(haddr, val);
+        break;
+    case MO_LEUL:
+        stl_le_p(haddr, val);
+        break;
+    case MO_LEQ:
+        stq_le_p(haddr, val);
+        break;
+    case MO_BEUW:
+        stw_be_p(haddr, val);
+        break;
+    case MO_BEUL:
+        stl_be_p(haddr, val);
+        break;
+    case MO_BEQ:
+        stq_be_p(haddr, val);
+        break;
+    default:
+        tcg_abort();
+    }
+}
+
+#ifdef CONFIG_SOFTMMU
+/*
+ * The TLB hit path of qemu_ld/qemu_st, done inline as the native backends
+ * do instead of going through the out-of-line helpers.  Returns NULL if
+ * the access is not naturally aligned or if the comparator does not match
+ * the page exactly, which includes TLB misses and all the TLB_* flags
+ * (MMIO, watchpoints, dirty tracking...); the helpers handle those.
+ */
+static inline void *tci_tlb_lookup(CPUArchState *env, target_ulong taddr,
+                                   TCGMemOpIdx oi, bool is_store)
+{
+    unsigned size = memop_size(get_memop(oi));
+    CPUTLBEntry *entry = tlb_entry(env, get_mmuidx(oi), taddr);
+    target_ulong cmp = is_store ? tlb_addr_write(entry) : entry->addr_read;
+
+    if (unlikely(taddr & (size - 1)) ||
+        unlikely(cmp != (taddr & TARGET_PAGE_MASK))) {
+        return NULL;
+    }
+    return (void *)((uintptr_t)taddr + entry->addend);
+}
+#endif
+
+static uint64_t tci_qemu_ld(CPUArchState *env, target_ulong taddr,
+                            TCGMemOpIdx oi, uintptr_t ra)
+{
+    MemOp mop = get_memop(oi);
 #ifdef CONFIG_SOFTMMU
-# define qemu_ld_ub \
-    helper_ret_ldub_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_leuw \
-    helper_le_lduw_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_leul \
-    helper_le_ldul_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_leq \
-    helper_le_ldq_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_beuw \
-    helper_be_lduw_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_beul \
-    helper_be_ldul_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_ld_beq \
-    helper_be_ldq_mmu(env, taddr, oi, (uintptr_t)tb_ptr)
-# define qemu_st_b(X) \
-    helper_ret_stb_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_lew(X) \
-    helper_le_stw_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_lel(X) \
-    helper_le_stl_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_leq(X) \
-    helper_le_stq_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_bew(X) \
-    helper_be_stw_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_bel(X) \
-    helper_be_stl_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
-# define qemu_st_beq(X) \
-    helper_be_stq_mmu(env, taddr, X, oi, (uintptr_t)tb_ptr)
+    void *haddr = tci_tlb_lookup(env, taddr, oi, false);
+
+    if (likely(haddr)) {
+        return tci_ld_host(haddr, mop);
+    }
+
+    switch (mop & (MO_BSWAP | MO_SSIZE)) {
+    case MO_UB:
+        return helper_ret_ldub_mmu(env, taddr, oi, ra);
+    case MO_SB:
+        return (int8_t)helper_ret_ldub_mmu(env, taddr, oi, ra);
+    case MO_LEUW:
+        return helper_le_lduw_mmu(env, taddr, oi, ra);
+    case MO_LESW:
+        return (int16_t)helper_le_lduw_mmu(env, taddr, oi, ra);
+    case MO_LEUL:
+        return (uint32_t)helper_le_ldul_mmu(env, taddr, oi, ra);
+    case MO_LESL:
+        return (int32_t)helper_le_ldul_mmu(env, taddr, oi, ra);
+    case MO_LEQ:
+        return helper_le_ldq_mmu(env, taddr, oi, ra);
+    case MO_BEUW:
+        return helper_be_lduw_mmu(env, taddr, oi, ra);
+    case MO_BESW:
+        return (int16_t)helper_be_lduw_mmu(env, taddr, oi, ra);
+    case MO_BEUL:
+        return (uint32_t)helper_be_ldul_mmu(env, taddr, oi, ra);
+    case MO_BESL:
+        return (int32_t)helper_be_ldul_mmu(env, taddr, oi, ra);
+    case MO_BEQ:
+        return helper_be_ldq_mmu(env, taddr, oi, ra);
+    default:
+        tcg_abort();
+    }
+#else
+    return tci_ld_host(g2h(taddr), mop);
+#endif
+}
+
+static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
+                        TCGMemOpIdx oi, uintptr_t ra)
+{
+    MemOp mop = get_memop(oi);
+#ifdef CONFIG_SOFTMMU
+    void *haddr = tci_tlb_lookup(env, taddr, oi, true);
+
+    if (likely(haddr)) {
+        tci_st_host(haddr, mop, val);
+        return;
+    }
+
+    switch (mop & (MO_BSWAP | MO_SIZE)) {
+    case MO_UB:
+        helper_ret_stb_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_LEUW:
+        helper_le_stw_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_LEUL:
+        helper_le_stl_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_LEQ:
+        helper_le_stq_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_BEUW:
+        helper_be_stw_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_BEUL:
+        helper_be_stl_mmu(env, taddr, val, oi, ra);
+        break;
+    case MO_BEQ:
+        helper_be_stq_mmu(env, taddr, val, oi, ra);
+        break;
+    default:
+        tcg_abort();
+    }
+#else
+    tci_st_host(g2h(taddr), mop, val);
+#endif
+}
+
+/*
+ * Threaded dispatch: every op ends with its own copy of the indirect jump
+ * to the next op, so that the host branch predictor sees one jump per op
+ * instead of a single one shared by the whole interpreter.  The frequent
+ * ops are reached directly from the dispatch table, the others through
+ * the switch statement.
+ */
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+# define tci_op_start() (op_size = tb_ptr[1], old_code_ptr = tb_ptr)
+#else
+# define tci_op_start() ((void)0)
+#endif
+
+#if defined(GETPC)
+# define tci_set_tb_ptr() (tci_tb_ptr = (uintptr_t)tb_ptr)
 #else
-# define qemu_ld_ub      ldub_p(g2h(taddr))
-# define qemu_ld_leuw    lduw_le_p(g2h(taddr))
-# define qemu_ld_leul    (uint32_t)ldl_le_p(g2h(taddr))
-# define qemu_ld_leq     ldq_le_p(g2h(taddr))
-# define qemu_ld_beuw    lduw_be_p(g2h(taddr))
-# define qemu_ld_beul    (uint32_t)ldl_be_p(g2h(taddr))
-# define qemu_ld_beq     ldq_be_p(g2h(taddr))
-# define qemu_st_b(X)    stb_p(g2h(taddr), X)
-# define qemu_st_lew(X)  stw_le_p(g2h(taddr), X)
-# define qemu_st_lel(X)  stl_le_p(g2h(taddr), X)
-# define qemu_st_leq(X)  stq_le_p(g2h(taddr), X)
-# define qemu_st_bew(X)  stw_be_p(g2h(taddr), X)
-# define qemu_st_bel(X)  stl_be_p(g2h(taddr), X)
-# define qemu_st_beq(X)  stq_be_p(g2h(taddr), X)
+# define tci_set_tb_ptr() ((void)0)
 #endif
 
+#define TCI_OP(name) [INDEX_op_##name] = &&do_##name
+
+#define TCI_DISPATCH()                          \
+    do {                                        \
+        opc = tb_ptr[0];                        \
+        tci_op_start();                         \
+        tci_set_tb_ptr();                       \
+        /* Skip opcode and size entry. */       \
+        tb_ptr += 2;                            \
+        goto *dispatch[opc];                    \
+    } while (0)
+
+#define TCI_NEXT()                                      \
+    do {                                                \
+        tci_assert(tb_ptr == old_code_ptr + op_size);   \
+        TCI_DISPATCH();                                 \
+    } while (0)
+
 /* Interpret pseudo code in tb. */
 uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
 {
@@ -481,795 +628,781 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
     long tcg_temps[CPU_TEMP_BUF_NLONGS];
     uintptr_t sp_value = (uintptr_t)(tcg_temps + CPU_TEMP_BUF_NLONGS);
     uintptr_t ret = 0;
-
-    regs[TCG_AREG0] = (tcg_target_ulong)env;
-    regs[TCG_REG_CALL_STACK] = sp_value;
-    tci_assert(tb_ptr);
-
-    for (;;) {
-        TCGOpcode opc = tb_ptr[0];
+    TCGOpcode opc;
 #if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
-        uint8_t op_size = tb_ptr[1];
-        uint8_t *old_code_ptr = tb_ptr;
+    uint8_t op_size;
+    uint8_t *old_code_ptr;
 #endif
-        tcg_target_ulong t0;
-        tcg_target_ulong t1;
-        tcg_target_ulong t2;
-        tcg_target_ulong label;
-        TCGCond condition;
-        target_ulong taddr;
-        uint8_t tmp8;
-        uint16_t tmp16;
-        uint32_t tmp32;
-        uint64_t tmp64;
+    tcg_target_ulong t0;
+    tcg_target_ulong t1;
+    tcg_target_ulong t2;
+    tcg_target_ulong label;
+    TCGCond condition;
+    target_ulong taddr;
+    uint8_t tmp8;
+    uint16_t tmp16;
+    uint32_t tmp32;
+    uint64_t tmp64;
 #if TCG_TARGET_REG_BITS == 32
-        uint64_t v64;
+    uint64_t v64;
 #endif
-        TCGMemOpIdx oi;
-
-#if defined(GETPC)
-        tci_tb_ptr = (uintptr_t)tb_ptr;
+    TCGMemOpIdx oi;
+    static const void *const dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&do_switch,
+        TCI_OP(call),
+        TCI_OP(br),
+        TCI_OP(setcond_i32),
+        TCI_OP(mov_i32),
+        TCI_OP(movi_i32),
+        TCI_OP(ld8u_i32),
+        TCI_OP(ld_i32),
+        TCI_OP(st8_i32),
+        TCI_OP(st16_i32),
+        TCI_OP(st_i32),
+        TCI_OP(add_i32),
+        TCI_OP(sub_i32),
+        TCI_OP(mul_i32),
+        TCI_OP(and_i32),
+        TCI_OP(or_i32),
+        TCI_OP(xor_i32),
+        TCI_OP(shl_i32),
+        TCI_OP(shr_i32),
+        TCI_OP(sar_i32),
+        TCI_OP(brcond_i32),
+        TCI_OP(exit_tb),
+        TCI_OP(goto_tb),
+        TCI_OP(qemu_ld_i32),
+        TCI_OP(qemu_ld_i64),
+        TCI_OP(qemu_st_i32),
+        TCI_OP(qemu_st_i64),
+#if TCG_TARGET_REG_BITS == 64
+        TCI_OP(setcond_i64),
+        TCI_OP(mov_i64),
+        TCI_OP(movi_i64),
+        TCI_OP(ld8u_i64),
+        TCI_OP(ld16u_i64),
+        TCI_OP(ld32u_i64),
+        TCI_OP(ld32s_i64),
+        TCI_OP(ld_i64),
+        TCI_OP(st8_i64),
+        TCI_OP(st16_i64),
+        TCI_OP(st32_i64),
+        TCI_OP(st_i64),
+        TCI_OP(add_i64),
+        TCI_OP(sub_i64),
+        TCI_OP(mul_i64),
+        TCI_OP(and_i64),
+        TCI_OP(or_i64),
+        TCI_OP(xor_i64),
+        TCI_OP(shl_i64),
+        TCI_OP(shr_i64),
+        TCI_OP(sar_i64),
+        TCI_OP(brcond_i64),
 #endif
+    };
+
+    regs[TCG_AREG0] = (tcg_target_ulong)env;
+    regs[TCG_REG_CALL_STACK] = sp_value;
+    tci_assert(tb_ptr);
 
-        /* Skip opcode and size entry. */
-        tb_ptr += 2;
+    TCI_DISPATCH();
 
-        switch (opc) {
-        case INDEX_op_call:
-            t0 = tci_read_ri(regs, &tb_ptr);
+do_switch:
+    switch (opc) {
+    case INDEX_op_call:
+    do_call:
+        t0 = tci_read_i(&tb_ptr);
 #if TCG_TARGET_REG_BITS == 32
-            tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
-                                          tci_read_reg(regs, TCG_REG_R1),
-                                          tci_read_reg(regs, TCG_REG_R2),
-                                          tci_read_reg(regs, TCG_REG_R3),
-                                          tci_read_reg(regs, TCG_REG_R5),
-                                          tci_read_reg(regs, TCG_REG_R6),
-                                          tci_read_reg(regs, TCG_REG_R7),
-                                          tci_read_reg(regs, TCG_REG_R8),
-                                          tci_read_reg(regs, TCG_REG_R9),
-                                          tci_read_reg(regs, TCG_REG_R10),
-                                          tci_read_reg(regs, TCG_REG_R11),
-                                          tci_read_reg(regs, TCG_REG_R12));
-            tci_write_reg(regs, TCG_REG_R0, tmp64);
-            tci_write_reg(regs, TCG_REG_R1, tmp64 >> 32);
+        tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
+                                      tci_read_reg(regs, TCG_REG_R1),
+                                      tci_read_reg(regs, TCG_REG_R2),
+                                      tci_read_reg(regs, TCG_REG_R3),
+                                      tci_read_reg(regs, TCG_REG_R5),
+                                      tci_read_reg(regs, TCG_REG_R6),
+                                      tci_read_reg(regs, TCG_REG_R7),
+                                      tci_read_reg(regs, TCG_REG_R8),
+                                      tci_read_reg(regs, TCG_REG_R9),
+                                      tci_read_reg(regs, TCG_REG_R10),
+                                      tci_read_reg(regs, TCG_REG_R11),
+                                      tci_read_reg(regs, TCG_REG_R12));
+        tci_write_reg(regs, TCG_REG_R0, tmp64);
+        tci_write_reg(regs, TCG_REG_R1, tmp64 >> 32);
 #else
-            tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
-                                          tci_read_reg(regs, TCG_REG_R1),
-                                          tci_read_reg(regs, TCG_REG_R2),
-                                          tci_read_reg(regs, TCG_REG_R3),
-                                          tci_read_reg(regs, TCG_REG_R5),
-                                          tci_read_reg(regs, TCG_REG_R6));
-            tci_write_reg(regs, TCG_REG_R0, tmp64);
+        tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
+                                      tci_read_reg(regs, TCG_REG_R1),
+                                      tci_read_reg(regs, TCG_REG_R2),
+                                      tci_read_reg(regs, TCG_REG_R3),
+                                      tci_read_reg(regs, TCG_REG_R5),
+                                      tci_read_reg(regs, TCG_REG_R6));
+        tci_write_reg(regs, TCG_REG_R0, tmp64);
 #endif
-            break;
-        case INDEX_op_br:
-            label = tci_read_label(&tb_ptr);
-            tci_assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr = (uint8_t *)label;
-            continue;
-        case INDEX_op_setcond_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
-            break;
+        TCI_NEXT();
+    case INDEX_op_br:
+    do_br:
+        label = tci_read_label(&tb_ptr);
+        tci_assert(tb_ptr == old_code_ptr + op_size);
+        tb_ptr = (uint8_t *)label;
+        TCI_DISPATCH();
+    case INDEX_op_setcond_i32:
+    do_setcond_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
+        TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
-            t0 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            v64 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
-            break;
+    case INDEX_op_setcond2_i32:
+        t0 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        v64 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
+        TCI_NEXT();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
-            break;
+    case INDEX_op_setcond_i64:
+    do_setcond_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
+        TCI_NEXT();
 #endif
-        case INDEX_op_mov_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i32(&tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
-
-            /* Load/store operations (32 bit). */
-
-        case INDEX_op_ld8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i32:
-            TODO();
-            break;
-        case INDEX_op_ld16u_i32:
-            TODO();
-            break;
-        case INDEX_op_ld16s_i32:
-            TODO();
-            break;
-        case INDEX_op_ld_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i32:
-            t0 = tci_read_r8(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i32:
-            t0 = tci_read_r16(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i32:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_assert(t1 != sp_value || (int32_t)t2 < 0);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
-
-            /* Arithmetic operations (32 bit). */
-
-        case INDEX_op_add_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 * t2);
-            break;
+    case INDEX_op_mov_i32:
+    do_mov_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
+    case INDEX_op_movi_i32:
+    do_movi_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_i32(&tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
+
+        /* Load/store operations (32 bit). */
+
+    case INDEX_op_ld8u_i32:
+    do_ld8u_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_ld8s_i32:
+        TODO();
+        TCI_NEXT();
+    case INDEX_op_ld16u_i32:
+        TODO();
+        TCI_NEXT();
+    case INDEX_op_ld16s_i32:
+        TODO();
+        TCI_NEXT();
+    case INDEX_op_ld_i32:
+    do_ld_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_st8_i32:
+    do_st8_i32:
+        t0 = tci_read_r8(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint8_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+    case INDEX_op_st16_i32:
+    do_st16_i32:
+        t0 = tci_read_r16(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint16_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+    case INDEX_op_st_i32:
+    do_st_i32:
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_assert(t1 != sp_value || (int32_t)t2 < 0);
+        *(uint32_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+
+        /* Arithmetic operations (32 bit). */
+
+    case INDEX_op_add_i32:
+    do_add_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 + t2);
+        TCI_NEXT();
+    case INDEX_op_sub_i32:
+    do_sub_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 - t2);
+        TCI_NEXT();
+    case INDEX_op_mul_i32:
+    do_mul_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 * t2);
+        TCI_NEXT();
 #if TCG_TARGET_HAS_div_i32
-        case INDEX_op_div_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
-            break;
-        case INDEX_op_divu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 / t2);
-            break;
-        case INDEX_op_rem_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
-            break;
-        case INDEX_op_remu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 % t2);
-            break;
+    case INDEX_op_div_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
+        TCI_NEXT();
+    case INDEX_op_divu_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 / t2);
+        TCI_NEXT();
+    case INDEX_op_rem_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
+        TCI_NEXT();
+    case INDEX_op_remu_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 % t2);
+        TCI_NEXT();
 #elif TCG_TARGET_HAS_div2_i32
-        case INDEX_op_div2_i32:
-        case INDEX_op_divu2_i32:
-            TODO();
-            break;
+    case INDEX_op_div2_i32:
+    case INDEX_op_divu2_i32:
+        TODO();
+        TCI_NEXT();
 #endif
-        case INDEX_op_and_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 ^ t2);
-            break;
-
-            /* Shift/rotate operations (32 bit). */
-
-        case INDEX_op_shl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 << (t2 & 31));
-            break;
-        case INDEX_op_shr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 >> (t2 & 31));
-            break;
-        case INDEX_op_sar_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
-            break;
+    case INDEX_op_and_i32:
+    do_and_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 & t2);
+        TCI_NEXT();
+    case INDEX_op_or_i32:
+    do_or_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 | t2);
+        TCI_NEXT();
+    case INDEX_op_xor_i32:
+    do_xor_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 ^ t2);
+        TCI_NEXT();
+
+        /* Shift/rotate operations (32 bit). */
+
+    case INDEX_op_shl_i32:
+    do_shl_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 << (t2 & 31));
+        TCI_NEXT();
+    case INDEX_op_shr_i32:
+    do_shr_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 >> (t2 & 31));
+        TCI_NEXT();
+    case INDEX_op_sar_i32:
+    do_sar_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
+        TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
-            break;
-        case INDEX_op_rotr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
-            break;
+    case INDEX_op_rotl_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
+        TCI_NEXT();
+    case INDEX_op_rotr_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            t2 = tci_read_r32(regs, &tb_ptr);
-            tmp16 = *tb_ptr++;
-            tmp8 = *tb_ptr++;
-            tmp32 = (((1 << tmp8) - 1) << tmp16);
-            tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
-            break;
+    case INDEX_op_deposit_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        t2 = tci_read_r32(regs, &tb_ptr);
+        tmp16 = *tb_ptr++;
+        tmp8 = *tb_ptr++;
+        tmp32 = (((1 << tmp8) - 1) << tmp16);
+        tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
+        TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i32:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare32(t0, t1, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
+    case INDEX_op_brcond_i32:
+    do_brcond_i32:
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare32(t0, t1, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            TCI_DISPATCH();
+        }
+        TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_add2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            tmp64 += tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_sub2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            tmp64 -= tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_brcond2_i32:
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            v64 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(tmp64, v64, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
-        case INDEX_op_mulu2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            t2 = tci_read_r32(regs, &tb_ptr);
-            tmp64 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, t2 * tmp64);
-            break;
+    case INDEX_op_add2_i32:
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        tmp64 += tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, tmp64);
+        TCI_NEXT();
+    case INDEX_op_sub2_i32:
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        tmp64 -= tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, tmp64);
+        TCI_NEXT();
+    case INDEX_op_brcond2_i32:
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        v64 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare64(tmp64, v64, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            TCI_DISPATCH();
+        }
+        TCI_NEXT();
+    case INDEX_op_mulu2_i32:
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        t2 = tci_read_r32(regs, &tb_ptr);
+        tmp64 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, t2 * tmp64);
+        TCI_NEXT();
 #endif /* TCG_TARGET_REG_BITS == 32 */
 #if TCG_TARGET_HAS_ext8s_i32
-        case INDEX_op_ext8s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    case INDEX_op_ext8s_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8s(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32
-        case INDEX_op_ext16s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    case INDEX_op_ext16s_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16s(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32
-        case INDEX_op_ext8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    case INDEX_op_ext8u_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32
-        case INDEX_op_ext16u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    case INDEX_op_ext16u_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32
-        case INDEX_op_bswap16_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, bswap16(t1));
-            break;
+    case INDEX_op_bswap16_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, bswap16(t1));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32
-        case INDEX_op_bswap32_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, bswap32(t1));
-            break;
+    case INDEX_op_bswap32_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, bswap32(t1));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i32
-        case INDEX_op_not_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ~t1);
-            break;
+    case INDEX_op_not_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ~t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i32
-        case INDEX_op_neg_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, -t1);
-            break;
+    case INDEX_op_neg_i32:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, -t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_mov_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i64(&tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
-
-            /* Load/store operations (64 bit). */
-
-        case INDEX_op_ld8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i64:
-            TODO();
-            break;
-        case INDEX_op_ld16u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld16s_i64:
-            TODO();
-            break;
-        case INDEX_op_ld32u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld32s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i64:
-            t0 = tci_read_r8(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i64:
-            t0 = tci_read_r16(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st32_i64:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i64:
-            t0 = tci_read_r64(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_assert(t1 != sp_value || (int32_t)t2 < 0);
-            *(uint64_t *)(t1 + t2) = t0;
-            break;
-
-            /* Arithmetic operations (64 bit). */
-
-        case INDEX_op_add_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 * t2);
-            break;
+    case INDEX_op_mov_i64:
+    do_mov_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
+    case INDEX_op_movi_i64:
+    do_movi_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_i64(&tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
+
+        /* Load/store operations (64 bit). */
+
+    case INDEX_op_ld8u_i64:
+    do_ld8u_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_ld8s_i64:
+        TODO();
+        TCI_NEXT();
+    case INDEX_op_ld16u_i64:
+    do_ld16u_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_ld16s_i64:
+        TODO();
+        TCI_NEXT();
+    case INDEX_op_ld32u_i64:
+    do_ld32u_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_ld32s_i64:
+    do_ld32s_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_ld_i64:
+    do_ld_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
+        TCI_NEXT();
+    case INDEX_op_st8_i64:
+    do_st8_i64:
+        t0 = tci_read_r8(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint8_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+    case INDEX_op_st16_i64:
+    do_st16_i64:
+        t0 = tci_read_r16(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint16_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+    case INDEX_op_st32_i64:
+    do_st32_i64:
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint32_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+    case INDEX_op_st_i64:
+    do_st_i64:
+        t0 = tci_read_r64(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_assert(t1 != sp_value || (int32_t)t2 < 0);
+        *(uint64_t *)(t1 + t2) = t0;
+        TCI_NEXT();
+
+        /* Arithmetic operations (64 bit). */
+
+    case INDEX_op_add_i64:
+    do_add_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 + t2);
+        TCI_NEXT();
+    case INDEX_op_sub_i64:
+    do_sub_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 - t2);
+        TCI_NEXT();
+    case INDEX_op_mul_i64:
+    do_mul_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 * t2);
+        TCI_NEXT();
 #if TCG_TARGET_HAS_div_i64
-        case INDEX_op_div_i64:
-        case INDEX_op_divu_i64:
-        case INDEX_op_rem_i64:
-        case INDEX_op_remu_i64:
-            TODO();
-            break;
+    case INDEX_op_div_i64:
+    case INDEX_op_divu_i64:
+    case INDEX_op_rem_i64:
+    case INDEX_op_remu_i64:
+        TODO();
+        TCI_NEXT();
 #elif TCG_TARGET_HAS_div2_i64
-        case INDEX_op_div2_i64:
-        case INDEX_op_divu2_i64:
-            TODO();
-            break;
+    case INDEX_op_div2_i64:
+    case INDEX_op_divu2_i64:
+        TODO();
+        TCI_NEXT();
 #endif
-        case INDEX_op_and_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 ^ t2);
-            break;
-
-            /* Shift/rotate operations (64 bit). */
-
-        case INDEX_op_shl_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 << (t2 & 63));
-            break;
-        case INDEX_op_shr_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 >> (t2 & 63));
-            break;
-        case INDEX_op_sar_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
-            break;
+    case INDEX_op_and_i64:
+    do_and_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 & t2);
+        TCI_NEXT();
+    case INDEX_op_or_i64:
+    do_or_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 | t2);
+        TCI_NEXT();
+    case INDEX_op_xor_i64:
+    do_xor_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 ^ t2);
+        TCI_NEXT();
+
+        /* Shift/rotate operations (64 bit). */
+
+    case INDEX_op_shl_i64:
+    do_shl_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 << (t2 & 63));
+        TCI_NEXT();
+    case INDEX_op_shr_i64:
+    do_shr_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 >> (t2 & 63));
+        TCI_NEXT();
+    case INDEX_op_sar_i64:
+    do_sar_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
+        TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
-            break;
-        case INDEX_op_rotr_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
-            break;
+    case INDEX_op_rotl_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
+        TCI_NEXT();
+    case INDEX_op_rotr_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            t2 = tci_read_r64(regs, &tb_ptr);
-            tmp16 = *tb_ptr++;
-            tmp8 = *tb_ptr++;
-            tmp64 = (((1ULL << tmp8) - 1) << tmp16);
-            tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
-            break;
+    case INDEX_op_deposit_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        t2 = tci_read_r64(regs, &tb_ptr);
+        tmp16 = *tb_ptr++;
+        tmp8 = *tb_ptr++;
+        tmp64 = (((1ULL << tmp8) - 1) << tmp16);
+        tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
+        TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i64:
-            t0 = tci_read_r64(regs, &tb_ptr);
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(t0, t1, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
+    case INDEX_op_brcond_i64:
+    do_brcond_i64:
+        t0 = tci_read_r64(regs, &tb_ptr);
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare64(t0, t1, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            TCI_DISPATCH();
+        }
+        TCI_NEXT();
 #if TCG_TARGET_HAS_ext8u_i64
-        case INDEX_op_ext8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_ext8u_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8s_i64
-        case INDEX_op_ext8s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_ext8s_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i64
-        case INDEX_op_ext16s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_ext16s_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i64
-        case INDEX_op_ext16u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_ext16u_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext32s_i64
-        case INDEX_op_ext32s_i64:
+    case INDEX_op_ext32s_i64:
 #endif
-        case INDEX_op_ext_i32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_ext_i32_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #if TCG_TARGET_HAS_ext32u_i64
-        case INDEX_op_ext32u_i64:
+    case INDEX_op_ext32u_i64:
 #endif
-        case INDEX_op_extu_i32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    case INDEX_op_extu_i32_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        TCI_NEXT();
 #if TCG_TARGET_HAS_bswap16_i64
-        case INDEX_op_bswap16_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap16(t1));
-            break;
+    case INDEX_op_bswap16_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap16(t1));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i64
-        case INDEX_op_bswap32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap32(t1));
-            break;
+    case INDEX_op_bswap32_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap32(t1));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap64(t1));
-            break;
+    case INDEX_op_bswap64_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap64(t1));
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i64
-        case INDEX_op_not_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ~t1);
-            break;
+    case INDEX_op_not_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ~t1);
+        TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i64
-        case INDEX_op_neg_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, -t1);
-            break;
+    case INDEX_op_neg_i64:
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, -t1);
+        TCI_NEXT();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
-            /* QEMU specific operations. */
-
-        case INDEX_op_exit_tb:
-            ret = *(uint64_t *)tb_ptr;
-            goto exit;
-            break;
-        case INDEX_op_goto_tb:
-            /* Jump address is aligned */
-            tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
-            t0 = atomic_read((int32_t *)tb_ptr);
-            tb_ptr += sizeof(int32_t);
-            tci_assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr += (int32_t)t0;
-            continue;
-        case INDEX_op_qemu_ld_i32:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
-            case MO_UB:
-                tmp32 = qemu_ld_ub;
-                break;
-            case MO_SB:
-                tmp32 = (int8_t)qemu_ld_ub;
-                break;
-            case MO_LEUW:
-                tmp32 = qemu_ld_leuw;
-                break;
-            case MO_LESW:
-                tmp32 = (int16_t)qemu_ld_leuw;
-                break;
-            case MO_LEUL:
-                tmp32 = qemu_ld_leul;
-                break;
-            case MO_BEUW:
-                tmp32 = qemu_ld_beuw;
-                break;
-            case MO_BESW:
-                tmp32 = (int16_t)qemu_ld_beuw;
-                break;
-            case MO_BEUL:
-                tmp32 = qemu_ld_beul;
-                break;
-            default:
-                tcg_abort();
-            }
-            tci_write_reg(regs, t0, tmp32);
-            break;
-        case INDEX_op_qemu_ld_i64:
-            t0 = *tb_ptr++;
-            if (TCG_TARGET_REG_BITS == 32) {
-                t1 = *tb_ptr++;
-            }
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
-            case MO_UB:
-                tmp64 = qemu_ld_ub;
-                break;
-            case MO_SB:
-                tmp64 = (int8_t)qemu_ld_ub;
-                break;
-            case MO_LEUW:
-                tmp64 = qemu_ld_leuw;
-                break;
-            case MO_LESW:
-                tmp64 = (int16_t)qemu_ld_leuw;
-                break;
-            case MO_LEUL:
-                tmp64 = qemu_ld_leul;
-                break;
-            case MO_LESL:
-                tmp64 = (int32_t)qemu_ld_leul;
-                break;
-            case MO_LEQ:
-                tmp64 = qemu_ld_leq;
-                break;
-            case MO_BEUW:
-                tmp64 = qemu_ld_beuw;
-                break;
-            case MO_BESW:
-                tmp64 = (int16_t)qemu_ld_beuw;
-                break;
-            case MO_BEUL:
-                tmp64 = qemu_ld_beul;
-                break;
-            case MO_BESL:
-                tmp64 = (int32_t)qemu_ld_beul;
-                break;
-            case MO_BEQ:
-                tmp64 = qemu_ld_beq;
-                break;
-            default:
-                tcg_abort();
-            }
-            tci_write_reg(regs, t0, tmp64);
-            if (TCG_TARGET_REG_BITS == 32) {
-                tci_write_reg(regs, t1, tmp64 >> 32);
-            }
-            break;
-        case INDEX_op_qemu_st_i32:
-            t0 = tci_read_r(regs, &tb_ptr);
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
-            case MO_UB:
-                qemu_st_b(t0);
-                break;
-            case MO_LEUW:
-                qemu_st_lew(t0);
-                break;
-            case MO_LEUL:
-                qemu_st_lel(t0);
-                break;
-            case MO_BEUW:
-                qemu_st_bew(t0);
-                break;
-            case MO_BEUL:
-                qemu_st_bel(t0);
-                break;
-            default:
-                tcg_abort();
-            }
-            break;
-        case INDEX_op_qemu_st_i64:
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
-            case MO_UB:
-                qemu_st_b(tmp64);
-                break;
-            case MO_LEUW:
-                qemu_st_lew(tmp64);
-                break;
-            case MO_LEUL:
-                qemu_st_lel(tmp64);
-                break;
-            case MO_LEQ:
-                qemu_st_leq(tmp64);
-                break;
-            case MO_BEUW:
-                qemu_st_bew(tmp64);
-                break;
-            case MO_BEUL:
-                qemu_st_bel(tmp64);
-                break;
-            case MO_BEQ:
-                qemu_st_beq(tmp64);
-                break;
-            default:
-                tcg_abort();
-            }
-            break;
-        case INDEX_op_mb:
-            /* Ensure ordering for all kinds */
-            smp_mb();
-            break;
-        default:
-            TODO();
-            break;
-        }
+        /* QEMU specific operations. */
+
+    case INDEX_op_exit_tb:
+    do_exit_tb:
+        ret = *(uint64_t *)tb_ptr;
+        goto exit;
+    case INDEX_op_goto_tb:
+    do_goto_tb:
+        /* Jump address is aligned */
+        tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
+        t0 = atomic_read((int32_t *)tb_ptr);
+        tb_ptr += sizeof(int32_t);
         tci_assert(tb_ptr == old_code_ptr + op_size);
+        tb_ptr += (int32_t)t0;
+        TCI_DISPATCH();
+    case INDEX_op_qemu_ld_i32:
+    do_qemu_ld_i32:
+        t0 = *tb_ptr++;
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        tmp32 = tci_qemu_ld(env, taddr, oi, (uintptr_t)tb_ptr);
+        tci_write_reg(regs, t0, tmp32);
+        TCI_NEXT();
+    case INDEX_op_qemu_ld_i64:
+    do_qemu_ld_i64:
+        t0 = *tb_ptr++;
+        if (TCG_TARGET_REG_BITS == 32) {
+            t1 = *tb_ptr++;
+        }
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        tmp64 = tci_qemu_ld(env, taddr, oi, (uintptr_t)tb_ptr);
+        tci_write_reg(regs, t0, tmp64);
+        if (TCG_TARGET_REG_BITS == 32) {
+            tci_write_reg(regs, t1, tmp64 >> 32);
+        }
+        TCI_NEXT();
+    case INDEX_op_qemu_st_i32:
+    do_qemu_st_i32:
+        t0 = tci_read_r(regs, &tb_ptr);
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        tci_qemu_st(env, taddr, t0, oi, (uintptr_t)tb_ptr);
+        TCI_NEXT();
+    case INDEX_op_qemu_st_i64:
+    do_qemu_st_i64:
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        tci_qemu_st(env, taddr, tmp64, oi, (uintptr_t)tb_ptr);
+        TCI_NEXT();
+    case INDEX_op_mb:
+        /* Ensure ordering for all kinds */
+        smp_mb();
+        TCI_NEXT();
+    default:
+        TODO();
+        TCI_NEXT();
     }
+    TCI_NEXT();
+
 exit:
     return ret;
 }
@@ -0,0 +1,63 @@
+/*
+ * XBZRLE encoder speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define PAGE_SIZE 4096
+
+static void test_encode_speed(const void *opaque)
+{
+    size_t changed = (size_t)opaque;
+    uint8_t *old_buf = g_malloc(PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(PAGE_SIZE);
+    uint8_t *compressed = g_malloc(PAGE_SIZE);
+    const size_t total = 2 * GiB;
+    size_t remain, i;
+    int len = 0;
+
+    for (i = 0; i < PAGE_SIZE; i++) {
+        old_buf[i] = new_buf[i] = g_test_rand_int();
+    }
+    /* spread the changed bytes evenly over the page */
+    for (i = 0; i < changed; i++) {
+        new_buf[i * (PAGE_SIZE / changed)] ^= 1;
+    }
+
+    do {
+        g_test_timer_start();
+        for (remain = total; remain; remain -= PAGE_SIZE) {
+            len = xbzrle_encode_buffer(old_buf, new_buf, PAGE_SIZE,
+                                       compressed, PAGE_SIZE);
+        }
+        g_test_timer_elapsed();
+
+        g_print("xbzrle: %zu bytes changed per page, encoded to %d bytes ",
+                changed, len);
+        g_print("%.2f MB/sec\n", (double)total / MiB / g_test_timer_last());
+    } while (test_xbzrle_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(compressed);
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    char name[64];
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 1; i <= 512; i *= 8) {
+        snprintf(name, sizeof(name), "/xbzrle/encode/speed-%zu", i);
+        g_test_add_data_func(name, (void *)i, test_encode_speed);
+    }
+
+    return g_test_run();
+}
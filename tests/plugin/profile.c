@@ -0,0 +1,213 @@
+/*
+ * Sampling profiler
+ *
+ * Periodically samples the guest PC of each running vCPU and reports
+ * the samples as folded stacks ("frame;frame;frame count"), ready to be
+ * fed to flamegraph.pl or similar tools.
+ *
+ * Arguments:
+ *   period=NS   sampling period in nanoseconds (default 1ms)
+ *   clock=virtual  measure the period in guest time (an instruction
+ *               budget with -icount) instead of host time
+ *   fp=REG      unwind the guest stack using the frame pointer REG
+ *               (e.g. rbp or x29); assumes the usual {fp, ret} frame
+ *               record and a little-endian guest
+ *   depth=N     maximum number of frames to unwind (default 16)
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MAX_REGS 1024
+
+static GMutex lock;
+static GHashTable *stacks;
+static uint64_t total_samples;
+
+static const char *fp_name;
+static struct qemu_plugin_register *fp_reg;
+static bool fp_looked_up;
+static int max_depth = 16;
+
+static gint cmp_count(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    GHashTable *ht = user_data;
+    uint64_t ca = GPOINTER_TO_SIZE(g_hash_table_lookup(ht, a));
+    uint64_t cb = GPOINTER_TO_SIZE(g_hash_table_lookup(ht, b));
+
+    return ca > cb ? -1 : ca < cb;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new(NULL);
+    GList *keys, *it;
+
+    g_mutex_lock(&lock);
+    g_string_append_printf(report, "# %" PRIu64 " samples\n", total_samples);
+    keys = g_hash_table_get_keys(stacks);
+    keys = g_list_sort_with_data(keys, cmp_count, stacks);
+    for (it = keys; it; it = it->next) {
+        g_string_append_printf(report, "%s %zu\n", (char *)it->data,
+                               GPOINTER_TO_SIZE(
+                                   g_hash_table_lookup(stacks, it->data)));
+    }
+    g_list_free(keys);
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_outs(report->str);
+}
+
+static struct qemu_plugin_register *find_fp(unsigned int vcpu_index)
+{
+    qemu_plugin_reg_descriptor *descs;
+    struct qemu_plugin_register *handle = NULL;
+    int i, n;
+
+    descs = g_new(qemu_plugin_reg_descriptor, MAX_REGS);
+    n = qemu_plugin_get_registers(vcpu_index, descs, MAX_REGS);
+    for (i = 0; i < n && i < MAX_REGS; i++) {
+        if (!strcmp(descs[i].name, fp_name)) {
+            handle = descs[i].handle;
+            break;
+        }
+    }
+    g_free(descs);
+
+    if (!handle) {
+        g_autofree gchar *out =
+            g_strdup_printf("profile: no register named %s\n", fp_name);
+        qemu_plugin_outs(out);
+    }
+    return handle;
+}
+
+/* append the callers of the sampled frame, innermost first */
+static void unwind(GPtrArray *frames)
+{
+    uint64_t fp = 0;
+    int size, depth;
+
+    size = qemu_plugin_read_register(fp_reg, &fp, sizeof(fp));
+    if (size != 4 && size != 8) {
+        return;
+    }
+
+    for (depth = 0; depth < max_depth && fp; depth++) {
+        uint64_t record[2] = { 0, 0 };
+
+        if (size == 8) {
+            if (!qemu_plugin_read_memory_vaddr(fp, record, sizeof(record))) {
+                break;
+            }
+        } else {
+            uint32_t record32[2];
+
+            if (!qemu_plugin_read_memory_vaddr(fp, record32,
+                                               sizeof(record32))) {
+                break;
+            }
+            record[0] = record32[0];
+            record[1] = record32[1];
+        }
+        if (record[1] == 0) {
+            break;
+        }
+        g_ptr_array_add(frames,
+                        g_strdup_printf("0x%" PRIx64, record[1]));
+        /* frames must move towards the stack base */
+        if (record[0] <= fp) {
+            break;
+        }
+        fp = record[0];
+    }
+}
+
+static void vcpu_sample(qemu_plugin_id_t id, unsigned int vcpu_index,
+                        uint64_t pc, int mmu_idx)
+{
+    g_autoptr(GPtrArray) frames = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GString) key = g_string_new(NULL);
+    gpointer orig_key, count;
+    int i;
+
+    g_ptr_array_add(frames, g_strdup_printf("0x%" PRIx64, pc));
+
+    if (fp_name) {
+        g_mutex_lock(&lock);
+        if (!fp_looked_up) {
+            fp_reg = find_fp(vcpu_index);
+            fp_looked_up = true;
+        }
+        g_mutex_unlock(&lock);
+        if (fp_reg) {
+            unwind(frames);
+        }
+    }
+
+    /* folded stacks start at the root */
+    g_string_append_printf(key, "mmu%d", mmu_idx);
+    for (i = frames->len - 1; i >= 0; i--) {
+        g_string_append_printf(key, ";%s",
+                               (char *)g_ptr_array_index(frames, i));
+    }
+
+    g_mutex_lock(&lock);
+    total_samples++;
+    if (g_hash_table_lookup_extended(stacks, key->str, &orig_key, &count)) {
+        g_hash_table_insert(stacks, orig_key,
+                            GSIZE_TO_POINTER(GPOINTER_TO_SIZE(count) + 1));
+    } else {
+        g_hash_table_insert(stacks, g_strdup(key->str), GSIZE_TO_POINTER(1));
+    }
+    g_mutex_unlock(&lock);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    enum qemu_plugin_sample_clock clock = QEMU_PLUGIN_SAMPLE_HOST;
+    uint64_t period = 1000000;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char *opt = argv[i];
+
+        if (g_str_has_prefix(opt, "period=")) {
+            period = g_ascii_strtoull(opt + 7, NULL, 10);
+        } else if (!strcmp(opt, "clock=virtual")) {
+            clock = QEMU_PLUGIN_SAMPLE_VIRTUAL;
+        } else if (!strcmp(opt, "clock=host")) {
+            clock = QEMU_PLUGIN_SAMPLE_HOST;
+        } else if (g_str_has_prefix(opt, "fp=")) {
+            fp_name = opt + 3;
+        } else if (g_str_has_prefix(opt, "depth=")) {
+            max_depth = atoi(opt + 6);
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+    if (period == 0) {
+        fprintf(stderr, "profile: the sampling period must not be 0\n");
+        return -1;
+    }
+
+    stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    qemu_plugin_register_vcpu_sample_cb(id, vcpu_sample, clock, period);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
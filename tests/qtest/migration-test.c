@@ -14,6 +14,7 @@
 
 #include "libqtest.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
@@ -200,6 +201,7 @@ static void read_blocktime(QTestState *who)
 
     rsp_return = migrate_query(who);
     g_assert(qdict_haskey(rsp_return, "postcopy-blocktime"));
+    g_assert(qdict_haskey(rsp_return, "postcopy-fault-latency"));
     qobject_unref(rsp_return);
 }
 
@@ -465,6 +467,8 @@ typedef struct {
     bool use_shmem;
     /* only launch the target process */
     bool only_target;
+    /* enable postcopy-prefetch in migrate_postcopy_prepare() */
+    bool postcopy_prefetch;
     char *opts_source;
     char *opts_target;
 } MigrateStart;
@@ -703,6 +707,8 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
                                     MigrateStart *args)
 {
     char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    /* test_migrate_start() frees args */
+    bool prefetch = args->postcopy_prefetch;
     QTestState *from, *to;
 
     if (test_migrate_start(&from, &to, uri, args)) {
@@ -712,6 +718,10 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
     migrate_set_capability(from, "postcopy-ram", true);
     migrate_set_capability(to, "postcopy-ram", true);
     migrate_set_capability(to, "postcopy-blocktime", true);
+    if (prefetch) {
+        migrate_set_capability(from, "postcopy-prefetch", true);
+        migrate_set_capability(to, "postcopy-prefetch", true);
+    }
 
     /* We want to pick a speed slow enough that the test completes
      * quickly, but that it doesn't complete precopy even on a slow
@@ -760,6 +770,20 @@ static void test_postcopy(void)
     migrate_postcopy_complete(from, to);
 }
 
+static void test_postcopy_prefetch(void)
+{
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+
+    args->postcopy_prefetch = true;
+
+    if (migrate_postcopy_prepare(&from, &to, args)) {
+        return;
+    }
+    migrate_postcopy_start(from, to);
+    migrate_postcopy_complete(from, to);
+}
+
 static void test_postcopy_recovery(void)
 {
     MigrateStart *args = migrate_start_new();
@@ -843,6 +867,7 @@ static void test_precopy_unix(void)
     char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
+    QDict *rsp;
 
     if (test_migrate_start(&from, &to, uri, args)) {
         return;
@@ -876,6 +901,16 @@ static void test_precopy_unix(void)
     wait_for_serial("dest_serial");
     wait_for_migration_complete(from);
 
+    /* The slowest devices of the downtime are reported */
+    rsp = migrate_query(from);
+    g_assert(qdict_haskey(rsp, "device-downtime"));
+    qobject_unref(rsp);
+
+    /* So is the time each stage of the completion took */
+    rsp = wait_command(from, "{ 'execute': 'query-migrate-timeline' }");
+    g_assert(!qlist_empty(qdict_get_qlist(rsp, "events")));
+    qobject_unref(rsp);
+
     test_migrate_end(from, to, true);
     g_free(uri);
 }
@@ -918,7 +953,7 @@ static void test_ignore_shared(void)
 }
 #endif
 
-static void test_xbzrle(const char *uri)
+static void test_xbzrle(const char *uri, int load_threads)
 {
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
@@ -941,6 +976,7 @@ static void test_xbzrle(const char *uri)
 
     migrate_set_capability(from, "xbzrle", "true");
     migrate_set_capability(to, "xbzrle", "true");
+    migrate_set_parameter_int(to, "load-threads", load_threads);
     /* Wait for the first serial output from the source */
     wait_for_serial("src_serial");
 
@@ -966,7 +1002,15 @@ static void test_xbzrle_unix(void)
 {
     char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
 
-    test_xbzrle(uri);
+    test_xbzrle(uri, 0);
+    g_free(uri);
+}
+
+static void test_xbzrle_unix_load_threads(void)
+{
+    char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+
+    test_xbzrle(uri, 4);
     g_free(uri);
 }
 
@@ -1260,7 +1304,100 @@ static void test_migrate_auto_converge(void)
     test_migrate_end(from, to, true);
 }
 
-static void test_multifd_tcp(const char *method)
+static void test_dirty_rate(void)
+{
+    char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+    QDict *rsp;
+
+    if (test_migrate_start(&from, &to, uri, args)) {
+        return;
+    }
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    rsp = wait_command(from, "{ 'execute': 'calc-dirty-rate',"
+                             "  'arguments': { 'calc-time': 1 } }");
+    qobject_unref(rsp);
+
+    /* Only one measurement can run at a time */
+    rsp = qtest_qmp(from, "{ 'execute': 'calc-dirty-rate',"
+                          "  'arguments': { 'calc-time': 1 } }");
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    for (;;) {
+        rsp = wait_command(from, "{ 'execute': 'query-dirty-rate' }");
+        if (!strcmp(qdict_get_str(rsp, "status"), "measured")) {
+            break;
+        }
+        g_assert(!qdict_haskey(rsp, "dirty-rate"));
+        qobject_unref(rsp);
+        usleep(1000 * 100);
+    }
+    /* The guest keeps writing to every page of its memory */
+    g_assert_cmpint(qdict_get_int(rsp, "calc-time"), ==, 1);
+    g_assert_cmpint(qdict_get_int(rsp, "dirty-rate"), >, 0);
+    qobject_unref(rsp);
+
+    test_migrate_end(from, to, false);
+    g_free(uri);
+}
+
+static void test_checkpoint(void)
+{
+    char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    unsigned char saved_byte, byte;
+    QTestState *from, *to;
+    QDict *rsp;
+
+    if (test_migrate_start(&from, &to, uri, args)) {
+        return;
+    }
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    qtest_qmp_discard_response(from, "{ 'execute' : 'stop'}");
+    rsp = wait_command(from, "{ 'execute': 'checkpoint-save' }");
+    qobject_unref(rsp);
+    qtest_memread(from, start_address, &saved_byte, 1);
+
+    /* The checkpoint uses the dirty log, so migration is refused */
+    rsp = qtest_qmp(from, "{ 'execute': 'migrate',"
+                          "  'arguments': { 'uri': %s } }", uri);
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    /* Let the guest run until it has changed its memory */
+    qtest_qmp_discard_response(from, "{ 'execute' : 'cont'}");
+    do {
+        qtest_memread(from, start_address, &byte, 1);
+        usleep(1000 * 10);
+    } while (byte == saved_byte);
+    qtest_qmp_discard_response(from, "{ 'execute' : 'stop'}");
+
+    rsp = wait_command(from, "{ 'execute': 'checkpoint-restore' }");
+    qobject_unref(rsp);
+    qtest_memread(from, start_address, &byte, 1);
+    g_assert_cmpint(byte, ==, saved_byte);
+
+    rsp = wait_command(from, "{ 'execute': 'query-checkpoint' }");
+    g_assert_cmpint(qdict_get_int(rsp, "dirty-pages"), >, 0);
+    g_assert_cmpint(qdict_get_int(rsp, "device-state"), >, 0);
+    qobject_unref(rsp);
+
+    rsp = wait_command(from, "{ 'execute': 'checkpoint-delete' }");
+    qobject_unref(rsp);
+
+    test_migrate_end(from, to, false);
+    g_free(uri);
+}
+
+static void test_multifd_tcp(const char *method, bool encode, bool tune)
 {
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
@@ -1290,6 +1427,19 @@ static void test_multifd_tcp(const char *method)
     migrate_set_capability(from, "multifd", "true");
     migrate_set_capability(to, "multifd", "true");
 
+    if (encode) {
+        migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+        migrate_set_capability(from, "xbzrle", "true");
+        migrate_set_capability(to, "xbzrle", "true");
+        migrate_set_capability(from, "multifd-encode-pages", "true");
+        migrate_set_capability(to, "multifd-encode-pages", "true");
+    }
+
+    if (tune) {
+        migrate_set_parameter_int(from, "multifd-zstd-dict-size", 65536);
+        migrate_set_parameter_int(from, "multifd-compression-cpu-budget", 50);
+    }
+
     /* Start incoming migration from the 1st socket */
     rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
                            "  'arguments': { 'uri': 'tcp:127.0.0.1:0' }}");
@@ -1318,20 +1468,77 @@ static void test_multifd_tcp(const char *method)
     g_free(uri);
 }
 
+static void test_mapped_ram_file(void)
+{
+    MigrateStart *args = migrate_start_new();
+    char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+    QTestState *from, *to;
+    QDict *rsp;
+
+    if (test_migrate_start(&from, &to, "defer", args)) {
+        return;
+    }
+
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_parameter_int(to, "multifd-channels", 4);
+
+    migrate_set_capability(from, "mapped-ram", "true");
+    migrate_set_capability(to, "mapped-ram", "true");
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    /* The whole file has to be written before it can be read back */
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+
+    rsp = qtest_qmp(to, "{ 'execute': 'migrate-incoming',"
+                        "  'arguments': { 'uri': %s }}", uri);
+    g_assert(qdict_haskey(rsp, "return"));
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    test_migrate_end(from, to, true);
+    cleanup("migfile");
+    g_free(uri);
+}
+
 static void test_multifd_tcp_none(void)
 {
-    test_multifd_tcp("none");
+    test_multifd_tcp("none", false, false);
+}
+
+static void test_multifd_tcp_encode(void)
+{
+    test_multifd_tcp("none", true, false);
 }
 
 static void test_multifd_tcp_zlib(void)
 {
-    test_multifd_tcp("zlib");
+    test_multifd_tcp("zlib", false, false);
 }
 
 #ifdef CONFIG_ZSTD
 static void test_multifd_tcp_zstd(void)
 {
-    test_multifd_tcp("zstd");
+    test_multifd_tcp("zstd", false, false);
+}
+
+static void test_multifd_tcp_zstd_dict(void)
+{
+    test_multifd_tcp("zstd", false, true);
+}
+#endif
+
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    test_multifd_tcp("lz4", false, false);
 }
 #endif
 
@@ -1480,6 +1687,7 @@ int main(int argc, char **argv)
     module_call_init(MODULE_INIT_QOM);
 
     qtest_add_func("/migration/postcopy/unix", test_postcopy);
+    qtest_add_func("/migration/postcopy/prefetch", test_postcopy_prefetch);
     qtest_add_func("/migration/postcopy/recovery", test_postcopy_recovery);
     qtest_add_func("/migration/deprecated", test_deprecated);
     qtest_add_func("/migration/bad_dest", test_baddest);
@@ -1487,6 +1695,8 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/precopy/tcp", test_precopy_tcp);
     /* qtest_add_func("/migration/ignore_shared", test_ignore_shared); */
     qtest_add_func("/migration/xbzrle/unix", test_xbzrle_unix);
+    qtest_add_func("/migration/xbzrle/load_threads",
+                   test_xbzrle_unix_load_threads);
     qtest_add_func("/migration/fd_proto", test_migrate_fd_proto);
     qtest_add_func("/migration/validate_uuid", test_validate_uuid);
     qtest_add_func("/migration/validate_uuid_error", test_validate_uuid_error);
@@ -1496,11 +1706,20 @@ int main(int argc, char **argv)
                    test_validate_uuid_dst_not_set);
 
     qtest_add_func("/migration/auto_converge", test_migrate_auto_converge);
+    qtest_add_func("/migration/dirty_rate", test_dirty_rate);
+    qtest_add_func("/migration/checkpoint", test_checkpoint);
+    qtest_add_func("/migration/mapped_ram/file", test_mapped_ram_file);
     qtest_add_func("/migration/multifd/tcp/none", test_multifd_tcp_none);
     qtest_add_func("/migration/multifd/tcp/cancel", test_multifd_tcp_cancel);
     qtest_add_func("/migration/multifd/tcp/zlib", test_multifd_tcp_zlib);
+    qtest_add_func("/migration/multifd/tcp/encode", test_multifd_tcp_encode);
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/zstd", test_multifd_tcp_zstd);
+    qtest_add_func("/migration/multifd/tcp/zstd-dict",
+                   test_multifd_tcp_zstd_dict);
+#endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/lz4", test_multifd_tcp_lz4);
 #endif
 
     ret = g_test_run();
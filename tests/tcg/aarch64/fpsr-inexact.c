@@ -0,0 +1,57 @@
+/*
+ * Inexact flag once the guest has cleared FPSR
+ *
+ * Until the guest first looks at the cumulative FP flags, QEMU may raise
+ * inexact for operations whose result is exact.  From then on, exact
+ * operations must leave it clear.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <fenv.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static volatile double d_one = 1.0, d_three = 3.0;
+static volatile int64_t i_big = INT64_C(1) << 60;
+
+static volatile double d_res;
+static volatile float f_res;
+static volatile int64_t i_res;
+
+static int check(const char *what, bool expect)
+{
+    bool inexact = fetestexcept(FE_INEXACT) != 0;
+
+    if (inexact != expect) {
+        printf("FAIL: %s: inexact %s\n", what, inexact ? "set" : "clear");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int err = 0;
+
+    /* Before anything has looked at FPSR.  */
+    d_res = d_one + d_three;
+
+    feclearexcept(FE_ALL_EXCEPT);
+    d_res = d_one + d_three;
+    d_res = d_three * d_three;
+    d_res = d_three - d_one;
+    d_res = (double)i_big;
+    f_res = (float)d_three;
+    i_res = (int64_t)d_three;
+    err |= check("exact operations", false);
+
+    d_res = d_one / d_three;
+    err |= check("1 / 3", true);
+
+    feclearexcept(FE_INEXACT);
+    d_res = d_three / d_one;
+    err |= check("3 / 1", false);
+
+    return err;
+}
@@ -0,0 +1,67 @@
+/*
+ * SVE vector lengths that are not a power of two
+ *
+ * The gvec expanders split such vectors into chunks of several host
+ * vector sizes; check that every element of the vector is computed.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <sys/prctl.h>
+#include <asm/hwcap.h>
+#include <stdio.h>
+#include <sys/auxv.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MAX_ELEMS (2048 / 64)
+
+static int test_width(int vl)
+{
+    int64_t in[MAX_ELEMS], mul[MAX_ELEMS], asr[MAX_ELEMS];
+    int i, res, n = vl / 8;
+
+    res = prctl(PR_SVE_SET_VL, vl, 0, 0, 0, 0);
+    if (res < 0 || (res & PR_SVE_VL_LEN_MASK) != vl) {
+        printf("SKIP: vector length %d not available\n", vl);
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        in[i] = -(i + 1) * 0x100000001ll;
+        mul[i] = asr[i] = 0;
+    }
+
+    /* unpredicated MUL and ASR by immediate expand through gvec */
+    asm volatile("ptrue p0.d\n"
+                 "ld1d {z0.d}, p0/z, [%[in]]\n"
+                 "mul z0.d, z0.d, #3\n"
+                 "asr z1.d, z0.d, #1\n"
+                 "st1d {z0.d}, p0, [%[mul]]\n"
+                 "st1d {z1.d}, p0, [%[asr]]\n"
+                 : /* no outputs kept */
+                 : [in] "r" (in), [mul] "r" (mul), [asr] "r" (asr)
+                 : "memory", "z0", "z1", "p0");
+
+    for (i = 0; i < n; i++) {
+        if (mul[i] != in[i] * 3 || asr[i] != (in[i] * 3) >> 1) {
+            printf("FAIL: vector length %d, element %d: "
+                   "mul %lld asr %lld\n", vl, i,
+                   (long long)mul[i], (long long)asr[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!(getauxval(AT_HWCAP) & HWCAP_SVE)) {
+        printf("SKIP: no HWCAP_SVE on this system\n");
+        return 0;
+    }
+    if (test_width(80) || test_width(96)) {
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
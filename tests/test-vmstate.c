@@ -30,6 +30,7 @@
 #include "../migration/qemu-file.h"
 #include "../migration/qemu-file-channel.h"
 #include "../migration/savevm.h"
+#include "qemu/bswap.h"
 #include "qemu/coroutine.h"
 #include "qemu/module.h"
 #include "io/channel-file.h"
@@ -333,6 +334,139 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+/*
+ * Fields that are adjacent in memory are saved in runs; this one is
+ * longer than the buffer that is used to byte swap them.
+ */
+#define RUNS_LEN 100
+
+typedef struct TestRuns {
+    uint32_t u32_1[RUNS_LEN];
+    uint32_t u32_2;
+    uint8_t  buf[3];
+    uint8_t  u8_1;
+    uint16_t u16_1;
+} TestRuns;
+
+static const VMStateDescription vmstate_runs = {
+    .name = "simple/runs",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(u32_1, TestRuns, RUNS_LEN),
+        VMSTATE_UINT32(u32_2, TestRuns),
+        VMSTATE_BUFFER(buf, TestRuns),
+        VMSTATE_UINT8(u8_1, TestRuns),
+        /* a different element size starts a new run */
+        VMSTATE_UINT16(u16_1, TestRuns),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void obj_runs_copy(void *target, void *source)
+{
+    memcpy(target, source, sizeof(TestRuns));
+}
+
+static void test_simple_runs(void)
+{
+    TestRuns obj_runs, obj, obj_clone;
+    uint8_t wire[(RUNS_LEN + 1) * 4 + 3 + 1 + 2 + 1];
+    uint8_t *p = wire;
+    int i;
+
+    memset(&obj_runs, 0, sizeof(obj_runs));
+    for (i = 0; i < RUNS_LEN; i++) {
+        obj_runs.u32_1[i] = 0x01020304 * i;
+        stl_be_p(p, obj_runs.u32_1[i]);
+        p += 4;
+    }
+    obj_runs.u32_2 = 0xdeadbeef;
+    stl_be_p(p, obj_runs.u32_2);
+    p += 4;
+    memcpy(obj_runs.buf, "abc", 3);
+    memcpy(p, "abc", 3);
+    p += 3;
+    obj_runs.u8_1 = 0x42;
+    *p++ = 0x42;
+    obj_runs.u16_1 = 0x1234;
+    stw_be_p(p, obj_runs.u16_1);
+    p += 2;
+    *p++ = QEMU_VM_EOF;
+    g_assert(p == wire + sizeof(wire));
+
+    save_vmstate(&vmstate_runs, &obj_runs);
+    compare_vmstate(wire, sizeof(wire));
+
+    memset(&obj, 0, sizeof(obj));
+    SUCCESS(load_vmstate(&vmstate_runs, &obj, &obj_clone, obj_runs_copy, 1,
+                         wire, sizeof(wire)));
+    SUCCESS(memcmp(&obj, &obj_runs, sizeof(obj)));
+}
+
+/*
+ * Small nested descriptions are where looking up the compiled program
+ * costs the most compared to the fields it saves.  Only run with -m perf.
+ */
+#define RUNS_PERF_ELEMS 64
+#define RUNS_PERF_ITERS 20000
+
+typedef struct TestRunsElem {
+    uint32_t a;
+    uint16_t b;
+} TestRunsElem;
+
+typedef struct TestRunsPerf {
+    TestRunsElem elem[RUNS_PERF_ELEMS];
+} TestRunsPerf;
+
+static const VMStateDescription vmstate_runs_elem = {
+    .name = "simple/runs/elem",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(a, TestRunsElem),
+        VMSTATE_UINT16(b, TestRunsElem),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_runs_perf = {
+    .name = "simple/runs/perf",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(elem, TestRunsPerf, RUNS_PERF_ELEMS, 1,
+                             vmstate_runs_elem, TestRunsElem),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void test_simple_runs_perf(void)
+{
+    TestRunsPerf obj;
+    QEMUFile *f;
+    double elapsed;
+    int i;
+
+    if (!g_test_perf()) {
+        return;
+    }
+
+    memset(&obj, 0, sizeof(obj));
+    f = open_test_file(true);
+    g_test_timer_start();
+    for (i = 0; i < RUNS_PERF_ITERS; i++) {
+        SUCCESS(vmstate_save_state(f, &vmstate_runs_perf, &obj, NULL));
+    }
+    elapsed = g_test_timer_elapsed();
+    g_assert(!qemu_file_get_error(f));
+    qemu_fclose(f);
+
+    g_test_message("%.1f ns per struct",
+                   elapsed * 1e9 / (RUNS_PERF_ITERS * (RUNS_PERF_ELEMS + 1)));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1496,6 +1630,8 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/simple/runs", test_simple_runs);
+    g_test_add_func("/vmstate/simple/runs/perf", test_simple_runs_perf);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
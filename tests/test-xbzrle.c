@@ -174,6 +174,86 @@ static void test_encode_decode(void)
     }
 }
 
+static void encode_compare(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                           int dlen)
+{
+    uint8_t *expected = g_malloc(slen + 16);
+    uint8_t *compressed = g_malloc(slen + 16);
+    int expected_len, len;
+
+    expected_len = xbzrle_encode_buffer_int(old_buf, new_buf, slen,
+                                            expected, dlen);
+    len = xbzrle_encode_buffer(old_buf, new_buf, slen, compressed, dlen);
+    g_assert_cmpint(len, ==, expected_len);
+    if (len > 0) {
+        g_assert(memcmp(compressed, expected, len) == 0);
+    }
+
+    g_free(expected);
+    g_free(compressed);
+}
+
+#define WINDOW_BUF_SIZE 128
+
+/*
+ * Compare the accelerated encoder with the plain C one.  Every pattern
+ * of changed bytes in a 16 byte window is tried, with the window placed
+ * across and between vector boundaries, and with room in the output
+ * buffer or not.  Random pages cover longer runs.
+ */
+static void encode_compare_all(void)
+{
+    static const int window_offsets[] = { 0, 8, 24, 32, 56, 64, 88, 112 };
+    uint8_t *old_buf = g_malloc(PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(PAGE_SIZE);
+    uint32_t mask;
+    int i, j, k;
+
+    for (k = 0; k < ARRAY_SIZE(window_offsets); k++) {
+        for (mask = 0; mask < 0x10000; mask++) {
+            for (i = 0; i < WINDOW_BUF_SIZE; i++) {
+                old_buf[i] = new_buf[i] = i * 7;
+            }
+            for (i = 0; i < 16; i++) {
+                if (mask & (1 << i)) {
+                    new_buf[window_offsets[k] + i] ^= 0x5a;
+                }
+            }
+            encode_compare(old_buf, new_buf, WINDOW_BUF_SIZE,
+                           WINDOW_BUF_SIZE);
+            encode_compare(old_buf, new_buf, WINDOW_BUF_SIZE, 16);
+        }
+    }
+
+    for (k = 0; k < 1000; k++) {
+        for (i = 0; i < PAGE_SIZE; i++) {
+            old_buf[i] = new_buf[i] = g_test_rand_int();
+        }
+        i = g_test_rand_int_range(0, PAGE_SIZE);
+        while (i < PAGE_SIZE) {
+            int run = g_test_rand_int_range(1, 300);
+
+            for (j = 0; j < run && i < PAGE_SIZE; j++, i++) {
+                new_buf[i] ^= g_test_rand_int_range(1, 256);
+            }
+            i += g_test_rand_int_range(1, 300);
+        }
+        encode_compare(old_buf, new_buf, PAGE_SIZE, PAGE_SIZE);
+        encode_compare(old_buf, new_buf, PAGE_SIZE,
+                       g_test_rand_int_range(0, PAGE_SIZE));
+    }
+
+    g_free(old_buf);
+    g_free(new_buf);
+}
+
+static void test_encode_accel(void)
+{
+    do {
+        encode_compare_all();
+    } while (test_xbzrle_next_accel());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +266,7 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
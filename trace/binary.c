@@ -0,0 +1,521 @@
+/*
+ * Binary trace backend
+ *
+ * Every thread that emits trace events owns a ring buffer.  Since only
+ * the owner ever appends to a ring, reserving space for a record is a
+ * plain load of the consumer position and a store-release of the new
+ * producer position once the record is complete; no lock and no atomic
+ * read-modify-write is needed on the hot path.
+ *
+ * A writeout thread drains the rings in chunks, optionally compresses
+ * each chunk, and appends it to the trace file.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "trace/control.h"
+#include "trace/binary.h"
+#include "qemu/error-report.h"
+#include "qemu/qemu-print.h"
+
+/** Trace file magic number, "QEMUBTR\0" */
+#define BT_MAGIC 0x00525442554d4551ULL
+
+/** Trace file version number, bump if format changes */
+#define BT_VERSION 1
+
+enum {
+    BT_CHUNK_MAPPING = 0,
+    BT_CHUNK_EVENTS = 1,
+    BT_CHUNK_DROPPED = 2,
+};
+
+enum {
+    BT_CODEC_NONE = 0,
+    BT_CODEC_ZSTD = 1,
+};
+
+enum {
+    BT_RING_FREE = 0,
+    BT_RING_OWNED = 1,
+    BT_RING_ORPHAN = 2,
+};
+
+enum {
+    BT_RING_SIZE = 64 * 1024,   /* must be a power of two */
+    BT_RING_FLUSH_THRESHOLD = BT_RING_SIZE / 4,
+    BT_WRITEOUT_PERIOD_US = 100 * 1000,
+};
+
+#ifdef CONFIG_TRACE_SIMPLE
+/* the simple backend owns the plain trace file name */
+#define BT_FILE_SUFFIX ".btr"
+#else
+#define BT_FILE_SUFFIX ""
+#endif
+
+typedef struct {
+    uint64_t magic;     /* BT_MAGIC */
+    uint32_t version;   /* BT_VERSION */
+    uint32_t pid;
+} BinaryTraceHeader;
+
+typedef struct {
+    uint32_t type;          /* BT_CHUNK_* */
+    uint32_t codec;         /* BT_CODEC_* */
+    uint32_t tid;           /* host thread that emitted the records */
+    uint32_t raw_len;       /* payload length before compression */
+    uint32_t stored_len;    /* payload length in the file */
+    uint32_t reserved;
+} BinaryTraceChunk;
+
+typedef struct {
+    uint32_t event;         /* event ID value */
+    uint32_t length;        /* in bytes, including this header */
+    uint64_t timestamp_ns;
+} BinaryTraceRecordHeader;
+
+struct BinaryTraceRing {
+    /* producer position, only advanced by the owning thread */
+    uint32_t head;
+    /* consumer position, only advanced with bt_lock held */
+    uint32_t tail;
+    /* a record is being written; catches reentrancy from signal handlers */
+    int busy;
+    int state;              /* BT_RING_* */
+    uint32_t dropped;
+    uint32_t tid;
+    BinaryTraceRing *next;
+    uint8_t data[BT_RING_SIZE];
+};
+
+/*
+ * Rings are never freed, because producers walk bt_rings without a lock;
+ * a ring left by an exited thread is recycled instead.  bt_ring_key holds
+ * the same pointer as bt_ring, only so that its destructor runs when any
+ * thread exits: QEMU threads, glib threads and linux-user guest threads
+ * alike.
+ */
+static void bt_ring_release(gpointer opaque);
+
+static BinaryTraceRing *bt_rings;
+static __thread BinaryTraceRing *bt_ring;
+static GPrivate bt_ring_key = G_PRIVATE_INIT(bt_ring_release);
+
+/* bt_lock serializes the consumers and protects the trace file */
+static GMutex bt_lock;
+static FILE *bt_fp;
+static char *bt_file_name;
+static uint32_t bt_pid;
+static bool bt_compress;
+static uint8_t bt_chunk[BT_RING_SIZE];
+#ifdef CONFIG_ZSTD
+static ZSTD_CCtx *bt_cctx;
+static uint8_t *bt_zbuf;
+static size_t bt_zbuf_size;
+#endif
+
+/* the writeout thread sleeps until kicked or for BT_WRITEOUT_PERIOD_US */
+static GMutex bt_wait_lock;
+static GCond bt_wait_cond;
+static int bt_kicked;
+
+static void bt_kick(void)
+{
+    if (!atomic_read(&bt_kicked)) {
+        atomic_set(&bt_kicked, 1);
+        g_cond_signal(&bt_wait_cond);
+    }
+}
+
+static void bt_ring_release(gpointer opaque)
+{
+    BinaryTraceRing *ring = opaque;
+
+    atomic_store_release(&ring->state, BT_RING_ORPHAN);
+    bt_ring = NULL;
+    bt_kick();
+}
+
+static BinaryTraceRing *bt_ring_get(void)
+{
+    BinaryTraceRing *ring, *old;
+
+    if (likely(bt_ring)) {
+        return bt_ring;
+    }
+
+    for (ring = atomic_rcu_read(&bt_rings); ring; ring = ring->next) {
+        if (atomic_read(&ring->state) == BT_RING_FREE &&
+            atomic_cmpxchg(&ring->state, BT_RING_FREE,
+                           BT_RING_OWNED) == BT_RING_FREE) {
+            break;
+        }
+    }
+
+    if (!ring) {
+        /* don't use g_malloc, can deadlock when traced */
+        ring = calloc(1, sizeof(*ring));
+        if (!ring) {
+            return NULL;
+        }
+        ring->state = BT_RING_OWNED;
+        do {
+            old = atomic_read(&bt_rings);
+            ring->next = old;
+        } while (atomic_cmpxchg(&bt_rings, old, ring) != old);
+    }
+
+    /* the ring is empty here, so the writeout thread does not read tid */
+    ring->tid = qemu_get_thread_id();
+    bt_ring = ring;
+    g_private_set(&bt_ring_key, ring);
+    return ring;
+}
+
+static uint32_t bt_ring_write(BinaryTraceRing *ring, uint32_t pos,
+                              const void *data, size_t size)
+{
+    uint32_t off = pos & (BT_RING_SIZE - 1);
+    size_t first = MIN(size, BT_RING_SIZE - off);
+
+    memcpy(ring->data + off, data, first);
+    memcpy(ring->data, (const uint8_t *)data + first, size - first);
+    return pos + size;
+}
+
+static void bt_ring_read(BinaryTraceRing *ring, uint32_t pos,
+                         void *data, size_t size)
+{
+    uint32_t off = pos & (BT_RING_SIZE - 1);
+    size_t first = MIN(size, BT_RING_SIZE - off);
+
+    memcpy(data, ring->data + off, first);
+    memcpy((uint8_t *)data + first, ring->data, size - first);
+}
+
+bool bt_record_start(BinaryTraceRecord *rec, uint32_t event, size_t datasize)
+{
+    BinaryTraceRing *ring = bt_ring_get();
+    BinaryTraceRecordHeader hdr;
+    uint32_t head, tail;
+
+    if (unlikely(!ring)) {
+        return false;
+    }
+    if (unlikely(ring->busy)) {
+        atomic_inc(&ring->dropped);
+        return false;
+    }
+    ring->busy = 1;
+    barrier();
+
+    hdr.event = event;
+    hdr.length = sizeof(hdr) + datasize;
+    hdr.timestamp_ns = get_clock();
+
+    head = ring->head;
+    tail = atomic_load_acquire(&ring->tail);
+    if (unlikely(head - tail + hdr.length > BT_RING_SIZE)) {
+        /* Trace Buffer Full, Event dropped ! */
+        atomic_inc(&ring->dropped);
+        barrier();
+        ring->busy = 0;
+        bt_kick();
+        return false;
+    }
+
+    rec->ring = ring;
+    rec->pos = bt_ring_write(ring, head, &hdr, sizeof(hdr));
+    return true;
+}
+
+void bt_record_write_u64(BinaryTraceRecord *rec, uint64_t val)
+{
+    rec->pos = bt_ring_write(rec->ring, rec->pos, &val, sizeof(val));
+}
+
+void bt_record_write_str(BinaryTraceRecord *rec, const char *s, uint32_t slen)
+{
+    /* Write string length first */
+    rec->pos = bt_ring_write(rec->ring, rec->pos, &slen, sizeof(slen));
+    /* Write actual string now, s may be NULL when slen is 0 */
+    if (slen) {
+        rec->pos = bt_ring_write(rec->ring, rec->pos, s, slen);
+    }
+}
+
+void bt_record_finish(BinaryTraceRecord *rec)
+{
+    BinaryTraceRing *ring = rec->ring;
+
+    atomic_store_release(&ring->head, rec->pos);
+    barrier();
+    ring->busy = 0;
+
+    if (rec->pos - atomic_read(&ring->tail) > BT_RING_FLUSH_THRESHOLD) {
+        bt_kick();
+    }
+}
+
+static bool bt_write_chunk(uint32_t type, uint32_t tid,
+                           const void *data, uint32_t len)
+{
+    BinaryTraceChunk chunk = {
+        .type = type,
+        .codec = BT_CODEC_NONE,
+        .tid = tid,
+        .raw_len = len,
+        .stored_len = len,
+    };
+
+#ifdef CONFIG_ZSTD
+    if (bt_compress && type == BT_CHUNK_EVENTS) {
+        size_t ret = ZSTD_compressCCtx(bt_cctx, bt_zbuf, bt_zbuf_size,
+                                       data, len, 1);
+        if (!ZSTD_isError(ret) && ret < len) {
+            chunk.codec = BT_CODEC_ZSTD;
+            chunk.stored_len = ret;
+            data = bt_zbuf;
+        }
+    }
+#endif
+
+    return fwrite(&chunk, sizeof(chunk), 1, bt_fp) == 1 &&
+           fwrite(data, chunk.stored_len, 1, bt_fp) == 1;
+}
+
+/* Called with bt_lock held */
+static void bt_drain_ring(BinaryTraceRing *ring)
+{
+    uint32_t head, tail, len, dropped;
+    int state;
+
+    state = atomic_load_acquire(&ring->state);
+    head = atomic_load_acquire(&ring->head);
+    tail = ring->tail;
+    len = head - tail;
+
+    if (len) {
+        bt_ring_read(ring, tail, bt_chunk, len);
+        atomic_store_release(&ring->tail, head);
+        bt_write_chunk(BT_CHUNK_EVENTS, ring->tid, bt_chunk, len);
+    }
+
+    dropped = atomic_xchg(&ring->dropped, 0);
+    if (dropped) {
+        uint64_t payload[2] = { get_clock(), dropped };
+
+        bt_write_chunk(BT_CHUNK_DROPPED, ring->tid, payload, sizeof(payload));
+    }
+
+    /* a ring whose thread exited is recycled once it has been drained */
+    if (state == BT_RING_ORPHAN) {
+        atomic_set(&ring->state, BT_RING_FREE);
+    }
+}
+
+/* Called with bt_lock held */
+static void bt_drain_all(void)
+{
+    BinaryTraceRing *ring;
+
+    for (ring = atomic_rcu_read(&bt_rings); ring; ring = ring->next) {
+        if (bt_fp) {
+            bt_drain_ring(ring);
+        } else if (atomic_load_acquire(&ring->state) == BT_RING_ORPHAN) {
+            /* nowhere to write what an exited thread left, drop it */
+            atomic_store_release(&ring->tail, atomic_read(&ring->head));
+            atomic_set(&ring->dropped, 0);
+            atomic_set(&ring->state, BT_RING_FREE);
+        }
+    }
+    if (bt_fp) {
+        fflush(bt_fp);
+    }
+}
+
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        g_mutex_lock(&bt_wait_lock);
+        if (!atomic_read(&bt_kicked)) {
+            g_cond_wait_until(&bt_wait_cond, &bt_wait_lock,
+                              g_get_monotonic_time() + BT_WRITEOUT_PERIOD_US);
+        }
+        atomic_set(&bt_kicked, 0);
+        g_mutex_unlock(&bt_wait_lock);
+
+        g_mutex_lock(&bt_lock);
+        bt_drain_all();
+        g_mutex_unlock(&bt_lock);
+    }
+    return NULL;
+}
+
+static int bt_write_event_mapping(void)
+{
+    GByteArray *buf = g_byte_array_new();
+    TraceEventIter iter;
+    TraceEvent *ev;
+    bool ok;
+
+    trace_event_iter_init(&iter, NULL);
+    while ((ev = trace_event_iter_next(&iter)) != NULL) {
+        uint32_t id = trace_event_get_id(ev);
+        const char *name = trace_event_get_name(ev);
+        uint32_t len = strlen(name);
+
+        g_byte_array_append(buf, (const guint8 *)&id, sizeof(id));
+        g_byte_array_append(buf, (const guint8 *)&len, sizeof(len));
+        g_byte_array_append(buf, (const guint8 *)name, len);
+    }
+
+    ok = bt_write_chunk(BT_CHUNK_MAPPING, 0, buf->data, buf->len);
+    g_byte_array_free(buf, true);
+    return ok ? 0 : -1;
+}
+
+void bt_set_trace_file_enabled(bool enable)
+{
+    g_mutex_lock(&bt_lock);
+    if (enable == !!bt_fp) {
+        goto out; /* no change */
+    }
+
+    if (enable) {
+        BinaryTraceHeader header = {
+            .magic = BT_MAGIC,
+            .version = BT_VERSION,
+            .pid = bt_pid,
+        };
+
+        bt_fp = fopen(bt_file_name, "wb");
+        if (!bt_fp) {
+            goto out;
+        }
+
+        if (fwrite(&header, sizeof(header), 1, bt_fp) != 1 ||
+            bt_write_event_mapping() < 0) {
+            fclose(bt_fp);
+            bt_fp = NULL;
+        }
+    } else {
+        bt_drain_all();
+        fclose(bt_fp);
+        bt_fp = NULL;
+    }
+out:
+    g_mutex_unlock(&bt_lock);
+}
+
+/**
+ * Set the name of a trace file
+ *
+ * @file        The trace file name or NULL for the default name-<pid> set at
+ *              config time
+ */
+void bt_set_trace_file(const char *file)
+{
+    bt_set_trace_file_enabled(false);
+
+    g_free(bt_file_name);
+
+    if (!file) {
+        /* Type cast needed for Windows where getpid() returns an int. */
+        bt_file_name = g_strdup_printf(CONFIG_TRACE_FILE BT_FILE_SUFFIX,
+                                       (pid_t)getpid());
+    } else {
+        bt_file_name = g_strdup_printf("%s" BT_FILE_SUFFIX, file);
+    }
+
+    bt_set_trace_file_enabled(true);
+}
+
+/**
+ * Enable or disable zstd compression of the event chunks
+ *
+ * Returns false if QEMU was built without zstd support.
+ */
+bool bt_set_compression(bool enable)
+{
+#ifdef CONFIG_ZSTD
+    g_mutex_lock(&bt_lock);
+    if (enable && !bt_cctx) {
+        bt_cctx = ZSTD_createCCtx();
+        bt_zbuf_size = ZSTD_compressBound(BT_RING_SIZE);
+        bt_zbuf = g_malloc(bt_zbuf_size);
+    }
+    bt_compress = enable && bt_cctx;
+    g_mutex_unlock(&bt_lock);
+    return bt_compress == enable;
+#else
+    return !enable;
+#endif
+}
+
+void bt_print_trace_file_status(void)
+{
+    qemu_printf("Trace file \"%s\" %s%s.\n",
+                bt_file_name, bt_fp ? "on" : "off",
+                bt_compress ? ", zstd compressed" : "");
+}
+
+void bt_flush_trace_buffer(void)
+{
+    g_mutex_lock(&bt_lock);
+    bt_drain_all();
+    g_mutex_unlock(&bt_lock);
+}
+
+/* Helper function to create a thread with signals blocked.  Use glib's
+ * portable threads since QEMU abstractions cannot be used due to reentrancy in
+ * the tracer.  Also note the signal masking on POSIX hosts so that the thread
+ * does not steal signals when the rest of the program wants them blocked.
+ */
+static GThread *trace_thread_create(GThreadFunc fn)
+{
+    GThread *thread;
+#ifndef _WIN32
+    sigset_t set, oldset;
+
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+#endif
+
+    thread = g_thread_new("trace-bin-thread", fn, NULL);
+
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+
+    return thread;
+}
+
+bool bt_init(void)
+{
+    GThread *thread;
+
+    bt_pid = getpid();
+
+    thread = trace_thread_create(writeout_thread);
+    if (!thread) {
+        warn_report("unable to initialize binary trace backend");
+        return false;
+    }
+
+    atexit(bt_flush_trace_buffer);
+    return true;
+}
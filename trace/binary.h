@@ -0,0 +1,57 @@
+/*
+ * Binary trace backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+#ifndef TRACE_BINARY_H
+#define TRACE_BINARY_H
+
+void bt_print_trace_file_status(void);
+void bt_set_trace_file_enabled(bool enable);
+void bt_set_trace_file(const char *file);
+bool bt_set_compression(bool enable);
+bool bt_init(void);
+void bt_flush_trace_buffer(void);
+
+typedef struct BinaryTraceRing BinaryTraceRing;
+
+typedef struct {
+    BinaryTraceRing *ring;
+    uint32_t pos;
+} BinaryTraceRecord;
+
+#define BT_MAX_STRLEN 512
+
+/**
+ * Initialize a trace record and claim space for it in the calling
+ * thread's ring buffer
+ *
+ * @arglen  number of bytes required for arguments
+ *
+ * Returns false if the record was dropped.  No other thread ever writes
+ * to the ring, so the reservation does not need locks or atomic
+ * read-modify-write operations.
+ */
+bool bt_record_start(BinaryTraceRecord *rec, uint32_t id, size_t arglen);
+
+/**
+ * Append a 64-bit argument to a trace record
+ */
+void bt_record_write_u64(BinaryTraceRecord *rec, uint64_t val);
+
+/**
+ * Append a string argument to a trace record
+ */
+void bt_record_write_str(BinaryTraceRecord *rec, const char *s, uint32_t slen);
+
+/**
+ * Publish a trace record to the writeout thread
+ *
+ * Don't append any more arguments to the trace record after calling this.
+ */
+void bt_record_finish(BinaryTraceRecord *rec);
+
+#endif /* TRACE_BINARY_H */
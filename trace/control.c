@@ -14,6 +14,9 @@
 #ifdef CONFIG_TRACE_SIMPLE
 #include "trace/simple.h"
 #endif
+#ifdef CONFIG_TRACE_BINARY
+#include "trace/binary.h"
+#endif
 #ifdef CONFIG_TRACE_FTRACE
 #include "trace/ftrace.h"
 #endif
@@ -55,6 +58,9 @@ QemuOptsList qemu_trace_opts = {
         },{
             .name = "file",
             .type = QEMU_OPT_STRING,
+        },{
+            .name = "compress",
+            .type = QEMU_OPT_BOOL,
         },
         { /* end of list */ }
     },
@@ -223,12 +229,18 @@ static void trace_init_events(const char *fname)
 
 void trace_init_file(const char *file)
 {
+#if defined CONFIG_TRACE_SIMPLE || defined CONFIG_TRACE_BINARY
 #ifdef CONFIG_TRACE_SIMPLE
     st_set_trace_file(file);
+#endif
+#ifdef CONFIG_TRACE_BINARY
+    /* with the simple backend also enabled, a ".btr" suffix is added */
+    bt_set_trace_file(file);
+#endif
 #elif defined CONFIG_TRACE_LOG
     /*
-     * If both the simple and the log backends are enabled, "--trace file"
-     * only applies to the simple backend; use "-D" for the log
+     * If both the simple (or binary) and the log backends are enabled,
+     * "--trace file" only applies to the former; use "-D" for the log
      * backend. However we should only override -D if we actually have
      * something to override it with.
      */
@@ -271,6 +283,13 @@ bool trace_init_backends(void)
     }
 #endif
 
+#ifdef CONFIG_TRACE_BINARY
+    if (!bt_init()) {
+        fprintf(stderr, "failed to initialize binary tracing backend.\n");
+        return false;
+    }
+#endif
+
 #ifdef CONFIG_TRACE_FTRACE
     if (!ftrace_init()) {
         fprintf(stderr, "failed to initialize ftrace backend.\n");
@@ -298,6 +317,19 @@ char *trace_opt_parse(const char *optarg)
     }
     trace_init_events(qemu_opt_get(opts, "events"));
     trace_file = g_strdup(qemu_opt_get(opts, "file"));
+    if (qemu_opt_get(opts, "compress")) {
+#ifdef CONFIG_TRACE_BINARY
+        if (!bt_set_compression(qemu_opt_get_bool(opts, "compress", false))) {
+            fprintf(stderr, "error: --trace compress=on: "
+                    "QEMU was built without zstd support\n");
+            exit(1);
+        }
+#else
+        fprintf(stderr, "error: --trace compress=...: "
+                "option not supported by the selected tracing backends\n");
+        exit(1);
+#endif
+    }
     qemu_opts_del(opts);
 
     return trace_file;
@@ -177,6 +177,27 @@ static void fallback_cache_info(int *isize, int *dsize)
     }
 }
 
+/*
+ * atomic16_cmpxchg() needs to know whether it may use CASPAL.
+ */
+
+#if defined(__aarch64__) && !defined(__ARM_FEATURE_ATOMICS)
+# include "elf.h"
+# include "qemu/atomic128.h"
+
+/* As named by the Linux <asm/hwcap.h> */
+#define HWCAP_ATOMICS (1 << 8)
+
+bool have_lse_atomics;
+
+static void atomic128_init(void)
+{
+    have_lse_atomics = qemu_getauxval(AT_HWCAP) & HWCAP_ATOMICS;
+}
+#else
+static void atomic128_init(void) { }
+#endif
+
 static void __attribute__((constructor)) init_cache_info(void)
 {
     int isize = 0, dsize = 0;
@@ -194,4 +215,5 @@ static void __attribute__((constructor)) init_cache_info(void)
     qemu_dcache_linesize_log = ctz32(dsize);
 
     atomic64_init();
+    atomic128_init();
 }
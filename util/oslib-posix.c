@@ -40,9 +40,13 @@
 #include <libgen.h>
 #include <sys/signal.h>
 #include "qemu/cutils.h"
+#include "qemu/units.h"
+#include "qemu/atomic.h"
+#include "qemu/bitops.h"
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
+#include <sched.h>
 #endif
 
 #ifdef __FreeBSD__
@@ -61,7 +65,16 @@
 #include "qemu/error-report.h"
 #endif
 
-#define MAX_MEM_PREALLOC_THREAD_COUNT 16
+#define MAX_MEM_PREALLOC_THREAD_COUNT 64
+
+/* Granularity at which preallocation threads report progress */
+#define MEM_PREALLOC_CHUNK_SIZE (64 * MiB)
+
+#ifdef CONFIG_LINUX
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#endif
 
 struct MemsetThread {
     char *addr;
@@ -69,16 +82,31 @@ struct MemsetThread {
     size_t hpagesize;
     QemuThread pgthread;
     sigjmp_buf env;
+    MemPreallocContext *ctx;
+#ifdef CONFIG_LINUX
+    bool bind;
+    cpu_set_t cpus;
+#endif
 };
 typedef struct MemsetThread MemsetThread;
 
-static MemsetThread *memset_thread;
-static int memset_num_threads;
-static bool memset_thread_failed;
+struct MemPreallocContext {
+    MemsetThread *threads;
+    int num_threads;
+    size_t hpagesize;
+    bool use_madv_populate_write;
+    bool threads_created;
+    bool failed;
+    /* Updated atomically by the threads, so no wider than a host word */
+    size_t pages_done;
+    Error *err;
+};
+
+/* Context whose threads rely on SIGBUS to detect allocation failures */
+static MemPreallocContext *sigbus_ctx;
 
 static QemuMutex page_mutex;
 static QemuCond page_cond;
-static bool threads_created_flag;
 
 int qemu_get_thread_id(void)
 {
@@ -393,83 +421,191 @@ char *qemu_get_exec_dir(void)
 static void sigbus_handler(int signal)
 {
     int i;
-    if (memset_thread) {
-        for (i = 0; i < memset_num_threads; i++) {
-            if (qemu_thread_is_self(&memset_thread[i].pgthread)) {
-                siglongjmp(memset_thread[i].env, 1);
+    if (sigbus_ctx) {
+        for (i = 0; i < sigbus_ctx->num_threads; i++) {
+            if (qemu_thread_is_self(&sigbus_ctx->threads[i].pgthread)) {
+                siglongjmp(sigbus_ctx->threads[i].env, 1);
+            }
+        }
+    }
+}
+
+static void touch_pages(MemsetThread *memset_args)
+{
+    char *addr = memset_args->addr;
+    size_t numpages = memset_args->numpages;
+    size_t hpagesize = memset_args->hpagesize;
+    size_t chunk = MAX(MEM_PREALLOC_CHUNK_SIZE / hpagesize, 1);
+    size_t i;
+
+    for (i = 0; i < numpages; i++) {
+        /*
+         * Read & write back the same value, so we don't
+         * corrupt existing user/app data that might be
+         * stored.
+         *
+         * 'volatile' to stop compiler optimizing this away
+         * to a no-op
+         *
+         * TODO: get a better solution from kernel so we
+         * don't need to write at all so we don't cause
+         * wear on the storage backing the region...
+         */
+        *(volatile char *)addr = *addr;
+        addr += hpagesize;
+        if ((i + 1) % chunk == 0) {
+            atomic_add(&memset_args->ctx->pages_done, chunk);
+        }
+    }
+    atomic_add(&memset_args->ctx->pages_done, numpages % chunk);
+}
+
+#ifdef CONFIG_LINUX
+/*
+ * Populate page tables without touching the memory, so that neither SIGBUS
+ * handling nor a quiescent guest is needed.  Failures are reported through
+ * the return value of madvise().
+ */
+static void populate_pages(MemsetThread *memset_args)
+{
+    char *addr = memset_args->addr;
+    size_t numpages = memset_args->numpages;
+    size_t hpagesize = memset_args->hpagesize;
+    size_t chunk = MAX(MEM_PREALLOC_CHUNK_SIZE / hpagesize, 1);
+
+    while (numpages) {
+        size_t n = MIN(numpages, chunk);
+
+        if (madvise(addr, n * hpagesize, MADV_POPULATE_WRITE)) {
+            if (errno == EINTR) {
+                continue;
             }
+            memset_args->ctx->failed = true;
+            return;
         }
+        atomic_add(&memset_args->ctx->pages_done, n);
+        addr += n * hpagesize;
+        numpages -= n;
     }
 }
 
+static bool madv_populate_write_possible(char *area, size_t pagesize)
+{
+    return !madvise(area, pagesize, MADV_POPULATE_WRITE) || errno != EINVAL;
+}
+
+/* Parse a sysfs cpulist such as "0-3,8-11" */
+static bool host_node_get_cpus(unsigned long node, cpu_set_t *set)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *contents = NULL;
+    const char *p;
+    unsigned long first, last;
+
+    path = g_strdup_printf("/sys/devices/system/node/node%lu/cpulist", node);
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        return false;
+    }
+
+    CPU_ZERO(set);
+    p = contents;
+    while (*p && *p != '\n') {
+        if (qemu_strtoul(p, &p, 10, &first)) {
+            return false;
+        }
+        last = first;
+        if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last)) {
+            return false;
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++) {
+            CPU_SET(first, set);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return CPU_COUNT(set) > 0;
+}
+#endif
+
 static void *do_touch_pages(void *arg)
 {
     MemsetThread *memset_args = (MemsetThread *)arg;
+    MemPreallocContext *ctx = memset_args->ctx;
     sigset_t set, oldset;
 
+#ifdef CONFIG_LINUX
+    /* Zero the pages from a CPU that is local to the memory.  */
+    if (memset_args->bind) {
+        sched_setaffinity(0, sizeof(memset_args->cpus), &memset_args->cpus);
+    }
+#endif
+
     /*
      * On Linux, the page faults from the loop below can cause mmap_sem
      * contention with allocation of the thread stacks.  Do not start
      * clearing until all threads have been created.
      */
     qemu_mutex_lock(&page_mutex);
-    while(!threads_created_flag){
+    while (!ctx->threads_created) {
         qemu_cond_wait(&page_cond, &page_mutex);
     }
     qemu_mutex_unlock(&page_mutex);
 
+#ifdef CONFIG_LINUX
+    if (ctx->use_madv_populate_write) {
+        populate_pages(memset_args);
+        return NULL;
+    }
+#endif
+
     /* unblock SIGBUS */
     sigemptyset(&set);
     sigaddset(&set, SIGBUS);
     pthread_sigmask(SIG_UNBLOCK, &set, &oldset);
 
     if (sigsetjmp(memset_args->env, 1)) {
-        memset_thread_failed = true;
+        ctx->failed = true;
     } else {
-        char *addr = memset_args->addr;
-        size_t numpages = memset_args->numpages;
-        size_t hpagesize = memset_args->hpagesize;
-        size_t i;
-        for (i = 0; i < numpages; i++) {
-            /*
-             * Read & write back the same value, so we don't
-             * corrupt existing user/app data that might be
-             * stored.
-             *
-             * 'volatile' to stop compiler optimizing this away
-             * to a no-op
-             *
-             * TODO: get a better solution from kernel so we
-             * don't need to write at all so we don't cause
-             * wear on the storage backing the region...
-             */
-            *(volatile char *)addr = *addr;
-            addr += hpagesize;
-        }
+        touch_pages(memset_args);
     }
     pthread_sigmask(SIG_SETMASK, &oldset, NULL);
     return NULL;
 }
 
-static inline int get_memset_num_threads(int smp_cpus)
+static inline int get_memset_num_threads(int max_threads)
 {
     long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
     int ret = 1;
 
     if (host_procs > 0) {
-        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), smp_cpus);
+        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT),
+                  max_threads);
     }
     /* In case sysconf() fails, we fall back to single threaded */
-    return ret;
+    return MAX(ret, 1);
 }
 
-static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                            int smp_cpus)
+static void start_touch_threads(MemPreallocContext *ctx, char *area,
+                                size_t numpages, int max_threads,
+                                const unsigned long *host_nodes,
+                                unsigned long maxnode)
 {
     static gsize initialized = 0;
     size_t numpages_per_thread, leftover;
     char *addr = area;
     int i = 0;
+#ifdef CONFIG_LINUX
+    unsigned long *nodes = g_new(unsigned long, MAX(maxnode, 1));
+    unsigned long node, nnodes = 0;
+
+    if (host_nodes) {
+        for (node = find_first_bit(host_nodes, maxnode); node < maxnode;
+             node = find_next_bit(host_nodes, maxnode, node + 1)) {
+            nodes[nnodes++] = node;
+        }
+    }
+#endif
 
     if (g_once_init_enter(&initialized)) {
         qemu_mutex_init(&page_mutex);
@@ -477,60 +613,96 @@ static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         g_once_init_leave(&initialized, 1);
     }
 
-    memset_thread_failed = false;
-    threads_created_flag = false;
-    memset_num_threads = get_memset_num_threads(smp_cpus);
-    memset_thread = g_new0(MemsetThread, memset_num_threads);
-    numpages_per_thread = numpages / memset_num_threads;
-    leftover = numpages % memset_num_threads;
-    for (i = 0; i < memset_num_threads; i++) {
-        memset_thread[i].addr = addr;
-        memset_thread[i].numpages = numpages_per_thread + (i < leftover);
-        memset_thread[i].hpagesize = hpagesize;
-        qemu_thread_create(&memset_thread[i].pgthread, "touch_pages",
-                           do_touch_pages, &memset_thread[i],
+    ctx->num_threads = get_memset_num_threads(max_threads);
+    ctx->threads = g_new0(MemsetThread, ctx->num_threads);
+    numpages_per_thread = numpages / ctx->num_threads;
+    leftover = numpages % ctx->num_threads;
+    for (i = 0; i < ctx->num_threads; i++) {
+        ctx->threads[i].addr = addr;
+        ctx->threads[i].numpages = numpages_per_thread + (i < leftover);
+        ctx->threads[i].hpagesize = ctx->hpagesize;
+        ctx->threads[i].ctx = ctx;
+#ifdef CONFIG_LINUX
+        /* Spread the threads round-robin over the backend's host nodes */
+        if (nnodes) {
+            ctx->threads[i].bind = host_node_get_cpus(nodes[i % nnodes],
+                                                      &ctx->threads[i].cpus);
+        }
+#endif
+        qemu_thread_create(&ctx->threads[i].pgthread, "touch_pages",
+                           do_touch_pages, &ctx->threads[i],
                            QEMU_THREAD_JOINABLE);
-        addr += memset_thread[i].numpages * hpagesize;
+        addr += ctx->threads[i].numpages * ctx->hpagesize;
     }
+#ifdef CONFIG_LINUX
+    g_free(nodes);
+#endif
 
     qemu_mutex_lock(&page_mutex);
-    threads_created_flag = true;
+    ctx->threads_created = true;
     qemu_cond_broadcast(&page_cond);
     qemu_mutex_unlock(&page_mutex);
+}
 
-    for (i = 0; i < memset_num_threads; i++) {
-        qemu_thread_join(&memset_thread[i].pgthread);
-    }
-    g_free(memset_thread);
-    memset_thread = NULL;
+static void join_touch_threads(MemPreallocContext *ctx)
+{
+    int i;
 
-    return memset_thread_failed;
+    for (i = 0; i < ctx->num_threads; i++) {
+        qemu_thread_join(&ctx->threads[i].pgthread);
+    }
+    g_free(ctx->threads);
+    ctx->threads = NULL;
+    ctx->num_threads = 0;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+MemPreallocContext *os_mem_prealloc_start(int fd, char *area, size_t memory,
+                                          int max_threads,
+                                          const unsigned long *host_nodes,
+                                          unsigned long maxnode, bool async)
 {
-    int ret;
+    MemPreallocContext *ctx = g_new0(MemPreallocContext, 1);
     struct sigaction act, oldact;
-    size_t hpagesize = qemu_fd_getpagesize(fd);
-    size_t numpages = DIV_ROUND_UP(memory, hpagesize);
+    size_t numpages;
+    int ret;
 
+    ctx->hpagesize = qemu_fd_getpagesize(fd);
+    numpages = DIV_ROUND_UP(memory, ctx->hpagesize);
+
+#ifdef CONFIG_LINUX
+    ctx->use_madv_populate_write =
+        madv_populate_write_possible(area, ctx->hpagesize);
+#endif
+    if (ctx->use_madv_populate_write) {
+        start_touch_threads(ctx, area, numpages, max_threads,
+                            host_nodes, maxnode);
+        if (!async) {
+            join_touch_threads(ctx);
+        }
+        return ctx;
+    }
+
+    /*
+     * Touching pages needs a process-wide SIGBUS handler and must not race
+     * with writes to guest memory, so this is always synchronous.
+     */
     memset(&act, 0, sizeof(act));
     act.sa_handler = &sigbus_handler;
     act.sa_flags = 0;
 
     ret = sigaction(SIGBUS, &act, &oldact);
     if (ret) {
-        error_setg_errno(errp, errno,
+        error_setg_errno(&ctx->err, errno,
             "os_mem_prealloc: failed to install signal handler");
-        return;
+        return ctx;
     }
 
     /* touch pages simultaneously */
-    if (touch_all_pages(area, hpagesize, numpages, smp_cpus)) {
-        error_setg(errp, "os_mem_prealloc: Insufficient free host memory "
-            "pages available to allocate guest RAM");
-    }
+    sigbus_ctx = ctx;
+    start_touch_threads(ctx, area, numpages, max_threads,
+                        host_nodes, maxnode);
+    join_touch_threads(ctx);
+    sigbus_ctx = NULL;
 
     ret = sigaction(SIGBUS, &oldact, NULL);
     if (ret) {
@@ -538,6 +710,33 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
         perror("os_mem_prealloc: failed to reinstall signal handler");
         exit(1);
     }
+    return ctx;
+}
+
+uint64_t os_mem_prealloc_progress(MemPreallocContext *ctx)
+{
+    return (uint64_t)atomic_read(&ctx->pages_done) * ctx->hpagesize;
+}
+
+void os_mem_prealloc_finish(MemPreallocContext *ctx, Error **errp)
+{
+    join_touch_threads(ctx);
+    if (ctx->err) {
+        error_propagate(errp, ctx->err);
+    } else if (ctx->failed) {
+        error_setg(errp, "os_mem_prealloc: Insufficient free host memory "
+            "pages available to allocate guest RAM");
+    }
+    g_free(ctx);
+}
+
+void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+                     Error **errp)
+{
+    MemPreallocContext *ctx;
+
+    ctx = os_mem_prealloc_start(fd, area, memory, smp_cpus, NULL, 0, false);
+    os_mem_prealloc_finish(ctx, errp);
 }
 
 char *qemu_get_pid_name(pid_t pid)
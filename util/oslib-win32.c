@@ -550,9 +550,16 @@ int getpagesize(void)
     return system_info.dwPageSize;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+struct MemPreallocContext {
+    uint64_t done;
+};
+
+MemPreallocContext *os_mem_prealloc_start(int fd, char *area, size_t memory,
+                                          int max_threads,
+                                          const unsigned long *host_nodes,
+                                          unsigned long maxnode, bool async)
 {
+    MemPreallocContext *ctx = g_new0(MemPreallocContext, 1);
     int i;
     size_t pagesize = qemu_real_host_page_size;
 
@@ -560,6 +567,26 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     for (i = 0; i < memory / pagesize; i++) {
         memset(area + pagesize * i, 0, 1);
     }
+    ctx->done = memory;
+    return ctx;
+}
+
+uint64_t os_mem_prealloc_progress(MemPreallocContext *ctx)
+{
+    return ctx->done;
+}
+
+void os_mem_prealloc_finish(MemPreallocContext *ctx, Error **errp)
+{
+    g_free(ctx);
+}
+
+void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+                     Error **errp)
+{
+    os_mem_prealloc_finish(os_mem_prealloc_start(fd, area, memory, smp_cpus,
+                                                 NULL, 0, false),
+                           errp);
 }
 
 char *qemu_get_pid_name(pid_t pid)